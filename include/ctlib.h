@@ -230,6 +230,8 @@ struct _cs_command
 	TDSCURSOR *cursor;
 	void *userdata;
 	int userdata_len;
+	/** keep bindings if results of the command are reused, see CS_STICKY_BINDS */
+	CS_BOOL sticky_binds;
 };
 
 struct _cs_blkdesc
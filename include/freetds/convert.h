@@ -91,6 +91,12 @@ TDS_INT tds_convert(const TDSCONTEXT * context, int srctype, const TDS_CHAR * sr
 
 size_t tds_strftime(char *buf, size_t maxsize, const char *format, const TDSDATEREC * timeptr, int prec);
 
+typedef struct tds_date_format TDS_DATE_FORMAT;
+
+TDS_DATE_FORMAT *tds_date_format_compile(const char *format);
+void tds_date_format_free(TDS_DATE_FORMAT * plan);
+size_t tds_date_format_apply(char *buf, size_t maxsize, const TDS_DATE_FORMAT * plan, const TDSDATEREC * dr, int prec);
+
 #ifdef __cplusplus
 #if 0
 {
@@ -173,6 +173,8 @@ typedef int TDSRET;
 #define TDS_SUCCESS          ((TDSRET)0)
 #define TDS_FAIL             ((TDSRET)-1)
 #define TDS_CANCELLED        ((TDSRET)-2)
+/** no data available with TDS_TOKEN_NOWAIT, negative so callers not expecting it see an error */
+#define TDS_WOULDBLOCK       ((TDSRET)-3)
 #define TDS_FAILED(rc) ((rc)<0)
 #define TDS_SUCCEED(rc) ((rc)>=0)
 
@@ -228,6 +230,10 @@ enum tds_token_flags
 	TDS_TOKEN_FLAG(PROC),
 	TDS_TOKEN_FLAG(MSG),
 	TDS_TOKEN_FLAG(ENV),
+	/** do not wait for data from server, return TDS_WOULDBLOCK instead */
+	TDS_TOKEN_NOWAIT = 0x40000000,
+	/** leave large values on the wire reading rows, see tds_blob_stream_read */
+	TDS_TOKEN_STREAM_BLOBS = 0x20000000,
 	TDS_TOKEN_RESULTS = TDS_RETURN_ROWFMT|TDS_RETURN_COMPUTEFMT|TDS_RETURN_DONE|TDS_STOPAT_ROW|TDS_STOPAT_COMPUTE|TDS_RETURN_PROC,
 	TDS_TOKEN_TRAILING = TDS_STOPAT_ROWFMT|TDS_STOPAT_COMPUTEFMT|TDS_STOPAT_ROW|TDS_STOPAT_COMPUTE|TDS_STOPAT_MSG|TDS_STOPAT_OTHERS
 };
@@ -435,6 +441,7 @@ bool is_tds_type_valid(int type)
 #define TDS_STR_BLKSZ    "initial block size"
 #define TDS_STR_SWAPDT   "swap broken dates"
 #define TDS_STR_DUMPFILE "dump file"
+#define TDS_STR_CAPTUREFILE "capture file"
 #define TDS_STR_DEBUGLVL "debug level"
 #define TDS_STR_DEBUGFLAGS "debug flags"
 #define TDS_STR_TIMEOUT  "timeout"
@@ -478,6 +485,8 @@ bool is_tds_type_valid(int type)
 #define TDS_STR_DBFILENAME	"database filename"
 /* Application Intent MSSQL 2012 support */
 #define TDS_STR_READONLY_INTENT "read-only intent"
+/* read column values directly from received packets */
+#define TDS_STR_ZEROCOPY	"zero copy"
 /* configurable cipher suite to send to openssl's SSL_set_cipher_list() function */
 #define TLS_STR_OPENSSL_CIPHERS "openssl ciphers"
 
@@ -538,6 +547,7 @@ typedef struct tds_login
 	struct addrinfo *ip_addrs;	  		/**< ip(s) of server */
 	DSTR instance_name;
 	DSTR dump_file;
+	DSTR capture_file;
 	int debug_flags;
 	int text_size;
 	DSTR routing_address;
@@ -558,6 +568,7 @@ typedef struct tds_login
 	unsigned int valid_configuration:1;
 	unsigned int check_ssl_hostname:1;
 	unsigned int readonly_intent:1;
+	unsigned int zero_copy:1;
 } TDSLOGIN;
 
 typedef struct tds_headers
@@ -572,7 +583,10 @@ typedef struct tds_locale
 {
 	char *language;
 	char *server_charset;
+	/** date format, use tds_locale_set_date_fmt() to change it */
 	char *date_fmt;
+	/** date_fmt compiled, NULL if not supported */
+	struct tds_date_format *date_fmt_plan;
 } TDSLOCALE;
 
 /** 
@@ -714,6 +728,18 @@ struct tds_column
 
 	unsigned char *column_data;
 	void (*column_data_free)(struct tds_column *column);
+	/**
+	 * Slot in the row buffer when column_data points into the received
+	 * packet (zero copy), NULL otherwise.
+	 */
+	unsigned char *column_row_data;
+	/**
+	 * Value of a skipped column in the received packet, NULL if the
+	 * value was read, see tds_skip_column.
+	 */
+	const unsigned char *column_wire_data;
+	TDS_INT column_wire_size;
+	TDS_UINT column_wire_packet;	/**< tds_socket::in_packets when value was skipped */
 	unsigned int column_nullable:1;
 	unsigned int column_writeable:1;
 	unsigned int column_identity:1;
@@ -721,6 +747,8 @@ struct tds_column
 	unsigned int column_hidden:1;
 	unsigned int column_output:1;
 	unsigned int column_timestamp:1;
+	/** value not needed by the application, skipped reading rows */
+	unsigned int column_lazy:1;
 	TDS_UCHAR column_collation[5];
 
 	/* additional fields flags for compute results */
@@ -759,6 +787,20 @@ struct tds_column
 	TDS_CHAR *bcp_terminator;
 };
 
+/**
+ * Make column_data point again to the row buffer.
+ * Forget also any skipped value.
+ */
+static inline void
+tds_column_reset_data(TDSCOLUMN *col)
+{
+	col->column_wire_data = NULL;
+	if (col->column_row_data) {
+		col->column_data = col->column_row_data;
+		col->column_row_data = NULL;
+	}
+}
+
 
 /** Hold information for any results */
 typedef struct tds_result_info
@@ -778,8 +820,62 @@ typedef struct tds_result_info
 	bool rows_exist;
 	/* TODO remove ?? used only in dblib */
 	bool more_results;
+	/** plan to decode rows, NULL to use generic decoding */
+	struct tds_row_plan *row_plan;
+	/** columns allocated together with this structure, see tds_alloc_results */
+	TDSCOLUMN *inline_columns;
+	TDS_USMALLINT num_inline_cols;
+	/**
+	 * true if metadata were identical to previous result so structures
+	 * and row buffer were reused; information derived from the metadata
+	 * (like descriptors) is still valid
+	 */
+	bool reused;
+	/**
+	 * opaque owner of client bindings (like a library command), bindings
+	 * of reused results are kept only if set, see tds_reset_bindings
+	 */
+	const void *bindings_owner;
+	/** raw metadata received, used to detect identical metadata */
+	unsigned char *metadata;
+	unsigned metadata_len;
 } TDSRESULTINFO;
 
+/**
+ * Values of a column for a batch of rows.
+ * Each value uses the format of column_data in the row buffer,
+ * for blobs a TDSBLOB is stored.
+ */
+typedef struct tds_batch_column
+{
+	unsigned char *values;	/**< value_size bytes for each row */
+	TDS_INT *lengths;	/**< size of each value, like column_cur_size */
+	unsigned char *nulls;	/**< bitmap, bit set if value is NULL */
+	TDS_UINT value_size;	/**< bytes used by each value */
+	bool is_blob;
+} TDSBATCHCOLUMN;
+
+/** Hold multiple rows of a result stored by column */
+typedef struct tds_batch
+{
+	TDSBATCHCOLUMN *columns;
+	TDS_USMALLINT num_cols;
+	TDS_UINT max_rows;	/**< rows allocated */
+	TDS_UINT num_rows;	/**< rows read */
+} TDSBATCH;
+
+static inline unsigned char *
+tds_batch_value(const TDSBATCHCOLUMN *col, TDS_UINT row)
+{
+	return col->values + (size_t) row * col->value_size;
+}
+
+static inline bool
+tds_batch_is_null(const TDSBATCHCOLUMN *col, TDS_UINT row)
+{
+	return (col->nulls[row / 8] >> (row % 8)) & 1;
+}
+
 /** values for tds->state */
 typedef enum tds_states
 {
@@ -840,6 +936,7 @@ typedef enum tds_operations
 #define TDS_DBGFLAG_TIME    0x2000
 #define TDS_DBGFLAG_SOURCE  0x4000
 #define TDS_DBGFLAG_THREAD  0x8000
+#define TDS_DBGFLAG_BINARY  0x10000
 
 #if 0
 /**
@@ -993,6 +1090,8 @@ typedef struct tds_dynamic
 	bool defer_close;
 	/* int dyn_state; */ /* TODO use it */
 	TDSPARAMINFO *res_info;	/**< query results */
+	/** last results read executing this dynamic, see tds_socket::last_results */
+	TDSRESULTINFO *last_results;
 	/**
 	 * query parameters.
 	 * Mostly used executing query however is a good idea to prepare query
@@ -1050,15 +1149,68 @@ typedef struct tds_packet
 {
 	struct tds_packet *next;
 	short sid;
+	/** offset of data to send in buf, data are from data_start to len */
+	unsigned short data_start;
 	unsigned len, capacity;
 	unsigned char buf[1];
 } TDSPACKET;
 
+/** Statistics of the process wide packet pool */
+typedef struct tds_packet_pool_stats
+{
+	TDS_UINT8 hits;		/**< packets allocated from the pool */
+	TDS_UINT8 misses;	/**< packets allocated from heap, pool was empty */
+	TDS_UINT8 released;	/**< packets returned to the pool */
+	TDS_UINT8 discarded;	/**< packets freed, pool was full */
+	unsigned cached;	/**< packets currently in the pool */
+} TDSPACKETPOOLSTATS;
+
+#if ENABLE_ODBC_MARS
+/**
+ * Space reserved in output buffer before TDS packet.
+ * Allows to add SMP headers (SYN and DATA) without moving data.
+ */
+#define TDS_SEND_HEADROOM (2 * sizeof(TDS72_SMP_HEADER))
+#else
+#define TDS_SEND_HEADROOM 0
+#endif
+
+/** Maximum number of packets written with a single system call */
+#define TDS_MAX_SEND_PACKETS 64
+
+#if HAVE_SYS_UIO_H && (HAVE_SENDMSG || HAVE_WRITEV)
+#define TDS_HAVE_WRITEV 1
+#endif
+
 typedef struct tds_poll_wakeup
 {
 	TDS_SYS_SOCKET s_signal, s_signaled;
 } TDSPOLLWAKEUP;
 
+/**
+ * Counters of the activity of a connection.
+ * Counters are always updated, they can be read with tds_get_stats.
+ * Time spent waiting is measured only after counters are read or reset
+ * the first time, so the clock is not read if nobody uses them.
+ * Counters are updated without locks, with MARS sessions of the same
+ * connection update them concurrently so values are approximate.
+ */
+typedef struct tds_stats
+{
+	TDS_UINT8 bytes_sent;		/**< bytes written to the socket */
+	TDS_UINT8 bytes_received;	/**< bytes read from the socket */
+	TDS_UINT8 packets_sent;
+	TDS_UINT8 packets_received;
+	TDS_UINT8 write_calls;		/**< system calls used to write */
+	TDS_UINT8 read_calls;		/**< system calls used to read */
+	TDS_UINT8 waits;		/**< times tds_select waited for the socket */
+	TDS_UINT8 wait_us;		/**< microseconds spent waiting in tds_select, see stats_timing */
+	TDS_UINT8 rows;			/**< rows decoded */
+	TDS_UINT8 iconv_bytes;		/**< bytes converted by iconv */
+	TDS_UINT8 allocations;		/**< large values read into allocated buffers */
+	TDS_UINT8 tokens[256];		/**< tokens processed, indexed by token type */
+} TDSSTATS;
+
 /* field related to connection */
 struct tds_connection
 {
@@ -1096,6 +1248,8 @@ struct tds_connection
 	unsigned int tds71rev1:1;
 	unsigned int pending_close:1;	/**< true is connection has pending closing (cursors or dynamic) */
 	unsigned int encrypt_single_packet:1;
+	/** column_data can point into received packet, see tds_generic_get */
+	unsigned int zero_copy:1;
 #if ENABLE_ODBC_MARS
 	unsigned int mars:1;
 
@@ -1110,10 +1264,17 @@ struct tds_connection
 #define TDSSOCKET_VALID(tds) (((TDS_UINTPTR)(tds)) > 1)
 	struct tds_socket **sessions;
 	unsigned num_sessions;
-	unsigned num_cached_packets;
-	TDSPACKET *packet_cache;
+#else
+	/** packets of a request not sent yet, see tds_write_packet */
+	TDSPACKET *send_packets;
+	unsigned num_send_packets;
 #endif
 
+	TDSSTATS stats;
+	bool stats_timing;		/**< measure time waiting, set once counters are read or reset */
+	/** number of connection in capture file, 0 if not assigned yet */
+	TDS_UINT capture_id;
+
 	int spid;
 	int client_spid;
 
@@ -1127,8 +1288,50 @@ struct tds_connection
 #endif
 	TDSAUTHENTICATION *authentication;
 	char *server;
+
+	/**
+	 * Data read from socket but not consumed yet.
+	 * Socket is read in large chunks to reduce the number of system
+	 * calls, packets are then extracted from this buffer.
+	 */
+	unsigned char *recv_buf;
+	unsigned recv_buf_pos;		/**< position of first byte not consumed */
+	unsigned recv_buf_len;		/**< bytes in recv_buf */
 };
 
+/**
+ * Large value read incrementally from the wire.
+ * Rows read using TDS_TOKEN_STREAM_BLOBS are read up to the first large
+ * value which is left on the wire to be read with tds_blob_stream_read.
+ * Following columns are read by tds_blob_stream_next.
+ *
+ * Used by dbreadtext and by ct_get_data for large values not bound.
+ * Not done yet:
+ * - values requiring a character conversion are read in memory, iconv
+ *   can split a character between reads and its state is not kept;
+ * - SQLGetData still reads the whole value, odbc_tds2sql converts it
+ *   using column_text_sqlgetdatapos as an offset into the data.
+ */
+typedef struct tds_blob_stream
+{
+	/** column whose value is being read, NULL if none */
+	TDSCOLUMN *column;
+	/** results of the row being read, a reference is kept */
+	TDSRESULTINFO *info;
+	/** total size of the value, -1 if not known */
+	TDS_INT8 size;
+	/** bytes left in current chunk, -1 at the end of the value */
+	TDS_INT chunk_left;
+	/** value is split in chunks (PLP format) */
+	bool plp;
+	/** row has a NULL bitmap (NBCROW) saved in nbcbuf */
+	bool nbc;
+	/** next column of the row to read */
+	TDS_USMALLINT next_col;
+	unsigned char *nbcbuf;
+	unsigned nbcbuf_size;
+} TDSBLOBSTREAM;
+
 /**
  * Information for a server connection
  */
@@ -1150,7 +1353,7 @@ struct tds_socket
 	/** Output buffer.
 	 * Points to sending packet buffer.
 	 * Output buffer can contain additional data before the raw TDS packet
-	 * so this buffer can point some bytes after send_packet->buf.
+	 * so this buffer points TDS_SEND_HEADROOM bytes after send_packet->buf.
 	 */
 	unsigned char *out_buf;
 
@@ -1164,6 +1367,11 @@ struct tds_socket
 	unsigned in_len;		/**< input buffer length */
 	unsigned char in_flag;		/**< input buffer type */
 	unsigned char out_flag;		/**< output buffer type */
+	TDS_UINT in_packets;		/**< packets read, used to check if in_buf changed */
+	bool skipped_values;		/**< current results have values to read before in_buf changes */
+	TDS_UINT token_need_packet;	/**< in_packets when token_need was computed */
+	unsigned token_need_pos;	/**< in_pos when token_need was computed */
+	size_t token_need;		/**< minimum bytes buffered to hold next token, (size_t) -1 if its size is unknown */
 
 	void *parent;
 
@@ -1187,10 +1395,13 @@ struct tds_socket
 	 */
 	TDSRESULTINFO *current_results;
 	TDSRESULTINFO *res_info;
+	/** last results read, kept to reuse them if next metadata are identical */
+	TDSRESULTINFO *last_results;
 	TDS_UINT num_comp_info;
 	TDSCOMPUTEINFO **comp_info;
 	TDSPARAMINFO *param_info;
 	TDSCURSOR *cur_cursor;		/**< cursor in use */
+	TDSBLOBSTREAM blob_stream;	/**< large value being read */
 	bool bulk_query;		/**< true is query sent was a bulk query so we need to switch state to QUERYING */
 	bool has_status; 		/**< true is ret_status is valid */
 	bool in_row;			/**< true if we are getting rows */
@@ -1241,8 +1452,12 @@ int tds_parse_boolean(const char *value, int default_value);
 int tds_config_boolean(const char *option, const char *value, TDSLOGIN * login);
 
 TDSLOCALE *tds_get_locale(void);
+bool tds_locale_set_date_fmt(TDSLOCALE * locale, const char *date_fmt);
 TDSRET tds_alloc_row(TDSRESULTINFO * res_info);
+void tds_unpin_row_data(TDSRESULTINFO * res_info);
 TDSRET tds_alloc_compute_row(TDSCOMPUTEINFO * res_info);
+TDSBATCH *tds_alloc_batch(TDSRESULTINFO *res_info, TDS_UINT max_rows);
+void tds_free_batch(TDSBATCH *batch);
 BCPCOLDATA * tds_alloc_bcp_column_data(unsigned int column_size);
 TDSDYNAMIC *tds_lookup_dynamic(TDSCONNECTION * conn, const char *id);
 /*@observer@*/ const char *tds_prtype(int token);
@@ -1264,6 +1479,7 @@ TDSICONV *tds_iconv_from_collate(TDSCONNECTION * conn, TDS_UCHAR collate[5]);
 void tds_free_socket(TDSSOCKET * tds);
 void tds_free_all_results(TDSSOCKET * tds);
 void tds_free_results(TDSRESULTINFO * res_info);
+void tds_reset_bindings(TDSRESULTINFO * res_info);
 void tds_free_param_results(TDSPARAMINFO * param_info);
 void tds_free_param_result(TDSPARAMINFO * param_info);
 void tds_free_msg(TDSMESSAGE * message);
@@ -1309,6 +1525,9 @@ void * tds_realloc(void **pp, size_t new_size);
 TDSPACKET *tds_alloc_packet(void *buf, unsigned len);
 TDSPACKET *tds_realloc_packet(TDSPACKET *packet, unsigned len);
 void tds_free_packets(TDSPACKET *packet);
+void tds_packet_pool_set_limit(unsigned max_packets);
+void tds_packet_pool_flush(void);
+void tds_packet_pool_get_stats(TDSPACKETPOOLSTATS *stats);
 TDSBCPINFO *tds_alloc_bcpinfo(void);
 void tds_free_bcpinfo(TDSBCPINFO *bcpinfo);
 void tds_deinit_bcpinfo(TDSBCPINFO *bcpinfo);
@@ -1390,12 +1609,27 @@ TDSRET tds_process_simple_query(TDSSOCKET * tds);
 int tds5_send_optioncmd(TDSSOCKET * tds, TDS_OPTION_CMD tds_command, TDS_OPTION tds_option, TDS_OPTION_ARG * tds_argument,
 			TDS_INT * tds_argsize);
 TDSRET tds_process_tokens(TDSSOCKET * tds, /*@out@*/ TDS_INT * result_type, /*@out@*/ int *done_flags, unsigned flag);
+TDSRET tds_process_row_batch(TDSSOCKET * tds, TDSBATCH *batch);
+TDSRET tds_discard_rows(TDSSOCKET * tds);
+void tds_compile_row_plan(TDSRESULTINFO * res_info);
+void tds_expand_null_bitmap(const unsigned char *bitmap, unsigned num_cols, unsigned char *nulls);
+TDSRET tds_blob_stream_next(TDSSOCKET * tds, bool stream);
+void tds_blob_stream_reset(TDSSOCKET * tds);
+TDSRET tds_blob_stream_finish(TDSSOCKET * tds);
 int determine_adjusted_size(const TDSICONV * char_conv, int size);
 
 
 /* data.c */
 void tds_set_param_type(TDSCONNECTION * conn, TDSCOLUMN * curcol, TDS_SERVER_TYPE type);
 void tds_set_column_type(TDSCONNECTION * conn, TDSCOLUMN * curcol, TDS_SERVER_TYPE type);
+TDSRET tds_blob_stream_start(TDSSOCKET * tds, TDSCOLUMN * curcol);
+int tds_blob_stream_read(TDSSOCKET * tds, void *ptr, size_t len);
+TDSRET tds_blob_stream_skip(TDSSOCKET * tds);
+TDSRET tds_skip_column(TDSSOCKET * tds, TDSCOLUMN * curcol);
+TDSRET tds_load_column(TDSSOCKET * tds, TDSCOLUMN * curcol);
+void tds_load_skipped_columns(TDSSOCKET * tds);
+TDSRET tds_discard_column(TDSSOCKET * tds, TDSCOLUMN * curcol);
+TDS_INT tds_column_wire_size(TDSSOCKET * tds, TDSCOLUMN * curcol, const unsigned char *p, size_t avail, size_t *need);
 
 
 /* tds_convert.c */
@@ -1440,6 +1674,9 @@ int tdserror (const TDSCONTEXT * tds_ctx, TDSSOCKET * tds, int msgno, int errnum
 TDS_STATE tds_set_state(TDSSOCKET * tds, TDS_STATE state);
 void tds_swap_bytes(void *buf, int bytes);
 unsigned int tds_gettime_ms(void);
+TDS_UINT8 tds_gettime_us(void);
+void tds_get_stats(TDSCONNECTION * conn, TDSSTATS * stats);
+void tds_reset_stats(TDSCONNECTION * conn);
 char *tds_strndup(const void *s, TDS_INTPTR len);
 
 
@@ -1453,6 +1690,8 @@ int tdsdump_open(const char *filename);
 void tdsdump_close(void);
 void tdsdump_dump_buf(const char* file, unsigned int level_line, const char *msg, const void *buf, size_t length);
 void tdsdump_col(const TDSCOLUMN *col);
+void tdsdump_prefix(FILE *file, int flags, const char *timestamp, int pid, const char *fname, int line);
+void tdsdump_hex(FILE *file, const void *buf, size_t length);
 #undef tdsdump_log
 void tdsdump_log(const char* file, unsigned int level_line, const char *fmt, ...)
 #if defined(__GNUC__) && __GNUC__ >= 2
@@ -1473,6 +1712,40 @@ extern int tds_debug_flags;
 extern int tds_g_append_mode;
 
 
+/* capture.c */
+/** packet header in a capture file, followed by the packet */
+typedef struct tds_capture_record
+{
+	/** microseconds from capture start */
+	TDS_UINT8 time;
+	/** number of the connection */
+	TDS_UINT conn;
+	/** length of the packet */
+	TDS_UINT len;
+	/** 1 if sent by client, 0 if received */
+	unsigned char sent;
+	unsigned char unused[7];
+} TDSCAPTURERECORD;
+
+int tds_capture_open(const char *filename);
+void tds_capture_close(void);
+void tds_capture_packet(TDSCONNECTION *conn, int sent, const void *buf, size_t len);
+int tds_capture_read_header(FILE *f);
+int tds_capture_read(FILE *f, TDSCAPTURERECORD *rec, unsigned char **buf, size_t *buf_size);
+#define TDS_CAPTURE_FAST if (TDS_UNLIKELY(tds_capture_enabled)) tds_capture_packet
+#define tds_capture_packet TDS_CAPTURE_FAST
+
+extern int tds_capture_enabled;
+
+
+/* trace.c */
+TDSRET tds_trace_start(FILE *file);
+void tds_trace_stop(void);
+void tds_trace_log(const char *file, unsigned int level_line, const char *fmt, va_list ap);
+void tds_trace_dump_buf(const char *file, unsigned int level_line, const char *msg, const void *buf, size_t length);
+TDSRET tds_trace_decode(FILE *in, FILE *out);
+
+
 /* net.c */
 TDSERRNO tds_open_socket(TDSSOCKET * tds, struct addrinfo *ipaddr, unsigned int port, int timeout, int *p_oserr);
 void tds_close_socket(TDSSOCKET * tds);
@@ -1482,6 +1755,11 @@ char *tds_prwsaerror(int erc);
 void tds_prwsaerror_free(char *s);
 int tds_connection_read(TDSSOCKET * tds, unsigned char *buf, int buflen);
 int tds_connection_write(TDSSOCKET *tds, const unsigned char *buf, int buflen, int final);
+#if ENABLE_ODBC_MARS
+int tds_connection_write_packets(TDSSOCKET *tds, TDSPACKET *packet, unsigned num_packets, unsigned pos, int final);
+#elif TDS_HAVE_WRITEV
+int tds_connection_write_chain(TDSSOCKET *tds, TDSPACKET *packet, int final);
+#endif
 #define TDSSELREAD  POLLIN
 #define TDSSELWRITE POLLOUT
 int tds_select(TDSSOCKET * tds, unsigned tds_sel, int timeout_seconds);
@@ -1497,10 +1775,23 @@ static inline TDS_SYS_SOCKET tds_wakeup_get_fd(const TDSPOLLWAKEUP *wakeup)
 {
 	return wakeup->s_signaled;
 }
+/** Size of connection receive buffer */
+#define TDS_RECV_BUF_SIZE 65536
+
+/** Return number of bytes already received from socket but not still consumed */
+static inline unsigned tds_connection_buffered(const TDSCONNECTION *conn)
+{
+	return conn->recv_buf_len - conn->recv_buf_pos;
+}
+int tds_connection_has_packet(TDSCONNECTION *conn);
+int tds_connection_fill(TDSCONNECTION *conn);
 
 
 /* packet.c */
 int tds_read_packet(TDSSOCKET * tds);
+bool tds_data_available(TDSSOCKET *tds);
+size_t tds_buffered_size(TDSSOCKET *tds, bool *last);
+unsigned char *tds_buffered_data(TDSSOCKET *tds, size_t *len, bool *last);
 TDSRET tds_write_packet(TDSSOCKET * tds, unsigned char final);
 #if ENABLE_ODBC_MARS
 int tds_append_cancel(TDSSOCKET *tds);
@@ -1510,6 +1801,16 @@ int tds_put_cancel(TDSSOCKET * tds);
 #endif
 
 
+/* reactor.c */
+typedef struct tds_reactor TDSREACTOR;
+TDSREACTOR *tds_reactor_alloc(void);
+void tds_reactor_free(TDSREACTOR *reactor);
+TDSRET tds_reactor_add(TDSREACTOR *reactor, TDSSOCKET *tds);
+TDSRET tds_reactor_remove(TDSREACTOR *reactor, TDSSOCKET *tds);
+void tds_reactor_wakeup(TDSREACTOR *reactor);
+int tds_reactor_wait(TDSREACTOR *reactor, TDSSOCKET **ready, int max_ready, int timeout_ms);
+
+
 /* vstrbuild.c */
 TDSRET tds_vstrbuild(char *buffer, int buflen, int *resultlen, const char *text, int textlen, const char *formats, int formatlen,
 		  va_list ap);
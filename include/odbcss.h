@@ -147,6 +147,29 @@ typedef struct tagSS_TIMESTAMPOFFSET_STRUCT {
 	SQLSMALLINT timezone_minute;
 } SQL_SS_TIMESTAMPOFFSET_STRUCT;
 
+/*
+ * FreeTDS specific, read only, returns connection counters in a SQL_TDSODBC_STATS_STRUCT.
+ * Counters are shared by all statements of the connection, with MARS they are
+ * updated without locks so values are approximate. Time waiting (wait_us) is
+ * measured only after counters are read the first time.
+ */
+#define SQL_COPT_TDSODBC_STATS	1400
+
+typedef struct tagTDSODBC_STATS_STRUCT {
+	SQLUBIGINT bytes_sent;
+	SQLUBIGINT bytes_received;
+	SQLUBIGINT packets_sent;
+	SQLUBIGINT packets_received;
+	SQLUBIGINT write_calls;
+	SQLUBIGINT read_calls;
+	SQLUBIGINT waits;
+	SQLUBIGINT wait_us;
+	SQLUBIGINT rows;
+	SQLUBIGINT iconv_bytes;
+	SQLUBIGINT allocations;
+	SQLUBIGINT tokens[256];
+} SQL_TDSODBC_STATS_STRUCT;
+
 
 #ifdef TDSODBC_BCP
 
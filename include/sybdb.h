@@ -446,6 +446,23 @@ typedef struct
 
 typedef struct tds_dblib_dbprocess DBPROCESS;
 
+/** Activity counters of a connection, FreeTDS extension, see dbgetstats() */
+typedef struct
+{
+	DBUBIGINT bytes_sent;
+	DBUBIGINT bytes_received;
+	DBUBIGINT packets_sent;
+	DBUBIGINT packets_received;
+	DBUBIGINT write_calls;		/**< system calls used to write */
+	DBUBIGINT read_calls;		/**< system calls used to read */
+	DBUBIGINT waits;		/**< times the library waited for the network */
+	DBUBIGINT wait_us;		/**< microseconds spent waiting for the network, measured after first dbgetstats() */
+	DBUBIGINT rows;			/**< rows decoded */
+	DBUBIGINT iconv_bytes;		/**< bytes converted between character sets */
+	DBUBIGINT allocations;		/**< large values read into allocated buffers */
+	DBUBIGINT tokens[256];		/**< protocol tokens received, indexed by token type */
+} DBSTATS;
+
 /*
  * Sybase & Microsoft use different names for the dbdaterec members. 
  * Keep these two structures physically identical in memory.  
@@ -772,6 +789,7 @@ int dbgetlusername(LOGINREC * login, BYTE * name_buffer, int buffer_len);
 int dbgetmaxprocs(void);
 char *dbgetnatlanf(DBPROCESS * dbprocess);
 int dbgetpacket(DBPROCESS * dbproc);
+RETCODE dbgetstats(DBPROCESS * dbproc, DBSTATS * stats, DBBOOL reset);
 RETCODE dbgetrow(DBPROCESS * dbproc, DBINT row);
 int dbgettime(void);
 #define DBGETTIME dbgettime
@@ -0,0 +1,73 @@
+/* FreeTDS - Library of routines accessing Sybase and Microsoft databases
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Convert a binary trace (log written with debug flag 0x10000)
+ * to the text log format.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+
+#if HAVE_STDLIB_H
+#include <stdlib.h>
+#endif /* HAVE_STDLIB_H */
+
+#if HAVE_STRING_H
+#include <string.h>
+#endif /* HAVE_STRING_H */
+
+#include <freetds/tds.h>
+#include <freetds/data.h>
+
+static void
+usage(const char invoked_as[])
+{
+	fprintf(stderr, "usage:  %s [trace file [output file]]\n", invoked_as);
+	exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+	FILE *in = stdin, *out = stdout;
+
+	if (argc > 3 || (argc > 1 && argv[1][0] == '-' && argv[1][1]))
+		usage(argv[0]);
+
+	if (argc > 1 && strcmp(argv[1], "-") != 0 && (in = fopen(argv[1], "rb")) == NULL) {
+		perror(argv[1]);
+		return 1;
+	}
+	if (argc > 2 && (out = fopen(argv[2], "w")) == NULL) {
+		perror(argv[2]);
+		return 1;
+	}
+
+	if (TDS_FAILED(tds_trace_decode(in, out))) {
+		fprintf(stderr, "%s: invalid or truncated trace\n", argv[0]);
+		return 1;
+	}
+
+	if (out != stdout)
+		fclose(out);
+	if (in != stdin)
+		fclose(in);
+	return 0;
+}
@@ -704,6 +704,27 @@ slurp_input_file(char *fname, char **mybuf, size_t *bufsz, size_t *buflen, int *
 	fclose(fp);
 }
 
+static void
+print_stats(TDSSOCKET *tds, int reset)
+{
+	TDSSTATS stats;
+	unsigned i;
+
+	tds_get_stats(tds->conn, &stats);
+	if (reset)
+		tds_reset_stats(tds->conn);
+
+	printf("bytes sent %" PRIu64 ", received %" PRIu64 "\n", stats.bytes_sent, stats.bytes_received);
+	printf("packets sent %" PRIu64 ", received %" PRIu64 "\n", stats.packets_sent, stats.packets_received);
+	printf("write calls %" PRIu64 ", read calls %" PRIu64 "\n", stats.write_calls, stats.read_calls);
+	printf("waits %" PRIu64 ", %" PRIu64 " us\n", stats.waits, stats.wait_us);
+	printf("rows %" PRIu64 ", converted bytes %" PRIu64 ", allocations %" PRIu64 "\n",
+	       stats.rows, stats.iconv_bytes, stats.allocations);
+	for (i = 0; i < TDS_VECTOR_SIZE(stats.tokens); ++i)
+		if (stats.tokens[i])
+			printf("token 0x%02x %" PRIu64 "\n", i, stats.tokens[i]);
+}
+
 static void
 print_instance_data(TDSLOGIN *login) 
 {
@@ -750,7 +771,7 @@ main(int argc, char **argv)
 	context = tds_alloc_context(NULL);
 	if (context->locale && !context->locale->date_fmt) {
 		/* set default in case there's no locale file */
-		context->locale->date_fmt = strdup(STD_DATETIME_FMT);
+		tds_locale_set_date_fmt(context->locale, STD_DATETIME_FMT);
 	}
 
 	context->msg_handler = tsql_handle_message;
@@ -852,6 +873,8 @@ main(int argc, char **argv)
 	if (VERBOSE) 
 		print_instance_data(connection);
 	tds_free_login(connection);
+	/* stats command shows time waiting too */
+	tds->conn->stats_timing = true;
 	/* give the buffer an initial size */
 	bufsz = 4096;
 	mybuf = tds_new(char, bufsz);
@@ -921,6 +944,12 @@ main(int argc, char **argv)
 			buflen = 0;
 			continue;
 		}
+		if (!strcasecmp(cmd, "stats")) {
+			cmd = strtok(NULL, " \t");
+			print_stats(tds, cmd && !strcasecmp(cmd, "reset"));
+			--line;
+			continue;
+		}
 		if (!strcasecmp(cmd, "reset")) {
 			line = 0;
 			mybuf[0] = '\0';
@@ -0,0 +1,69 @@
+#!/bin/sh
+# Measure result set throughput of db-lib, ct-lib and ODBC against
+# the synthetic server (src/server/tdsbenchsrv).
+#
+# usage: bench.sh [build directory]
+#
+# Environment:
+#   BENCH_PORT          port used by the server (default 14333)
+#   BENCH_ITERATIONS    times every query is executed (default 5)
+#   BENCH_VERSIONS      TDS versions to test (default "5.0 7.4")
+#   BENCH_PACKET_SIZES  packet sizes to test (default "4096")
+#   BENCH_APIS          libraries to test (default "dblib ctlib odbc")
+#   BENCH_FLAGS         additional options for the programs, like -c
+#
+# A line of key=value pairs is printed for every run.
+
+B=${1:-.}
+PORT=${BENCH_PORT:-14333}
+ITERATIONS=${BENCH_ITERATIONS:-5}
+VERSIONS=${BENCH_VERSIONS:-"5.0 7.4"}
+PACKET_SIZES=${BENCH_PACKET_SIZES:-4096}
+APIS=${BENCH_APIS:-"dblib ctlib odbc"}
+FLAGS=${BENCH_FLAGS:-}
+
+SERVER="$B/src/server/tdsbenchsrv"
+if test ! -x "$SERVER"; then
+	echo "$SERVER not found" >&2
+	exit 1
+fi
+
+# avoid user configuration affecting results
+FREETDSCONF=/dev/null
+export FREETDSCONF
+unset TDSDUMP TDSDUMPCONFIG
+
+"$SERVER" $PORT &
+SERVER_PID=$!
+trap 'kill $SERVER_PID 2> /dev/null' 0 1 2 15
+sleep 1
+
+result=0
+while read query; do
+	for ver in $VERSIONS; do
+		# nvarchar requires TDS 7
+		case "$ver:$query" in
+		5.*nvarchar*) continue ;;
+		esac
+		for api in $APIS; do
+			prog="$B/src/bench/bench_$api"
+			test -x "$prog" || continue
+			test $api = odbc && test $ver = 5.0 && continue
+			for size in $PACKET_SIZES; do
+				if ! TDSVER=$ver "$prog" -S 127.0.0.1:$PORT -n $ITERATIONS -s $size $FLAGS "$query"; then
+					echo "api=$api tdsver=$ver packet_size=$size failed query=\"$query\""
+					result=1
+				fi
+			done
+		done
+	done
+done <<EOF
+rows=200000 cols=int,int,int,int
+rows=100000 cols=int,bigint,float,datetime,numeric nulls=10
+rows=100000 cols=int,varchar,varchar strlen=30 nulls=10
+rows=20000 cols=varchar,varchar,varchar,varchar strlen=250
+rows=50000 cols=int,nvarchar strlen=50
+rows=2000 cols=int,plp plp=100000
+EOF
+
+exit $result
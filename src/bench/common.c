@@ -0,0 +1,93 @@
+#include "common.h"
+
+#if TIME_WITH_SYS_TIME
+# include <sys/time.h>
+# include <time.h>
+#else
+# if HAVE_SYS_TIME_H
+#  include <sys/time.h>
+# else
+#  include <time.h>
+# endif
+#endif
+
+static void
+usage(const char *name)
+{
+	fprintf(stderr, "usage:  %s [-S server] [-U user] [-P password] [-n iterations] [-s packet_size] [-c] [query]\n"
+		"  -c  convert every column to a string\n"
+		"  server defaults to 127.0.0.1:5000, query to \"rows=100000 cols=int,varchar\"\n", name);
+	exit(1);
+}
+
+void
+bench_parse_args(int argc, char **argv, BENCH_OPTIONS *opts)
+{
+	int ch;
+
+	opts->server = "127.0.0.1:5000";
+	opts->user = "bench";
+	opts->password = "bench";
+	opts->query = "rows=100000 cols=int,varchar";
+	opts->iterations = 5;
+	opts->packet_size = 0;
+	opts->as_string = 0;
+
+	while ((ch = getopt(argc, argv, "S:U:P:n:s:c")) != -1) {
+		switch (ch) {
+		case 'S':
+			opts->server = optarg;
+			break;
+		case 'U':
+			opts->user = optarg;
+			break;
+		case 'P':
+			opts->password = optarg;
+			break;
+		case 'n':
+			opts->iterations = atoi(optarg);
+			break;
+		case 's':
+			opts->packet_size = atoi(optarg);
+			break;
+		case 'c':
+			opts->as_string = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind > 1)
+		usage(argv[0]);
+	if (argc > optind)
+		opts->query = argv[optind];
+	if (!opts->iterations)
+		opts->iterations = 1;
+}
+
+double
+bench_time(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+/**
+ * Print results in a line of key=value pairs, easy to parse.
+ */
+void
+bench_report(const char *api, const BENCH_OPTIONS *opts, const BENCH_RESULT *res)
+{
+	const char *tdsver = getenv("TDSVER");
+	double elapsed = bench_time() - res->start;
+
+	if (elapsed <= 0)
+		elapsed = 1e-6;
+	printf("api=%s tdsver=%s packet_size=%d bind=%s iterations=%u rows=%llu bytes=%llu seconds=%.6f "
+	       "rows_per_sec=%.0f mb_per_sec=%.2f query=\"%s\"\n",
+	       api, tdsver ? tdsver : "default", opts->packet_size, opts->as_string ? "string" : "native",
+	       opts->iterations, res->rows, res->bytes, elapsed, res->rows / elapsed, res->bytes / elapsed / (1024.0 * 1024.0), opts->query);
+	fflush(stdout);
+}
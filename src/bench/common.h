@@ -0,0 +1,49 @@
+#ifndef COMMON_h
+#define COMMON_h
+
+#include <config.h>
+
+#include <stdio.h>
+
+#if HAVE_STDLIB_H
+#include <stdlib.h>
+#endif /* HAVE_STDLIB_H */
+
+#if HAVE_STRING_H
+#include <string.h>
+#endif /* HAVE_STRING_H */
+
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+
+#include "replacements.h"
+
+typedef struct
+{
+	const char *server;
+	const char *user;
+	const char *password;
+	/** result set specification, see src/server/bench.c */
+	const char *query;
+	/** times the query is executed */
+	unsigned iterations;
+	/** requested packet size, 0 for library default */
+	int packet_size;
+	/** convert all columns to strings instead of fetching native data */
+	int as_string;
+} BENCH_OPTIONS;
+
+typedef struct
+{
+	unsigned long long rows;
+	/** bytes of data received by the application */
+	unsigned long long bytes;
+	double start;
+} BENCH_RESULT;
+
+void bench_parse_args(int argc, char **argv, BENCH_OPTIONS *opts);
+double bench_time(void);
+void bench_report(const char *api, const BENCH_OPTIONS *opts, const BENCH_RESULT *res);
+
+#endif
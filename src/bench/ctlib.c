@@ -0,0 +1,163 @@
+/* FreeTDS - Library of routines accessing Sybase and Microsoft databases
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Fetch result sets with ct-lib and report the throughput.
+ * Columns are bound with their own type so no conversion is done or,
+ * with -c, as null terminated strings.
+ */
+
+#include "common.h"
+
+#include <ctpublic.h>
+
+/** limit for buffers of large columns */
+#define MAX_BIND 0x100000
+
+typedef struct
+{
+	CS_DATAFMT fmt;
+	CS_VOID *data;
+	CS_INT len;
+	CS_SMALLINT ind;
+} COLUMN;
+
+static CS_RETCODE
+clientmsg_cb(CS_CONTEXT * context, CS_CONNECTION * connection, CS_CLIENTMSG * errmsg)
+{
+	fprintf(stderr, "ct-lib message %d: %s\n", (int) errmsg->msgnumber, errmsg->msgstring);
+	return CS_SUCCEED;
+}
+
+static CS_RETCODE
+servermsg_cb(CS_CONTEXT * context, CS_CONNECTION * connection, CS_SERVERMSG * srvmsg)
+{
+	if (srvmsg->severity > 10)
+		fprintf(stderr, "server message %d: %s\n", (int) srvmsg->msgnumber, srvmsg->text);
+	return CS_SUCCEED;
+}
+
+static int
+fetch_rows(CS_COMMAND *cmd, const BENCH_OPTIONS *opts, BENCH_RESULT *res)
+{
+	COLUMN *cols;
+	CS_INT num_cols, count, i;
+	CS_RETCODE ret;
+	int rc = 0;
+
+	if (ct_res_info(cmd, CS_NUMDATA, &num_cols, CS_UNUSED, NULL) != CS_SUCCEED || num_cols <= 0)
+		return 0;
+	cols = (COLUMN *) calloc(num_cols, sizeof(COLUMN));
+	if (!cols)
+		return 0;
+
+	for (i = 0; i < num_cols; ++i) {
+		if (ct_describe(cmd, i + 1, &cols[i].fmt) != CS_SUCCEED)
+			goto cleanup;
+		if (cols[i].fmt.maxlength > MAX_BIND || cols[i].fmt.maxlength <= 0)
+			cols[i].fmt.maxlength = MAX_BIND;
+		cols[i].fmt.format = CS_FMT_UNUSED;
+		if (opts->as_string) {
+			/* room for binary data in hexadecimal and any fixed size type */
+			cols[i].fmt.maxlength = cols[i].fmt.maxlength * 2 + 64;
+			cols[i].fmt.datatype = CS_CHAR_TYPE;
+			cols[i].fmt.format = CS_FMT_NULLTERM;
+		}
+		cols[i].fmt.count = 1;
+		cols[i].fmt.locale = NULL;
+		/* room for CS_NUMERIC and similar structures */
+		cols[i].data = malloc(cols[i].fmt.maxlength + 64);
+		if (!cols[i].data)
+			goto cleanup;
+		if (ct_bind(cmd, i + 1, &cols[i].fmt, cols[i].data, &cols[i].len, &cols[i].ind) != CS_SUCCEED)
+			goto cleanup;
+	}
+
+	while ((ret = ct_fetch(cmd, CS_UNUSED, CS_UNUSED, CS_UNUSED, &count)) == CS_SUCCEED || ret == CS_ROW_FAIL) {
+		++res->rows;
+		for (i = 0; i < num_cols; ++i)
+			if (cols[i].ind != -1)
+				res->bytes += opts->as_string ? cols[i].len - 1 : cols[i].len;
+	}
+	rc = ret == CS_END_DATA;
+
+cleanup:
+	for (i = 0; i < num_cols; ++i)
+		free(cols[i].data);
+	free(cols);
+	return rc;
+}
+
+int
+main(int argc, char **argv)
+{
+	BENCH_OPTIONS opts;
+	BENCH_RESULT res;
+	CS_CONTEXT *ctx;
+	CS_CONNECTION *conn;
+	CS_COMMAND *cmd;
+	CS_INT result_type;
+	CS_RETCODE ret;
+	unsigned i;
+
+	bench_parse_args(argc, argv, &opts);
+
+	if (cs_ctx_alloc(CS_VERSION_100, &ctx) != CS_SUCCEED || ct_init(ctx, CS_VERSION_100) != CS_SUCCEED)
+		return 1;
+	ct_callback(ctx, NULL, CS_SET, CS_CLIENTMSG_CB, (CS_VOID *) clientmsg_cb);
+	ct_callback(ctx, NULL, CS_SET, CS_SERVERMSG_CB, (CS_VOID *) servermsg_cb);
+
+	if (ct_con_alloc(ctx, &conn) != CS_SUCCEED)
+		return 1;
+	ct_con_props(conn, CS_SET, CS_USERNAME, (CS_VOID *) opts.user, CS_NULLTERM, NULL);
+	ct_con_props(conn, CS_SET, CS_PASSWORD, (CS_VOID *) opts.password, CS_NULLTERM, NULL);
+	ct_con_props(conn, CS_SET, CS_APPNAME, "bench_ctlib", CS_NULLTERM, NULL);
+	if (opts.packet_size) {
+		CS_INT size = opts.packet_size;
+
+		ct_con_props(conn, CS_SET, CS_PACKETSIZE, &size, CS_UNUSED, NULL);
+	}
+	if (ct_connect(conn, (CS_CHAR *) opts.server, CS_NULLTERM) != CS_SUCCEED)
+		return 1;
+	if (ct_cmd_alloc(conn, &cmd) != CS_SUCCEED)
+		return 1;
+
+	memset(&res, 0, sizeof(res));
+	res.start = bench_time();
+	for (i = 0; i < opts.iterations; ++i) {
+		if (ct_command(cmd, CS_LANG_CMD, (CS_CHAR *) opts.query, CS_NULLTERM, CS_UNUSED) != CS_SUCCEED
+		    || ct_send(cmd) != CS_SUCCEED)
+			return 1;
+		while ((ret = ct_results(cmd, &result_type)) == CS_SUCCEED) {
+			if (result_type == CS_CMD_FAIL)
+				return 1;
+			if (result_type == CS_ROW_RESULT && !fetch_rows(cmd, &opts, &res))
+				return 1;
+		}
+		if (ret != CS_END_RESULTS)
+			return 1;
+	}
+	bench_report("ctlib", &opts, &res);
+
+	ct_cmd_drop(cmd);
+	ct_close(conn, CS_UNUSED);
+	ct_con_drop(conn);
+	ct_exit(ctx, CS_UNUSED);
+	cs_ctx_drop(ctx);
+	return 0;
+}
@@ -0,0 +1,130 @@
+/* FreeTDS - Library of routines accessing Sybase and Microsoft databases
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Fetch result sets with db-lib and report the throughput.
+ * Data is read with dbdata() without conversions or, with -c, bound
+ * as null terminated strings.
+ */
+
+#include "common.h"
+
+#include <sybfront.h>
+#include <sybdb.h>
+
+/** limit for buffers of large columns */
+#define MAX_BIND 0x100000
+
+static int
+err_handler(DBPROCESS * dbproc, int severity, int dberr, int oserr, char *dberrstr, char *oserrstr)
+{
+	fprintf(stderr, "db-lib error %d: %s\n", dberr, dberrstr);
+	return INT_CANCEL;
+}
+
+static int
+msg_handler(DBPROCESS * dbproc, DBINT msgno, int msgstate, int severity, char *msgtext, char *srvname, char *procname,
+	    int line)
+{
+	if (severity > 10)
+		fprintf(stderr, "server message %d: %s\n", (int) msgno, msgtext);
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	BENCH_OPTIONS opts;
+	BENCH_RESULT res;
+	LOGINREC *login;
+	DBPROCESS *dbproc;
+	RETCODE rc;
+	unsigned i;
+	int col, num_cols;
+	char **bufs = NULL;
+
+	bench_parse_args(argc, argv, &opts);
+
+	if (dbinit() == FAIL)
+		return 1;
+	dberrhandle(err_handler);
+	dbmsghandle(msg_handler);
+
+	login = dblogin();
+	DBSETLUSER(login, opts.user);
+	DBSETLPWD(login, opts.password);
+	DBSETLAPP(login, "bench_dblib");
+	if (opts.packet_size)
+		DBSETLPACKET(login, opts.packet_size);
+
+	dbproc = dbopen(login, opts.server);
+	dbloginfree(login);
+	if (!dbproc)
+		return 1;
+
+	memset(&res, 0, sizeof(res));
+	res.start = bench_time();
+	for (i = 0; i < opts.iterations; ++i) {
+		if (dbcmd(dbproc, opts.query) == FAIL || dbsqlexec(dbproc) == FAIL)
+			return 1;
+		while ((rc = dbresults(dbproc)) != NO_MORE_RESULTS) {
+			if (rc == FAIL)
+				return 1;
+			num_cols = dbnumcols(dbproc);
+			if (opts.as_string) {
+				bufs = (char **) calloc(num_cols, sizeof(char *));
+				if (!bufs)
+					return 1;
+				for (col = 1; col <= num_cols; ++col) {
+					DBINT size = dbprcollen(dbproc, col);
+
+					if (size > MAX_BIND || size <= 0)
+						size = MAX_BIND;
+					bufs[col - 1] = (char *) malloc(size + 1);
+					if (!bufs[col - 1]
+					    || dbbind(dbproc, col, NTBSTRINGBIND, size + 1, (BYTE *) bufs[col - 1]) == FAIL)
+						return 1;
+				}
+			}
+			while ((rc = dbnextrow(dbproc)) != NO_MORE_ROWS) {
+				if (rc == FAIL)
+					return 1;
+				++res.rows;
+				for (col = 1; col <= num_cols; ++col) {
+					if (dbdata(dbproc, col) == NULL)
+						continue;
+					if (bufs)
+						res.bytes += strlen(bufs[col - 1]);
+					else
+						res.bytes += dbdatlen(dbproc, col);
+				}
+			}
+			if (bufs) {
+				for (col = 0; col < num_cols; ++col)
+					free(bufs[col]);
+				free(bufs);
+				bufs = NULL;
+			}
+		}
+	}
+	bench_report("dblib", &opts, &res);
+
+	dbclose(dbproc);
+	dbexit();
+	return 0;
+}
@@ -0,0 +1,616 @@
+/* FreeTDS - Library of routines accessing Sybase and Microsoft databases
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Time hot paths of libtds without any server: conversions, numeric
+ * formatting, character set conversion, date cracking and formatting and
+ * decoding of result tokens from a synthetic in-memory reply.
+ *
+ * Every benchmark is repeated till it runs for a minimum time and a line of
+ * key=value pairs is printed with the time per operation and the
+ * throughput. "bytes" are the bytes of text produced or parsed, of binary
+ * values cracked or of wire data decoded for token benchmarks.
+ */
+
+#include "common.h"
+
+#include <freetds/tds.h>
+#include <freetds/data.h>
+#include <freetds/convert.h>
+#include <freetds/iconv.h>
+#include <freetds/bytes.h>
+
+typedef struct micro_bench MICRO_BENCH;
+
+struct micro_bench
+{
+	const char *name;
+	/** run the operation n times, return bytes processed */
+	size_t (*run)(const MICRO_BENCH *bench, unsigned long n);
+	/** source type, TDS type for datecrack or new precision for rescale */
+	int srctype;
+	/** destination type for conversions or new scale for rescale */
+	int desttype;
+	/** input value or format */
+	const void *arg;
+	unsigned arg_len;
+	/** operations done by every run, rows for token benchmarks */
+	unsigned ops;
+};
+
+static TDSCONTEXT *ctx;
+static TDSSOCKET *tds;
+
+/* prevent the compiler from removing unused results */
+static volatile unsigned sink;
+
+static TDS_INT int_value = 123456789;
+static TDS_FLOAT float_value = 12345.678901;
+static TDS_MONEY money_value;
+static TDS_NUMERIC numeric38_value, numeric10_value;
+static TDS_DATETIME datetime_value;
+static TDS_DATETIMEALL datetime2_value;
+static TDS_BIGDATETIME bigdatetime_value;
+static unsigned char binary_value[64];
+static TDSDATEREC daterec_value;
+
+/* UTF-8 and UCS-2 text for character set conversion */
+static char utf8_ascii[4096], utf8_text[4096];
+static char ucs2_text[8192];
+
+/* synthetic replies to decode */
+#define TOKEN_ROWS 1000
+
+typedef struct
+{
+	unsigned char *data;
+	unsigned len, size;
+} STREAM;
+
+static STREAM int_stream, mixed_stream;
+
+static void
+fatal(const char *msg)
+{
+	fprintf(stderr, "%s\n", msg);
+	exit(1);
+}
+
+static size_t
+run_convert(const MICRO_BENCH *bench, unsigned long n)
+{
+	CONV_RESULT cr;
+	TDS_INT len;
+	size_t bytes = 0;
+	bool to_char = is_char_type(bench->desttype) || is_binary_type(bench->desttype);
+
+	while (n--) {
+		if (bench->desttype == SYBNUMERIC) {
+			cr.n.precision = 38;
+			cr.n.scale = 10;
+		}
+		len = tds_convert(ctx, bench->srctype, (const TDS_CHAR *) bench->arg, bench->arg_len, bench->desttype, &cr);
+		if (len < 0)
+			fatal("conversion failed");
+		if (to_char) {
+			sink += (unsigned char) cr.c[0];
+			free(cr.c);
+			bytes += len;
+		} else {
+			sink += cr.ti;
+			bytes += bench->arg_len;
+		}
+	}
+	return bytes;
+}
+
+static size_t
+run_numeric_to_string(const MICRO_BENCH *bench, unsigned long n)
+{
+	char buf[80];
+	size_t bytes = 0;
+
+	while (n--) {
+		if (tds_numeric_to_string((const TDS_NUMERIC *) bench->arg, buf) < 0)
+			fatal("tds_numeric_to_string failed");
+		bytes += strlen(buf);
+	}
+	return bytes;
+}
+
+static size_t
+run_rescale(const MICRO_BENCH *bench, unsigned long n)
+{
+	TDS_NUMERIC num;
+	size_t bytes = 0;
+
+	while (n--) {
+		num = *(const TDS_NUMERIC *) bench->arg;
+		if (tds_numeric_change_prec_scale(&num, bench->srctype, bench->desttype) < 0)
+			fatal("tds_numeric_change_prec_scale failed");
+		sink += num.array[1];
+		bytes += sizeof(num);
+	}
+	return bytes;
+}
+
+static size_t
+run_iconv(const MICRO_BENCH *bench, unsigned long n)
+{
+	TDSICONV *conv = tds->conn->char_convs[client2ucs2];
+	char buf[16384];
+	size_t bytes = 0;
+
+	while (n--) {
+		const char *ib = (const char *) bench->arg;
+		size_t il = bench->arg_len;
+		char *ob = buf;
+		size_t ol = sizeof(buf);
+
+		if (tds_iconv(tds, conv, (TDS_ICONV_DIRECTION) bench->srctype, &ib, &il, &ob, &ol) == (size_t) -1)
+			fatal("tds_iconv failed");
+		sink += (unsigned char) buf[0];
+		bytes += bench->arg_len;
+	}
+	return bytes;
+}
+
+static size_t
+run_datecrack(const MICRO_BENCH *bench, unsigned long n)
+{
+	TDSDATEREC dr;
+	size_t bytes = 0;
+
+	while (n--) {
+		if (TDS_FAILED(tds_datecrack(bench->srctype, bench->arg, &dr)))
+			fatal("tds_datecrack failed");
+		sink += dr.day;
+		bytes += bench->arg_len;
+	}
+	return bytes;
+}
+
+static size_t
+run_strftime(const MICRO_BENCH *bench, unsigned long n)
+{
+	char buf[128];
+	size_t bytes = 0;
+
+	while (n--) {
+		bytes += tds_strftime(buf, sizeof(buf), (const char *) bench->arg, &daterec_value, 3);
+		sink += (unsigned char) buf[0];
+	}
+	return bytes;
+}
+
+static size_t
+run_date_format(const MICRO_BENCH *bench, unsigned long n)
+{
+	char buf[128];
+	size_t bytes = 0;
+	TDS_DATE_FORMAT *plan;
+
+	plan = tds_date_format_compile((const char *) bench->arg);
+	if (!plan)
+		fatal("error compiling date format");
+	while (n--) {
+		bytes += tds_date_format_apply(buf, sizeof(buf), plan, &daterec_value, 3);
+		sink += (unsigned char) buf[0];
+	}
+	tds_date_format_free(plan);
+	return bytes;
+}
+
+static size_t
+run_tokens(const MICRO_BENCH *bench, unsigned long n)
+{
+	const STREAM *stream = (const STREAM *) bench->arg;
+	unsigned char *in_buf = tds->in_buf;
+	TDS_INT result_type;
+	int done_flags;
+	TDSRET rc;
+	size_t bytes = 0;
+	unsigned rows;
+
+	while (n--) {
+		tds->in_buf = stream->data;
+		tds->in_len = stream->len;
+		tds->in_pos = 0;
+		tds->in_flag = TDS_REPLY;
+		tds->state = TDS_PENDING;
+		rows = 0;
+		while ((rc = tds_process_tokens(tds, &result_type, &done_flags, TDS_RETURN_ROW)) == TDS_SUCCESS)
+			++rows;
+		if (rc != TDS_NO_MORE_RESULTS || rows != bench->ops)
+			fatal("token decoding failed");
+		bytes += stream->len;
+	}
+	tds->in_buf = in_buf;
+	return bytes;
+}
+
+#define CONVERT(name, src, dest, value, len) { name, run_convert, src, dest, value, len, 1 }
+
+static MICRO_BENCH benches[] = {
+	CONVERT("convert_int_to_char", SYBINT4, SYBVARCHAR, &int_value, sizeof(int_value)),
+	CONVERT("convert_char_to_int", SYBVARCHAR, SYBINT4, "123456789", 9),
+	CONVERT("convert_float_to_char", SYBFLT8, SYBVARCHAR, &float_value, sizeof(float_value)),
+	CONVERT("convert_char_to_float", SYBVARCHAR, SYBFLT8, "12345.678901", 12),
+	CONVERT("convert_money_to_char", SYBMONEY, SYBVARCHAR, &money_value, sizeof(money_value)),
+	CONVERT("convert_numeric_to_char", SYBNUMERIC, SYBVARCHAR, &numeric38_value, sizeof(numeric38_value)),
+	CONVERT("convert_char_to_numeric", SYBVARCHAR, SYBNUMERIC, "1234567890123456789012345678.0123456789", 39),
+	CONVERT("convert_datetime_to_char", SYBDATETIME, SYBVARCHAR, &datetime_value, sizeof(datetime_value)),
+	CONVERT("convert_datetime2_to_char", SYBMSDATETIME2, SYBVARCHAR, &datetime2_value, sizeof(datetime2_value)),
+	CONVERT("convert_char_to_datetime", SYBVARCHAR, SYBDATETIME, "2024-03-15 12:34:56.789", 23),
+	CONVERT("convert_binary_to_char", SYBVARBINARY, SYBVARCHAR, binary_value, sizeof(binary_value)),
+	{ "numeric_to_string_p38", run_numeric_to_string, 0, 0, &numeric38_value, 0, 1 },
+	{ "numeric_to_string_p10", run_numeric_to_string, 0, 0, &numeric10_value, 0, 1 },
+	CONVERT("convert_int_to_numeric", SYBINT4, SYBNUMERIC, &int_value, sizeof(int_value)),
+	CONVERT("convert_numeric_to_numeric", SYBNUMERIC, SYBNUMERIC, &numeric10_value, sizeof(numeric10_value)),
+	{ "numeric_rescale_up", run_rescale, 38, 10, &numeric10_value, 0, 1 },
+	{ "numeric_rescale_down", run_rescale, 30, 2, &numeric38_value, 0, 1 },
+	{ "iconv_utf8_to_ucs2_ascii", run_iconv, to_server, 0, utf8_ascii, 0, 1 },
+	{ "iconv_utf8_to_ucs2", run_iconv, to_server, 0, utf8_text, 0, 1 },
+	{ "iconv_ucs2_to_utf8", run_iconv, to_client, 0, ucs2_text, 0, 1 },
+	{ "datecrack_datetime", run_datecrack, SYBDATETIME, 0, &datetime_value, sizeof(datetime_value), 1 },
+	{ "datecrack_datetime2", run_datecrack, SYBMSDATETIME2, 0, &datetime2_value, sizeof(datetime2_value), 1 },
+	{ "datecrack_bigdatetime", run_datecrack, SYB5BIGDATETIME, 0, &bigdatetime_value, sizeof(bigdatetime_value), 1 },
+	{ "strftime_default", run_strftime, 0, 0, "%b %e %Y %I:%M%p", 0, 1 },
+	{ "strftime_iso", run_strftime, 0, 0, "%Y-%m-%d %H:%M:%S.%z", 0, 1 },
+	{ "strftime_long", run_strftime, 0, 0, "%A %d %B %Y %H:%M:%S.%z (%j)", 0, 1 },
+	{ "datefmt_default", run_date_format, 0, 0, "%b %e %Y %I:%M%p", 0, 1 },
+	{ "datefmt_iso", run_date_format, 0, 0, "%Y-%m-%d %H:%M:%S.%z", 0, 1 },
+	{ "datefmt_long", run_date_format, 0, 0, "%A %d %B %Y %H:%M:%S.%z (%j)", 0, 1 },
+	{ "tokens_int", run_tokens, 0, 0, &int_stream, 0, TOKEN_ROWS },
+	{ "tokens_mixed", run_tokens, 0, 0, &mixed_stream, 0, TOKEN_ROWS },
+};
+
+static void
+add_byte(STREAM *s, unsigned char b)
+{
+	if (s->len >= s->size) {
+		s->size = s->size ? s->size * 2 : 4096;
+		s->data = (unsigned char *) realloc(s->data, s->size);
+		if (!s->data)
+			fatal("out of memory");
+	}
+	s->data[s->len++] = b;
+}
+
+static void
+add_smallint(STREAM *s, TDS_USMALLINT n)
+{
+	add_byte(s, n & 0xff);
+	add_byte(s, n >> 8);
+}
+
+static void
+add_int(STREAM *s, TDS_UINT n)
+{
+	add_smallint(s, n & 0xffff);
+	add_smallint(s, n >> 16);
+}
+
+static void
+add_bytes(STREAM *s, const void *data, unsigned len)
+{
+	const unsigned char *p = (const unsigned char *) data;
+
+	while (len--)
+		add_byte(s, *p++);
+}
+
+/* column in COLMETADATA, user type, flags, type and name */
+static void
+add_column(STREAM *s, TDS_SERVER_TYPE type)
+{
+	add_int(s, 0);
+	add_smallint(s, 1);
+	add_byte(s, type);
+}
+
+static void
+add_name(STREAM *s)
+{
+	add_byte(s, 0);
+}
+
+static void
+add_collation(STREAM *s)
+{
+	/* Latin1_General_CI_AS */
+	static const unsigned char collation[5] = { 0x09, 0x04, 0xd0, 0x00, 0x34 };
+
+	add_bytes(s, collation, sizeof(collation));
+}
+
+static void
+add_done(STREAM *s)
+{
+	add_byte(s, TDS_DONE_TOKEN);
+	add_smallint(s, TDS_DONE_COUNT);
+	add_smallint(s, 0);
+	add_int(s, TOKEN_ROWS);
+	add_int(s, 0);
+}
+
+/* four int columns */
+static void
+build_int_stream(STREAM *s)
+{
+	int row, col;
+
+	add_byte(s, TDS7_RESULT_TOKEN);
+	add_smallint(s, 4);
+	for (col = 0; col < 4; ++col) {
+		add_column(s, SYBINTN);
+		add_byte(s, 4);
+		add_name(s);
+	}
+	for (row = 0; row < TOKEN_ROWS; ++row) {
+		add_byte(s, TDS_ROW_TOKEN);
+		for (col = 0; col < 4; ++col) {
+			add_byte(s, 4);
+			add_int(s, row * 4 + col);
+		}
+	}
+	add_done(s);
+}
+
+/* int, nvarchar(100), varchar(100), float, datetime and numeric(18,2), some NULLs */
+static void
+build_mixed_stream(STREAM *s)
+{
+	int row, i;
+	bool null;
+
+	add_byte(s, TDS7_RESULT_TOKEN);
+	add_smallint(s, 6);
+	add_column(s, SYBINTN);
+	add_byte(s, 4);
+	add_name(s);
+	add_column(s, XSYBNVARCHAR);
+	add_smallint(s, 200);
+	add_collation(s);
+	add_name(s);
+	add_column(s, XSYBVARCHAR);
+	add_smallint(s, 100);
+	add_collation(s);
+	add_name(s);
+	add_column(s, SYBFLTN);
+	add_byte(s, 8);
+	add_name(s);
+	add_column(s, SYBDATETIMN);
+	add_byte(s, 8);
+	add_name(s);
+	add_column(s, SYBNUMERIC);
+	add_byte(s, 9);
+	add_byte(s, 18);
+	add_byte(s, 2);
+	add_name(s);
+
+	for (row = 0; row < TOKEN_ROWS; ++row) {
+		TDS_FLOAT f = row * 1.5;
+
+		/* every tenth row has a NULL nvarchar */
+		null = row % 10 == 9;
+		if (null) {
+			add_byte(s, TDS_NBC_ROW_TOKEN);
+			add_byte(s, 1 << 1);
+		} else {
+			add_byte(s, TDS_ROW_TOKEN);
+		}
+		add_byte(s, 4);
+		add_int(s, row);
+		if (!null) {
+			add_smallint(s, 40);
+			for (i = 0; i < 20; ++i)
+				add_smallint(s, 'a' + (row + i) % 26);
+		}
+		add_smallint(s, 20);
+		for (i = 0; i < 20; ++i)
+			add_byte(s, 'A' + (row + i) % 26);
+		add_byte(s, 8);
+		add_bytes(s, &f, 8);
+		add_byte(s, 8);
+		add_int(s, 45000 + row);
+		add_int(s, row * 300u);
+		add_byte(s, 9);
+		add_byte(s, 1);
+		add_int(s, row * 12345u);
+		add_int(s, 0);
+	}
+	add_done(s);
+}
+
+static void
+init_values(void)
+{
+	CONV_RESULT cr;
+	unsigned i;
+	char *p;
+
+	money_value.mny = (TDS_INT8) 123456789 * 10000 + 1234;
+
+	cr.n.precision = 38;
+	cr.n.scale = 10;
+	if (tds_convert(ctx, SYBVARCHAR, "-1234567890123456789012345678.0123456789", 40, SYBNUMERIC, &cr) < 0)
+		fatal("numeric conversion failed");
+	numeric38_value = cr.n;
+	cr.n.precision = 10;
+	cr.n.scale = 2;
+	if (tds_convert(ctx, SYBVARCHAR, "12345678.90", 11, SYBNUMERIC, &cr) < 0)
+		fatal("numeric conversion failed");
+	numeric10_value = cr.n;
+
+	if (tds_convert(ctx, SYBVARCHAR, "2024-03-15 12:34:56.789", 23, SYBDATETIME, &cr) < 0)
+		fatal("datetime conversion failed");
+	datetime_value = cr.dt;
+
+	datetime2_value.date = 45364;
+	datetime2_value.time = (TDS_UINT8) (12 * 3600 + 34 * 60 + 56) * 10000000u + 1234567u;
+	datetime2_value.time_prec = 7;
+	datetime2_value.has_date = 1;
+	datetime2_value.has_time = 1;
+	bigdatetime_value = ((TDS_UINT8) (693961 + 45364) * 86400u + 45296u) * 1000000u + 123456u;
+
+	for (i = 0; i < sizeof(binary_value); ++i)
+		binary_value[i] = (unsigned char) (i * 37);
+
+	if (TDS_FAILED(tds_datecrack(SYBDATETIME, &datetime_value, &daterec_value)))
+		fatal("tds_datecrack failed");
+
+	/* text, mostly ASCII with some accented letters */
+	for (i = 0; i < sizeof(utf8_ascii) - 1; ++i)
+		utf8_ascii[i] = 'a' + i % 26;
+	for (i = 0, p = utf8_text; p + 2 < utf8_text + sizeof(utf8_text); ++i) {
+		if (i % 8 == 7) {
+			/* U+00E8 */
+			*p++ = (char) 0xc3;
+			*p++ = (char) 0xa8;
+		} else {
+			*p++ = 'a' + i % 26;
+		}
+	}
+	*p = 0;
+	for (i = 0; i < sizeof(ucs2_text) / 2; ++i) {
+		ucs2_text[i * 2] = (i % 8 == 7) ? (char) 0xe8 : 'a' + i % 26;
+		ucs2_text[i * 2 + 1] = 0;
+	}
+
+	build_int_stream(&int_stream);
+	build_mixed_stream(&mixed_stream);
+
+	for (i = 0; i < TDS_VECTOR_SIZE(benches); ++i) {
+		MICRO_BENCH *bench = &benches[i];
+
+		if (bench->run != run_iconv)
+			continue;
+		if (bench->arg == ucs2_text)
+			bench->arg_len = sizeof(ucs2_text);
+		else
+			bench->arg_len = (unsigned) strlen((const char *) bench->arg);
+	}
+}
+
+static void
+usage(const char *name)
+{
+	fprintf(stderr, "usage:  %s [-l] [-t seconds] [benchmark_prefix ...]\n"
+		"  -l list benchmarks, -t minimum time for every benchmark (default 0.5)\n", name);
+	exit(1);
+}
+
+static bool
+selected(const char *name, int argc, char **argv)
+{
+	int i;
+
+	if (!argc)
+		return true;
+	for (i = 0; i < argc; ++i)
+		if (strncmp(name, argv[i], strlen(argv[i])) == 0)
+			return true;
+	return false;
+}
+
+static void
+measure(const MICRO_BENCH *bench, double min_time)
+{
+	unsigned long n = 1;
+	double start, elapsed;
+	size_t bytes;
+	unsigned long long ops;
+
+	/* warm up caches and lazily initialized data */
+	bench->run(bench, 1);
+
+	/* double runs till the time is long enough to be measured */
+	for (;;) {
+		start = bench_time();
+		bytes = bench->run(bench, n);
+		elapsed = bench_time() - start;
+		if (elapsed >= min_time || n >= 0x40000000ul)
+			break;
+		if (elapsed < min_time / 64)
+			n *= 16;
+		else
+			n *= 2;
+	}
+	if (elapsed <= 0)
+		elapsed = 1e-6;
+
+	ops = (unsigned long long) n * bench->ops;
+	printf("bench=%s ops=%llu seconds=%.6f ns_per_op=%.2f bytes=%llu bytes_per_sec=%.0f\n",
+	       bench->name, ops, elapsed, elapsed * 1e9 / ops, (unsigned long long) bytes, bytes / elapsed);
+	fflush(stdout);
+}
+
+int
+main(int argc, char **argv)
+{
+	double min_time = 0.5;
+	bool list = false;
+	unsigned i;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "lt:")) != -1) {
+		switch (ch) {
+		case 'l':
+			list = true;
+			break;
+		case 't':
+			min_time = atof(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (list) {
+		for (i = 0; i < TDS_VECTOR_SIZE(benches); ++i)
+			printf("%s\n", benches[i].name);
+		return 0;
+	}
+
+	ctx = tds_alloc_context(NULL);
+	if (!ctx)
+		fatal("error allocating context");
+	if (ctx->locale && !ctx->locale->date_fmt)
+		tds_locale_set_date_fmt(ctx->locale, STD_DATETIME_FMT);
+	tds = tds_alloc_socket(ctx, 512);
+	if (!tds)
+		fatal("error allocating socket");
+	tds->conn->tds_version = 0x704;
+	if (TDS_FAILED(tds_iconv_open(tds->conn, "UTF-8", 1)))
+		fatal("error initializing character conversions");
+
+	init_values();
+
+	for (i = 0; i < TDS_VECTOR_SIZE(benches); ++i)
+		if (selected(benches[i].name, argc, argv))
+			measure(&benches[i], min_time);
+
+	tds_free_socket(tds);
+	tds_free_context(ctx);
+	free(int_stream.data);
+	free(mixed_stream.data);
+	return 0;
+}
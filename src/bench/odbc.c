@@ -0,0 +1,165 @@
+/* FreeTDS - Library of routines accessing Sybase and Microsoft databases
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Fetch result sets with the ODBC driver and report the throughput.
+ * Columns are bound as SQL_C_BINARY to avoid conversions, except numeric
+ * columns bound as SQL_C_NUMERIC, or, with -c, as SQL_C_CHAR.
+ * The program is linked directly to the driver, no driver manager is used.
+ */
+
+#include "common.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include <sql.h>
+#include <sqlext.h>
+
+/** limit for buffers of large columns */
+#define MAX_BIND 0x100000
+
+typedef struct
+{
+	SQLPOINTER data;
+	SQLLEN len;
+	SQLLEN ind;
+} COLUMN;
+
+static void
+check(SQLRETURN rc, SQLSMALLINT type, SQLHANDLE handle, const char *func)
+{
+	SQLCHAR state[6], msg[256];
+	SQLINTEGER native;
+	SQLSMALLINT len;
+
+	if (SQL_SUCCEEDED(rc))
+		return;
+	state[0] = msg[0] = 0;
+	SQLGetDiagRec(type, handle, 1, state, &native, msg, sizeof(msg), &len);
+	fprintf(stderr, "%s failed: %s %s\n", func, (char *) state, (char *) msg);
+	exit(1);
+}
+
+#define CHECK(func, type, handle, args) check(func args, type, handle, #func)
+
+static void
+fetch_rows(SQLHSTMT stmt, SQLSMALLINT num_cols, const BENCH_OPTIONS *opts, BENCH_RESULT *res)
+{
+	COLUMN *cols;
+	SQLSMALLINT i;
+	SQLRETURN rc;
+
+	cols = (COLUMN *) calloc(num_cols, sizeof(COLUMN));
+	if (!cols)
+		exit(1);
+
+	for (i = 0; i < num_cols; ++i) {
+		SQLULEN size = 0;
+		SQLSMALLINT type, digits, nullable, c_type;
+
+		CHECK(SQLDescribeCol, SQL_HANDLE_STMT, stmt,
+		      (stmt, i + 1, NULL, 0, NULL, &type, &size, &digits, &nullable));
+		/* wide characters are returned as binary data */
+		if (size == 0 || size > MAX_BIND / 2)
+			size = MAX_BIND / 2;
+		cols[i].len = size * 2 + 64;
+		cols[i].data = malloc(cols[i].len);
+		if (!cols[i].data)
+			exit(1);
+		c_type = SQL_C_BINARY;
+		if (opts->as_string)
+			c_type = SQL_C_CHAR;
+		else if (type == SQL_NUMERIC || type == SQL_DECIMAL)
+			c_type = SQL_C_NUMERIC;
+		CHECK(SQLBindCol, SQL_HANDLE_STMT, stmt, (stmt, i + 1, c_type, cols[i].data, cols[i].len, &cols[i].ind));
+	}
+
+	while ((rc = SQLFetch(stmt)) != SQL_NO_DATA) {
+		check(rc, SQL_HANDLE_STMT, stmt, "SQLFetch");
+		++res->rows;
+		for (i = 0; i < num_cols; ++i)
+			if (cols[i].ind != SQL_NULL_DATA)
+				res->bytes += cols[i].ind < cols[i].len ? cols[i].ind : cols[i].len;
+	}
+
+	SQLFreeStmt(stmt, SQL_UNBIND);
+	for (i = 0; i < num_cols; ++i)
+		free(cols[i].data);
+	free(cols);
+}
+
+int
+main(int argc, char **argv)
+{
+	BENCH_OPTIONS opts;
+	BENCH_RESULT res;
+	SQLHENV env;
+	SQLHDBC dbc;
+	SQLHSTMT stmt;
+	SQLSMALLINT num_cols, len;
+	SQLRETURN rc;
+	char conn_str[512], out_str[512], host[256];
+	const char *port, *tdsver = getenv("TDSVER");
+	unsigned i;
+
+	bench_parse_args(argc, argv, &opts);
+
+	strlcpy(host, opts.server, sizeof(host));
+	port = strchr(opts.server, ':');
+	if (port)
+		host[port++ - opts.server] = 0;
+
+	snprintf(conn_str, sizeof(conn_str), "SERVER=%s;PORT=%s;UID=%s;PWD=%s;APP=bench_odbc",
+		 host, port ? port : "1433", opts.user, opts.password);
+	if (tdsver)
+		snprintf(strchr(conn_str, 0), sizeof(conn_str) - strlen(conn_str), ";TDS_Version=%s", tdsver);
+	if (opts.packet_size)
+		snprintf(strchr(conn_str, 0), sizeof(conn_str) - strlen(conn_str), ";PacketSize=%d", opts.packet_size);
+
+	CHECK(SQLAllocHandle, SQL_HANDLE_ENV, NULL, (SQL_HANDLE_ENV, SQL_NULL_HANDLE, &env));
+	CHECK(SQLSetEnvAttr, SQL_HANDLE_ENV, env, (env, SQL_ATTR_ODBC_VERSION, (SQLPOINTER) SQL_OV_ODBC3, SQL_IS_UINTEGER));
+	CHECK(SQLAllocHandle, SQL_HANDLE_ENV, env, (SQL_HANDLE_DBC, env, &dbc));
+	CHECK(SQLDriverConnect, SQL_HANDLE_DBC, dbc, (dbc, NULL, (SQLCHAR *) conn_str, SQL_NTS, (SQLCHAR *) out_str,
+						      sizeof(out_str), &len, SQL_DRIVER_NOPROMPT));
+	CHECK(SQLAllocHandle, SQL_HANDLE_DBC, dbc, (SQL_HANDLE_STMT, dbc, &stmt));
+
+	memset(&res, 0, sizeof(res));
+	res.start = bench_time();
+	for (i = 0; i < opts.iterations; ++i) {
+		CHECK(SQLExecDirect, SQL_HANDLE_STMT, stmt, (stmt, (SQLCHAR *) opts.query, SQL_NTS));
+		for (;;) {
+			CHECK(SQLNumResultCols, SQL_HANDLE_STMT, stmt, (stmt, &num_cols));
+			if (num_cols > 0)
+				fetch_rows(stmt, num_cols, &opts, &res);
+			rc = SQLMoreResults(stmt);
+			if (rc == SQL_NO_DATA)
+				break;
+			check(rc, SQL_HANDLE_STMT, stmt, "SQLMoreResults");
+		}
+		SQLFreeStmt(stmt, SQL_CLOSE);
+	}
+	bench_report("odbc", &opts, &res);
+
+	SQLFreeHandle(SQL_HANDLE_STMT, stmt);
+	SQLDisconnect(dbc);
+	SQLFreeHandle(SQL_HANDLE_DBC, dbc);
+	SQLFreeHandle(SQL_HANDLE_ENV, env);
+	return 0;
+}
@@ -329,7 +329,7 @@ cs_ctx_alloc(CS_INT version, CS_CONTEXT ** ctx)
 	(*ctx)->tds_ctx = tds_ctx;
 	if (tds_ctx->locale && !tds_ctx->locale->date_fmt) {
 		/* set default in case there's no locale file */
-		tds_ctx->locale->date_fmt = strdup(STD_DATETIME_FMT);
+		tds_locale_set_date_fmt(tds_ctx->locale, STD_DATETIME_FMT);
 	}
 	return CS_SUCCEED;
 }
@@ -466,6 +466,7 @@ cs_convert(CS_CONTEXT * ctx, CS_DATAFMT * srcfmt, CS_VOID * srcdata, CS_DATAFMT
 {
 	TDS_SERVER_TYPE src_type, desttype;
 	int src_len, destlen, len, i = 0;
+	int conv_type;
 	CONV_RESULT cres;
 	unsigned char *dest;
 	CS_RETCODE ret;
@@ -684,8 +685,29 @@ cs_convert(CS_CONTEXT * ctx, CS_DATAFMT * srcfmt, CS_VOID * srcdata, CS_DATAFMT
 			cres.n.scale = srcfmt->scale;
 	}
 
+	/* character and binary results are stored directly in the destination */
+	switch (desttype) {
+	case SYBBINARY:
+	case SYBVARBINARY:
+	case SYBIMAGE:
+		cres.cb.ib = (TDS_CHAR *) dest;
+		cres.cb.len = destlen;
+		conv_type = TDS_CONVERT_BINARY;
+		break;
+	case SYBCHAR:
+	case SYBVARCHAR:
+	case SYBTEXT:
+		cres.cc.c = (TDS_CHAR *) dest;
+		cres.cc.len = destlen;
+		conv_type = TDS_CONVERT_CHAR;
+		break;
+	default:
+		conv_type = desttype;
+		break;
+	}
+
 	tdsdump_log(TDS_DBG_FUNC, "cs_convert() calling tds_convert\n");
-	len = tds_convert(ctx->tds_ctx, src_type, (TDS_CHAR*) srcdata, src_len, desttype, &cres);
+	len = tds_convert(ctx->tds_ctx, src_type, (TDS_CHAR*) srcdata, src_len, conv_type, &cres);
 
 	tdsdump_log(TDS_DBG_FUNC, "cs_convert() tds_convert returned %d\n", len);
 
@@ -726,8 +748,6 @@ cs_convert(CS_CONTEXT * ctx, CS_DATAFMT * srcfmt, CS_VOID * srcdata, CS_DATAFMT
 			ret = CS_FAIL;
 			len = destlen;
 		}
-		memcpy(dest, cres.ib, len);
-		free(cres.ib);
 		*resultlen = destlen;
 		if (destvc) {
 			destvc->len = len;
@@ -786,7 +806,6 @@ cs_convert(CS_CONTEXT * ctx, CS_DATAFMT * srcfmt, CS_VOID * srcdata, CS_DATAFMT
 				tdsdump_log(TDS_DBG_FUNC, "not enough room for data + a null terminator - error\n");
 				ret = CS_FAIL;	/* not enough room for data + a null terminator - error */
 			} else {
-				memcpy(dest, cres.c, len);
 				dest[len] = 0;
 				*resultlen = len + 1;
 			}
@@ -794,8 +813,6 @@ cs_convert(CS_CONTEXT * ctx, CS_DATAFMT * srcfmt, CS_VOID * srcdata, CS_DATAFMT
 
 		case CS_FMT_PADBLANK:
 			tdsdump_log(TDS_DBG_FUNC, "cs_convert() FMT_PADBLANK\n");
-			/* strcpy here can lead to a small buffer overflow */
-			memcpy(dest, cres.c, len);
 			for (i = len; i < destlen; i++)
 				dest[i] = ' ';
 			*resultlen = destlen;
@@ -803,15 +820,12 @@ cs_convert(CS_CONTEXT * ctx, CS_DATAFMT * srcfmt, CS_VOID * srcdata, CS_DATAFMT
 
 		case CS_FMT_PADNULL:
 			tdsdump_log(TDS_DBG_FUNC, "cs_convert() FMT_PADNULL\n");
-			/* strcpy here can lead to a small buffer overflow */
-			memcpy(dest, cres.c, len);
 			for (i = len; i < destlen; i++)
 				dest[i] = '\0';
 			*resultlen = destlen;
 			break;
 		case CS_FMT_UNUSED:
 			tdsdump_log(TDS_DBG_FUNC, "cs_convert() FMT_UNUSED\n");
-			memcpy(dest, cres.c, len);
 			*resultlen = len;
 			break;
 		default:
@@ -822,7 +836,6 @@ cs_convert(CS_CONTEXT * ctx, CS_DATAFMT * srcfmt, CS_VOID * srcdata, CS_DATAFMT
 			destvc->len = len;
 			*resultlen = sizeof(*destvc);
 		}
-		free(cres.c);
 		break;
 	default:
 		ret = CS_FAIL;
@@ -47,6 +47,10 @@ static const char * ct_describe_cmd_state(CS_INT state);
  * @return 0 on success
  */
 static int _ct_fetch_cursor(CS_COMMAND * cmd, CS_INT type, CS_INT offset, CS_INT option, CS_INT * rows_read);
+static CS_RETCODE _ct_fetch_batch(CS_COMMAND * cmd, CS_INT * rows_read);
+static bool _ct_can_stream_blobs(TDSRESULTINFO * resinfo);
+static CS_RETCODE _ct_get_data_stream(CS_COMMAND * cmd, TDSRESULTINFO * resinfo, CS_INT item, unsigned char *buffer,
+				      CS_INT buflen, CS_INT * outlen);
 static int _ct_fetchable_results(CS_COMMAND * cmd);
 static TDSRET _ct_process_return_status(TDSSOCKET * tds);
 
@@ -57,6 +61,7 @@ void _ctclient_msg(CS_CONNECTION * con, const char *funcname, int layer, int ori
 int _ct_bind_data(CS_CONTEXT *ctx, TDSRESULTINFO * resinfo, TDSRESULTINFO *bindinfo, CS_INT offset);
 static void _ct_initialise_cmd(CS_COMMAND *cmd);
 static CS_RETCODE _ct_cancel_cleanup(CS_COMMAND * cmd);
+static void _ct_cmd_forget_bindings(CS_COMMAND * cmd);
 static CS_INT _ct_map_compute_op(CS_INT comp_op);
 
 /* Added for CT_DIAG */
@@ -662,10 +667,8 @@ ct_connect(CS_CONNECTION * con, CS_CHAR * servername, CS_INT snamelen)
 		}
 		if (con->locale->time && tds_get_ctx(con->tds_socket)) {
 			TDSLOCALE *locale = tds_get_ctx(con->tds_socket)->locale;
-			free(locale->date_fmt);
 			/* TODO convert format from CTLib to libTDS */
-			locale->date_fmt = strdup(con->locale->time);
-			if (!locale->date_fmt)
+			if (!tds_locale_set_date_fmt(locale, con->locale->time))
 				goto Cleanup;
 		}
 		/* TODO how to handle this?
@@ -1244,6 +1247,14 @@ ct_results(CS_COMMAND * cmd, CS_INT * result_type)
 				cmd->results_state = _CS_RES_RESULTSET_EMPTY;
 				rows_affected = tds->rows_affected = TDS_NO_COUNT;
 
+				/*
+				 * same results of previous execution, skip ct_bind calls if requested;
+				 * bindings are kept only if this command did them
+				 */
+				if (tds->current_results && tds->current_results->reused
+				    && (!cmd->sticky_binds || tds->current_results->bindings_owner != cmd))
+					tds_reset_bindings(tds->current_results);
+
 				if (cmd->command_type == CS_CUR_CMD ||
 				    cmd->command_type == CS_DYNAMIC_CMD)
 					break;
@@ -1550,6 +1561,8 @@ ct_bind(CS_COMMAND * cmd, CS_INT item, CS_DATAFMT * datafmt, CS_VOID * buffer, C
 	if (copied) {
 		colinfo->column_lenbind = copied;
 	}
+	/* bindings survive reusing results only for this command */
+	resinfo->bindings_owner = cmd->sticky_binds ? cmd : NULL;
 	return CS_SUCCEED;
 }
 
@@ -1615,6 +1628,9 @@ ct_fetch(CS_COMMAND * cmd, CS_INT type, CS_INT offset, CS_INT option, CS_INT * p
 	if (cmd->curr_result_type == CS_CMD_FAIL)
 		return CS_CMD_FAIL;
 
+	/* complete previous row if a large value was left on the wire */
+	if (TDS_FAILED(tds_blob_stream_finish(tds)))
+		return CS_FAIL;
 
 	marker = tds_peek(tds);
 	if ((cmd->curr_result_type == CS_ROW_RESULT    && marker != TDS_ROW_TOKEN && marker != TDS_NBC_ROW_TOKEN)
@@ -1623,10 +1639,14 @@ ct_fetch(CS_COMMAND * cmd, CS_INT type, CS_INT offset, CS_INT option, CS_INT * p
 
 	/* Array Binding Code changes start here */
 
+	if (cmd->bind_count > 1 && cmd->curr_result_type == CS_ROW_RESULT)
+		return _ct_fetch_batch(cmd, prows_read);
+
 	for (temp_count = 0; temp_count < cmd->bind_count; temp_count++) {
 
 		ret = tds_process_tokens(tds, &ret_type, NULL,
-					 TDS_STOPAT_ROWFMT|TDS_STOPAT_DONE|TDS_RETURN_ROW|TDS_RETURN_COMPUTE);
+					 TDS_STOPAT_ROWFMT|TDS_STOPAT_DONE|TDS_RETURN_ROW|TDS_RETURN_COMPUTE
+					 | (_ct_can_stream_blobs(tds->current_results) ? TDS_TOKEN_STREAM_BLOBS : 0));
 
 		tdsdump_log(TDS_DBG_FUNC, "inside ct_fetch() process_row_tokens returned %d\n", ret);
 
@@ -1668,6 +1688,95 @@ ct_fetch(CS_COMMAND * cmd, CS_INT type, CS_INT offset, CS_INT option, CS_INT * p
 	return CS_SUCCEED;
 }
 
+/**
+ * Check if large values can be left on the wire reading a row.
+ * They are then read by ct_get_data while returned, so the first large
+ * value and all following columns must not be bound.
+ */
+static bool
+_ct_can_stream_blobs(TDSRESULTINFO * resinfo)
+{
+	bool blob_found = false;
+	int i;
+
+	if (!resinfo)
+		return false;
+
+	for (i = 0; i < resinfo->num_cols; i++) {
+		TDSCOLUMN *curcol = resinfo->columns[i];
+
+		if (is_blob_col(curcol))
+			blob_found = true;
+		if (blob_found && curcol->column_varaddr)
+			return false;
+	}
+	return blob_found;
+}
+
+/**
+ * Fetch rows for array binding reading them all at once in a batch,
+ * then converting each row to the bound arrays.
+ */
+static CS_RETCODE
+_ct_fetch_batch(CS_COMMAND * cmd, CS_INT * rows_read)
+{
+	TDSSOCKET *tds = cmd->con->tds_socket;
+	TDSRESULTINFO *resinfo = tds->current_results;
+	TDSBATCH *batch;
+	TDS_UINT row;
+	unsigned char **saved_data;
+	TDS_INT *saved_sizes;
+	CS_RETCODE ret = CS_SUCCEED;
+	int i;
+
+	tdsdump_log(TDS_DBG_FUNC, "_ct_fetch_batch(%p, %p)\n", cmd, rows_read);
+
+	batch = tds_alloc_batch(resinfo, cmd->bind_count);
+	saved_data = tds_new(unsigned char *, resinfo->num_cols);
+	saved_sizes = tds_new(TDS_INT, resinfo->num_cols);
+	if (!batch || !saved_data || !saved_sizes) {
+		ret = CS_FAIL;
+		goto Cleanup;
+	}
+
+	if (TDS_FAILED(tds_process_row_batch(tds, batch))) {
+		ret = CS_FAIL;
+		goto Cleanup;
+	}
+
+	/* bind each row pointing columns to the values in the batch */
+	for (i = 0; i < resinfo->num_cols; i++) {
+		saved_data[i] = resinfo->columns[i]->column_data;
+		saved_sizes[i] = resinfo->columns[i]->column_cur_size;
+	}
+	cmd->get_data_item = 0;
+	cmd->get_data_bytes_returned = 0;
+	for (row = 0; row < batch->num_rows; ++row) {
+		for (i = 0; i < resinfo->num_cols; i++) {
+			resinfo->columns[i]->column_data = tds_batch_value(&batch->columns[i], row);
+			resinfo->columns[i]->column_cur_size = batch->columns[i].lengths[row];
+		}
+		if (_ct_bind_data(cmd->con->ctx, resinfo, resinfo, row)) {
+			ret = CS_ROW_FAIL;
+			break;
+		}
+		(*rows_read)++;
+	}
+	for (i = 0; i < resinfo->num_cols; i++) {
+		resinfo->columns[i]->column_data = saved_data[i];
+		resinfo->columns[i]->column_cur_size = saved_sizes[i];
+	}
+
+	if (ret == CS_SUCCEED && !batch->num_rows)
+		ret = CS_END_DATA;
+
+Cleanup:
+	free(saved_sizes);
+	free(saved_data);
+	tds_free_batch(batch);
+	return ret;
+}
+
 static CS_RETCODE
 _ct_fetch_cursor(CS_COMMAND * cmd, CS_INT type, CS_INT offset, CS_INT option, CS_INT * rows_read)
 {
@@ -1867,6 +1976,7 @@ ct_cmd_drop(CS_COMMAND * cmd)
 			free(cmd->rpc);
 		}
 		free(cmd->iodesc);
+		_ct_cmd_forget_bindings(cmd);
 
 		/* now remove this command from the list of commands in the connection */
 		con = cmd->con;
@@ -1890,6 +2000,30 @@ ct_cmd_drop(CS_COMMAND * cmd)
 	return CS_SUCCEED;
 }
 
+/**
+ * Remove bindings done by a command being freed from results kept
+ * by the connection, these results could be reused by another command
+ * allocated at the same address.
+ */
+static void
+_ct_cmd_forget_bindings(CS_COMMAND * cmd)
+{
+	TDSSOCKET *tds;
+	TDSDYNAMIC *dyn;
+
+	if (!cmd->con || !cmd->con->tds_socket)
+		return;
+	tds = cmd->con->tds_socket;
+
+	if (tds->last_results && tds->last_results->bindings_owner == cmd)
+		tds_reset_bindings(tds->last_results);
+	if (tds->current_results && tds->current_results->bindings_owner == cmd)
+		tds_reset_bindings(tds->current_results);
+	for (dyn = tds->conn->dyns; dyn; dyn = dyn->next)
+		if (dyn->last_results && dyn->last_results->bindings_owner == cmd)
+			tds_reset_bindings(dyn->last_results);
+}
+
 CS_RETCODE
 ct_close(CS_CONNECTION * con, CS_INT option)
 {
@@ -2165,6 +2299,12 @@ ct_cancel(CS_CONNECTION * conn, CS_COMMAND * cmd, CS_INT type)
 			return CS_SUCCEED;
 		}
 
+		/* rows are not bound, just skip them on the wire */
+		if (cmd->curr_result_type == CS_ROW_RESULT && cmd->command_type != CS_CUR_CMD
+		    && cmd->results_state != _CS_RES_CMD_DONE && cmd->con && cmd->con->tds_socket
+		    && TDS_FAILED(tds_discard_rows(cmd->con->tds_socket)))
+			return CS_FAIL;
+
 		tdsdump_log(TDS_DBG_FUNC, "ct_cancel() - fetching results()\n");
 		do {
 			ret = ct_fetch(cmd, CS_UNUSED, CS_UNUSED, CS_UNUSED, NULL);
@@ -2569,6 +2709,9 @@ ct_cmd_props(CS_COMMAND * cmd, CS_INT action, CS_INT property, CS_VOID * buffer,
 			cmd->userdata_len = buflen;
 			memcpy(cmd->userdata, buffer, buflen);
 			break;
+		case CS_STICKY_BINDS:
+			cmd->sticky_binds = *(CS_BOOL *) buffer == CS_TRUE;
+			break;
 		default:
 			break;
 		}
@@ -2627,6 +2770,10 @@ ct_cmd_props(CS_COMMAND * cmd, CS_INT action, CS_INT property, CS_VOID * buffer,
 				maxcp = buflen;
 			memcpy(buffer, cmd->userdata, maxcp);
 			break;
+		case CS_STICKY_BINDS:
+			*(CS_BOOL *) buffer = cmd->sticky_binds ? CS_TRUE : CS_FALSE;
+			if (outlen) *outlen = sizeof(CS_BOOL);
+			break;
 		default:
 			break;
 		}
@@ -2724,8 +2871,10 @@ ct_compute_info(CS_COMMAND * cmd, CS_INT type, CS_INT colnum, CS_VOID * buffer,
 CS_RETCODE
 ct_get_data(CS_COMMAND * cmd, CS_INT item, CS_VOID * buffer, CS_INT buflen, CS_INT * outlen)
 {
+	TDSSOCKET *tds;
 	TDSRESULTINFO *resinfo;
 	TDSCOLUMN *curcol;
+	TDSBLOBSTREAM *bs;
 	unsigned char *src;
 	TDS_INT srclen;
 
@@ -2734,7 +2883,7 @@ ct_get_data(CS_COMMAND * cmd, CS_INT item, CS_VOID * buffer, CS_INT buflen, CS_I
 	tdsdump_log(TDS_DBG_FUNC, "ct_get_data() item = %d buflen = %d\n", item, buflen);
 
 	/* basic validations... */
-	if (!cmd || !cmd->con || !cmd->con->tds_socket || !(resinfo = cmd->con->tds_socket->current_results))
+	if (!cmd || !cmd->con || !(tds = cmd->con->tds_socket) || !(resinfo = tds->current_results))
 		return CS_FAIL;
 	if (item < 1 || item > resinfo->num_cols)
 		return CS_FAIL;
@@ -2748,6 +2897,12 @@ ct_get_data(CS_COMMAND * cmd, CS_INT item, CS_VOID * buffer, CS_INT buflen, CS_I
 		return CS_CANCELED;
 	}
 
+	/* large values left on the wire by ct_fetch are read in order, skip the ones before this column */
+	bs = &tds->blob_stream;
+	while (bs->column && bs->info == resinfo && bs->next_col < item)
+		if (TDS_FAILED(tds_blob_stream_next(tds, true)))
+			return CS_FAIL;
+
 	/* This is a new column we are being asked to return */
 
 	if (item != cmd->get_data_item) {
@@ -2780,6 +2935,8 @@ ct_get_data(CS_COMMAND * cmd, CS_INT item, CS_VOID * buffer, CS_INT buflen, CS_I
 		cmd->iodesc->locale = cmd->con->locale;
 		cmd->iodesc->usertype = curcol->column_usertype;
 		cmd->iodesc->total_txtlen = curcol->column_cur_size;
+		if (bs->column == curcol)
+			cmd->iodesc->total_txtlen = bs->size >= 0 && bs->size <= 0x7fffffff ? (CS_INT) bs->size : 0;
 		cmd->iodesc->offset = 0;
 		cmd->iodesc->log_on_update = CS_FALSE;
 
@@ -2813,6 +2970,10 @@ ct_get_data(CS_COMMAND * cmd, CS_INT item, CS_VOID * buffer, CS_INT buflen, CS_I
 
 	}
 
+	/* value is read from the wire while returned, memory used does not depend on its size */
+	if (bs->column == curcol)
+		return _ct_get_data_stream(cmd, resinfo, item, (unsigned char *) buffer, buflen, outlen);
+
 	/*
 	 * and adjust the data and length based on
 	 * what we may have already returned
@@ -2821,8 +2982,12 @@ ct_get_data(CS_COMMAND * cmd, CS_INT item, CS_VOID * buffer, CS_INT buflen, CS_I
 	srclen = curcol->column_cur_size;
 	if (srclen < 0)
 		srclen = 0;
-	src += cmd->get_data_bytes_returned;
 	srclen -= cmd->get_data_bytes_returned;
+	/* a value streamed is not kept */
+	if (srclen < 0)
+		srclen = 0;
+	else
+		src += cmd->get_data_bytes_returned;
 
 	/* if we have enough buffer to cope with all the data */
 
@@ -2843,6 +3008,47 @@ ct_get_data(CS_COMMAND * cmd, CS_INT item, CS_VOID * buffer, CS_INT buflen, CS_I
 	return CS_SUCCEED;
 }
 
+/**
+ * Return data of a large value left on the wire by ct_fetch.
+ * When the value ends the row is read up to the next large value.
+ */
+static CS_RETCODE
+_ct_get_data_stream(CS_COMMAND * cmd, TDSRESULTINFO * resinfo, CS_INT item, unsigned char *buffer, CS_INT buflen,
+		    CS_INT * outlen)
+{
+	TDSSOCKET *tds = cmd->con->tds_socket;
+	TDSBLOBSTREAM *bs = &tds->blob_stream;
+	CS_INT copied = 0;
+	bool more = true;
+	int len;
+
+	while (copied < buflen) {
+		len = tds_blob_stream_read(tds, buffer + copied, buflen - copied);
+		if (len < 0)
+			return CS_FAIL;
+		if (len == 0) {
+			more = false;
+			break;
+		}
+		copied += len;
+	}
+	/* PLP values can have other chunks */
+	if (!bs->plp && bs->chunk_left == 0)
+		more = false;
+
+	cmd->get_data_bytes_returned += copied;
+	if (outlen)
+		*outlen = copied;
+	if (more)
+		return CS_SUCCEED;
+
+	if (TDS_FAILED(tds_blob_stream_next(tds, true)))
+		return CS_FAIL;
+	if (item < resinfo->num_cols)
+		return CS_END_ITEM;
+	return CS_END_DATA;
+}
+
 CS_RETCODE
 ct_send_data(CS_COMMAND * cmd, CS_VOID * buffer, CS_INT buflen)
 {
@@ -0,0 +1,127 @@
+/* Test bindings kept with CS_STICKY_BINDS are used only by the command
+ * which did them, executing again the same query with another command
+ * must not fill buffers bound by the first one.
+ */
+#include <config.h>
+
+#include <stdio.h>
+
+#if HAVE_STDLIB_H
+#include <stdlib.h>
+#endif /* HAVE_STDLIB_H */
+
+#if HAVE_STRING_H
+#include <string.h>
+#endif /* HAVE_STRING_H */
+
+#include <ctpublic.h>
+#include "common.h"
+
+static void
+check_ret(const char *name, CS_RETCODE ret)
+{
+	if (ret != CS_SUCCEED) {
+		fprintf(stderr, "%s(): failed\n", name);
+		exit(1);
+	}
+}
+
+static void
+set_sticky(CS_COMMAND * cmd, CS_BOOL sticky)
+{
+	check_ret("ct_cmd_props", ct_cmd_props(cmd, CS_SET, CS_STICKY_BINDS, &sticky, CS_UNUSED, NULL));
+}
+
+/*
+ * Execute the query, binding the column to value if requested.
+ * Returns the sum of values received in value.
+ */
+static int
+select_rows(CS_COMMAND * cmd, int bind, CS_INT * value)
+{
+	CS_INT result_type, rows_read;
+	CS_DATAFMT datafmt;
+	CS_RETCODE ret;
+	int sum = 0;
+
+	check_ret("ct_command", ct_command(cmd, CS_LANG_CMD, "SELECT n FROM #sticky ORDER BY n", CS_NULLTERM, CS_UNUSED));
+	check_ret("ct_send", ct_send(cmd));
+	while ((ret = ct_results(cmd, &result_type)) == CS_SUCCEED) {
+		if (result_type != CS_ROW_RESULT)
+			continue;
+		if (bind) {
+			memset(&datafmt, 0, sizeof(datafmt));
+			datafmt.datatype = CS_INT_TYPE;
+			datafmt.count = 1;
+			check_ret("ct_bind", ct_bind(cmd, 1, &datafmt, value, NULL, NULL));
+		}
+		for (;;) {
+			*value = 0;
+			ret = ct_fetch(cmd, CS_UNUSED, CS_UNUSED, CS_UNUSED, &rows_read);
+			if (ret == CS_END_DATA)
+				break;
+			check_ret("ct_fetch", ret);
+			sum += *value;
+		}
+	}
+	if (ret != CS_END_RESULTS)
+		check_ret("ct_results", ret);
+	return sum;
+}
+
+static void
+check_sum(int line, int sum, int expected)
+{
+	if (sum != expected) {
+		fprintf(stderr, "line %d: wrong sum %d expected %d\n", line, sum, expected);
+		exit(1);
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	CS_CONTEXT *ctx;
+	CS_CONNECTION *conn;
+	CS_COMMAND *cmd, *cmd2;
+	CS_INT value, value2;
+	int verbose = 0;
+
+	printf("%s: test sticky bindings\n", __FILE__);
+
+	check_ret("try_ctlogin", try_ctlogin(&ctx, &conn, &cmd, verbose));
+
+	check_ret("run_command", run_command(cmd, "CREATE TABLE #sticky (n INT NOT NULL)"));
+	check_ret("run_command", run_command(cmd, "INSERT INTO #sticky VALUES(1) INSERT INTO #sticky VALUES(2) "
+					     "INSERT INTO #sticky VALUES(3)"));
+
+	check_ret("ct_cmd_alloc", ct_cmd_alloc(conn, &cmd2));
+	set_sticky(cmd, CS_TRUE);
+
+	/* bindings are kept executing the same query */
+	check_sum(__LINE__, select_rows(cmd, 1, &value), 6);
+	check_sum(__LINE__, select_rows(cmd, 0, &value), 6);
+
+	/* but not inherited by another command */
+	check_sum(__LINE__, select_rows(cmd2, 0, &value), 0);
+	check_sum(__LINE__, select_rows(cmd, 0, &value), 0);
+
+	/* nor kept without sticky bindings */
+	check_sum(__LINE__, select_rows(cmd, 1, &value), 6);
+	set_sticky(cmd, CS_FALSE);
+	check_sum(__LINE__, select_rows(cmd, 0, &value), 0);
+
+	/* nor inherited by a command allocated after freeing the owner */
+	set_sticky(cmd2, CS_TRUE);
+	check_sum(__LINE__, select_rows(cmd2, 1, &value2), 6);
+	check_ret("ct_cmd_drop", ct_cmd_drop(cmd2));
+	check_ret("ct_cmd_alloc", ct_cmd_alloc(conn, &cmd2));
+	set_sticky(cmd2, CS_TRUE);
+	check_sum(__LINE__, select_rows(cmd2, 0, &value2), 0);
+	check_ret("ct_cmd_drop", ct_cmd_drop(cmd2));
+
+	check_ret("try_ctlogout", try_ctlogout(ctx, conn, cmd, verbose));
+
+	printf("Test succeeded\n");
+	return 0;
+}
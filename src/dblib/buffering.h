@@ -545,6 +545,7 @@ buffer_save_row(DBPROCESS *dbproc)
 		row = &buf->rows[idx];
 
 		if (row->resinfo && !row->row_data) {
+			tds_unpin_row_data(row->resinfo);
 			row->row_data = row->resinfo->current_row;
 			tds_alloc_row(row->resinfo);
 		}
@@ -276,7 +276,7 @@ dblib_get_tds_ctx(void)
 #else
 							   "%b %d %Y %I:%M:%S:%z%p";
 #endif
-			g_dblib_ctx.tds_ctx->locale->date_fmt = strdup(date_format);
+			tds_locale_set_date_fmt(g_dblib_ctx.tds_ctx->locale, date_format);
 		}
 	}
 	tds_mutex_unlock(&dblib_mutex);
@@ -359,6 +359,55 @@ dbcolptr(DBPROCESS* dbproc, int column)
 	return dbproc->tds_socket->res_info->columns[column - 1];
 }
 
+/** \internal
+ * \ingroup dblib_internal
+ * \brief Get a column of the current row making sure its value was read.
+ * 
+ * Columns not bound are skipped reading rows, see dblib_set_lazy_columns().
+ * The value is read here if still available, following rows will read
+ * the column as usual.
+ * \param dbproc contains all information needed by db-lib to manage communications with the server.
+ * \param column Nth column in the result set, starting with 1.
+ * \returns column or NULL on error
+ */
+static TDSCOLUMN*
+dbcolvalue(DBPROCESS* dbproc, int column)
+{
+	TDSCOLUMN *colinfo = dbcolptr(dbproc, column);
+
+	if (colinfo) {
+		colinfo->column_lazy = 0;
+		tds_load_column(dbproc->tds_socket, colinfo);
+	}
+	return colinfo;
+}
+
+/** \internal
+ * \ingroup dblib_internal
+ * \brief Skip values of columns not bound reading rows.
+ * 
+ * Skipped values are not converted, read only if requested by dbdata() and
+ * similar functions. Not done if rows are buffered as values of previous
+ * rows would not be available.
+ * \param dbproc contains all information needed by db-lib to manage communications with the server.
+ */
+static void
+dblib_set_lazy_columns(DBPROCESS * dbproc)
+{
+	TDSRESULTINFO *resinfo = dbproc->tds_socket->res_info;
+	const bool buffered = dbproc->row_buf.capacity > 1;
+	int i;
+
+	if (!resinfo)
+		return;
+
+	for (i = 0; i < resinfo->num_cols; ++i) {
+		TDSCOLUMN *colinfo = resinfo->columns[i];
+
+		colinfo->column_lazy = !buffered && !colinfo->column_varaddr && !colinfo->column_nullbind;
+	}
+}
+
 static TDSCOLUMN*
 dbacolptr(DBPROCESS* dbproc, int computeid, int column, int is_bind)
 {
@@ -1729,6 +1778,7 @@ _dbresults(DBPROCESS * dbproc)
 			case TDS_ROWFMT_RESULT:
 				buffer_free(&dbproc->row_buf);
 				buffer_alloc(dbproc);
+				dblib_set_lazy_columns(dbproc);
 				dbproc->dbresults_state = _DB_RES_RESULTSET_EMPTY;
 				break;
 	
@@ -2240,6 +2290,52 @@ dblib_bound_type(int bindtype)
 	}
 }
 
+/** size of stack buffers used for character and binary conversions */
+#define DBLIB_CONVERT_BUF 512
+
+/**
+ * \internal
+ * \ingroup dblib_internal
+ * \brief Call tds_convert() storing character and binary results in \a buf if possible.
+ *
+ * Only results too large for \a buf are allocated; the caller must free
+ * dres->c (or dres->ib) only if it differs from \a buf.
+ * \param buf buffer of DBLIB_CONVERT_BUF bytes
+ * \returns length of the result or a TDS_CONVERT_* failure code, like tds_convert().
+ */
+static TDS_INT
+_dblib_convert(TDS_SERVER_TYPE srctype, const BYTE * src, DBINT srclen, TDS_SERVER_TYPE desttype,
+	       CONV_RESULT * dres, TDS_CHAR * buf)
+{
+	TDS_INT len;
+
+	switch (desttype) {
+	case SYBCHAR:
+	case SYBVARCHAR:
+	case SYBTEXT:
+		dres->cc.c = buf;
+		dres->cc.len = DBLIB_CONVERT_BUF;
+		len = tds_convert(g_dblib_ctx.tds_ctx, srctype, (const TDS_CHAR *) src, srclen, TDS_CONVERT_CHAR, dres);
+		break;
+	case SYBBINARY:
+	case SYBVARBINARY:
+	case SYBIMAGE:
+		dres->cb.ib = buf;
+		dres->cb.len = DBLIB_CONVERT_BUF;
+		len = tds_convert(g_dblib_ctx.tds_ctx, srctype, (const TDS_CHAR *) src, srclen, TDS_CONVERT_BINARY, dres);
+		break;
+	default:
+		return tds_convert(g_dblib_ctx.tds_ctx, srctype, (const TDS_CHAR *) src, srclen, desttype, dres);
+	}
+
+	/* result did not fit, let tds_convert() allocate it */
+	if (len > DBLIB_CONVERT_BUF)
+		return tds_convert(g_dblib_ctx.tds_ctx, srctype, (const TDS_CHAR *) src, srclen, desttype, dres);
+
+	dres->c = buf;
+	return len;
+}
+
 /**
  * \ingroup dblib_core
  * \brief Convert one datatype to another.
@@ -2285,6 +2381,7 @@ dbconvert_ps(DBPROCESS * dbproc, int db_srctype, const BYTE * src, DBINT srclen,
 	     int db_desttype, BYTE * dest, DBINT destlen, DBTYPEINFO * typeinfo)
 {
 	CONV_RESULT dres;
+	TDS_CHAR conv_buf[DBLIB_CONVERT_BUF];
 	DBINT ret;
 	int i;
 	int len;
@@ -2454,7 +2551,7 @@ dbconvert_ps(DBPROCESS * dbproc, int db_srctype, const BYTE * src, DBINT srclen,
 
 	tdsdump_log(TDS_DBG_INFO1, "dbconvert_ps() calling tds_convert\n");
 
-	len = tds_convert(g_dblib_ctx.tds_ctx, srctype, (const TDS_CHAR *) src, srclen, desttype, &dres);
+	len = _dblib_convert(srctype, src, srclen, desttype, &dres, conv_buf);
 	tdsdump_log(TDS_DBG_INFO1, "dbconvert_ps() called tds_convert returned %d\n", len);
 
 	if (len < 0) {
@@ -2475,7 +2572,8 @@ dbconvert_ps(DBPROCESS * dbproc, int db_srctype, const BYTE * src, DBINT srclen,
 				memset(dest + len, 0, destlen - len);
 			ret = len;
 		}
-		free(dres.ib);
+		if (dres.ib != conv_buf)
+			free(dres.ib);
 		break;
 	case SYBINT1:
 	case SYBINT2:
@@ -2546,7 +2644,8 @@ dbconvert_ps(DBPROCESS * dbproc, int db_srctype, const BYTE * src, DBINT srclen,
 			break;
 		}
 
-		free(dres.c);
+		if (dres.c != conv_buf)
+			free(dres.c);
 
 		break;
 	default:
@@ -2679,6 +2778,7 @@ dbbind(DBPROCESS * dbproc, int column, int vartype, DBINT varlen, BYTE * varaddr
 	colinfo->column_varaddr = (char *) varaddr;
 	colinfo->column_bindtype = vartype;
 	colinfo->column_bindlen = varlen;
+	colinfo->column_lazy = 0;
 
 	return SUCCEED;
 }				/* dbbind()  */
@@ -2732,6 +2832,7 @@ dbnullbind(DBPROCESS * dbproc, int column, DBINT * indicator)
 		return FAIL; /* dbcolptr sent SYBECNOR, Column number out of range */
 
 	colinfo->column_nullbind = (TDS_SMALLINT *)indicator;
+	colinfo->column_lazy = 0;
 	return SUCCEED;
 }
 
@@ -3310,7 +3411,7 @@ dbdatlen(DBPROCESS * dbproc, int column)
 
 	tdsdump_log(TDS_DBG_FUNC, "dbdatlen(%p, %d)\n", dbproc, column);
 
-	colinfo = dbcolptr(dbproc, column);
+	colinfo = dbcolvalue(dbproc, column);
 	if (!colinfo)
 		return -1;	
 
@@ -3335,7 +3436,7 @@ dbdata(DBPROCESS * dbproc, int column)
 {
 	tdsdump_log(TDS_DBG_FUNC, "dbdata(%p, %d)\n", dbproc, column);
 
-	return _dbcoldata(dbcolptr(dbproc, column));
+	return _dbcoldata(dbcolvalue(dbproc, column));
 }
 
 /** \internal
@@ -3454,7 +3555,7 @@ dbspr1row(DBPROCESS * dbproc, char *buffer, DBINT buf_len)
 
 	for (col = 0; col < tds->res_info->num_cols; col++) {
 		int padlen, collen, namlen;
-		TDSCOLUMN *colinfo = tds->res_info->columns[col];
+		TDSCOLUMN *colinfo = dbcolvalue(dbproc, col + 1);
 		if (colinfo->column_cur_size < 0) {
 			len = 4;
 			if (buf_len <= len) {
@@ -3564,7 +3665,7 @@ dbprrow(DBPROCESS * dbproc)
 			}
 
 			for (col = 0; col < resinfo->num_cols; col++) {
-				colinfo = resinfo->columns[col];
+				colinfo = dbcolvalue(dbproc, col + 1);
 				if (colinfo->column_cur_size < 0) {
 					len = 4;
 					strcpy(dest, "NULL");
@@ -4044,6 +4145,54 @@ dbsetdeflang(char *language)
 }
 #endif
 
+/**
+ * \ingroup dblib_core
+ * \brief Get activity counters of the connection.
+ *
+ * Counters are always collected, they can be used to diagnose where time
+ * is spent without enabling a full dump. Time waiting for the network is
+ * measured only after the first call.
+ * \param dbproc contains all information needed by db-lib to manage communications with the server.
+ * \param stats structure to fill.
+ * \param reset if TRUE counters are reset after being read.
+ * \retval SUCCEED counters copied.
+ * \retval FAIL no connection.
+ * \remarks This is a FreeTDS extension.
+ */
+RETCODE
+dbgetstats(DBPROCESS * dbproc, DBSTATS * stats, DBBOOL reset)
+{
+	TDSSTATS tds_stats;
+	unsigned i;
+
+	tdsdump_log(TDS_DBG_FUNC, "dbgetstats(%p, %p, %d)\n", dbproc, stats, reset);
+	CHECK_PARAMETER(dbproc, SYBENULL, FAIL);
+	CHECK_NULP(stats, "dbgetstats", 2, FAIL);
+
+	/* counters are available also for dead connections */
+	if (!dbproc->tds_socket)
+		return FAIL;
+
+	tds_get_stats(dbproc->tds_socket->conn, &tds_stats);
+	if (reset)
+		tds_reset_stats(dbproc->tds_socket->conn);
+
+	stats->bytes_sent = tds_stats.bytes_sent;
+	stats->bytes_received = tds_stats.bytes_received;
+	stats->packets_sent = tds_stats.packets_sent;
+	stats->packets_received = tds_stats.packets_received;
+	stats->write_calls = tds_stats.write_calls;
+	stats->read_calls = tds_stats.read_calls;
+	stats->waits = tds_stats.waits;
+	stats->wait_us = tds_stats.wait_us;
+	stats->rows = tds_stats.rows;
+	stats->iconv_bytes = tds_stats.iconv_bytes;
+	stats->allocations = tds_stats.allocations;
+	for (i = 0; i < TDS_VECTOR_SIZE(stats->tokens); ++i)
+		stats->tokens[i] = tds_stats.tokens[i];
+	return SUCCEED;
+}
+
 /**
  * \ingroup dblib_core
  * \brief Get TDS packet size for the connection.
@@ -4561,6 +4710,7 @@ dbsetopt(DBPROCESS * dbproc, int option, const char *char_param, int int_param)
 
 			if( 1 < nrows && nrows <= 2147483647 ) {
 				buffer_set_capacity(dbproc, nrows);
+				dblib_set_lazy_columns(dbproc);
 				rc = SUCCEED;
 			}
 		}
@@ -4851,6 +5001,7 @@ dbsqlok(DBPROCESS * dbproc)
 			case TDS_ROWFMT_RESULT:
 				buffer_free(&dbproc->row_buf);
 				buffer_alloc(dbproc);
+				dblib_set_lazy_columns(dbproc);
 			case TDS_COMPUTEFMT_RESULT:
 				dbproc->dbresults_state = _DB_RES_RESULTSET_EMPTY;
 			case TDS_COMPUTE_RESULT:
@@ -6513,7 +6664,7 @@ dbtxtimestamp(DBPROCESS * dbproc, int column)
 
 	tdsdump_log(TDS_DBG_FUNC, "dbtxtimestamp(%p, %d)\n", dbproc, column);
 
-	colinfo = dbcolptr(dbproc, column);
+	colinfo = dbcolvalue(dbproc, column);
 	if (!colinfo || !is_blob_col(colinfo))
 		return NULL;
 
@@ -6543,7 +6694,7 @@ dbtxptr(DBPROCESS * dbproc, int column)
 
 	tdsdump_log(TDS_DBG_FUNC, "dbtxptr(%p, %d)\n", dbproc, column);
 
-	colinfo = dbcolptr(dbproc, column);
+	colinfo = dbcolvalue(dbproc, column);
 	if (!colinfo || !is_blob_col(colinfo))
 		return NULL;
 
@@ -6661,6 +6812,7 @@ dbreadtext(DBPROCESS * dbproc, void *buf, DBINT bufsize)
 
 	resinfo = tds->res_info;
 	curcol = resinfo->columns[0];
+	curcol->column_lazy = 0;
 
 	/*
 	 * if the current position is beyond the end of the text
@@ -6677,8 +6829,8 @@ dbreadtext(DBPROCESS * dbproc, void *buf, DBINT bufsize)
 	 * then read another row
 	 */
 
-	if (curcol->column_textpos == 0) {
-		const int mask = TDS_STOPAT_ROWFMT|TDS_STOPAT_DONE|TDS_RETURN_ROW|TDS_RETURN_COMPUTE;
+	if (curcol->column_textpos == 0 && tds->blob_stream.column != curcol) {
+		const int mask = TDS_STOPAT_ROWFMT|TDS_STOPAT_DONE|TDS_RETURN_ROW|TDS_RETURN_COMPUTE|TDS_TOKEN_STREAM_BLOBS;
 		buffer_save_row(dbproc);
 		switch (tds_process_tokens(dbproc->tds_socket, &result_type, NULL, mask)) {
 		case TDS_SUCCESS:
@@ -6689,6 +6841,20 @@ dbreadtext(DBPROCESS * dbproc, void *buf, DBINT bufsize)
 		default:
 			return -1;
 		}
+		/* only first column is returned, read the others */
+		if (tds->blob_stream.column && tds->blob_stream.column != curcol
+		    && TDS_FAILED(tds_blob_stream_finish(tds)))
+			return -1;
+	}
+
+	/* value is read from the wire while returned, memory used does not depend on its size */
+	if (tds->blob_stream.column == curcol) {
+		if (bufsize <= 0)
+			return 0;
+		cpbytes = tds_blob_stream_read(tds, buf, bufsize);
+		if (cpbytes == 0 && TDS_FAILED(tds_blob_stream_finish(tds)))
+			return -1;
+		return cpbytes;
 	}
 
 	/* find the number of bytes to return */
@@ -7400,6 +7566,7 @@ copy_data_to_host_var(DBPROCESS * dbproc, TDS_SERVER_TYPE srctype, const BYTE *
 		      int bindtype, DBINT *indicator)
 {
 	CONV_RESULT dres;
+	TDS_CHAR conv_buf[DBLIB_CONVERT_BUF];
 	DBINT ret;
 	int i, len;
 	DBINT indicator_value = 0;
@@ -7565,7 +7732,7 @@ copy_data_to_host_var(DBPROCESS * dbproc, TDS_SERVER_TYPE srctype, const BYTE *
 
 	} /* end srctype == desttype */
 
-	len = tds_convert(g_dblib_ctx.tds_ctx, srctype, (const TDS_CHAR *) src, srclen, desttype, &dres);
+	len = _dblib_convert(srctype, src, srclen, desttype, &dres, conv_buf);
 
 	tdsdump_log(TDS_DBG_INFO1, "copy_data_to_host_var(): tds_convert returned %d\n", len);
 
@@ -7597,7 +7764,8 @@ copy_data_to_host_var(DBPROCESS * dbproc, TDS_SERVER_TYPE srctype, const BYTE *
 					memset(dest + len, 0, destlen - len);
 			}
 		}
-		TDS_ZERO_FREE(dres.ib);
+		if (dres.ib != conv_buf)
+			free(dres.ib);
 		break;
 	case SYBINT1:
 	case SYBINT2:
@@ -7683,7 +7851,8 @@ copy_data_to_host_var(DBPROCESS * dbproc, TDS_SERVER_TYPE srctype, const BYTE *
 				break;
 		} 
 
-		free(dres.c);
+		if (dres.c != conv_buf)
+			free(dres.c);
 		break;
 	default:
 		tdsdump_log(TDS_DBG_INFO1, "error: copy_data_to_host_var(): unrecognized desttype %d \n", desttype);
@@ -1640,8 +1640,7 @@ _SQLAllocEnv(SQLHENV FAR * phenv, SQLINTEGER odbc_version)
 	ctx->err_handler = odbc_errmsg_handler;
 
 	/* ODBC has its own format */
-	free(ctx->locale->date_fmt);
-	ctx->locale->date_fmt = strdup("%Y-%m-%d %H:%M:%S.%z");
+	tds_locale_set_date_fmt(ctx->locale, "%Y-%m-%d %H:%M:%S.%z");
 
 	tds_mutex_init(&env->mtx);
 	*phenv = (SQLHENV) env;
@@ -3714,6 +3713,26 @@ odbc_fix_data_type_col(TDS_STMT *stmt, int idx)
 	}
 }
 
+/**
+ * Mark columns not bound to be skipped reading the next row.
+ * Values of these columns are read by SQLGetData only if requested,
+ * see tds_skip_column. Computed for every row as bindings can change
+ * between fetches.
+ */
+static void
+odbc_set_lazy_columns(TDS_STMT *stmt, TDSRESULTINFO *resinfo)
+{
+	TDS_DESC *ard = stmt->ard;
+	struct _drecord *drec;
+	int i;
+
+	for (i = 0; i < resinfo->num_cols; i++) {
+		drec = (i < ard->header.sql_desc_count) ? &ard->records[i] : NULL;
+		resinfo->columns[i]->column_lazy = !drec || (!drec->sql_desc_data_ptr && !drec->sql_desc_indicator_ptr
+							     && !drec->sql_desc_octet_length_ptr);
+	}
+}
+
 /*
  * - handle correctly SQLGetData (for forward cursors accept only row_size == 1
  *   for other types application must use SQLSetPos)
@@ -3854,6 +3873,10 @@ _SQLFetch(TDS_STMT * stmt, SQLSMALLINT FetchOrientation, SQLLEN FetchOffset)
 			break;
 
 		default:
+			/* cursor rows are read above and SQLGetData uses cursor->res_info */
+			if (!stmt->cursor && tds->res_info && tds->current_results == tds->res_info)
+				odbc_set_lazy_columns(stmt, tds->res_info);
+
 			/* FIXME stmt->row_count set correctly ?? TDS_DONE_COUNT not checked */
 			switch (odbc_process_tokens(stmt, TDS_STOPAT_ROWFMT|TDS_RETURN_ROW|TDS_STOPAT_COMPUTE)) {
 			case TDS_ROW_RESULT:
@@ -4785,6 +4808,28 @@ ODBC_FUNC(SQLColumns, (P(SQLHSTMT,hstmt), PCHARIN(CatalogName,SQLSMALLINT),	/* o
 	ODBC_EXIT_(stmt);
 }
 
+static void
+odbc_get_stats(TDSCONNECTION *conn, SQL_TDSODBC_STATS_STRUCT *stats)
+{
+	TDSSTATS tds_stats;
+	unsigned i;
+
+	tds_get_stats(conn, &tds_stats);
+	stats->bytes_sent = tds_stats.bytes_sent;
+	stats->bytes_received = tds_stats.bytes_received;
+	stats->packets_sent = tds_stats.packets_sent;
+	stats->packets_received = tds_stats.packets_received;
+	stats->write_calls = tds_stats.write_calls;
+	stats->read_calls = tds_stats.read_calls;
+	stats->waits = tds_stats.waits;
+	stats->wait_us = tds_stats.wait_us;
+	stats->rows = tds_stats.rows;
+	stats->iconv_bytes = tds_stats.iconv_bytes;
+	stats->allocations = tds_stats.allocations;
+	for (i = 0; i < TDS_VECTOR_SIZE(stats->tokens); ++i)
+		stats->tokens[i] = tds_stats.tokens[i];
+}
+
 ODBC_FUNC(SQLGetConnectAttr, (P(SQLHDBC,hdbc), P(SQLINTEGER,Attribute), P(SQLPOINTER,Value), P(SQLINTEGER,BufferLength),
 	P(SQLINTEGER *,StringLength) WIDE))
 {
@@ -4846,6 +4891,15 @@ ODBC_FUNC(SQLGetConnectAttr, (P(SQLHDBC,hdbc), P(SQLINTEGER,Attribute), P(SQLPOI
 	case SQL_COPT_SS_BCP:
 		*((SQLUINTEGER *) Value) = dbc->attr.bulk_enabled;
 		break;
+	case SQL_COPT_TDSODBC_STATS:
+		if (!dbc->tds_socket) {
+			odbc_errs_add(&dbc->errs, "08003", NULL);
+			break;
+		}
+		odbc_get_stats(dbc->tds_socket->conn, (SQL_TDSODBC_STATS_STRUCT *) Value);
+		if (StringLength)
+			*StringLength = sizeof(SQL_TDSODBC_STATS_STRUCT);
+		break;
 	default:
 		odbc_errs_add(&dbc->errs, "HY092", NULL);
 		break;
@@ -4919,6 +4973,12 @@ SQLGetData(SQLHSTMT hstmt, SQLUSMALLINT icol, SQLSMALLINT fCType, SQLPOINTER rgb
 	}
 	colinfo = resinfo->columns[icol - 1];
 
+	/* value of a column not bound is skipped by SQLFetch, read it now */
+	if (!stmt->cursor && TDS_FAILED(tds_load_column(stmt->tds, colinfo))) {
+		odbc_errs_add(&stmt->errs, "HY000", "Column value not available");
+		ODBC_EXIT_(stmt);
+	}
+
 	if (colinfo->column_cur_size < 0) {
 		/* TODO check what should happen if pcbValue was NULL */
 		*pcbValue = SQL_NULL_DATA;
@@ -0,0 +1,74 @@
+#include "common.h"
+#include <odbcss.h>
+
+/*
+ * Test connection counters returned by SQL_COPT_TDSODBC_STATS
+ * are updated by a query.
+ */
+
+static void
+get_stats(SQL_TDSODBC_STATS_STRUCT * stats)
+{
+	SQLINTEGER len = 0;
+
+	memset(stats, 0xaa, sizeof(*stats));
+	CHKGetConnectAttr(SQL_COPT_TDSODBC_STATS, stats, sizeof(*stats), &len, "S");
+	if (len != sizeof(*stats)) {
+		fprintf(stderr, "Wrong length %d\n", (int) len);
+		exit(1);
+	}
+}
+
+static void
+check(int line, int cond, const char *msg)
+{
+	if (!cond) {
+		fprintf(stderr, "line %d: %s\n", line, msg);
+		exit(1);
+	}
+}
+
+#define CHECK(cond) check(__LINE__, cond, #cond)
+
+int
+main(int argc, char *argv[])
+{
+	SQL_TDSODBC_STATS_STRUCT before, after;
+	int rows = 0;
+
+	odbc_use_version3 = 1;
+	odbc_connect();
+
+	if (!odbc_driver_is_freetds()) {
+		odbc_disconnect();
+		odbc_test_skipped();
+		return 0;
+	}
+
+	/* login is already counted */
+	get_stats(&before);
+	CHECK(before.bytes_sent > 0 && before.packets_sent > 0);
+	CHECK(before.bytes_received > 0 && before.packets_received > 0);
+	CHECK(before.write_calls > 0 && before.read_calls > 0);
+
+	odbc_command("SELECT 1 UNION ALL SELECT 2 UNION ALL SELECT 3");
+	while (CHKFetch("SNo") == SQL_SUCCESS)
+		++rows;
+	CHKMoreResults("No");
+	CHECK(rows == 3);
+
+	get_stats(&after);
+	CHECK(after.bytes_sent > before.bytes_sent && after.packets_sent > before.packets_sent);
+	CHECK(after.bytes_received > before.bytes_received && after.packets_received > before.packets_received);
+	CHECK(after.waits > before.waits);
+	CHECK(after.wait_us >= before.wait_us);
+	CHECK(after.rows - before.rows == 3);
+	/* ROW and NBCROW */
+	CHECK(after.tokens[0xd1] + after.tokens[0xd2] - before.tokens[0xd1] - before.tokens[0xd2] == 3);
+	CHECK(after.tokens[0xfd] > before.tokens[0xfd]);	/* DONE */
+
+	odbc_disconnect();
+
+	printf("Done.\n");
+	return 0;
+}
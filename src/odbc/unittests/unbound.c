@@ -0,0 +1,144 @@
+#include "common.h"
+
+/*
+ * Test values of columns not bound are read correctly by SQLGetData.
+ * SQLFetch skips these values and loads them only if requested so check
+ * reading all, some or none of them, in any order, and bound columns
+ * mixed with columns not bound.
+ */
+
+#define NUM_ROWS 200
+
+static void
+expected_string(int row, char *out)
+{
+	memset(out, 'A' + row % 26, row);
+	out[row] = 0;
+}
+
+static void
+expected_binary(int row, char *out)
+{
+	memset(out, 'a' + row % 26, row % 40);
+	out[row % 40] = 0;
+}
+
+static void
+check_int(int row, int col, SQLINTEGER value, SQLLEN ind, int null, SQLINTEGER expected)
+{
+	if (null && ind == SQL_NULL_DATA)
+		return;
+	if (null || ind != sizeof(SQLINTEGER) || value != expected) {
+		fprintf(stderr, "Wrong value row %d column %d\n", row, col);
+		exit(1);
+	}
+}
+
+static void
+check_string(int row, int col, const char *value, SQLLEN ind, int null, const char *expected)
+{
+	if (null && ind == SQL_NULL_DATA)
+		return;
+	if (null || ind != (SQLLEN) strlen(expected) || memcmp(value, expected, ind) != 0) {
+		fprintf(stderr, "Wrong value row %d column %d\n", row, col);
+		exit(1);
+	}
+}
+
+static void
+get_column(int row, int col)
+{
+	char buf[320], expected[320];
+	SQLINTEGER num;
+	SQLLEN ind;
+
+	switch (col) {
+	case 1:
+		CHKGetData(1, SQL_C_SLONG, &num, 0, &ind, "S");
+		check_int(row, col, num, ind, 0, row);
+		break;
+	case 2:
+		CHKGetData(2, SQL_C_CHAR, buf, sizeof(buf), &ind, "S");
+		expected_string(row, expected);
+		check_string(row, col, buf, ind, row % 7 == 3, expected);
+		break;
+	case 3:
+		CHKGetData(3, SQL_C_BINARY, buf, sizeof(buf), &ind, "S");
+		expected_binary(row, expected);
+		check_string(row, col, buf, ind, row % 5 == 2, expected);
+		break;
+	case 4:
+		CHKGetData(4, SQL_C_SLONG, &num, 0, &ind, "S");
+		check_int(row, col, num, ind, row % 4 == 1, row * 3);
+		break;
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	static const char select[] = "SELECT i, v, b, n FROM #unbound ORDER BY i";
+	char buf[320], expected[320];
+	SQLINTEGER num;
+	SQLLEN num_ind, ind;
+	int row, col;
+
+	odbc_use_version3 = 1;
+	odbc_connect();
+
+	/* rows long enough to span many packets */
+	odbc_command("CREATE TABLE #unbound (i INT NOT NULL, v VARCHAR(300) NULL, b VARBINARY(40) NULL, n INT NULL)");
+	odbc_command("DECLARE @i INT SET @i = 0 WHILE @i < 200 BEGIN "
+		     "INSERT INTO #unbound VALUES(@i, "
+		     "CASE WHEN @i % 7 = 3 THEN NULL ELSE REPLICATE(CHAR(65 + @i % 26), @i) END, "
+		     "CASE WHEN @i % 5 = 2 THEN NULL ELSE CONVERT(VARBINARY(40), REPLICATE(CHAR(97 + @i % 26), @i % 40)) END, "
+		     "CASE WHEN @i % 4 = 1 THEN NULL ELSE @i * 3 END) "
+		     "SET @i = @i + 1 END");
+
+	/* nothing bound, read all values */
+	odbc_command(select);
+	for (row = 0; row < NUM_ROWS; ++row) {
+		CHKFetch("S");
+		for (col = 1; col <= 4; ++col)
+			get_column(row, col);
+	}
+	CHKFetch("No");
+	CHKMoreResults("No");
+
+	/* nothing bound, read some values in reverse order */
+	odbc_command(select);
+	for (row = 0; row < NUM_ROWS; ++row) {
+		CHKFetch("S");
+		for (col = 4; col >= 1; --col)
+			if ((row + col) % 3 != 0)
+				get_column(row, col);
+	}
+	CHKFetch("No");
+	CHKMoreResults("No");
+
+	/* some columns bound, bindings changed while fetching */
+	odbc_command(select);
+	CHKBindCol(1, SQL_C_SLONG, &num, 0, &num_ind, "S");
+	CHKBindCol(2, SQL_C_CHAR, buf, sizeof(buf), &ind, "S");
+	for (row = 0; row < NUM_ROWS; ++row) {
+		if (row == NUM_ROWS / 2)
+			CHKFreeStmt(SQL_UNBIND, "S");
+		CHKFetch("S");
+		if (row < NUM_ROWS / 2) {
+			check_int(row, 1, num, num_ind, 0, row);
+			expected_string(row, expected);
+			check_string(row, 2, buf, ind, row % 7 == 3, expected);
+		} else {
+			get_column(row, 2);
+			get_column(row, 1);
+		}
+		get_column(row, 4);
+	}
+	CHKFetch("No");
+	CHKMoreResults("No");
+
+	odbc_disconnect();
+
+	printf("Done.\n");
+	return 0;
+}
@@ -0,0 +1,519 @@
+/* FreeTDS - Library of routines accessing Sybase and Microsoft databases
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Server generating synthetic result sets, used to measure client throughput.
+ *
+ * Any login is accepted. Queries are result set specifications like
+ *
+ *   rows=100000 cols=int,varchar,float nulls=10 strlen=20 plp=4000
+ *
+ * rows    number of rows
+ * cols    column types: int, bigint, float, datetime, numeric,
+ *         varchar, nvarchar, varbinary and plp (varchar(max) for
+ *         TDS 7.2+, long char for TDS 5.0)
+ * nulls   percentage of NULL values
+ * strlen  length of varchar, nvarchar and varbinary values
+ * plp     length of plp values
+ *
+ * Other queries (like settings sent by libraries) return no data.
+ * Column data is generated before sending, so rows are sent at the
+ * speed of the network layer.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+
+#if HAVE_STDLIB_H
+#include <stdlib.h>
+#endif /* HAVE_STDLIB_H */
+
+#if HAVE_STRING_H
+#include <string.h>
+#endif /* HAVE_STRING_H */
+
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+
+#if HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif /* HAVE_SYS_TYPES_H */
+
+#if HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif /* HAVE_SYS_SOCKET_H */
+
+#if HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif /* HAVE_NETINET_IN_H */
+
+#if HAVE_NETINET_TCP_H
+#include <netinet/tcp.h>
+#endif /* HAVE_NETINET_TCP_H */
+
+#include <freetds/tds.h>
+#include <freetds/iconv.h>
+#include <freetds/bytes.h>
+#include <freetds/server.h>
+#include "replacements.h"
+
+/** different values generated for every column */
+#define NUM_VALUES 256u
+
+#define MAX_COLUMNS 256
+
+typedef enum
+{
+	BENCH_INT,
+	BENCH_BIGINT,
+	BENCH_FLOAT,
+	BENCH_DATETIME,
+	BENCH_NUMERIC,
+	BENCH_VARCHAR,
+	BENCH_NVARCHAR,
+	BENCH_VARBINARY,
+	BENCH_PLP
+} BENCH_TYPE;
+
+static const char *const type_names[] = {
+	"int", "bigint", "float", "datetime", "numeric",
+	"varchar", "nvarchar", "varbinary", "plp"
+};
+
+typedef struct
+{
+	unsigned rows;
+	unsigned nulls;
+	unsigned str_len;
+	unsigned plp_len;
+	unsigned num_cols;
+	BENCH_TYPE cols[MAX_COLUMNS];
+} BENCH_SPEC;
+
+/* Latin1_General_CI_AS */
+static const TDS_UCHAR bench_collation[5] = { 0x09, 0x04, 0xd0, 0x00, 0x34 };
+
+static int packet_size = 0;
+
+static void
+usage(const char invoked_as[])
+{
+	fprintf(stderr, "usage:  %s [-n clients] [-s packet_size] port\n"
+		"  -n  number of clients to serve before exiting (default unlimited)\n"
+		"  -s  packet size (default requested by client)\n", invoked_as);
+	exit(1);
+}
+
+/**
+ * Parse a result set specification.
+ * \return 1 if parsed, 0 if query is not a specification, -1 on error
+ */
+static int
+parse_spec(const char *query, BENCH_SPEC *spec, char *error, size_t error_len)
+{
+	const char *p = query;
+	int found = 0;
+
+	memset(spec, 0, sizeof(*spec));
+	spec->rows = 1000;
+	spec->str_len = 20;
+	spec->plp_len = 4000;
+
+	for (;;) {
+		const char *value;
+		size_t name_len;
+
+		p += strspn(p, " \t\r\n");
+		if (!*p)
+			break;
+		value = strchr(p, '=');
+		if (!value)
+			return found ? (snprintf(error, error_len, "invalid option '%.30s'", p), -1) : 0;
+		name_len = value++ - p;
+
+		if (name_len == 4 && strncmp(p, "rows", 4) == 0) {
+			spec->rows = strtoul(value, NULL, 10);
+		} else if (name_len == 5 && strncmp(p, "nulls", 5) == 0) {
+			spec->nulls = strtoul(value, NULL, 10);
+			if (spec->nulls > 100)
+				spec->nulls = 100;
+		} else if (name_len == 6 && strncmp(p, "strlen", 6) == 0) {
+			spec->str_len = strtoul(value, NULL, 10);
+		} else if (name_len == 3 && strncmp(p, "plp", 3) == 0) {
+			spec->plp_len = strtoul(value, NULL, 10);
+		} else if (name_len == 4 && strncmp(p, "cols", 4) == 0) {
+			const char *type = value;
+
+			spec->num_cols = 0;
+			while (*type && *type != ' ') {
+				size_t len = strcspn(type, ", \t\r\n");
+				unsigned n;
+
+				for (n = 0; n < TDS_VECTOR_SIZE(type_names); ++n)
+					if (strlen(type_names[n]) == len && strncmp(type, type_names[n], len) == 0)
+						break;
+				if (n >= TDS_VECTOR_SIZE(type_names) || spec->num_cols >= MAX_COLUMNS) {
+					snprintf(error, error_len, "invalid column type '%.*s'", (int) len, type);
+					return -1;
+				}
+				spec->cols[spec->num_cols++] = (BENCH_TYPE) n;
+				type += len;
+				if (*type == ',')
+					++type;
+			}
+		} else if (!found) {
+			return 0;
+		} else {
+			snprintf(error, error_len, "invalid option '%.*s'", (int) name_len, p);
+			return -1;
+		}
+		found = 1;
+		p = value + strcspn(value, " \t\r\n");
+	}
+	if (!found)
+		return 0;
+	if (!spec->num_cols) {
+		spec->num_cols = 2;
+		spec->cols[0] = BENCH_INT;
+		spec->cols[1] = BENCH_VARCHAR;
+	}
+	return 1;
+}
+
+/**
+ * Set the type of a column for the TDS version of the client and
+ * generate the values to send, in wire format.
+ * \return false if the type cannot be sent with this TDS version
+ */
+static int
+setup_column(TDSSOCKET *tds, TDSCOLUMN *col, BENCH_TYPE type, const BENCH_SPEC *spec, unsigned char *values[NUM_VALUES])
+{
+	int tds7 = IS_TDS7_PLUS(tds->conn);
+	unsigned i, j, len;
+	unsigned max_len = tds7 ? 8000 : 255;
+
+	col->column_cur_size = 0;
+	switch (type) {
+	case BENCH_INT:
+		col->column_type = SYBINTN;
+		col->column_size = 4;
+		break;
+	case BENCH_BIGINT:
+		col->column_type = SYBINTN;
+		col->column_size = 8;
+		break;
+	case BENCH_FLOAT:
+		col->column_type = SYBFLTN;
+		col->column_size = 8;
+		break;
+	case BENCH_DATETIME:
+		col->column_type = SYBDATETIMN;
+		col->column_size = 8;
+		break;
+	case BENCH_NUMERIC:
+		col->column_type = SYBNUMERIC;
+		col->column_prec = 18;
+		col->column_scale = 4;
+		col->column_size = tds_numeric_bytes_per_prec[18];
+		break;
+	case BENCH_VARCHAR:
+		col->column_type = tds7 ? XSYBVARCHAR : SYBVARCHAR;
+		col->column_size = spec->str_len;
+		break;
+	case BENCH_NVARCHAR:
+		if (!tds7)
+			return 0;
+		col->column_type = XSYBNVARCHAR;
+		col->column_size = spec->str_len * 2;
+		break;
+	case BENCH_VARBINARY:
+		col->column_type = tds7 ? XSYBVARBINARY : SYBVARBINARY;
+		col->column_size = spec->str_len;
+		break;
+	case BENCH_PLP:
+		if (tds7 && !IS_TDS72_PLUS(tds->conn))
+			return 0;
+		col->column_type = tds7 ? XSYBVARCHAR : SYBLONGCHAR;
+		col->column_size = tds7 ? 0x3fffffff : 0x7fffffff;
+		break;
+	}
+	if ((type == BENCH_VARCHAR || type == BENCH_VARBINARY) && col->column_size > max_len)
+		return 0;
+	if (type == BENCH_NVARCHAR && col->column_size > 8000)
+		return 0;
+	if (col->column_size == 0)
+		col->column_size = 1;
+	col->column_flags = 1;	/* nullable */
+	memcpy(col->column_collation, bench_collation, sizeof(bench_collation));
+
+	len = col->column_size;
+	if (type == BENCH_PLP)
+		len = spec->plp_len;
+	else if (type == BENCH_VARCHAR || type == BENCH_VARBINARY || type == BENCH_NVARCHAR)
+		len = type == BENCH_NVARCHAR ? spec->str_len * 2 : spec->str_len;
+
+	for (i = 0; i < NUM_VALUES; ++i) {
+		unsigned char *p = (unsigned char *) malloc(len ? len : 1);
+
+		if (!p)
+			return 0;
+		values[i] = p;
+		switch (type) {
+		case BENCH_INT:
+			TDS_PUT_UA4LE(p, i * 7919u);
+			break;
+		case BENCH_BIGINT:
+			TDS_PUT_UA4LE(p, i * 7919u);
+			TDS_PUT_UA4LE(p + 4, i);
+			break;
+		case BENCH_FLOAT: {
+			TDS_FLOAT f = i * 1.25 - 100.0;
+
+			memcpy(p, &f, 8);
+			}
+			break;
+		case BENCH_DATETIME:
+			TDS_PUT_UA4LE(p, 40000u + i);
+			TDS_PUT_UA4LE(p + 4, (i * 300u * 337u) % (86400u * 300u));
+			break;
+		case BENCH_NUMERIC:
+			/* sign (inverted for TDS 7) and value, big endian for TDS 5.0 */
+			memset(p, 0, len);
+			p[0] = tds7 ? 1 : 0;
+			for (j = 0; j < 4; ++j)
+				p[tds7 ? 1 + j : len - 1 - j] = (unsigned char) ((i * 1234567u) >> (8 * j));
+			break;
+		case BENCH_NVARCHAR:
+			for (j = 0; j < len; j += 2) {
+				p[j] = 'a' + (i + j / 2) % 26;
+				p[j + 1] = 0;
+			}
+			break;
+		default:
+			for (j = 0; j < len; ++j)
+				p[j] = 'a' + (i + j) % 26;
+			break;
+		}
+	}
+	col->column_cur_size = len;
+	return 1;
+}
+
+static void
+send_error(TDSSOCKET *tds, const char *msg)
+{
+	tds_send_msg(tds, 50000, 1, 16, msg, "BENCH", NULL, 1);
+	tds_send_done_token(tds, TDS_DONE_ERROR, 0);
+}
+
+static void
+send_results(TDSSOCKET *tds, const BENCH_SPEC *spec)
+{
+	TDSRESULTINFO *resinfo;
+	unsigned char **values;
+	TDS_INT sizes[MAX_COLUMNS];
+	unsigned i, row, seed = 1;
+	char name[32];
+
+	resinfo = tds_alloc_results(spec->num_cols);
+	values = tds_new0(unsigned char *, spec->num_cols * NUM_VALUES);
+	if (!resinfo || !values) {
+		tds_free_results(resinfo);
+		free(values);
+		send_error(tds, "out of memory");
+		return;
+	}
+	for (i = 0; i < spec->num_cols; ++i) {
+		TDSCOLUMN *col = resinfo->columns[i];
+
+		if (!setup_column(tds, col, spec->cols[i], spec, values + i * NUM_VALUES)) {
+			send_error(tds, "type not supported by protocol version");
+			goto cleanup;
+		}
+		sizes[i] = col->column_cur_size;
+		sprintf(name, "c%u_%s", i + 1, type_names[spec->cols[i]]);
+		if (!tds_dstr_copy(&col->column_name, name)) {
+			send_error(tds, "out of memory");
+			goto cleanup;
+		}
+	}
+
+	tds_send_table_header(tds, resinfo);
+	for (row = 0; row < spec->rows; ++row) {
+		for (i = 0; i < spec->num_cols; ++i) {
+			TDSCOLUMN *col = resinfo->columns[i];
+
+			col->column_data = values[i * NUM_VALUES + (row + i) % NUM_VALUES];
+			col->column_cur_size = sizes[i];
+			if (spec->nulls) {
+				seed = seed * 1103515245u + 12345u;
+				if ((seed >> 16) % 100u < spec->nulls)
+					col->column_cur_size = -1;
+			}
+		}
+		tds_send_row(tds, resinfo);
+	}
+	tds_send_done_token(tds, TDS_DONE_COUNT, spec->rows);
+
+cleanup:
+	for (i = 0; i < spec->num_cols; ++i) {
+		unsigned n;
+
+		resinfo->columns[i]->column_data = NULL;
+		for (n = 0; n < NUM_VALUES; ++n)
+			free(values[i * NUM_VALUES + n]);
+	}
+	free(values);
+	tds_free_results(resinfo);
+}
+
+static void
+serve(TDSSOCKET *tds)
+{
+	TDSLOGIN *login;
+	char *query, error[128], old_size[16], new_size[16];
+	BENCH_SPEC spec;
+	int size;
+
+	login = tds_alloc_read_login(tds);
+	if (!login) {
+		fprintf(stderr, "error reading login\n");
+		return;
+	}
+	tds->conn->tds_version = login->tds_version;
+	if (IS_TDS7_PLUS(tds->conn))
+		tds->conn->product_version = TDS_MS_VER(10, 0, 1600);
+	else
+		tds->conn->product_version = TDS_SYB_VER(15, 0, 0);
+	size = packet_size ? packet_size : login->block_size;
+	if (size < 512 || size > 32767)
+		size = 4096;
+	tds_free_login(login);
+
+	tds->out_flag = TDS_REPLY;
+	tds_env_change(tds, TDS_ENV_DATABASE, "master", "bench");
+	sprintf(old_size, "%d", tds->conn->env.block_size);
+	sprintf(new_size, "%d", size);
+	tds_env_change(tds, TDS_ENV_PACKSIZE, old_size, new_size);
+	tds_send_login_ack(tds, "bench server");
+	if (IS_TDS50(tds->conn))
+		tds_send_capabilities_token(tds);
+	tds_send_done_token(tds, 0, 0);
+	if (TDS_FAILED(tds_flush_packet(tds)))
+		return;
+	if (!tds_realloc_socket(tds, size))
+		return;
+
+	while ((query = tds_get_generic_query(tds)) != NULL) {
+		/* skip TDS 7.2 headers, returned as garbage */
+		while (*query && (unsigned char) *query < ' ')
+			++query;
+
+		tds->out_flag = TDS_REPLY;
+		switch (parse_spec(query, &spec, error, sizeof(error))) {
+		case 1:
+			send_results(tds, &spec);
+			break;
+		case 0:
+			tds_send_done_token(tds, 0, 0);
+			break;
+		default:
+			send_error(tds, error);
+			break;
+		}
+		if (TDS_FAILED(tds_flush_packet(tds)))
+			break;
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	TDSCONTEXT *ctx;
+	TDSSOCKET *tds;
+	struct sockaddr_in sin;
+	TDS_SYS_SOCKET s, fd;
+	socklen_t len;
+	int ch, port;
+	unsigned clients = 0, served;
+
+	while ((ch = getopt(argc, argv, "n:s:")) != -1) {
+		switch (ch) {
+		case 'n':
+			clients = atoi(optarg);
+			break;
+		case 's':
+			packet_size = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc - optind != 1 || (port = atoi(argv[optind])) <= 0)
+		usage(argv[0]);
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_addr.s_addr = INADDR_ANY;
+	sin.sin_port = htons((short) port);
+	sin.sin_family = AF_INET;
+
+	s = socket(AF_INET, SOCK_STREAM, 0);
+	if (TDS_IS_SOCKET_INVALID(s)) {
+		perror("socket");
+		return 1;
+	}
+	ch = 1;
+	setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const void *) &ch, sizeof(ch));
+	if (bind(s, (struct sockaddr *) &sin, sizeof(sin)) < 0) {
+		perror("bind");
+		CLOSESOCKET(s);
+		return 1;
+	}
+	listen(s, 5);
+
+	ctx = tds_alloc_context(NULL);
+	if (!ctx)
+		return 1;
+
+	for (served = 0; !clients || served < clients; ++served) {
+		len = sizeof(sin);
+		fd = tds_accept(s, (struct sockaddr *) &sin, &len);
+		if (TDS_IS_SOCKET_INVALID(fd)) {
+			perror("accept");
+			break;
+		}
+		tds = tds_alloc_socket(ctx, 4096);
+		if (!tds) {
+			CLOSESOCKET(fd);
+			break;
+		}
+		ch = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const void *) &ch, sizeof(ch));
+		tds_set_s(tds, fd);
+		tds->state = TDS_IDLE;
+		tds_iconv_open(tds->conn, "ISO8859-1", 0);
+		serve(tds);
+		tds_free_socket(tds);
+	}
+
+	tds_free_context(ctx);
+	CLOSESOCKET(s);
+	return 0;
+}
@@ -175,7 +175,7 @@ tds7_read_login(TDSSOCKET * tds, TDSLOGIN * login)
 		tds_set_version(login, a & 0xff, (a >> 8) & 0xff);
 	else
 		tds_set_version(login, (a >> 28) & 0xf, (a >> 24) & 0xf);
-	tds_get_int(tds);	/*desired packet size being requested by client */
+	login->block_size = tds_get_int(tds);	/*desired packet size being requested by client */
 	/* client prog ver (4 byte) + pid (int) + connection id (4 byte) + flag1 (byte) */
 	tds_get_n(tds, NULL, 13);
 	login->option_flag2 = tds_get_byte(tds);
@@ -271,7 +271,6 @@ tds7_read_login(TDSSOCKET * tds, TDSLOGIN * login)
 	tds_get_n(tds, NULL, auth_len);
 
 	tds_dstr_empty(&login->server_charset);	/*empty char_set for TDS 7.0 */
-	login->block_size = 0;	/*0 block size for TDS 7.0 */
 	login->encryption_level = TDS_ENCRYPTION_OFF;
 
 	return res;
@@ -0,0 +1,396 @@
+/* FreeTDS - Library of routines accessing Sybase and Microsoft databases
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Replay the server side of a connection recorded with "capture file".
+ *
+ * Every request read from the client is matched with the next recorded
+ * request and answered with the recorded server packets, either as fast
+ * as possible or with the recorded delays (-r).
+ * Requests are not checked, the client should execute the same commands
+ * of the recorded session. Encryption is removed from the prelogin reply,
+ * TLS handshake packets are skipped. MARS sessions are not supported and
+ * cancels are replayed only if the client sends them at the same point.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+
+#if HAVE_STDLIB_H
+#include <stdlib.h>
+#endif /* HAVE_STDLIB_H */
+
+#if HAVE_STRING_H
+#include <string.h>
+#endif /* HAVE_STRING_H */
+
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+
+#if HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif /* HAVE_SYS_TYPES_H */
+
+#if HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif /* HAVE_SYS_SOCKET_H */
+
+#if HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif /* HAVE_NETINET_IN_H */
+
+#if HAVE_NETINET_TCP_H
+#include <netinet/tcp.h>
+#endif /* HAVE_NETINET_TCP_H */
+
+#include <freetds/tds.h>
+#include <freetds/data.h>
+#include <freetds/bytes.h>
+#include <freetds/utils.h>
+#include <freetds/server.h>
+#include "replacements.h"
+
+typedef struct
+{
+	/** wait a request from the client instead of sending */
+	unsigned char read;
+	TDS_UINT len;
+	TDS_UINT8 time;
+	unsigned char *data;
+} STEP;
+
+static STEP *steps = NULL;
+static unsigned num_steps = 0;
+
+static void
+usage(const char invoked_as[])
+{
+	fprintf(stderr, "usage:  %s [-r] [-c connection] [-n clients] port capture_file\n"
+		"        %s -l capture_file\n"
+		"  -r  replay with recorded timing\n"
+		"  -c  connection to replay (default first one)\n"
+		"  -n  number of clients to serve before exiting (default unlimited)\n"
+		"  -l  list connections in the capture\n", invoked_as, invoked_as);
+	exit(1);
+}
+
+static FILE *
+open_capture(const char *name)
+{
+	FILE *f = fopen(name, "rb");
+
+	if (!f) {
+		perror(name);
+		exit(1);
+	}
+	if (!tds_capture_read_header(f)) {
+		fprintf(stderr, "%s: not a capture file\n", name);
+		exit(1);
+	}
+	return f;
+}
+
+static void
+list_connections(const char *name)
+{
+	typedef struct
+	{
+		TDS_UINT conn;
+		unsigned packets[2];
+		TDS_UINT8 bytes[2];
+		TDS_UINT8 first, last;
+	} CONNINFO;
+	CONNINFO *conns = NULL, *info;
+	unsigned num_conns = 0, i;
+	TDSCAPTURERECORD rec;
+	unsigned char *buf = NULL;
+	size_t buf_size = 0;
+	FILE *f = open_capture(name);
+	int rc;
+
+	while ((rc = tds_capture_read(f, &rec, &buf, &buf_size)) > 0) {
+		for (i = 0; i < num_conns && conns[i].conn != rec.conn; ++i)
+			continue;
+		if (i == num_conns) {
+			if (!TDS_RESIZE(conns, num_conns + 1)) {
+				fprintf(stderr, "out of memory\n");
+				exit(1);
+			}
+			info = &conns[num_conns++];
+			memset(info, 0, sizeof(*info));
+			info->conn = rec.conn;
+			info->first = rec.time;
+		}
+		info = &conns[i];
+		info->packets[rec.sent]++;
+		info->bytes[rec.sent] += rec.len;
+		info->last = rec.time;
+	}
+	if (rc < 0)
+		fprintf(stderr, "%s: truncated capture\n", name);
+
+	printf("%10s %10s %12s %10s %12s %10s\n", "connection", "requests", "bytes", "responses", "bytes", "seconds");
+	for (i = 0; i < num_conns; ++i) {
+		info = &conns[i];
+		printf("%10u %10u %12" PRIu64 " %10u %12" PRIu64 " %10.3f\n", info->conn,
+		       info->packets[1], info->bytes[1], info->packets[0], info->bytes[0],
+		       (info->last - info->first) / 1000000.0);
+	}
+	free(conns);
+	free(buf);
+	fclose(f);
+}
+
+/**
+ * Disable encryption in the prelogin reply, replayed client could
+ * not continue with the recorded handshake.
+ */
+static void
+patch_prelogin_reply(unsigned char *p, TDS_UINT len)
+{
+	unsigned char *opt = p + 8;
+
+	for (; opt + 5 <= p + len && opt[0] != 0xff; opt += 5) {
+		unsigned offset = TDS_GET_UA2BE(opt + 1) + 8;
+
+		if (opt[0] == 1 && TDS_GET_UA2BE(opt + 3) >= 1 && offset < len)
+			p[offset] = 2;	/* ENCRYPT_NOT_SUP */
+	}
+}
+
+static void
+add_step(int read, const TDSCAPTURERECORD *rec, unsigned char *data)
+{
+	STEP *step;
+
+	if (!TDS_RESIZE(steps, num_steps + 1)) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	step = &steps[num_steps++];
+	step->read = read;
+	step->len = rec->len;
+	step->time = rec->time;
+	step->data = data;
+}
+
+/**
+ * Load the packets of a connection as a sequence of requests to
+ * wait and packets to send.
+ */
+static void
+load_connection(const char *name, TDS_UINT conn)
+{
+	TDSCAPTURERECORD rec;
+	unsigned char *buf = NULL;
+	size_t buf_size = 0;
+	FILE *f = open_capture(name);
+	int rc, prelogin = 0, skip_reply = 0, patch_reply = 0;
+
+	while ((rc = tds_capture_read(f, &rec, &buf, &buf_size)) > 0) {
+		if (!conn)
+			conn = rec.conn;
+		if (rec.conn != conn)
+			continue;
+
+		if (rec.sent) {
+			skip_reply = 0;
+			if (buf[0] == TDS71_PRELOGIN) {
+				/* first prelogin, following ones are the TLS handshake */
+				if (prelogin++) {
+					skip_reply = 1;
+					continue;
+				}
+				patch_reply = 1;
+			}
+			/* the client can split requests differently, only wait whole requests */
+			if (buf[1] & 1)
+				add_step(1, &rec, NULL);
+			continue;
+		}
+
+		if (skip_reply)
+			continue;
+		if (patch_reply && buf[0] == TDS_REPLY) {
+			patch_prelogin_reply(buf, rec.len);
+			patch_reply = 0;
+		}
+		add_step(0, &rec, buf);
+		buf = NULL;
+		buf_size = 0;
+	}
+	free(buf);
+	if (rc < 0)
+		fprintf(stderr, "%s: truncated capture\n", name);
+	fclose(f);
+
+	if (!num_steps) {
+		fprintf(stderr, "%s: no packets for connection %u\n", name, conn);
+		exit(1);
+	}
+}
+
+/**
+ * Read a whole request from the client.
+ * \return false on error or if client closed the connection
+ */
+static int
+read_request(TDSSOCKET *tds)
+{
+	for (;;) {
+		if (tds_read_packet(tds) < 0)
+			return 0;
+		if (tds->in_len >= 8 && (tds->in_buf[1] & 1) != 0)
+			return 1;
+	}
+}
+
+static void
+replay(TDSSOCKET *tds, int recorded_speed)
+{
+	TDS_UINT8 start = tds_gettime_us(), base = start, now;
+	TDS_UINT8 bytes = 0;
+	unsigned i, packets = 0;
+
+	for (i = 0; i < num_steps; ++i) {
+		const STEP *step = &steps[i];
+
+		if (step->read) {
+			if (!read_request(tds)) {
+				fprintf(stderr, "client closed connection\n");
+				return;
+			}
+			/* delays are relative to the last request */
+			base = tds_gettime_us() - step->time;
+			continue;
+		}
+
+		if (recorded_speed && (now = tds_gettime_us()) < base + step->time)
+			tds_sleep_ms((unsigned) ((base + step->time - now) / 1000u));
+
+		if (tds_connection_write(tds, step->data, step->len, 0) != (int) step->len) {
+			fprintf(stderr, "error writing to client\n");
+			return;
+		}
+		++packets;
+		bytes += step->len;
+	}
+
+	now = tds_gettime_us();
+	printf("replayed %u packets, %" PRIu64 " bytes in %.3f seconds\n", packets, bytes, (now - start) / 1000000.0);
+	fflush(stdout);
+
+	/* wait client to close */
+	while (tds_read_packet(tds) >= 0)
+		continue;
+}
+
+int
+main(int argc, char **argv)
+{
+	TDSCONTEXT *ctx;
+	TDSSOCKET *tds;
+	struct sockaddr_in sin;
+	TDS_SYS_SOCKET s, fd;
+	socklen_t len;
+	int ch, recorded_speed = 0, list = 0, port;
+	unsigned conn = 0, clients = 0, served;
+
+	while ((ch = getopt(argc, argv, "rc:n:l")) != -1) {
+		switch (ch) {
+		case 'r':
+			recorded_speed = 1;
+			break;
+		case 'c':
+			conn = atoi(optarg);
+			break;
+		case 'n':
+			clients = atoi(optarg);
+			break;
+		case 'l':
+			list = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (list) {
+		if (argc != 1)
+			usage(argv[-optind]);
+		list_connections(argv[0]);
+		return 0;
+	}
+
+	if (argc != 2 || (port = atoi(argv[0])) <= 0)
+		usage(argv[-optind]);
+
+	load_connection(argv[1], conn);
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_addr.s_addr = INADDR_ANY;
+	sin.sin_port = htons((short) port);
+	sin.sin_family = AF_INET;
+
+	s = socket(AF_INET, SOCK_STREAM, 0);
+	if (TDS_IS_SOCKET_INVALID(s)) {
+		perror("socket");
+		return 1;
+	}
+	ch = 1;
+	setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const void *) &ch, sizeof(ch));
+	if (bind(s, (struct sockaddr *) &sin, sizeof(sin)) < 0) {
+		perror("bind");
+		CLOSESOCKET(s);
+		return 1;
+	}
+	listen(s, 5);
+
+	ctx = tds_alloc_context(NULL);
+	if (!ctx)
+		return 1;
+
+	for (served = 0; !clients || served < clients; ++served) {
+		len = sizeof(sin);
+		fd = tds_accept(s, (struct sockaddr *) &sin, &len);
+		if (TDS_IS_SOCKET_INVALID(fd)) {
+			perror("accept");
+			break;
+		}
+		tds = tds_alloc_socket(ctx, 4096);
+		if (!tds) {
+			CLOSESOCKET(fd);
+			break;
+		}
+		/* responses are already split in packets, send them at once */
+		ch = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const void *) &ch, sizeof(ch));
+		tds_set_s(tds, fd);
+		tds->state = TDS_IDLE;
+		replay(tds, recorded_speed);
+		tds_free_socket(tds);
+	}
+
+	tds_free_context(ctx);
+	CLOSESOCKET(s);
+	return 0;
+}
@@ -312,6 +312,40 @@ tds_send_col_info(TDSSOCKET * tds, TDSRESULTINFO * resinfo)
 	}
 }
 
+/**
+ * Return the number of bytes used to send the length of column data,
+ * 8 for PLP data ((n)varchar(max) and varbinary(max) columns).
+ */
+static int
+tds_send_varint_size(TDSSOCKET * tds, TDSCOLUMN * curcol)
+{
+	int size = tds_get_varint_size(tds->conn, curcol->column_type);
+
+	if (size == 2 && IS_TDS72_PLUS(tds->conn) && curcol->column_size > 8000)
+		return 8;
+	return size;
+}
+
+static void
+tds_send_column_size(TDSSOCKET * tds, TDSCOLUMN * curcol)
+{
+	switch (tds_send_varint_size(tds, curcol)) {
+	case 8:
+		tds_put_smallint(tds, -1);
+		break;
+	case 5:
+	case 4:
+		tds_put_int(tds, curcol->column_size);
+		break;
+	case 2:
+		tds_put_smallint(tds, curcol->column_size);
+		break;
+	case 1:
+		tds_put_byte(tds, curcol->column_size);
+		break;
+	}
+}
+
 void
 tds_send_result(TDSSOCKET * tds, TDSRESULTINFO * resinfo)
 {
@@ -326,10 +360,17 @@ tds_send_result(TDSSOCKET * tds, TDSRESULTINFO * resinfo)
 		len = tds_dstr_len(&curcol->column_name);
 		totlen += 8;
 		totlen += len;
-		curcol = resinfo->columns[i];
-		if (!is_fixed_type(curcol->column_type)) {
+		switch (tds_send_varint_size(tds, curcol)) {
+		case 5:
+		case 4:
+			totlen += 4;
+			break;
+		case 1:
 			totlen++;
+			break;
 		}
+		if (is_numeric_type(curcol->column_type))
+			totlen += 2;
 	}
 	tds_put_smallint(tds, totlen);
 	tds_put_smallint(tds, resinfo->num_cols);
@@ -341,8 +382,10 @@ tds_send_result(TDSSOCKET * tds, TDSRESULTINFO * resinfo)
 		tds_put_byte(tds, '0');
 		tds_put_int(tds, curcol->column_usertype);
 		tds_put_byte(tds, curcol->column_type);
-		if (!is_fixed_type(curcol->column_type)) {
-			tds_put_byte(tds, curcol->column_size);
+		tds_send_column_size(tds, curcol);
+		if (is_numeric_type(curcol->column_type)) {
+			tds_put_byte(tds, curcol->column_prec);
+			tds_put_byte(tds, curcol->column_scale);
 		}
 		tds_put_byte(tds, 0);
 	}
@@ -365,20 +408,19 @@ tds7_send_result(TDSSOCKET * tds, TDSRESULTINFO * resinfo)
 
 		/* usertype, flags, and type */
 		curcol = resinfo->columns[i];
-		tds_put_smallint(tds, curcol->column_usertype);
+		if (IS_TDS72_PLUS(tds->conn))
+			tds_put_int(tds, curcol->column_usertype);
+		else
+			tds_put_smallint(tds, curcol->column_usertype);
 		tds_put_smallint(tds, curcol->column_flags);
 		tds_put_byte(tds, curcol->column_type); /* smallint? */
 
 		/* bytes in "size" field varies */
-		if (is_blob_type(curcol->column_type)) {
-			tds_put_int(tds, curcol->column_size);
-		} else if (curcol->column_type>=128) { /*is_large_type*/
-			tds_put_smallint(tds, curcol->column_size);
-		} else {
-			tds_put_tinyint(tds, curcol->column_size);
-		}
+		tds_send_column_size(tds, curcol);
 
 		/* some types have extra info */
+		if (IS_TDS71_PLUS(tds->conn) && is_collate_type(curcol->column_type))
+			tds_put_n(tds, curcol->column_collation, 5);
 		if (is_numeric_type(curcol->column_type)) {
 			tds_put_tinyint(tds, curcol->column_prec);
 			tds_put_tinyint(tds, curcol->column_scale);
@@ -386,7 +428,9 @@ tds7_send_result(TDSSOCKET * tds, TDSRESULTINFO * resinfo)
 			size_t len = tds_dstr_len(&curcol->table_name);
 			const char *name = tds_dstr_cstr(&curcol->table_name);
 
-			tds_put_smallint(tds, 2 * len);
+			if (IS_TDS72_PLUS(tds->conn))
+				tds_put_byte(tds, 1);
+			tds_put_smallint(tds, len);
 			for (j = 0; name[j] != '\0'; j++){
 				tds_put_byte(tds, name[j]);
 				tds_put_byte(tds, 0);
@@ -440,6 +484,14 @@ void tds_send_table_header(TDSSOCKET * tds, TDSRESULTINFO * resinfo)
 	}
 }
 
+/**
+ * Send a row of data.
+ * Fixed types are sent from column_data using the size of the type,
+ * other types use column_cur_size as length of the data, a negative
+ * length sends a NULL.
+ * \param tds		The socket to which the row will be written.
+ * \param resinfo	The table, as sent by tds_send_table_header().
+ */
 void
 tds_send_row(TDSSOCKET * tds, TDSRESULTINFO * resinfo)
 {
@@ -449,14 +501,46 @@ tds_send_row(TDSSOCKET * tds, TDSRESULTINFO * resinfo)
 	tds_put_byte(tds, TDS_ROW_TOKEN);
 	for (i = 0; i < resinfo->num_cols; i++) {
 		curcol = resinfo->columns[i];
-		if (!is_fixed_type(curcol->column_type)) {
-			/* FIX ME -- I have no way of knowing the actual length of non character variable data (eg nullable int) */
-			colsize = strlen((char *) curcol->column_data);
-			tds_put_byte(tds, colsize);
-			tds_put_n(tds, curcol->column_data, colsize);
-		} else {
+		colsize = curcol->column_cur_size;
+		switch (tds_send_varint_size(tds, curcol)) {
+		case 0:
 			tds_put_n(tds, curcol->column_data, tds_get_size_by_type(curcol->column_type));
+			continue;
+		case 8:
+			/* PLP, all data in a single chunk */
+			if (colsize < 0) {
+				tds_put_int8(tds, -1);
+				continue;
+			}
+			tds_put_int8(tds, colsize);
+			if (colsize) {
+				tds_put_int(tds, colsize);
+				tds_put_n(tds, curcol->column_data, colsize);
+			}
+			tds_put_int(tds, 0);
+			continue;
+		case 5:
+			tds_put_int(tds, colsize < 0 ? 0 : colsize);
+			break;
+		case 4:
+			if (colsize < 0) {
+				tds_put_byte(tds, 0);
+				continue;
+			}
+			/* text pointer and timestamp */
+			tds_put_byte(tds, 16);
+			tds_put_n(tds, NULL, 16 + 8);
+			tds_put_int(tds, colsize);
+			break;
+		case 2:
+			tds_put_smallint(tds, colsize < 0 ? -1 : colsize);
+			break;
+		default:
+			tds_put_byte(tds, colsize < 0 ? 0 : colsize);
+			break;
 		}
+		if (colsize > 0)
+			tds_put_n(tds, curcol->column_data, colsize);
 	}
 }
 
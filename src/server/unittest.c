@@ -96,6 +96,7 @@ main(int argc, char **argv)
 		exit(1);
 	resinfo->current_row = (TDS_UCHAR*) "pubs2";
 	resinfo->columns[0]->column_data = resinfo->current_row;
+	resinfo->columns[0]->column_cur_size = 5;
 	tds_send_result(tds, resinfo);
 	tds_send_control_token(tds, 1);
 	tds_send_row(tds, resinfo);
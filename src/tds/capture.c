@@ -0,0 +1,257 @@
+/* FreeTDS - Library of routines accessing Sybase and Microsoft databases
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * \file
+ * \brief Capture of TDS packets.
+ *
+ * When a capture file is specified ("capture file" in the configuration
+ * or TDSCAPTURE environment variable) every packet sent or received is
+ * written to it with the time and a number identifying the connection.
+ * Packets are recorded before encryption and without MARS headers.
+ * The file can be played back by the tdsreplay server.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+
+#if HAVE_STDLIB_H
+#include <stdlib.h>
+#endif /* HAVE_STDLIB_H */
+
+#if HAVE_STRING_H
+#include <string.h>
+#endif /* HAVE_STRING_H */
+
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+
+#if HAVE_FCNTL_H
+#include <fcntl.h>
+#endif /* HAVE_FCNTL_H */
+
+#include <freetds/tds.h>
+#include <freetds/thread.h>
+
+#undef tds_capture_packet
+
+typedef struct
+{
+	char magic[8];
+	TDS_UINT order;
+	TDS_UINT unused;
+	/** microseconds from 1970 at capture start */
+	TDS_UINT8 wall_time;
+} TDSCAPTUREHEADER;
+
+static const char capture_magic[8] = "FTDSCAP1";
+
+/** Tell if packets are captured */
+int tds_capture_enabled = 0;
+
+static tds_mutex g_capture_mutex = TDS_MUTEX_INITIALIZER;
+static FILE *g_capture_file = NULL;
+static char *g_capture_filename = NULL;
+static TDS_UINT g_capture_conns = 0;
+static TDS_UINT8 g_capture_start;
+
+/**
+ * Create the capture file readable only by the owner, captured packets
+ * can contain sensitive data.
+ */
+static FILE *
+tds_capture_fopen(const char *filename)
+{
+#if !defined(_WIN32) && HAVE_FCNTL_H
+	FILE *f;
+	int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+	if (fd < 0)
+		return NULL;
+	f = fdopen(fd, "wb");
+	if (!f)
+		close(fd);
+	return f;
+#else
+	return fopen(filename, "wb");
+#endif
+}
+
+/**
+ * Start capturing packets to a file.
+ * If the file is already used nothing is done.
+ * \param filename file to write, truncated
+ * \return true if file is opened
+ */
+int
+tds_capture_open(const char *filename)
+{
+	TDSCAPTUREHEADER hdr;
+	FILE *f;
+
+	tds_mutex_lock(&g_capture_mutex);
+	if (g_capture_filename && strcmp(g_capture_filename, filename) == 0) {
+		tds_mutex_unlock(&g_capture_mutex);
+		return 1;
+	}
+
+	f = tds_capture_fopen(filename);
+	if (!f) {
+		tds_mutex_unlock(&g_capture_mutex);
+		tdsdump_log(TDS_DBG_ERROR, "Unable to open capture file %s\n", filename);
+		return 0;
+	}
+
+	if (g_capture_file)
+		fclose(g_capture_file);
+	free(g_capture_filename);
+	g_capture_filename = strdup(filename);
+	g_capture_file = f;
+	g_capture_start = tds_gettime_us();
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, capture_magic, sizeof(hdr.magic));
+	hdr.order = 0x01020304;
+	hdr.wall_time = (TDS_UINT8) time(NULL) * 1000000u;
+	fwrite(&hdr, sizeof(hdr), 1, f);
+	fflush(f);
+
+	tds_capture_enabled = 1;
+	tds_mutex_unlock(&g_capture_mutex);
+	return 1;
+}
+
+/**
+ * Stop capturing packets.
+ */
+void
+tds_capture_close(void)
+{
+	tds_mutex_lock(&g_capture_mutex);
+	tds_capture_enabled = 0;
+	if (g_capture_file)
+		fclose(g_capture_file);
+	g_capture_file = NULL;
+	TDS_ZERO_FREE(g_capture_filename);
+	tds_mutex_unlock(&g_capture_mutex);
+}
+
+#if !defined(TDS_DEBUG_LOGIN)
+/**
+ * Check if a packet sent is part of a login, the content is recorded
+ * as zeroes.
+ */
+static bool
+tds_capture_is_login(const void *buf)
+{
+	switch (((const unsigned char *) buf)[0]) {
+	case TDS_LOGIN:
+	case TDS7_LOGIN:
+	case TDS7_AUTH:
+		return true;
+	}
+	return false;
+}
+#endif
+
+/**
+ * Write a packet to the capture file.
+ * \param conn connection
+ * \param sent 1 if packet is sent, 0 if received
+ * \param buf  packet, including header
+ * \param len  length of the packet
+ */
+void
+tds_capture_packet(TDSCONNECTION *conn, int sent, const void *buf, size_t len)
+{
+	TDSCAPTURERECORD rec;
+
+	tds_mutex_lock(&g_capture_mutex);
+	if (!g_capture_file) {
+		tds_mutex_unlock(&g_capture_mutex);
+		return;
+	}
+	if (!conn->capture_id)
+		conn->capture_id = ++g_capture_conns;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.time = tds_gettime_us() - g_capture_start;
+	rec.conn = conn->capture_id;
+	rec.len = (TDS_UINT) len;
+	rec.sent = sent ? 1 : 0;
+	fwrite(&rec, sizeof(rec), 1, g_capture_file);
+#if !defined(TDS_DEBUG_LOGIN)
+	/* like the log, do not record logins, they contain passwords */
+	if (sent && len > 8 && tds_capture_is_login(buf)) {
+		static const unsigned char zeros[256];
+		size_t n, left;
+
+		fwrite(buf, 1, 8, g_capture_file);
+		for (left = len - 8; left > 0; left -= n) {
+			n = left < sizeof(zeros) ? left : sizeof(zeros);
+			fwrite(zeros, 1, n, g_capture_file);
+		}
+	} else
+#endif
+		fwrite(buf, 1, len, g_capture_file);
+	/* file can be read while the application is still running */
+	if (rec.sent || (len > 1 && (((const unsigned char *) buf)[1] & 1) != 0))
+		fflush(g_capture_file);
+	tds_mutex_unlock(&g_capture_mutex);
+}
+
+/**
+ * Check the header of a capture file.
+ * \return true if file is a capture file
+ */
+int
+tds_capture_read_header(FILE *f)
+{
+	TDSCAPTUREHEADER hdr;
+
+	return fread(&hdr, sizeof(hdr), 1, f) == 1 && memcmp(hdr.magic, capture_magic, sizeof(hdr.magic)) == 0
+		&& hdr.order == 0x01020304;
+}
+
+/**
+ * Read next packet from a capture file.
+ * \param f        file to read
+ * \param rec      filled with packet information
+ * \param buf      buffer for the packet, reallocated if needed
+ * \param buf_size size of the buffer
+ * \return 1 if a packet was read, 0 at end of file, -1 on error
+ */
+int
+tds_capture_read(FILE *f, TDSCAPTURERECORD *rec, unsigned char **buf, size_t *buf_size)
+{
+	if (fread(rec, sizeof(*rec), 1, f) != 1)
+		return feof(f) ? 0 : -1;
+
+	if (rec->len < 8 || rec->len > 0x10000u)
+		return -1;
+	if (rec->len > *buf_size) {
+		if (!TDS_RESIZE(*buf, rec->len))
+			return -1;
+		*buf_size = rec->len;
+	}
+	if (fread(*buf, rec->len, 1, f) != 1)
+		return -1;
+	return 1;
+}
@@ -78,6 +78,7 @@
 
 static int tds_config_login(TDSLOGIN * connection, TDSLOGIN * login);
 static int tds_config_env_tdsdump(TDSLOGIN * login);
+static int tds_config_env_tdscapture(TDSLOGIN * login);
 static void tds_config_env_tdsver(TDSLOGIN * login);
 static void tds_config_env_tdsport(TDSLOGIN * login);
 static int tds_config_env_tdshost(TDSLOGIN * login);
@@ -245,6 +246,7 @@ tds_read_config_info(TDSSOCKET * tds, TDSLOGIN * login, TDSLOCALE * locale)
 			(not null terminated) */
 		tdsdump_log(TDS_DBG_INFO1, "\t%20s = %s\n", "database", tds_dstr_cstr(&connection->database));
 		tdsdump_log(TDS_DBG_INFO1, "\t%20s = %s\n", "dump_file", tds_dstr_cstr(&connection->dump_file));
+		tdsdump_log(TDS_DBG_INFO1, "\t%20s = %s\n", "capture_file", tds_dstr_cstr(&connection->capture_file));
 		tdsdump_log(TDS_DBG_INFO1, "\t%20s = %x\n", "debug_flags", connection->debug_flags);
 		tdsdump_log(TDS_DBG_INFO1, "\t%20s = %d\n", "text_size", connection->text_size);
 		tdsdump_log(TDS_DBG_INFO1, "\t%20s = %d\n", "emul_little_endian", connection->emul_little_endian);
@@ -255,6 +257,7 @@ tds_read_config_info(TDSSOCKET * tds, TDSLOGIN * login, TDSLOCALE * locale)
 		tdsdump_log(TDS_DBG_INFO1, "\t%20s = %d\n", "check_ssl_hostname", connection->check_ssl_hostname);
 		tdsdump_log(TDS_DBG_INFO1, "\t%20s = %s\n", "db_filename", tds_dstr_cstr(&connection->db_filename));
 		tdsdump_log(TDS_DBG_INFO1, "\t%20s = %d\n", "readonly_intent", connection->readonly_intent);
+		tdsdump_log(TDS_DBG_INFO1, "\t%20s = %d\n", "zero_copy", connection->zero_copy);
 #ifdef HAVE_OPENSSL
 		tdsdump_log(TDS_DBG_INFO1, "\t%20s = %s\n", "openssl_ciphers", tds_dstr_cstr(&connection->openssl_ciphers));
 #endif
@@ -284,6 +287,7 @@ tds_fix_login(TDSLOGIN * login)
 	/* Now check the environment variables */
 	tds_config_env_tdsver(login);
 	tds_config_env_tdsdump(login);
+	tds_config_env_tdscapture(login);
 	tds_config_env_tdsport(login);
 	tds_config_env_tdshost(login);
 }
@@ -608,6 +612,8 @@ tds_parse_conf_section(const char *option, const char *value, void *param)
 		login->gssapi_use_delegation = tds_config_boolean(option, value, login);
 	} else if (!strcmp(option, TDS_STR_DUMPFILE)) {
 		s = tds_dstr_copy(&login->dump_file, value);
+	} else if (!strcmp(option, TDS_STR_CAPTUREFILE)) {
+		s = tds_dstr_copy(&login->capture_file, value);
 	} else if (!strcmp(option, TDS_STR_DEBUGFLAGS)) {
 		char *end;
 		long flags;
@@ -681,6 +687,8 @@ tds_parse_conf_section(const char *option, const char *value, void *param)
 	} else if (!strcmp(option, TDS_STR_READONLY_INTENT)) {
 		login->readonly_intent = tds_config_boolean(option, value, login);
 		tdsdump_log(TDS_DBG_FUNC, "Setting ReadOnly Intent to '%s'.\n", value);
+	} else if (!strcmp(option, TDS_STR_ZEROCOPY)) {
+		login->zero_copy = tds_config_boolean(option, value, login);
 	} else if (!strcmp(option, TLS_STR_OPENSSL_CIPHERS)) {
 		s = tds_dstr_copy(&login->openssl_ciphers, value);
 	} else {
@@ -773,6 +781,8 @@ tds_config_login(TDSLOGIN * connection, TDSLOGIN * login)
 
 	if (login->readonly_intent)
 		connection->readonly_intent = login->readonly_intent;
+	if (login->zero_copy)
+		connection->zero_copy = login->zero_copy;
 	connection->use_new_password = login->use_new_password;
 
 	if (login->use_ntlmv2_specified) {
@@ -810,6 +820,19 @@ tds_config_env_tdsdump(TDSLOGIN * login)
 	return 1;
 }
 
+static int
+tds_config_env_tdscapture(TDSLOGIN * login)
+{
+	char *s = getenv("TDSCAPTURE");
+	if (!s || !s[0])
+		return 1;
+
+	if (!tds_dstr_copy(&login->capture_file, s))
+		return 0;
+	tdsdump_log(TDS_DBG_INFO1, "Setting 'capture_file' to '%s' from $TDSCAPTURE.\n", tds_dstr_cstr(&login->capture_file));
+	return 1;
+}
+
 static void
 tds_config_env_tdsport(TDSLOGIN * login)
 {
@@ -130,6 +130,7 @@ static TDS_INT string_to_int(const char *buf, const char *pend, TDS_INT * res);
 static TDS_INT string_to_int8(const char *buf, const char *pend, TDS_INT8 * res);
 static TDS_INT string_to_uint8(const char *buf, const char *pend, TDS_UINT8 * res);
 static TDS_INT string_to_float(const TDS_CHAR * src, TDS_UINT srclen, int desttype, CONV_RESULT * cr);
+static size_t tds_locale_strftime(char *buf, size_t maxsize, const TDSLOCALE * locale, const TDSDATEREC * dr, int prec);
 
 static int store_hour(const char *, const char *, struct tds_time *);
 static int store_time(const char *, struct tds_time *);
@@ -1262,8 +1263,7 @@ tds_convert_datetimeall(const TDSCONTEXT * tds_ctx, int srctype, const TDS_DATET
 	case TDS_CONVERT_CHAR:
 	case CASE_ALL_CHAR:
 		tds_datecrack(srctype, dta, &when);
-		tds_strftime(whole_date_string, sizeof(whole_date_string), tds_ctx->locale->date_fmt, &when, 
-		             dta->time_prec);
+		tds_locale_strftime(whole_date_string, sizeof(whole_date_string), tds_ctx->locale, &when, dta->time_prec);
 
 		return string_to_result(desttype, whole_date_string, cr);
 	case SYBDATETIME:
@@ -1331,7 +1331,7 @@ tds_convert_datetime(const TDSCONTEXT * tds_ctx, const TDS_DATETIME * dt, int de
 	case TDS_CONVERT_CHAR:
 	case CASE_ALL_CHAR:
 		tds_datecrack(SYBDATETIME, dt, &when);
-		tds_strftime(whole_date_string, sizeof(whole_date_string), tds_ctx->locale->date_fmt, &when, 3);
+		tds_locale_strftime(whole_date_string, sizeof(whole_date_string), tds_ctx->locale, &when, 3);
 
 		return string_to_result(desttype, whole_date_string, cr);
 	case SYBDATETIME:
@@ -1859,6 +1859,11 @@ tds_convert_to_binary(int srctype, const TDS_CHAR * src, TDS_UINT srclen, int de
  * Do not expect strings to be zero terminated. Databases support zero inside
  * string. Using strlen may result on data loss or even a segmentation fault.
  * Instead, use memcpy to copy destination using length returned.
+ * Character and binary results are allocated and must be freed by the caller.
+ * To avoid the allocation pass TDS_CONVERT_CHAR or TDS_CONVERT_BINARY as
+ * \a desttype and set cr->cc or cr->cb to a buffer and its size; the result
+ * is truncated to the buffer and the full length is returned, so a return
+ * value greater than the buffer size means the buffer was too small.
  * This function does not handle NULL, srclen should be >0.  Client libraries handle NULLs each in their own way. 
  * @param tds_ctx  context (used in conversion to data and to return messages)
  * @param srctype  type of source
@@ -1993,6 +1998,7 @@ string_to_datetime(const char *instr, TDS_UINT len, int desttype, CONV_RESULT *
 	char *tok;
 	char *lasts;
 	char last_token[32];
+	char in_buf[64];
 	int monthdone = 0;
 	int yeardone = 0;
 	int mdaydone = 0;
@@ -2008,8 +2014,15 @@ string_to_datetime(const char *instr, TDS_UINT len, int desttype, CONV_RESULT *
 	memset(&t, '\0', sizeof(t));
 	t.tm_mday = 1;
 
-	in = tds_strndup(instr, len);
-	test_alloc(in);
+	/* short strings (the common case) do not need an allocation */
+	if (len < sizeof(in_buf)) {
+		in = in_buf;
+		memcpy(in, instr, len);
+		in[len] = 0;
+	} else {
+		in = tds_strndup(instr, len);
+		test_alloc(in);
+	}
 
 	tok = strtok_r(in, " ,", &lasts);
 
@@ -2198,7 +2211,8 @@ string_to_datetime(const char *instr, TDS_UINT len, int desttype, CONV_RESULT *
 
 			tdsdump_log(TDS_DBG_INFO1,
 				    "error_handler:  Attempt to convert data stopped by syntax error in source field \n");
-			free(in);
+			if (in != in_buf)
+				free(in);
 			return TDS_CONVERT_SYNTAX;
 		}
 
@@ -2209,7 +2223,8 @@ string_to_datetime(const char *instr, TDS_UINT len, int desttype, CONV_RESULT *
 	dt_days = 1461 * (t.tm_year + 1900 + i) / 4 +
 		(367 * (t.tm_mon - 1 - 12 * i)) / 12 - (3 * ((t.tm_year + 2000 + i) / 100)) / 4 + t.tm_mday - 693932;
 
-	free(in);
+	if (in != in_buf)
+		free(in);
 
 	if (desttype == SYBDATE) {
 		cr->date = dt_days;
@@ -2258,6 +2273,50 @@ stringz_to_numeric(const char *instr, CONV_RESULT * cr)
 	return string_to_numeric(instr, instr + strlen(instr), cr);
 }
 
+/**
+ * Convert a parsed number to numeric accumulating digits in a single integer.
+ * cr->n.precision and cr->n.scale must be already checked.
+ * @return false if the number is too big for this path
+ */
+static bool
+string_to_numeric_fast(const char *instr, size_t digits, size_t decimals, CONV_RESULT * cr)
+{
+#ifdef __SIZEOF_INT128__
+	/* 10^38 < 2^128 */
+	typedef unsigned __int128 acc_t;
+	enum { max_digits = 38 };
+#else
+	/* 10^19 < 2^64 */
+	typedef TDS_UINT8 acc_t;
+	enum { max_digits = 19 };
+#endif
+	const size_t scale = cr->n.scale;
+	const char *p, *end;
+	acc_t n = 0;
+	int bytes;
+
+	if (digits + scale > max_digits)
+		return false;
+
+	for (p = instr, end = instr + digits; p != end; ++p)
+		n = n * 10u + (*p - '0');
+	if (decimals > scale)
+		decimals = scale;
+	if (decimals) {
+		for (p = instr + digits + 1, end = p + decimals; p != end; ++p)
+			n = n * 10u + (*p - '0');
+	}
+	for (; decimals < scale; ++decimals)
+		n *= 10u;
+
+	/* store big endian, number is less than 10^precision so it fits */
+	memset(cr->n.array + 1, 0, sizeof(cr->n.array) - 1);
+	bytes = tds_numeric_bytes_per_prec[cr->n.precision];
+	for (; n; n >>= 8)
+		cr->n.array[--bytes] = (TDS_UCHAR) n;
+	return true;
+}
+
 static int
 string_to_numeric(const char *instr, const char *pend, CONV_RESULT * cr)
 {
@@ -2307,6 +2366,9 @@ string_to_numeric(const char *instr, const char *pend, CONV_RESULT * cr)
 	if (cr->n.precision - cr->n.scale < digits)
 		return TDS_CONVERT_OVERFLOW;
 
+	if (string_to_numeric_fast(instr, digits, decimals, cr))
+		return sizeof(TDS_NUMERIC);
+
 	/* copy digits before the dot */
 	memcpy(ptr, instr, digits);
 	ptr += digits;
@@ -2951,6 +3013,110 @@ tds_get_null_type(TDS_SERVER_TYPE srctype)
 	return srctype;
 }
 
+/** parts of ISO 8601 formats, see tds_strftime_iso() */
+#define TDS_ISO_DATE 1
+#define TDS_ISO_TIME 2
+
+/**
+ * Check if format is one of the ISO 8601 formats handled by tds_strftime_iso().
+ * @return parts of the format, 0 if not an ISO format
+ */
+static unsigned int
+tds_iso_format_parts(const char *format)
+{
+	if (strcmp(format, "%Y-%m-%d %H:%M:%S.%z") == 0)
+		return TDS_ISO_DATE | TDS_ISO_TIME;
+	if (strcmp(format, "%Y-%m-%d") == 0)
+		return TDS_ISO_DATE;
+	if (strcmp(format, "%H:%M:%S.%z") == 0)
+		return TDS_ISO_TIME;
+	return 0;
+}
+
+static inline char *
+tds_put_2digits(char *p, unsigned int n)
+{
+	p[0] = (char) ('0' + n / 10u);
+	p[1] = (char) ('0' + n % 10u);
+	return p + 2;
+}
+
+/** write a number without padding, like %d */
+static char *
+tds_put_uint(char *p, unsigned int n)
+{
+	char tmp[16], *s = tmp + sizeof(tmp);
+	size_t len;
+
+	do {
+		*--s = (char) ('0' + n % 10u);
+		n /= 10u;
+	} while (n);
+	len = tmp + sizeof(tmp) - s;
+	memcpy(p, s, len);
+	return p + len;
+}
+
+/** write first prec digits of the 7 digits fraction of seconds */
+static char *
+tds_put_fraction(char *p, TDS_INT decimicrosecond, int prec)
+{
+	static const unsigned int factors[8] = {
+		10000000u, 1000000u, 100000u, 10000u, 1000u, 100u, 10u, 1u
+	};
+	unsigned int n = (unsigned int) decimicrosecond / factors[prec];
+	int i;
+
+	for (i = prec; --i >= 0; n /= 10u)
+		p[i] = (char) ('0' + n % 10u);
+	return p + prec;
+}
+
+/**
+ * Format a date as ISO 8601, same result of tds_strftime() with formats
+ * "%Y-%m-%d %H:%M:%S.%z", "%Y-%m-%d" or "%H:%M:%S.%z".
+ * @param parts TDS_ISO_DATE and/or TDS_ISO_TIME
+ */
+static size_t
+tds_strftime_iso(char *buf, size_t maxsize, const TDSDATEREC * dr, int prec, unsigned int parts)
+{
+	char tmp[48], *p = tmp;
+	size_t len;
+
+	if (parts & TDS_ISO_DATE) {
+		if (dr->year >= 1000 && dr->year <= 9999) {
+			p = tds_put_2digits(p, dr->year / 100);
+			p = tds_put_2digits(p, dr->year % 100);
+		} else {
+			p = tds_put_uint(p, dr->year);
+		}
+		*p++ = '-';
+		p = tds_put_2digits(p, dr->month + 1);
+		*p++ = '-';
+		p = tds_put_2digits(p, dr->day);
+		if (parts & TDS_ISO_TIME)
+			*p++ = ' ';
+	}
+	if (parts & TDS_ISO_TIME) {
+		p = tds_put_2digits(p, dr->hour);
+		*p++ = ':';
+		p = tds_put_2digits(p, dr->minute);
+		*p++ = ':';
+		p = tds_put_2digits(p, dr->second);
+		if (prec) {
+			*p++ = '.';
+			p = tds_put_fraction(p, dr->decimicrosecond, prec);
+		}
+	}
+
+	len = p - tmp;
+	if (len >= maxsize)
+		return 0;
+	memcpy(buf, tmp, len);
+	buf[len] = 0;
+	return len;
+}
+
 /**
  * format a date string according to an "extended" strftime(3) formatting definition.
  * @param buf     output buffer
@@ -2968,7 +3134,10 @@ tds_strftime(char *buf, size_t maxsize, const char *format, const TDSDATEREC * d
 	size_t length;
 	char *our_format;
 	char *pz = NULL;
-	
+	char format_buf[64];
+	size_t format_len;
+	unsigned int iso_parts;
+
 	assert(buf);
 	assert(format);
 	assert(dr);
@@ -2976,6 +3145,10 @@ tds_strftime(char *buf, size_t maxsize, const char *format, const TDSDATEREC * d
 	if (prec < 0 || prec > 7)
 		prec = 3;
 
+	iso_parts = tds_iso_format_parts(format);
+	if (iso_parts)
+		return tds_strftime_iso(buf, maxsize, dr, prec, iso_parts);
+
 	tm.tm_sec = dr->second;
 	tm.tm_min = dr->minute;
 	tm.tm_hour = dr->hour;
@@ -2992,9 +3165,13 @@ tds_strftime(char *buf, size_t maxsize, const char *format, const TDSDATEREC * d
 #endif
 
 	/* more characters are required because we replace %z with up to 7 digits */
-	our_format = tds_new(char, strlen(format) + 1 + 5);
-	if (!our_format)
-		return 0;
+	format_len = strlen(format) + 1 + 5;
+	our_format = format_buf;
+	if (format_len > sizeof(format_buf)) {
+		our_format = tds_new(char, format_len);
+		if (!our_format)
+			return 0;
+	}
 
 	strcpy(our_format, format);
 
@@ -3023,11 +3200,330 @@ tds_strftime(char *buf, size_t maxsize, const char *format, const TDSDATEREC * d
 
 	length = strftime(buf, maxsize, our_format, &tm);
 
-	free(our_format);
+	if (our_format != format_buf)
+		free(our_format);
 
 	return length;
 }
 
+/** opcodes of a compiled date format */
+enum
+{
+	TDS_DFMT_END,
+	TDS_DFMT_LITERAL,	/**< followed by length and characters */
+	TDS_DFMT_YEAR,		/**< %Y */
+	TDS_DFMT_YEAR2,		/**< %y */
+	TDS_DFMT_MONTH,		/**< %m */
+	TDS_DFMT_DAY,		/**< %d */
+	TDS_DFMT_DAY_SPACE,	/**< %e */
+	TDS_DFMT_HOUR,		/**< %H */
+	TDS_DFMT_HOUR12,	/**< %I */
+	TDS_DFMT_MINUTE,	/**< %M */
+	TDS_DFMT_SECOND,	/**< %S */
+	TDS_DFMT_DAYOFYEAR,	/**< %j */
+	TDS_DFMT_FRACTION,	/**< %z */
+	TDS_DFMT_DOT_FRACTION,	/**< .%z, dot is omitted if precision is 0 */
+	TDS_DFMT_NAME		/**< followed by index in names */
+};
+
+/* indexes of names in TDS_DATE_FORMAT */
+#define TDS_DFMT_WDAY_ABBR	0
+#define TDS_DFMT_WDAY		7
+#define TDS_DFMT_MONTH_ABBR	14
+#define TDS_DFMT_MONTH_NAME	26
+#define TDS_DFMT_AMPM		38
+#define TDS_DFMT_NUM_NAMES	40
+
+struct tds_date_format
+{
+	/** format compiled, used to detect changes */
+	char *format;
+	/** ISO 8601 format parts, see tds_strftime_iso(), 0 for other formats */
+	unsigned int iso_parts;
+	/** weekday, month and AM/PM names (%a %A %b %B %p) */
+	char names[TDS_DFMT_NUM_NAMES][32];
+	/** opcodes, terminated by TDS_DFMT_END */
+	unsigned char ops[1];
+};
+
+/** fill names for %a %A %b %B %p using the current C library locale */
+static bool
+tds_date_format_names(TDS_DATE_FORMAT * plan)
+{
+	struct tm tm;
+	int i;
+	bool ok = true;
+
+	memset(&tm, 0, sizeof(tm));
+	tm.tm_mday = 1;
+	for (i = 0; i < 7; ++i) {
+		tm.tm_wday = i;
+		ok = ok && strftime(plan->names[TDS_DFMT_WDAY_ABBR + i], sizeof(plan->names[0]), "%a", &tm) > 0;
+		ok = ok && strftime(plan->names[TDS_DFMT_WDAY + i], sizeof(plan->names[0]), "%A", &tm) > 0;
+	}
+	for (i = 0; i < 12; ++i) {
+		tm.tm_mon = i;
+		ok = ok && strftime(plan->names[TDS_DFMT_MONTH_ABBR + i], sizeof(plan->names[0]), "%b", &tm) > 0;
+		ok = ok && strftime(plan->names[TDS_DFMT_MONTH_NAME + i], sizeof(plan->names[0]), "%B", &tm) > 0;
+	}
+	for (i = 0; i < 2; ++i) {
+		tm.tm_hour = i * 12;
+		/* some locales have no AM/PM designators */
+		plan->names[TDS_DFMT_AMPM + i][0] = 0;
+		strftime(plan->names[TDS_DFMT_AMPM + i], sizeof(plan->names[0]), "%p", &tm);
+	}
+	return ok;
+}
+
+/**
+ * Compile a tds_strftime() format so dates can be formatted quickly
+ * with tds_date_format_apply().
+ * Weekday, month and AM/PM names are taken from the C library locale
+ * active at compile time.
+ * @return compiled format, NULL if format is not supported or out of memory
+ */
+TDS_DATE_FORMAT *
+tds_date_format_compile(const char *format)
+{
+	TDS_DATE_FORMAT *plan;
+	unsigned char *op, *lit = NULL;
+	const char *p, *pz;
+	size_t len;
+	bool names = false;
+
+	if (!format)
+		return NULL;
+
+	/* every character needs at most 3 opcode bytes (a new literal) */
+	len = strlen(format);
+	plan = (TDS_DATE_FORMAT *) malloc(sizeof(TDS_DATE_FORMAT) + len * 3 + len + 1);
+	if (!plan)
+		return NULL;
+
+	/* tds_strftime() replaces only the first %z not preceded by % or at start */
+	for (pz = format; (pz = strstr(pz, "%z")) != NULL; pz++)
+		if (pz > format && pz[-1] != '%')
+			break;
+
+	op = plan->ops;
+	for (p = format; *p; ++p) {
+		unsigned char c = (unsigned char) *p;
+		unsigned char code, name = 0;
+
+		if (c == '%') {
+			switch (*++p) {
+			case 'Y': code = TDS_DFMT_YEAR; break;
+			case 'y': code = TDS_DFMT_YEAR2; break;
+			case 'm': code = TDS_DFMT_MONTH; break;
+			case 'd': code = TDS_DFMT_DAY; break;
+			case 'e': code = TDS_DFMT_DAY_SPACE; break;
+			case 'H': code = TDS_DFMT_HOUR; break;
+			case 'I': code = TDS_DFMT_HOUR12; break;
+			case 'M': code = TDS_DFMT_MINUTE; break;
+			case 'S': code = TDS_DFMT_SECOND; break;
+			case 'j': code = TDS_DFMT_DAYOFYEAR; break;
+			case 'a': code = TDS_DFMT_NAME; name = TDS_DFMT_WDAY_ABBR; break;
+			case 'A': code = TDS_DFMT_NAME; name = TDS_DFMT_WDAY; break;
+			case 'b':
+			case 'h': code = TDS_DFMT_NAME; name = TDS_DFMT_MONTH_ABBR; break;
+			case 'B': code = TDS_DFMT_NAME; name = TDS_DFMT_MONTH_NAME; break;
+			case 'p': code = TDS_DFMT_NAME; name = TDS_DFMT_AMPM; break;
+			case 'z':
+				if (p - 1 != pz) {
+					free(plan);
+					return NULL;
+				}
+				code = TDS_DFMT_FRACTION;
+				/* the dot before the fraction is removed if precision is 0 */
+				if (lit && lit[*lit] == '.') {
+					code = TDS_DFMT_DOT_FRACTION;
+					--op;
+					if (--*lit == 0)
+						op -= 2;
+				}
+				break;
+			case '%': c = '%'; goto literal;
+			case 'n': c = '\n'; goto literal;
+			case 't': c = '\t'; goto literal;
+			default:
+				/* not supported (or truncated format), use tds_strftime */
+				free(plan);
+				return NULL;
+			}
+			*op++ = code;
+			if (code == TDS_DFMT_NAME) {
+				*op++ = name;
+				names = true;
+			}
+			lit = NULL;
+			continue;
+		}
+	literal:
+		if (!lit || *lit == 255) {
+			*op++ = TDS_DFMT_LITERAL;
+			lit = op++;
+			*lit = 0;
+		}
+		*op++ = c;
+		++*lit;
+	}
+	*op++ = TDS_DFMT_END;
+
+	if (names && !tds_date_format_names(plan)) {
+		free(plan);
+		return NULL;
+	}
+	plan->iso_parts = tds_iso_format_parts(format);
+	plan->format = (char *) op;
+	memcpy(plan->format, format, len + 1);
+	return plan;
+}
+
+void
+tds_date_format_free(TDS_DATE_FORMAT * plan)
+{
+	free(plan);
+}
+
+/**
+ * Format a date using a compiled format.
+ * Result is the same of tds_strftime() using the source format.
+ * @param buf     output buffer
+ * @param maxsize size of buffer in bytes (space include terminator)
+ * @param plan    format compiled with tds_date_format_compile()
+ * @param dr      date to convert
+ * @param prec    second fraction precision (0-7).
+ * @return length of string returned, 0 for error
+ */
+size_t
+tds_date_format_apply(char *buf, size_t maxsize, const TDS_DATE_FORMAT * plan, const TDSDATEREC * dr, int prec)
+{
+	const unsigned char *op;
+	const char *name;
+	char *p = buf, *const end = buf + maxsize;
+	char year[16];
+	size_t len;
+	unsigned int n;
+
+	if (prec < 0 || prec > 7)
+		prec = 3;
+
+	if (plan->iso_parts)
+		return tds_strftime_iso(buf, maxsize, dr, prec, plan->iso_parts);
+
+	if (!maxsize)
+		return 0;
+
+	/* assure there is space for n characters and the terminator */
+#define NEED(n) do { if ((size_t) (end - p) <= (size_t) (n)) goto overflow; } while(0)
+	for (op = plan->ops;;) {
+		switch (*op++) {
+		case TDS_DFMT_END:
+			*p = 0;
+			return p - buf;
+		case TDS_DFMT_LITERAL:
+			len = *op++;
+			NEED(len);
+			memcpy(p, op, len);
+			p += len;
+			op += len;
+			break;
+		case TDS_DFMT_YEAR:
+			len = tds_put_uint(year, dr->year) - year;
+			NEED(len);
+			memcpy(p, year, len);
+			p += len;
+			break;
+		case TDS_DFMT_YEAR2:
+			NEED(2);
+			p = tds_put_2digits(p, dr->year % 100u);
+			break;
+		case TDS_DFMT_MONTH:
+			NEED(2);
+			p = tds_put_2digits(p, dr->month + 1);
+			break;
+		case TDS_DFMT_DAY:
+			NEED(2);
+			p = tds_put_2digits(p, dr->day);
+			break;
+		case TDS_DFMT_DAY_SPACE:
+			NEED(2);
+			p = tds_put_2digits(p, dr->day);
+			if (p[-2] == '0')
+				p[-2] = ' ';
+			break;
+		case TDS_DFMT_HOUR:
+			NEED(2);
+			p = tds_put_2digits(p, dr->hour);
+			break;
+		case TDS_DFMT_HOUR12:
+			NEED(2);
+			n = dr->hour % 12u;
+			p = tds_put_2digits(p, n ? n : 12);
+			break;
+		case TDS_DFMT_MINUTE:
+			NEED(2);
+			p = tds_put_2digits(p, dr->minute);
+			break;
+		case TDS_DFMT_SECOND:
+			NEED(2);
+			p = tds_put_2digits(p, dr->second);
+			break;
+		case TDS_DFMT_DAYOFYEAR:
+			/* tds_strftime() passes dayofyear as tm_yday */
+			NEED(3);
+			n = dr->dayofyear + 1;
+			*p++ = (char) ('0' + n / 100u);
+			p = tds_put_2digits(p, n % 100u);
+			break;
+		case TDS_DFMT_FRACTION:
+			NEED(prec);
+			p = tds_put_fraction(p, dr->decimicrosecond, prec);
+			break;
+		case TDS_DFMT_DOT_FRACTION:
+			if (!prec)
+				break;
+			NEED(prec + 1);
+			*p++ = '.';
+			p = tds_put_fraction(p, dr->decimicrosecond, prec);
+			break;
+		case TDS_DFMT_NAME:
+			n = *op++;
+			if (n == TDS_DFMT_AMPM)
+				n += dr->hour >= 12;
+			else if (n == TDS_DFMT_WDAY_ABBR || n == TDS_DFMT_WDAY)
+				n += dr->weekday;
+			else
+				n += dr->month;
+			name = plan->names[n];
+			len = strlen(name);
+			NEED(len);
+			memcpy(p, name, len);
+			p += len;
+			break;
+		}
+	}
+#undef NEED
+
+overflow:
+	buf[0] = 0;
+	return 0;
+}
+
+/**
+ * Format a date with the date format of a locale.
+ */
+static size_t
+tds_locale_strftime(char *buf, size_t maxsize, const TDSLOCALE * locale, const TDSDATEREC * dr, int prec)
+{
+	const TDS_DATE_FORMAT *plan = locale->date_fmt_plan;
+
+	/* date_fmt could have been changed directly, check the plan is still valid */
+	if (plan && strcmp(plan->format, locale->date_fmt) == 0)
+		return tds_date_format_apply(buf, maxsize, plan, dr, prec);
+	return tds_strftime(buf, maxsize, locale->date_fmt, dr, prec);
+}
+
 #if 0
 static TDS_UINT
 utf16len(const utf16_t * s)
@@ -3121,7 +3617,8 @@ tds_datecrack(TDS_INT datetype, const void *di, TDSDATEREC * dr)
 	unsigned int dt_time;
 
 	int years, months, days, ydays, wday, hours, mins, secs, dms, tzone = 0;
-	int l, n, i, j;
+	TDS_UINT n, century, cdays, ydays_mar, md;
+	TDS_UINT8 p;
 
 	memset(dr, 0, sizeof(*dr));
 
@@ -3181,35 +3678,56 @@ tds_datecrack(TDS_INT datetype, const void *di, TDSDATEREC * dr)
 		dt_time = dt_time / 60u;
 	} else if (datetype == SYB5BIGDATETIME) {
 		TDS_UINT8 bigdatetime = *((const TDS_BIGDATETIME*) di);
+		TDS_UINT8 bigdays;
+
 		dms = bigdatetime % 1000000u * 10u;
 		bigdatetime /= 1000000u;
-		secs = bigdatetime % 60u;
-		bigdatetime /= 60u;
-		dt_time = bigdatetime % (24u*60u);
-		dt_days = bigdatetime / (24u*60u) - BIGDATETIME_BIAS;
+		/* only days need 64 bit arithmetic */
+		bigdays = bigdatetime / 86400u;
+		dt_time = (unsigned int) (bigdatetime - bigdays * 86400u);
+		dt_days = (int) (bigdays - BIGDATETIME_BIAS);
+		secs = dt_time % 60u;
+		dt_time /= 60u;
 	} else {
 		return TDS_FAIL;
 	}
 
 	/*
-	 * -53690 is minimun  (1753-1-1) (Gregorian calendar start in 1732) 
-	 * 2958463 is maximun (9999-12-31)
+	 * Split days using only multiplications and shifts, see
+	 * C. Neri, L. Schneider, "Euclidean affine functions and their
+	 * application to calendar algorithms" (2022).
+	 * Years start on March 1st so leap day is the last day of the year.
+	 * Computation is unsigned, days are counted from 0000-03-01,
+	 * 693901 days before 1900-01-01 (day 0 of all formats).
 	 */
-	l = dt_days + (146038 + 146097*4);
-	wday = (l + 4) % 7;
-	n = (4 * l) / 146097;	/* n century */
-	l = l - (146097 * n + 3) / 4;	/* days from xx00-02-28 (y-m-d) */
-	i = (4000 * (l + 1)) / 1461001;	/* years from xx00-02-28 */
-	l = l - (1461 * i) / 4;	/* year days from xx00-02-28 */
-	ydays = l >= 306 ? l - 305 : l + 60;
-	l += 31;
-	j = (80 * l) / 2447;
-	days = l - (2447 * j) / 80;
-	l = j / 11;
-	months = j + 1 - 12 * l;
-	years = 100 * (n - 1) + i + l;
-	if (l == 0 && (years & 3) == 0 && (years % 100 != 0 || years % 400 == 0))
-		++ydays;
+	n = (TDS_UINT) (dt_days + 693901);
+	wday = (n + 3u) % 7u;
+
+	/* centuries and days in century */
+	n = 4u * n + 3u;
+	century = n / 146097u;
+	cdays = n % 146097u / 4u;
+
+	/* years in century and days from March 1st */
+	p = (TDS_UINT8) 2939745u * (4u * cdays + 3u);
+	years = (int) (100u * century + (TDS_UINT) (p >> 32));
+	ydays_mar = (TDS_UINT) p / 2939745u / 4u;
+
+	/* month (3-14) and day of month */
+	md = 2141u * ydays_mar + 197913u;
+	months = (int) (md >> 16) - 1;
+	days = (int) ((md & 0xffffu) / 2141u) + 1;
+
+	if (ydays_mar >= 306) {
+		/* January or February of next year */
+		++years;
+		months -= 12;
+		ydays = (int) ydays_mar - 305;
+	} else {
+		ydays = (int) ydays_mar + 60;
+		if ((years & 3) == 0 && (years % 100 != 0 || years % 400 == 0))
+			++ydays;
+	}
 
 	hours = dt_time / 60;
 	mins = dt_time % 60;
@@ -498,6 +498,7 @@ tds_get_char_dynamic(TDSSOCKET *tds, TDSCOLUMN *curcol, void **pp, size_t alloca
 	res = tds_dynamic_stream_init(&w, pp, allocated);
 	if (TDS_FAILED(res))
 		return res;
+	++tds->conn->stats.allocations;
 
 	if (USE_ICONV && curcol->char_conv)
 		res = tds_convert_stream(tds, curcol->char_conv, to_client, r_stream, &w.stream);
@@ -720,6 +721,60 @@ error_type:
 	return TDS_FAIL;
 }
 
+/**
+ * Check if a value can be used directly from the received packet.
+ * Only character and binary values not needing conversion, truncation
+ * or padding are used this way, other types could require alignment.
+ */
+static bool
+tds_can_zero_copy(TDSSOCKET * tds, const TDSCOLUMN * curcol, int colsize)
+{
+	if (!tds->conn->zero_copy || curcol->column_data_free || colsize > curcol->column_size
+	    || tds->in_len - tds->in_pos < (unsigned) colsize)
+		return false;
+	if (curcol->char_conv && curcol->char_conv->flags != TDS_ENCODING_MEMCPY)
+		return false;
+
+	switch (curcol->column_type) {
+	case SYBVARCHAR:
+	case XSYBVARCHAR:
+	case SYBVARBINARY:
+	case XSYBVARBINARY:
+		return true;
+	case SYBCHAR:
+	case XSYBCHAR:
+	case SYBBINARY:
+	case XSYBBINARY:
+		/* no padding needed */
+		return colsize == curcol->column_size;
+	default:
+		break;
+	}
+	return false;
+}
+
+/**
+ * Read text pointer, timestamp and size of a text/image value.
+ * \return size of the value, -1 if NULL
+ */
+static int
+tds_get_blob_header(TDSSOCKET * tds, TDSCOLUMN * curcol)
+{
+	TDSBLOB *blob = (TDSBLOB *) curcol->column_data;
+
+	if (tds_get_byte(tds) != 16)
+		return -1;
+
+	/*  Jeff's hack */
+	tds_get_n(tds, blob->textptr, 16);
+	tds_get_n(tds, blob->timestamp, 8);
+	blob->valid_ptr = 1;
+	if (IS_TDS72_PLUS(tds->conn) &&
+	    memcmp(blob->textptr, "dummy textptr\0\0",16) == 0)
+		blob->valid_ptr = 0;
+	return tds_get_int(tds);
+}
+
 /**
  * Read a data from wire
  * \param tds state information for the socket and the TDS protocol
@@ -730,30 +785,20 @@ TDSRET
 tds_generic_get(TDSSOCKET * tds, TDSCOLUMN * curcol)
 {
 	unsigned char *dest;
-	int len, colsize;
+	int colsize;
 	int fillchar;
 	TDSBLOB *blob = NULL;
 
 	CHECK_TDS_EXTRA(tds);
 	CHECK_COLUMN_EXTRA(curcol);
 
+	tds_column_reset_data(curcol);
+
 	tdsdump_log(TDS_DBG_INFO1, "tds_get_data: type %d, varint size %d\n", curcol->column_type, curcol->column_varint_size);
 	switch (curcol->column_varint_size) {
 	case 4:
 		/* It's a BLOB... */
-		len = tds_get_byte(tds);
-		blob = (TDSBLOB *) curcol->column_data;
-		if (len == 16) {	/*  Jeff's hack */
-			tds_get_n(tds, blob->textptr, 16);
-			tds_get_n(tds, blob->timestamp, 8);
-			blob->valid_ptr = 1;
-			if (IS_TDS72_PLUS(tds->conn) &&
-			    memcmp(blob->textptr, "dummy textptr\0\0",16) == 0)
-				blob->valid_ptr = 0;
-			colsize = tds_get_int(tds);
-		} else {
-			colsize = -1;
-		}
+		colsize = tds_get_blob_header(tds, curcol);
 		break;
 	case 5:
 		colsize = tds_get_int(tds);
@@ -832,7 +877,13 @@ tds_generic_get(TDSSOCKET * tds, TDSCOLUMN * curcol)
 
 	/* non-numeric and non-blob */
 
-	if (USE_ICONV && curcol->char_conv) {
+	if (tds_can_zero_copy(tds, curcol, colsize)) {
+		/* point to packet, valid till next row is read */
+		curcol->column_row_data = dest;
+		curcol->column_data = tds->in_buf + tds->in_pos;
+		curcol->column_cur_size = colsize;
+		tds->in_pos += colsize;
+	} else if (USE_ICONV && curcol->char_conv) {
 		if (TDS_FAILED(tds_get_char_data(tds, (char *) dest, colsize, curcol)))
 			return TDS_FAIL;
 	} else {
@@ -884,6 +935,455 @@ tds_generic_get(TDSSOCKET * tds, TDSCOLUMN * curcol)
 	return TDS_SUCCESS;
 }
 
+/**
+ * Start reading a large value incrementally.
+ * Only the header of the value is read, the data are left on the wire
+ * and tds->blob_stream.column is set to the column; data can then be
+ * read using tds_blob_stream_read.
+ * NULL and empty values and values requiring a character conversion
+ * are read as usual, tds->blob_stream.column is not set (see TDSBLOBSTREAM
+ * for the reasons).
+ * \tds
+ * \param curcol column to read
+ * \return TDS_FAIL on error or TDS_SUCCESS
+ */
+TDSRET
+tds_blob_stream_start(TDSSOCKET * tds, TDSCOLUMN * curcol)
+{
+	TDSBLOBSTREAM *bs = &tds->blob_stream;
+	TDSBLOB *blob = (TDSBLOB *) curcol->column_data;
+	TDS_INT8 size;
+
+	CHECK_TDS_EXTRA(tds);
+	CHECK_COLUMN_EXTRA(curcol);
+
+	if (curcol->funcs->get_data != tds_generic_get
+	    || (curcol->column_varint_size != 4 && curcol->column_varint_size != 8)
+	    || (curcol->char_conv && curcol->char_conv->flags != TDS_ENCODING_MEMCPY))
+		return curcol->funcs->get_data(tds, curcol);
+
+	tds_column_reset_data(curcol);
+
+	if (curcol->column_varint_size == 4)
+		size = tds_get_blob_header(tds, curcol);
+	else
+		size = tds_get_int8(tds);
+	if (IS_TDSDEAD(tds))
+		return TDS_FAIL;
+
+	/* NULL, PLP format uses -2 for unknown sizes */
+	if (size == -1 || (curcol->column_varint_size == 4 && size < 0)) {
+		curcol->column_cur_size = -1;
+		return TDS_SUCCESS;
+	}
+
+	TDS_ZERO_FREE(blob->textvalue);
+	curcol->column_cur_size = 0;
+
+	bs->column = curcol;
+	bs->plp = curcol->column_varint_size == 8;
+	bs->size = size < 0 ? -1 : size;
+	bs->chunk_left = bs->plp ? 0 : (TDS_INT) size;
+
+	/* PLP values have a terminator even if empty */
+	if (size == 0)
+		return tds_blob_stream_skip(tds);
+	return TDS_SUCCESS;
+}
+
+/**
+ * Read data of the large value being streamed.
+ * \tds
+ * \param ptr buffer to fill, NULL to discard data
+ * \param len size of the buffer
+ * \return bytes read, 0 at the end of the value or -1 on error
+ */
+int
+tds_blob_stream_read(TDSSOCKET * tds, void *ptr, size_t len)
+{
+	TDSBLOBSTREAM *bs = &tds->blob_stream;
+
+	CHECK_TDS_EXTRA(tds);
+
+	if (!bs->column)
+		return 0;
+
+	/* read chunk len if needed */
+	if (bs->chunk_left == 0 && bs->plp) {
+		TDS_INT l = tds_get_int(tds);
+		if (l <= 0) l = -1;
+		bs->chunk_left = l;
+	}
+
+	/* no more data */
+	if (bs->chunk_left <= 0) {
+		bs->chunk_left = -1;
+		return 0;
+	}
+
+	if (len > (size_t) bs->chunk_left)
+		len = bs->chunk_left;
+	/* tds_get_n returns NULL discarding data */
+	if (!tds_get_n(tds, ptr, len) && (ptr || IS_TDSDEAD(tds)))
+		return -1;
+	bs->chunk_left -= (TDS_INT) len;
+	return (int) len;
+}
+
+/**
+ * Discard the rest of the large value being streamed.
+ * After the call tds->blob_stream.column is NULL.
+ * \tds
+ * \return TDS_FAIL on error or TDS_SUCCESS
+ */
+TDSRET
+tds_blob_stream_skip(TDSSOCKET * tds)
+{
+	int len;
+
+	while ((len = tds_blob_stream_read(tds, NULL, 0x7fffffff)) > 0)
+		continue;
+	tds->blob_stream.column = NULL;
+	return len < 0 ? TDS_FAIL : TDS_SUCCESS;
+}
+
+static inline TDS_UINT
+tds_peek_uint(TDSSOCKET * tds, const unsigned char *p)
+{
+#ifdef WORDS_BIGENDIAN
+	if (tds->conn->emul_little_endian)
+		return TDS_GET_UA4LE(p);
+#endif
+	return TDS_GET_UA4(p);
+}
+
+static inline TDS_USMALLINT
+tds_peek_usmallint(TDSSOCKET * tds, const unsigned char *p)
+{
+#ifdef WORDS_BIGENDIAN
+	if (tds->conn->emul_little_endian)
+		return (TDS_USMALLINT) TDS_GET_UA2LE(p);
+#endif
+	return (TDS_USMALLINT) TDS_GET_UA2(p);
+}
+
+/**
+ * Compute the wire size of a value read by tds_generic_get without
+ * consuming it.
+ * \tds
+ * \param curcol column of the value
+ * \param p      received data starting with the value
+ * \param avail  number of bytes in p
+ * \param need   if not NULL and the value is not entirely in p, set to the
+ *               minimum number of bytes p must contain to hold it
+ * \return size of the value including its length prefix, -1 if the
+ *         value is not entirely in p or -2 if the size is unknown
+ */
+static TDS_INT
+tds_generic_wire_size(TDSSOCKET * tds, TDSCOLUMN * curcol, const unsigned char *p, size_t avail, size_t *need)
+{
+	size_t pos, size = 0, min_size = 0;
+	TDS_UINT8 total;
+	TDS_UINT len;
+
+/** \cond HIDDEN_SYMBOLS */
+#define NEED(n) do { \
+	if (avail < (n)) { \
+		if (need) \
+			*need = (n) > min_size ? (n) : min_size; \
+		return -1; \
+	} \
+} while(0)
+/** \endcond */
+
+	switch (curcol->column_varint_size) {
+	case 4:
+		/* textptr and timestamp */
+		NEED(1);
+		pos = 1;
+		if (p[0] != 16)
+			break;
+		NEED(1 + 16 + 8 + 4);
+		pos = 1 + 16 + 8 + 4;
+		size = tds_peek_uint(tds, p + 1 + 16 + 8);
+		break;
+	case 5:
+		NEED(4);
+		pos = 4;
+		size = tds_peek_uint(tds, p);
+		break;
+	case 8:
+		NEED(8);
+		pos = 8;
+		total = tds_peek_uint(tds, p) | ((TDS_UINT8) tds_peek_uint(tds, p + 4) << 32);
+		if (total == ~(TDS_UINT8) 0)
+			break;
+		/* when the total length is known all chunks are at least as big */
+		if (total < ~(TDS_UINT8) 1 && total <= 0x7fffffffu)
+			min_size = 8 + (size_t) total + 4;
+		/* all chunks */
+		for (;;) {
+			NEED(pos + 4);
+			len = tds_peek_uint(tds, p + pos);
+			pos += 4;
+			if (len == 0)
+				break;
+			if (len > 0x7fffffffu)
+				return -2;
+			NEED(pos + len);
+			pos += len;
+		}
+		break;
+	case 2:
+		NEED(2);
+		pos = 2;
+		size = tds_peek_usmallint(tds, p);
+		if (size == 0xffff)
+			size = 0;
+		break;
+	case 1:
+		NEED(1);
+		pos = 1;
+		size = p[0];
+		break;
+	case 0:
+		pos = 0;
+		size = tds_get_size_by_type(curcol->column_type);
+		break;
+	default:
+		return -2;
+	}
+	NEED(pos + size);
+	return (TDS_INT) (pos + size);
+#undef NEED
+}
+
+/**
+ * Compute the wire size of a value of a row without consuming it.
+ * \tds
+ * \param curcol column of the value
+ * \param p      received data starting with the value
+ * \param avail  number of bytes in p
+ * \param need   if not NULL and the value is not entirely in p, set to the
+ *               minimum number of bytes p must contain to hold it
+ * \return size of the value, -1 if the value is not entirely in p or
+ *         -2 if the size cannot be computed for this type
+ */
+TDS_INT
+tds_column_wire_size(TDSSOCKET * tds, TDSCOLUMN * curcol, const unsigned char *p, size_t avail, size_t *need)
+{
+	TDS_UINT size;
+
+	if (curcol->funcs->get_data == tds_generic_get)
+		return tds_generic_wire_size(tds, curcol, p, avail, need);
+
+	/* one byte of length */
+	if (curcol->funcs->get_data == tds_numeric_get || curcol->funcs->get_data == tds_msdatetime_get
+	    || curcol->funcs->get_data == tds_sybbigtime_get) {
+		size = 1;
+		if (avail >= 1)
+			size += p[0];
+	} else if (curcol->funcs->get_data == tds_variant_get) {
+		size = 4;
+		if (avail >= 4) {
+			size = tds_peek_uint(tds, p);
+			if (size > 0x7fffffffu - 4)
+				return -2;
+			size += 4;
+		}
+	} else {
+		return -2;
+	}
+	if (avail < size) {
+		if (need)
+			*need = size;
+		return -1;
+	}
+	return (TDS_INT) size;
+}
+
+/**
+ * Skip a value read by tds_generic_get reading only its size.
+ * \tds
+ * \param curcol column of the value
+ * \return size of the value or -1 if NULL
+ */
+static TDS_INT8
+tds_skip_generic_value(TDSSOCKET * tds, TDSCOLUMN * curcol)
+{
+	TDS_INT8 colsize;
+	TDS_INT len;
+
+	switch (curcol->column_varint_size) {
+	case 4:
+		/* textptr and timestamp */
+		if (tds_get_byte(tds) != 16)
+			return -1;
+		tds_get_n(tds, NULL, 16 + 8);
+		colsize = tds_get_int(tds);
+		break;
+	case 5:
+		colsize = tds_get_int(tds);
+		if (colsize == 0)
+			colsize = -1;
+		break;
+	case 8:
+		colsize = tds_get_int8(tds);
+		if (colsize == -1)
+			return -1;
+		/* skip all chunks */
+		while ((len = tds_get_int(tds)) > 0 && !IS_TDSDEAD(tds))
+			tds_get_n(tds, NULL, len);
+		return 0;
+	case 2:
+		colsize = tds_get_smallint(tds);
+		break;
+	case 1:
+		colsize = tds_get_byte(tds);
+		if (colsize == 0)
+			colsize = -1;
+		break;
+	case 0:
+		colsize = tds_get_size_by_type(curcol->column_type);
+		break;
+	default:
+		return -1;
+	}
+	if (colsize > 0)
+		tds_get_n(tds, NULL, (size_t) colsize);
+	return colsize;
+}
+
+/**
+ * Skip a value not needed by the application.
+ * The value is not converted and no memory is allocated, only its size
+ * is read from the wire. The value can be read later with tds_load_column
+ * till another packet is read. Values not entirely in the received packet
+ * would not be available so they are read normally, as are values not
+ * read by tds_generic_get and fixed size values (cheap to read and
+ * never NULL).
+ * \tds
+ * \param curcol column to skip
+ * \return TDS_FAIL on error or TDS_SUCCESS
+ */
+TDSRET
+tds_skip_column(TDSSOCKET * tds, TDSCOLUMN * curcol)
+{
+	const unsigned char *start;
+	TDS_INT8 colsize;
+
+	CHECK_TDS_EXTRA(tds);
+	CHECK_COLUMN_EXTRA(curcol);
+
+	if (curcol->funcs->get_data != tds_generic_get || curcol->column_varint_size == 0
+	    || tds_generic_wire_size(tds, curcol, tds->in_buf + tds->in_pos, tds->in_len - tds->in_pos, NULL) < 0)
+		return curcol->funcs->get_data(tds, curcol);
+
+	tds_column_reset_data(curcol);
+	start = tds->in_buf + tds->in_pos;
+	curcol->column_wire_packet = tds->in_packets;
+
+	colsize = tds_skip_generic_value(tds, curcol);
+	if (IS_TDSDEAD(tds))
+		return TDS_FAIL;
+
+	curcol->column_cur_size = -1;
+	if (colsize < 0)
+		return TDS_SUCCESS;
+
+	curcol->column_wire_data = start;
+	curcol->column_wire_size = (TDS_INT) (tds->in_buf + tds->in_pos - start);
+	tds->skipped_values = true;
+	return TDS_SUCCESS;
+}
+
+/**
+ * Discard a value of a row the application is not going to read.
+ * Only the wire format is walked, column data are not changed.
+ * Types with a reader not known here are read normally.
+ * \tds
+ * \param curcol column of the value
+ * \return TDS_FAIL on error or TDS_SUCCESS
+ */
+TDSRET
+tds_discard_column(TDSSOCKET * tds, TDSCOLUMN * curcol)
+{
+	tds_func_get_data *get_data = curcol->funcs->get_data;
+
+	CHECK_TDS_EXTRA(tds);
+
+	if (get_data == tds_generic_get)
+		tds_skip_generic_value(tds, curcol);
+	else if (get_data == tds_numeric_get || get_data == tds_msdatetime_get || get_data == tds_sybbigtime_get)
+		tds_get_n(tds, NULL, tds_get_byte(tds));
+	else if (get_data == tds_variant_get)
+		tds_get_n(tds, NULL, tds_get_uint(tds));
+	else
+		return get_data(tds, curcol);
+	return IS_TDSDEAD(tds) ? TDS_FAIL : TDS_SUCCESS;
+}
+
+/**
+ * Read a value skipped by tds_skip_column.
+ * \tds
+ * \param curcol column to read
+ * \return TDS_SUCCESS if the value was read or not skipped, TDS_FAIL if
+ *         value is not available anymore, in this case it's set to NULL
+ */
+TDSRET
+tds_load_column(TDSSOCKET * tds, TDSCOLUMN * curcol)
+{
+	const unsigned char *start;
+	unsigned in_pos, in_len;
+	TDSRET rc;
+
+	CHECK_TDS_EXTRA(tds);
+	CHECK_COLUMN_EXTRA(curcol);
+
+	if (!curcol->column_wire_data)
+		return TDS_SUCCESS;
+
+	/* packet containing the value was replaced */
+	start = curcol->column_wire_data;
+	if (curcol->column_wire_packet != tds->in_packets || start < tds->in_buf
+	    || start + curcol->column_wire_size > tds->in_buf + tds->in_len) {
+		tdsdump_log(TDS_DBG_ERROR, "tds_load_column: skipped value not available\n");
+		curcol->column_wire_data = NULL;
+		curcol->column_cur_size = -1;
+		return TDS_FAIL;
+	}
+
+	/* read the value limiting the packet to it, in_buf is not changed */
+	in_pos = tds->in_pos;
+	in_len = tds->in_len;
+	tds->in_pos = (unsigned) (start - tds->in_buf);
+	tds->in_len = tds->in_pos + curcol->column_wire_size;
+	rc = curcol->funcs->get_data(tds, curcol);
+	tds->in_pos = in_pos;
+	tds->in_len = in_len;
+	curcol->column_wire_data = NULL;
+	return rc;
+}
+
+/**
+ * Read values skipped by tds_skip_column in current results.
+ * Called before the packet containing them is replaced so values of a
+ * row spanning packets are still available once the row is read.
+ * \tds
+ */
+void
+tds_load_skipped_columns(TDSSOCKET * tds)
+{
+	TDSRESULTINFO *info = tds->current_results;
+	TDS_USMALLINT i;
+
+	tds->skipped_values = false;
+	if (!info)
+		return;
+	for (i = 0; i < info->num_cols; ++i)
+		tds_load_column(tds, info->columns[i]);
+}
+
 /**
  * Put data information to wire
  * \param tds   state information for the socket and the TDS protocol
@@ -563,6 +563,7 @@ tds_iconv(TDSSOCKET * tds, TDSICONV * conv, TDS_ICONV_DIRECTION io,
 	size_t one_character;
 	int eilseq_raised = 0;
 	int conv_errno;
+	size_t initial_left;
 	/* cast away const-ness */
 	TDS_ERRNO_MESSAGE_FLAGS *suppress = (TDS_ERRNO_MESSAGE_FLAGS*) &conv->suppress;
 
@@ -607,6 +608,7 @@ tds_iconv(TDSSOCKET * tds, TDSICONV * conv, TDS_ICONV_DIRECTION io,
 	/*
 	 * Call iconv() as many times as necessary, until we reach the end of input or exhaust output.  
 	 */
+	initial_left = *inbytesleft;
 	for (;;) {
 		conv_errno = 0;
 		irreversible = tds_sys_iconv(to->cd, (ICONV_CONST char **) inbuf, inbytesleft, outbuf, outbytesleft);
@@ -704,6 +706,9 @@ tds_iconv(TDSSOCKET * tds, TDSICONV * conv, TDS_ICONV_DIRECTION io,
 		tds_sys_iconv_close(error_cd);
 	}
 
+	if (tds)
+		tds->conn->stats.iconv_bytes += initial_left - *inbytesleft;
+
 	errno = conv_errno;
 	return irreversible;
 }
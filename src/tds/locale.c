@@ -38,6 +38,7 @@
 
 #include <freetds/tds.h>
 #include <freetds/configs.h>
+#include <freetds/convert.h>
 #include "replacements.h"
 
 static void tds_parse_locale(const char *option, const char *value, void *param);
@@ -119,7 +120,25 @@ tds_parse_locale(const char *option, const char *value, void *param)
 		free(locale->language);
 		locale->language = strdup(value);
 	} else if (!strcmp(option, TDS_STR_DATEFMT)) {
-		free(locale->date_fmt);
-		locale->date_fmt = strdup(value);
+		tds_locale_set_date_fmt(locale, value);
 	}
 }
+
+/**
+ * Change date format of a locale.
+ * The format is compiled to speed up date conversions.
+ * @return false on memory error, in this case format is not changed
+ */
+bool
+tds_locale_set_date_fmt(TDSLOCALE * locale, const char *date_fmt)
+{
+	char *fmt = strdup(date_fmt);
+
+	if (!fmt)
+		return false;
+	free(locale->date_fmt);
+	locale->date_fmt = fmt;
+	tds_date_format_free(locale->date_fmt_plan);
+	locale->date_fmt_plan = tds_date_format_compile(fmt);
+	return true;
+}
@@ -58,6 +58,8 @@ static char *g_dump_filename = NULL;
 int tds_write_dump = 0;
 static FILE *g_dumpfile = NULL;	/* file pointer for dump log          */
 static tds_mutex g_dump_mutex = TDS_MUTEX_INITIALIZER;
+/** Tell if log is written as binary trace, see trace.c */
+static int g_dump_binary = 0;
 
 static FILE* tdsdump_append(void);
 
@@ -124,6 +126,10 @@ tdsdump_open(const char *filename)
 	tds_write_dump = 0;
 
 	/* free old one */
+	if (g_dump_binary) {
+		tds_trace_stop();
+		g_dump_binary = 0;
+	}
 	if (g_dumpfile != NULL && g_dumpfile != stdout && g_dumpfile != stderr)
 		fclose(g_dumpfile);
 	g_dumpfile = NULL;
@@ -147,10 +153,13 @@ tdsdump_open(const char *filename)
 		g_dumpfile = stdout;
 	} else if (!strcmp(filename, "stderr")) {
 		g_dumpfile = stderr;
-	} else if (NULL == (g_dumpfile = fopen(filename, "w"))) {
+	} else if (NULL == (g_dumpfile = fopen(filename, (tds_debug_flags & TDS_DBGFLAG_BINARY) ? "wb" : "w"))) {
 		result = 0;
 	}
 
+	if (result && !tds_g_append_mode && (tds_debug_flags & TDS_DBGFLAG_BINARY))
+		g_dump_binary = TDS_SUCCEED(tds_trace_start(g_dumpfile));
+
 	if (result)
 		tds_write_dump = 1;
 	tds_mutex_unlock(&g_dump_mutex);
@@ -194,6 +203,10 @@ tdsdump_close(void)
 {
 	tds_mutex_lock(&g_dump_mutex);
 	tds_write_dump = 0;
+	if (g_dump_binary) {
+		tds_trace_stop();
+		g_dump_binary = 0;
+	}
 	if (g_dumpfile != NULL && g_dumpfile != stdout && g_dumpfile != stderr)
 		fclose(g_dumpfile);
 	g_dumpfile = NULL;
@@ -202,27 +215,36 @@ tdsdump_close(void)
 	tds_mutex_unlock(&g_dump_mutex);
 }				/* tdsdump_close()  */
 
-static void
-tdsdump_start(FILE *file, const char *fname, int line)
+/**
+ * Write the prefix of a log line.
+ * \param file      log file
+ * \param flags     debug flags
+ * \param timestamp time of the event
+ * \param pid       process id
+ * \param fname     source file name
+ * \param line      source line
+ */
+void
+tdsdump_prefix(FILE *file, int flags, const char *timestamp, int pid, const char *fname, int line)
 {
 	char buf[128], *pbuf;
 	int started = 0;
 
 	/* write always time before log */
-	if (tds_debug_flags & TDS_DBGFLAG_TIME) {
-		fputs(tds_timestamp_str(buf, 127), file);
+	if (flags & TDS_DBGFLAG_TIME) {
+		fputs(timestamp, file);
 		started = 1;
 	}
 
 	pbuf = buf;
-	if (tds_debug_flags & TDS_DBGFLAG_PID) {
+	if (flags & TDS_DBGFLAG_PID) {
 		if (started)
 			*pbuf++ = ' ';
-		pbuf += sprintf(pbuf, "%d", (int) getpid());
+		pbuf += sprintf(pbuf, "%d", pid);
 		started = 1;
 	}
 
-	if ((tds_debug_flags & TDS_DBGFLAG_SOURCE) && fname && line) {
+	if ((flags & TDS_DBGFLAG_SOURCE) && fname && line) {
 		const char *p;
 		p = strrchr(fname, '/');
 		if (p)
@@ -242,52 +264,30 @@ tdsdump_start(FILE *file, const char *fname, int line)
 	fputs(buf, file);
 }
 
-#undef tdsdump_dump_buf
+static void
+tdsdump_start(FILE *file, const char *fname, int line)
+{
+	char buf[128];
+
+	buf[0] = 0;
+	if (tds_debug_flags & TDS_DBGFLAG_TIME)
+		tds_timestamp_str(buf, 127);
+	tdsdump_prefix(file, tds_debug_flags, buf, (int) getpid(), fname, line);
+}
+
 /**
- * Dump the contents of data into the log file in a human readable format.
- * \param file       source file name
- * \param level_line line and level combined. This and file are automatically computed by
- *                   TDS_DBG_* macros.
- * \param msg        message to print before dump
- * \param buf        buffer to dump
- * \param length     number of bytes in the buffer
+ * Write the content of a buffer in a human readable format.
+ * \param file   log file
+ * \param buf    buffer to dump
+ * \param length number of bytes in the buffer
  */
 void
-tdsdump_dump_buf(const char* file, unsigned int level_line, const char *msg, const void *buf, size_t length)
+tdsdump_hex(FILE *file, const void *buf, size_t length)
 {
 	size_t i, j;
 #define BYTES_PER_LINE 16
 	const unsigned char *data = (const unsigned char *) buf;
-	const int debug_lvl = level_line & 15;
-	const int line = level_line >> 4;
 	char line_buf[BYTES_PER_LINE * 8 + 16], *p;
-	FILE *dumpfile;
-
-	if (((tds_debug_flags >> debug_lvl) & 1) == 0 || !tds_write_dump)
-		return;
-
-	if (!g_dumpfile && !g_dump_filename)
-		return;
-
-	tds_mutex_lock(&g_dump_mutex);
-
-	dumpfile = g_dumpfile;
-#ifdef TDS_HAVE_MUTEX
-	if (tds_g_append_mode && dumpfile == NULL)
-		dumpfile = g_dumpfile = tdsdump_append();
-#else
-	if (tds_g_append_mode)
-		dumpfile = tdsdump_append();
-#endif
-
-	if (dumpfile == NULL) {
-		tds_mutex_unlock(&g_dump_mutex);
-		return;
-	}
-
-	tdsdump_start(dumpfile, file, line);
-
-	fprintf(dumpfile, "%s\n", msg);
 
 	for (i = 0; i < length; i += BYTES_PER_LINE) {
 		p = line_buf;
@@ -324,9 +324,60 @@ tdsdump_dump_buf(const char* file, unsigned int level_line, const char *msg, con
 			p += sprintf(p, "%c", (isprint(data[j])) ? data[j] : '.');
 		}
 		strcpy(p, "|\n");
-		fputs(line_buf, dumpfile);
+		fputs(line_buf, file);
 	}
-	fputs("\n", dumpfile);
+	fputs("\n", file);
+}
+
+#undef tdsdump_dump_buf
+/**
+ * Dump the contents of data into the log file in a human readable format.
+ * \param file       source file name
+ * \param level_line line and level combined. This and file are automatically computed by
+ *                   TDS_DBG_* macros.
+ * \param msg        message to print before dump
+ * \param buf        buffer to dump
+ * \param length     number of bytes in the buffer
+ */
+void
+tdsdump_dump_buf(const char* file, unsigned int level_line, const char *msg, const void *buf, size_t length)
+{
+	const int debug_lvl = level_line & 15;
+	const int line = level_line >> 4;
+	FILE *dumpfile;
+
+	if (((tds_debug_flags >> debug_lvl) & 1) == 0 || !tds_write_dump)
+		return;
+
+	if (!g_dumpfile && !g_dump_filename)
+		return;
+
+	if (g_dump_binary) {
+		tds_trace_dump_buf(file, level_line, msg, buf, length);
+		return;
+	}
+
+	tds_mutex_lock(&g_dump_mutex);
+
+	dumpfile = g_dumpfile;
+#ifdef TDS_HAVE_MUTEX
+	if (tds_g_append_mode && dumpfile == NULL)
+		dumpfile = g_dumpfile = tdsdump_append();
+#else
+	if (tds_g_append_mode)
+		dumpfile = tdsdump_append();
+#endif
+
+	if (dumpfile == NULL) {
+		tds_mutex_unlock(&g_dump_mutex);
+		return;
+	}
+
+	tdsdump_start(dumpfile, file, line);
+
+	fprintf(dumpfile, "%s\n", msg);
+
+	tdsdump_hex(dumpfile, buf, length);
 
 	fflush(dumpfile);
 
@@ -364,6 +415,13 @@ tdsdump_log(const char* file, unsigned int level_line, const char *fmt, ...)
 	if (!g_dumpfile && !g_dump_filename)
 		return;
 
+	if (g_dump_binary) {
+		va_start(ap, fmt);
+		tds_trace_log(file, level_line, fmt, ap);
+		va_end(ap);
+		return;
+	}
+
 	tds_mutex_lock(&g_dump_mutex);
 
 	dumpfile = g_dumpfile;
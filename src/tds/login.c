@@ -432,10 +432,17 @@ tds_connect(TDSSOCKET * tds, TDSLOGIN * login, int *p_oserr)
 		tdsdump_open(tds_dstr_cstr(&login->dump_file));
 	}
 
+	/*
+	 * If a capture file has been specified, start recording packets
+	 */
+	if (!tds_dstr_isempty(&login->capture_file))
+		tds_capture_open(tds_dstr_cstr(&login->capture_file));
+
 	tds->login = login;
 
 	tds->conn->tds_version = login->tds_version;
 	tds->conn->emul_little_endian = login->emul_little_endian;
+	tds->conn->zero_copy = login->zero_copy;
 #ifdef WORDS_BIGENDIAN
 	/*
 	 * Enable automatically little endian emulation.
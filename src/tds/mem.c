@@ -36,6 +36,7 @@
 #include "replacements.h"
 #include <freetds/enum_cap.h>
 #include <freetds/utils.h>
+#include <freetds/convert.h>
 
 #if HAVE_SYS_SOCKET_H
 #include <sys/socket.h>
@@ -137,13 +138,84 @@ tds_alloc_column(void)
 	return col;
 }
 
+/**
+ * Check if a column was allocated together with its result.
+ */
+static inline bool
+tds_column_is_inline(const TDSRESULTINFO *res_info, const TDSCOLUMN *col)
+{
+	return col >= res_info->inline_columns && col < res_info->inline_columns + res_info->num_inline_cols;
+}
+
 static void
-tds_free_column(TDSCOLUMN *col)
+tds_free_column(const TDSRESULTINFO *res_info, TDSCOLUMN *col)
 {
 	tds_dstr_free(&col->table_name);
 	tds_dstr_free(&col->column_name);
 	tds_dstr_free(&col->table_column_name);
-	free(col);
+	if (!tds_column_is_inline(res_info, col))
+		free(col);
+}
+
+/** Offset of column pointers in a block allocated by tds_alloc_result_block */
+#define RESULT_BLOCK_PTRS \
+	((sizeof(TDSRESULTINFO) + TDS_ALIGN_SIZE - 1) / TDS_ALIGN_SIZE * TDS_ALIGN_SIZE)
+/** Offset of columns in a block allocated by tds_alloc_result_block */
+#define RESULT_BLOCK_COLUMNS(num_cols) \
+	(RESULT_BLOCK_PTRS + (sizeof(TDSCOLUMN *) * (num_cols) + TDS_ALIGN_SIZE - 1) / TDS_ALIGN_SIZE * TDS_ALIGN_SIZE)
+
+/**
+ * Allocate a result with its columns.
+ * Result, column pointers and columns are carved from a single block
+ * so allocating and freeing metadata for a result cost a single
+ * malloc/free instead of one for each column.
+ * Names (table_name, column_name and table_column_name) are still
+ * allocated separately: they are read after the block is allocated so
+ * their sizes are not known yet and libraries change them with
+ * tds_dstr_copy/tds_dstr_dup which reallocate or free the string.
+ * Results with identical metadata are reused (see tds7_reuse_results)
+ * so names are not allocated again for every result set.
+ */
+static TDSRESULTINFO *
+tds_alloc_result_block(TDS_USMALLINT num_cols)
+{
+	TDSRESULTINFO *res_info;
+	unsigned char *block;
+	TDS_USMALLINT col;
+
+	block = (unsigned char *) calloc(1, RESULT_BLOCK_COLUMNS(num_cols) + sizeof(TDSCOLUMN) * num_cols);
+	if (!block)
+		return NULL;
+
+	res_info = (TDSRESULTINFO *) block;
+	res_info->ref_count = 1;
+	if (!num_cols)
+		return res_info;
+
+	res_info->columns = (TDSCOLUMN **) (block + RESULT_BLOCK_PTRS);
+	res_info->inline_columns = (TDSCOLUMN *) (block + RESULT_BLOCK_COLUMNS(num_cols));
+	res_info->num_inline_cols = num_cols;
+	for (col = 0; col < num_cols; col++) {
+		TDSCOLUMN *curcol = &res_info->inline_columns[col];
+
+		tds_dstr_init(&curcol->table_name);
+		tds_dstr_init(&curcol->column_name);
+		tds_dstr_init(&curcol->table_column_name);
+		curcol->funcs = &tds_invalid_funcs;
+		res_info->columns[col] = curcol;
+	}
+	res_info->num_cols = num_cols;
+	return res_info;
+}
+
+/**
+ * Check if column pointers were allocated together with the result.
+ */
+static inline bool
+tds_result_inline_ptrs(const TDSRESULTINFO *res_info)
+{
+	return res_info->num_inline_cols
+	       && res_info->columns == (TDSCOLUMN **) ((unsigned char *) res_info + RESULT_BLOCK_PTRS);
 }
 
 
@@ -262,6 +334,7 @@ tds_release_dynamic(TDSDYNAMIC ** pdyn)
 	tds_detach_results(dyn->res_info);
 
 	tds_free_results(dyn->res_info);
+	tds_free_results(dyn->last_results);
 	tds_free_input_params(dyn);
 	free(dyn->query);
 	free(dyn);
@@ -300,8 +373,17 @@ tds_alloc_param_result(TDSPARAMINFO * old_param)
 		param_info->ref_count = 1;
 	}
 
-	if (!TDS_RESIZE(param_info->columns, param_info->num_cols + 1u))
+	/* column pointers allocated inline cannot be resized */
+	if (tds_result_inline_ptrs(param_info)) {
+		TDSCOLUMN **columns = tds_new(TDSCOLUMN *, param_info->num_cols + 1u);
+
+		if (!columns)
+			goto Cleanup;
+		memcpy(columns, param_info->columns, sizeof(TDSCOLUMN *) * param_info->num_cols);
+		param_info->columns = columns;
+	} else if (!TDS_RESIZE(param_info->columns, param_info->num_cols + 1u)) {
 		goto Cleanup;
+	}
 
 	param_info->columns[param_info->num_cols++] = colinfo;
 	return param_info;
@@ -328,7 +410,7 @@ tds_free_param_result(TDSPARAMINFO * param_info)
 	if (col->column_data && col->column_data_free)
 		col->column_data_free(col);
 
-	if (param_info->num_cols == 0)
+	if (param_info->num_cols == 0 && !tds_result_inline_ptrs(param_info))
 		TDS_ZERO_FREE(param_info->columns);
 
 	/*
@@ -339,7 +421,7 @@ tds_free_param_result(TDSPARAMINFO * param_info)
 	 * parameters
 	 * -- freddy77
 	 */
-	tds_free_column(col);
+	tds_free_column(param_info, col);
 }
 
 static void
@@ -394,18 +476,11 @@ tds_alloc_param_data(TDSCOLUMN * curparam)
 static TDSCOMPUTEINFO *
 tds_alloc_compute_result(TDS_USMALLINT num_cols, TDS_USMALLINT by_cols)
 {
-	TDS_USMALLINT col;
 	TDSCOMPUTEINFO *info;
 
-	TEST_MALLOC(info, TDSCOMPUTEINFO);
-	info->ref_count = 1;
-
-	TEST_CALLOC(info->columns, TDSCOLUMN *, num_cols);
-
-	info->num_cols = num_cols;
-	for (col = 0; col < num_cols; col++)
-		if (!(info->columns[col] = tds_alloc_column()))
-			goto Cleanup;
+	info = tds_alloc_result_block(num_cols);
+	if (!info)
+		return NULL;
 
 	if (by_cols) {
 		TEST_CALLOC(info->bycolumns, TDS_SMALLINT, by_cols);
@@ -448,25 +523,15 @@ tds_alloc_compute_results(TDSSOCKET * tds, TDS_USMALLINT num_cols, TDS_USMALLINT
 	return comp_info;
 }
 
+/**
+ * Allocate a result with its columns.
+ * \param num_cols number of columns
+ * \return result allocated or NULL on out of memory
+ */
 TDSRESULTINFO *
 tds_alloc_results(TDS_USMALLINT num_cols)
 {
-	TDSRESULTINFO *res_info;
-	TDS_USMALLINT col;
-
-	TEST_MALLOC(res_info, TDSRESULTINFO);
-	res_info->ref_count = 1;
-	if (num_cols)
-		TEST_CALLOC(res_info->columns, TDSCOLUMN *, num_cols);
-	for (col = 0; col < num_cols; col++)
-		if (!(res_info->columns[col] = tds_alloc_column()))
-			goto Cleanup;
-	res_info->num_cols = num_cols;
-	res_info->row_size = 0;
-	return res_info;
-      Cleanup:
-	tds_free_results(res_info);
-	return NULL;
+	return tds_alloc_result_block(num_cols);
 }
 
 void
@@ -553,21 +618,120 @@ tds_alloc_row(TDSRESULTINFO * res_info)
 		col = res_info->columns[i];
 
 		col->column_data = ptr + row_size;
+		col->column_row_data = NULL;
 
 		row_size += col->funcs->row_len(col);
 		row_size += (TDS_ALIGN_SIZE - 1);
 		row_size -= row_size % TDS_ALIGN_SIZE;
 	}
 
+	tds_compile_row_plan(res_info);
+
 	return TDS_SUCCESS;
 }
 
+/**
+ * Copy values pointing into the received packet to the row buffer.
+ * Must be called before keeping a row after the packet is released.
+ * \param res_info result to check
+ */
+void
+tds_unpin_row_data(TDSRESULTINFO * res_info)
+{
+	int i;
+	TDSCOLUMN *col;
+
+	for (i = 0; i < res_info->num_cols; ++i) {
+		col = res_info->columns[i];
+		if (!col->column_row_data)
+			continue;
+		if (col->column_cur_size > 0)
+			memcpy(col->column_row_data, col->column_data, col->column_cur_size);
+		tds_column_reset_data(col);
+	}
+}
+
 TDSRET
 tds_alloc_compute_row(TDSCOMPUTEINFO * res_info)
 {
 	return tds_alloc_row(res_info);
 }
 
+/**
+ * Allocate a batch to read rows of a result by column.
+ * \param res_info result to read
+ * \param max_rows maximum number of rows in the batch
+ * \return batch allocated or NULL on failure
+ */
+TDSBATCH *
+tds_alloc_batch(TDSRESULTINFO *res_info, TDS_UINT max_rows)
+{
+	TDSBATCH *batch;
+	int i;
+
+	if (!res_info || res_info->num_cols <= 0 || !max_rows)
+		return NULL;
+
+	batch = tds_new0(TDSBATCH, 1);
+	if (!batch)
+		return NULL;
+	batch->max_rows = max_rows;
+	batch->columns = tds_new0(TDSBATCHCOLUMN, res_info->num_cols);
+	if (!batch->columns)
+		goto Cleanup;
+	batch->num_cols = res_info->num_cols;
+
+	for (i = 0; i < res_info->num_cols; ++i) {
+		TDSCOLUMN *col = res_info->columns[i];
+		TDSBATCHCOLUMN *bcol = &batch->columns[i];
+		TDS_UINT size;
+
+		size = col->funcs->row_len(col);
+		size += (TDS_ALIGN_SIZE - 1);
+		size -= size % TDS_ALIGN_SIZE;
+
+		bcol->value_size = size;
+		bcol->is_blob = is_blob_col(col);
+		bcol->values = (unsigned char *) calloc(max_rows, size);
+		bcol->lengths = tds_new(TDS_INT, max_rows);
+		bcol->nulls = tds_new0(unsigned char, (max_rows + 7) / 8);
+		if (!bcol->values || !bcol->lengths || !bcol->nulls)
+			goto Cleanup;
+	}
+	return batch;
+
+Cleanup:
+	tds_free_batch(batch);
+	return NULL;
+}
+
+/** Free a batch allocated with tds_alloc_batch, including blob values */
+void
+tds_free_batch(TDSBATCH *batch)
+{
+	int i;
+	TDS_UINT row;
+
+	if (!batch)
+		return;
+
+	for (i = 0; i < batch->num_cols; ++i) {
+		TDSBATCHCOLUMN *bcol = &batch->columns[i];
+
+		if (bcol->is_blob && bcol->values) {
+			for (row = 0; row < batch->max_rows; ++row) {
+				TDSBLOB *blob = (TDSBLOB *) tds_batch_value(bcol, row);
+				free(blob->textvalue);
+			}
+		}
+		free(bcol->values);
+		free(bcol->lengths);
+		free(bcol->nulls);
+	}
+	free(batch->columns);
+	free(batch);
+}
+
 void
 tds_free_param_results(TDSPARAMINFO * param_info)
 {
@@ -641,15 +805,46 @@ tds_free_results(TDSRESULTINFO * res_info)
 	if (res_info->num_cols && res_info->columns) {
 		for (i = 0; i < res_info->num_cols; i++)
 			if ((curcol = res_info->columns[i]) != NULL)
-				tds_free_column(curcol);
-		free(res_info->columns);
+				tds_free_column(res_info, curcol);
 	}
+	if (!tds_result_inline_ptrs(res_info))
+		free(res_info->columns);
 
 	free(res_info->bycolumns);
+	free(res_info->row_plan);
+	free(res_info->metadata);
 
 	free(res_info);
 }
 
+/**
+ * Remove client bindings from results, and their owner.
+ * Reused results (see TDSRESULTINFO::reused) keep bindings of the
+ * previous execution only if TDSRESULTINFO::bindings_owner is set, the
+ * owner calls this function if the bindings are not valid any more.
+ * \param res_info results to reset
+ */
+void
+tds_reset_bindings(TDSRESULTINFO * res_info)
+{
+	int i;
+	TDSCOLUMN *curcol;
+
+	if (!res_info)
+		return;
+
+	for (i = 0; i < res_info->num_cols; i++) {
+		curcol = res_info->columns[i];
+		curcol->column_bindtype = 0;
+		curcol->column_bindfmt = 0;
+		curcol->column_bindlen = 0;
+		curcol->column_nullbind = NULL;
+		curcol->column_varaddr = NULL;
+		curcol->column_lenbind = NULL;
+	}
+	res_info->bindings_owner = NULL;
+}
+
 void
 tds_free_all_results(TDSSOCKET * tds)
 {
@@ -991,6 +1186,7 @@ tds_alloc_login(int use_environment)
 
 	tds_dstr_init(&login->database);
 	tds_dstr_init(&login->dump_file);
+	tds_dstr_init(&login->capture_file);
 	tds_dstr_init(&login->client_charset);
 	tds_dstr_init(&login->instance_name);
 	tds_dstr_init(&login->server_realm_name);
@@ -1048,6 +1244,7 @@ tds_free_login(TDSLOGIN * login)
 
 	tds_dstr_free(&login->database);
 	tds_dstr_free(&login->dump_file);
+	tds_dstr_free(&login->capture_file);
 	tds_dstr_free(&login->instance_name);
 	tds_dstr_free(&login->server_realm_name);
 	tds_dstr_free(&login->server_spn);
@@ -1059,14 +1256,153 @@ tds_free_login(TDSLOGIN * login)
 	free(login);
 }
 
+/*
+ * Process wide packet pool.
+ *
+ * Packets freed are kept in lists by size class to be reused by any
+ * connection, avoiding a malloc/free for every packet or connection.
+ * Block sizes are usually powers of 2, class capacities are powers of 2
+ * plus some slack to hold additional headers.
+ * Each class has its own lock to reduce contention.
+ */
+#define TDS_POOL_MIN_SHIFT 6
+#define TDS_POOL_NUM_CLASSES 11
+#define TDS_POOL_SLACK 64
+#define TDS_POOL_CLASS_CAPACITY(c) ((64u << (c)) + TDS_POOL_SLACK)
+
+typedef struct tds_packet_pool_class
+{
+	tds_mutex mtx;
+	TDSPACKET *packets;
+	unsigned num_packets;
+	TDS_UINT8 hits, misses, released, discarded;
+} TDSPACKETPOOLCLASS;
+
+static TDSPACKETPOOLCLASS packet_pool[TDS_POOL_NUM_CLASSES] = {
+#define CLASS { TDS_MUTEX_INITIALIZER, NULL, 0, 0, 0, 0, 0 }
+	CLASS, CLASS, CLASS, CLASS, CLASS, CLASS, CLASS, CLASS, CLASS, CLASS, CLASS
+#undef CLASS
+};
+
+static unsigned packet_pool_limit = 64;
+
+/* return smallest class with capacity >= len, TDS_POOL_NUM_CLASSES if too big */
+static unsigned
+tds_packet_pool_class_get(unsigned len)
+{
+	unsigned c;
+
+	for (c = 0; c < TDS_POOL_NUM_CLASSES; ++c)
+		if (TDS_POOL_CLASS_CAPACITY(c) >= len)
+			break;
+	return c;
+}
+
+/* return class to store a packet of given capacity, TDS_POOL_NUM_CLASSES if none */
+static unsigned
+tds_packet_pool_class_put(unsigned capacity)
+{
+	unsigned c = tds_packet_pool_class_get(capacity);
+
+	if (c < TDS_POOL_NUM_CLASSES && TDS_POOL_CLASS_CAPACITY(c) == capacity)
+		return c;
+	/* do not keep too big packets wasting memory */
+	if (c == 0 || c == TDS_POOL_NUM_CLASSES)
+		return TDS_POOL_NUM_CLASSES;
+	return c - 1;
+}
+
+/**
+ * Set maximum number of free packets kept in the pool for each size class.
+ * 0 disables the pool.
+ */
+void
+tds_packet_pool_set_limit(unsigned max_packets)
+{
+	packet_pool_limit = max_packets;
+	if (!max_packets)
+		tds_packet_pool_flush();
+}
+
+/**
+ * Free all packets kept in the pool.
+ */
+void
+tds_packet_pool_flush(void)
+{
+	unsigned c;
+	TDSPACKET *packets, *next;
+
+	for (c = 0; c < TDS_POOL_NUM_CLASSES; ++c) {
+		TDSPACKETPOOLCLASS *pool = &packet_pool[c];
+
+		tds_mutex_lock(&pool->mtx);
+		packets = pool->packets;
+		pool->packets = NULL;
+		pool->num_packets = 0;
+		tds_mutex_unlock(&pool->mtx);
+
+		for (; packets; packets = next) {
+			next = packets->next;
+			free(packets);
+		}
+	}
+}
+
+/**
+ * Retrieve packet pool statistics.
+ */
+void
+tds_packet_pool_get_stats(TDSPACKETPOOLSTATS *stats)
+{
+	unsigned c;
+
+	memset(stats, 0, sizeof(*stats));
+	for (c = 0; c < TDS_POOL_NUM_CLASSES; ++c) {
+		TDSPACKETPOOLCLASS *pool = &packet_pool[c];
+
+		tds_mutex_lock(&pool->mtx);
+		stats->hits += pool->hits;
+		stats->misses += pool->misses;
+		stats->released += pool->released;
+		stats->discarded += pool->discarded;
+		stats->cached += pool->num_packets;
+		tds_mutex_unlock(&pool->mtx);
+	}
+}
+
 TDSPACKET *
 tds_alloc_packet(void *buf, unsigned len)
 {
-	TDSPACKET *packet = (TDSPACKET *) malloc(len + TDS_OFFSET(TDSPACKET, buf));
+	TDSPACKET *packet = NULL;
+	unsigned capacity = len;
+	unsigned c = tds_packet_pool_class_get(len);
+
+	if (c < TDS_POOL_NUM_CLASSES) {
+		TDSPACKETPOOLCLASS *pool = &packet_pool[c];
+
+		tds_mutex_lock(&pool->mtx);
+		packet = pool->packets;
+		if (packet) {
+			pool->packets = packet->next;
+			--pool->num_packets;
+			++pool->hits;
+		} else {
+			++pool->misses;
+		}
+		tds_mutex_unlock(&pool->mtx);
+
+		capacity = TDS_POOL_CLASS_CAPACITY(c);
+		if (packet)
+			TDS_MARK_UNDEFINED(packet->buf, capacity);
+	}
+	if (!packet)
+		packet = (TDSPACKET *) malloc(capacity + TDS_OFFSET(TDSPACKET, buf));
 	if (TDS_LIKELY(packet)) {
 		packet->len = 0;
-		packet->capacity = len;
+		packet->capacity = capacity;
 		packet->sid = 0;
+		packet->data_start = 0;
 		packet->next = NULL;
 		if (buf) {
 			memcpy(packet->buf, buf, len);
@@ -1080,6 +1416,11 @@ TDSPACKET *
 tds_realloc_packet(TDSPACKET *packet, unsigned len)
 {
 	if (packet->capacity < len) {
+		unsigned c = tds_packet_pool_class_get(len);
+
+		/* allocate full class so packet can be reused */
+		if (c < TDS_POOL_NUM_CLASSES)
+			len = TDS_POOL_CLASS_CAPACITY(c);
 		packet = (TDSPACKET *) realloc(packet, len + TDS_OFFSET(TDSPACKET, buf));
 		if (TDS_LIKELY(packet))
 			packet->capacity = len;
@@ -1087,12 +1428,35 @@ tds_realloc_packet(TDSPACKET *packet, unsigned len)
 	return packet;
 }
 
+/**
+ * Free a list of packets.
+ * Packets are returned to the pool if possible.
+ */
 void
 tds_free_packets(TDSPACKET *packet)
 {
 	TDSPACKET *next;
+	unsigned c;
+
 	for (; packet; packet = next) {
 		next = packet->next;
+
+		c = tds_packet_pool_class_put(packet->capacity);
+		if (c < TDS_POOL_NUM_CLASSES) {
+			TDSPACKETPOOLCLASS *pool = &packet_pool[c];
+
+			tds_mutex_lock(&pool->mtx);
+			if (pool->num_packets < packet_pool_limit) {
+				packet->next = pool->packets;
+				pool->packets = packet;
+				++pool->num_packets;
+				++pool->released;
+				packet = NULL;
+			} else {
+				++pool->discarded;
+			}
+			tds_mutex_unlock(&pool->mtx);
+		}
 		free(packet);
 	}
 }
@@ -1114,14 +1478,18 @@ tds_deinit_connection(TDSCONNECTION *conn)
 	tds_iconv_free(conn);
 	free(conn->product_name);
 	free(conn->server);
+	free(conn->recv_buf);
 	tds_free_env(conn);
+	tdsdump_log(TDS_DBG_INFO1, "sent %" PRIu64 " packets using %" PRIu64 " write calls\n",
+		    conn->stats.packets_sent, conn->stats.write_calls);
 #if ENABLE_ODBC_MARS
 	tds_mutex_free(&conn->list_mtx);
 	tds_free_packets(conn->packets);
 	tds_free_packets(conn->recv_packet);
 	tds_free_packets(conn->send_packets);
-	tds_free_packets(conn->packet_cache);
 	free(conn->sessions);
+#else
+	tds_free_packets(conn->send_packets);
 #endif
 }
 
@@ -1163,10 +1531,10 @@ tds_init_socket(TDSSOCKET * tds_socket, unsigned int bufsize)
 		goto Cleanup;
 	tds_socket->in_buf = tds_socket->recv_packet->buf;
 
-	tds_socket->send_packet = tds_alloc_packet(NULL, bufsize + TDS_ADDITIONAL_SPACE);
+	tds_socket->send_packet = tds_alloc_packet(NULL, bufsize + TDS_ADDITIONAL_SPACE + TDS_SEND_HEADROOM);
 	if (!tds_socket->send_packet)
 		goto Cleanup;
-	tds_socket->out_buf = tds_socket->send_packet->buf;
+	tds_socket->out_buf = tds_socket->send_packet->buf + TDS_SEND_HEADROOM;
 
 	tds_socket->out_buf_max = bufsize;
 
@@ -1301,11 +1669,11 @@ tds_realloc_socket(TDSSOCKET * tds, size_t bufsize)
 	if (tds->out_pos > bufsize)
 		return NULL;
 
-	packet = tds_realloc_packet(tds->send_packet, bufsize + TDS_ADDITIONAL_SPACE);
+	packet = tds_realloc_packet(tds->send_packet, bufsize + TDS_ADDITIONAL_SPACE + TDS_SEND_HEADROOM);
 	if (packet == NULL)
 		return NULL;
 
-	tds->out_buf = packet->buf;
+	tds->out_buf = packet->buf + TDS_SEND_HEADROOM;
 	tds->out_buf_max = bufsize;
 	tds->send_packet = packet;
 	return tds;
@@ -1374,6 +1742,9 @@ tds_free_socket(TDSSOCKET * tds)
 	}
 #endif
 	tds_free_all_results(tds);
+	tds_free_results(tds->last_results);
+	tds_blob_stream_reset(tds);
+	free(tds->blob_stream.nbcbuf);
 #if ENABLE_ODBC_MARS
 	tds_cond_destroy(&tds->packet_cond);
 #endif
@@ -1393,6 +1764,7 @@ tds_free_locale(TDSLOCALE * locale)
 	free(locale->language);
 	free(locale->server_charset);
 	free(locale->date_fmt);
+	tds_date_format_free(locale->date_fmt_plan);
 	free(locale);
 }
 
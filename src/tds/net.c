@@ -65,6 +65,10 @@
 #include <sys/ioctl.h>
 #endif /* HAVE_SYS_IOCTL_H */
 
+#if HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif /* HAVE_SYS_UIO_H */
+
 #if HAVE_SELECT_H
 #include <sys/select.h>
 #endif /* HAVE_SELECT_H */
@@ -90,6 +94,7 @@
 #include <freetds/tds.h>
 #include <freetds/string.h>
 #include <freetds/tls.h>
+#include <freetds/bytes.h>
 #include "replacements.h"
 
 #include <signal.h>
@@ -582,6 +587,8 @@ tds_connection_close(TDSCONNECTION *conn)
 		CLOSESOCKET(conn->s);
 		conn->s = INVALID_SOCKET;
 	}
+	/* discard data received */
+	conn->recv_buf_pos = conn->recv_buf_len = 0;
 
 #if ENABLE_ODBC_MARS
 	tds_mutex_lock(&conn->list_mtx);
@@ -607,6 +614,7 @@ tds_select(TDSSOCKET * tds, unsigned tds_sel, int timeout_seconds)
 {
 	int rc, seconds;
 	unsigned int poll_seconds;
+	TDS_UINT8 start;
 
 	assert(tds != NULL);
 	assert(timeout_seconds >= 0);
@@ -634,6 +642,9 @@ tds_select(TDSSOCKET * tds, unsigned tds_sel, int timeout_seconds)
 		if (TDS_IS_SOCKET_INVALID(tds_get_s(tds)))
 			return -1;
 
+		if ((tds_sel & TDSSELREAD) != 0 && tds_connection_buffered(tds->conn))
+			return POLLIN;
+
 		if ((tds_sel & TDSSELREAD) != 0 && tds->conn->tls_session && tds_ssl_pending(tds->conn))
 			return POLLIN;
 
@@ -643,7 +654,14 @@ tds_select(TDSSOCKET * tds, unsigned tds_sel, int timeout_seconds)
 		fds[1].fd = tds_wakeup_get_fd(&tds->conn->wakeup);
 		fds[1].events = POLLIN;
 		fds[1].revents = 0;
-		rc = poll(fds, 2, timeout);
+		++tds->conn->stats.waits;
+		if (tds->conn->stats_timing) {
+			start = tds_gettime_us();
+			rc = poll(fds, 2, timeout);
+			tds->conn->stats.wait_us += tds_gettime_us() - start;
+		} else {
+			rc = poll(fds, 2, timeout);
+		}
 
 		if (rc > 0 ) {
 			if (fds[0].revents & POLLERR) {
@@ -714,6 +732,8 @@ tds_select(TDSSOCKET * tds, unsigned tds_sel, int timeout_seconds)
 
 /**
  * Read from an OS socket
+ * Data are read in large chunks into connection receive buffer so
+ * a single system call can return many packets.
  * @TODO remove tds, save error somewhere, report error in another way
  * @returns 0 if blocking, <0 error >0 bytes read
  */
@@ -733,10 +753,41 @@ tds_socket_read(TDSCONNECTION * conn, TDSSOCKET *tds, unsigned char *buf, int bu
 	}
 #endif
 
-	/* read directly from socket*/
-	len = READSOCKET(conn->s, buf, buflen);
-	if (len > 0)
+	/* data already received ? */
+	if (conn->recv_buf_pos < conn->recv_buf_len) {
+		len = conn->recv_buf_len - conn->recv_buf_pos;
+		if (len > buflen)
+			len = buflen;
+		memcpy(buf, conn->recv_buf + conn->recv_buf_pos, len);
+		conn->recv_buf_pos += len;
 		return len;
+	}
+	conn->recv_buf_pos = conn->recv_buf_len = 0;
+
+	if (!conn->recv_buf && buflen < TDS_RECV_BUF_SIZE)
+		conn->recv_buf = tds_new(unsigned char, TDS_RECV_BUF_SIZE);
+
+	/* large read or no buffer, read directly from socket */
+	if (!conn->recv_buf || buflen >= TDS_RECV_BUF_SIZE) {
+		len = READSOCKET(conn->s, buf, buflen);
+		++conn->stats.read_calls;
+		if (len > 0) {
+			conn->stats.bytes_received += len;
+			return len;
+		}
+	} else {
+		len = READSOCKET(conn->s, conn->recv_buf, TDS_RECV_BUF_SIZE);
+		++conn->stats.read_calls;
+		if (len > 0) {
+			conn->stats.bytes_received += len;
+			conn->recv_buf_len = len;
+			if (len > buflen)
+				len = buflen;
+			memcpy(buf, conn->recv_buf, len);
+			conn->recv_buf_pos = len;
+			return len;
+		}
+	}
 
 	err = sock_errno;
 	if (len < 0 && TDSSOCK_WOULDBLOCK(err))
@@ -748,6 +799,72 @@ tds_socket_read(TDSCONNECTION * conn, TDSSOCKET *tds, unsigned char *buf, int bu
 	return -1;
 }
 
+/**
+ * Check if a complete packet was already received.
+ * For encrypted connections any data received is considered a packet.
+ * @returns 1 if a packet is available, 0 otherwise
+ */
+int
+tds_connection_has_packet(TDSCONNECTION *conn)
+{
+	const unsigned char *p;
+	unsigned len = tds_connection_buffered(conn);
+
+	if (conn->tls_session)
+		return len > 0 || tds_ssl_pending(conn);
+
+	if (len < 8)
+		return 0;
+	p = conn->recv_buf + conn->recv_buf_pos;
+	if (p[0] == TDS72_SMP)
+		return len >= sizeof(TDS72_SMP_HEADER) && len >= TDS_GET_UA4LE(p + 4);
+	return len >= TDS_GET_UA2BE(p + 2);
+}
+
+/**
+ * Read data available from the socket without blocking.
+ * Data are kept in the connection buffer.
+ * @returns 1 if a packet is available or an error or end of file
+ *          should be reported reading, 0 otherwise
+ */
+int
+tds_connection_fill(TDSCONNECTION *conn)
+{
+	int len, err;
+
+	if (TDS_IS_SOCKET_INVALID(conn->s))
+		return 1;
+
+	if (!conn->recv_buf) {
+		conn->recv_buf = tds_new(unsigned char, TDS_RECV_BUF_SIZE);
+		if (!conn->recv_buf)
+			return 1;
+	}
+
+	/* move partial data at the beginning of the buffer */
+	if (conn->recv_buf_pos) {
+		conn->recv_buf_len -= conn->recv_buf_pos;
+		memmove(conn->recv_buf, conn->recv_buf + conn->recv_buf_pos, conn->recv_buf_len);
+		conn->recv_buf_pos = 0;
+	}
+
+	if (conn->recv_buf_len < TDS_RECV_BUF_SIZE) {
+		len = READSOCKET(conn->s, conn->recv_buf + conn->recv_buf_len, TDS_RECV_BUF_SIZE - conn->recv_buf_len);
+		++conn->stats.read_calls;
+		if (len > 0) {
+			conn->stats.bytes_received += len;
+			conn->recv_buf_len += len;
+		} else {
+			/* let next read report the error */
+			err = sock_errno;
+			if (len == 0 || !TDSSOCK_WOULDBLOCK(err))
+				return 1;
+		}
+	}
+
+	return tds_connection_has_packet(conn);
+}
+
 /**
  * Write to an OS socket
  * @returns 0 if blocking, <0 error >0 bytes readed
@@ -774,8 +891,11 @@ tds_socket_write(TDSCONNECTION *conn, TDSSOCKET *tds, const unsigned char *buf,
 #else
 	len = WRITESOCKET(conn->s, buf, buflen);
 #endif
-	if (len > 0)
+	++conn->stats.write_calls;
+	if (len > 0) {
+		conn->stats.bytes_sent += len;
 		return len;
+	}
 
 	err = sock_errno;
 	if (0 == len || TDSSOCK_WOULDBLOCK(err))
@@ -970,6 +1090,47 @@ tds_connection_read(TDSSOCKET * tds, unsigned char *buf, int buflen)
 #endif
 }
 
+/**
+ * Wait for the socket to be writable.
+ * \param tds the famous socket
+ * \return >0 if writable, 0 to retry, <0 on failure (socket closed)
+ */
+static int
+tds_wait_write(TDSSOCKET * tds)
+{
+	/* TODO if send buffer is full we block receive !!! */
+	int len = tds_select(tds, TDSSELWRITE, tds->query_timeout);
+
+	if (len > 0)
+		return len;
+
+	/* error */
+	if (len < 0) {
+		int err = sock_errno;
+		char *errstr;
+
+		if (TDSSOCK_WOULDBLOCK(err)) /* shouldn't happen, but OK, retry */
+			return 0;
+		errstr = sock_strerror(err);
+		tdsdump_log(TDS_DBG_NETWORK, "select(2) failed: %d (%s)\n", err, errstr);
+		sock_strerror_free(errstr);
+		tds_connection_close(tds->conn);
+		tdserror(tds_get_ctx(tds), tds, TDSEWRIT, err);
+		return -1;
+	}
+
+	/* timeout */
+	tdsdump_log(TDS_DBG_NETWORK, "tds_goodwrite(): timed out, asking client\n");
+	switch (tdserror(tds_get_ctx(tds), tds, TDSETIME, sock_errno)) {
+	case TDS_INT_CONTINUE:
+		return 0;
+	default:
+	case TDS_INT_CANCEL:
+		tds_close_socket(tds);
+		return -1;
+	}
+}
+
 /**
  * \param tds the famous socket
  * \param buffer data to send
@@ -986,45 +1147,16 @@ tds_goodwrite(TDSSOCKET * tds, const unsigned char *buffer, size_t buflen)
 	assert(tds && buffer);
 
 	while (sent < buflen) {
-		/* TODO if send buffer is full we block receive !!! */
-		len = tds_select(tds, TDSSELWRITE, tds->query_timeout);
-
-		if (len > 0) {
-			len = tds_socket_write(tds->conn, tds, buffer + sent, buflen - sent);
-			if (len == 0)
-				continue;
-			if (len < 0)
-				return len;
-
-			sent += len;
+		len = tds_wait_write(tds);
+		if (len < 0)
+			return len;
+		if (len == 0)
 			continue;
-		}
-
-		/* error */
-		if (len < 0) {
-			int err = sock_errno;
-			char *errstr;
-
-			if (TDSSOCK_WOULDBLOCK(err)) /* shouldn't happen, but OK, retry */
-				continue;
-			errstr = sock_strerror(err);
-			tdsdump_log(TDS_DBG_NETWORK, "select(2) failed: %d (%s)\n", err, errstr);
-			sock_strerror_free(errstr);
-			tds_connection_close(tds->conn);
-			tdserror(tds_get_ctx(tds), tds, TDSEWRIT, err);
-			return -1;
-		}
 
-		/* timeout */
-		tdsdump_log(TDS_DBG_NETWORK, "tds_goodwrite(): timed out, asking client\n");
-		switch (tdserror(tds_get_ctx(tds), tds, TDSETIME, sock_errno)) {
-		case TDS_INT_CONTINUE:
-			break;
-		default:
-		case TDS_INT_CANCEL:
-			tds_close_socket(tds);
-			return -1;
-		}
+		len = tds_socket_write(tds->conn, tds, buffer + sent, buflen - sent);
+		if (len < 0)
+			return len;
+		sent += len;
 	}
 
 	return (int) sent;
@@ -1078,6 +1210,202 @@ tds_connection_write(TDSSOCKET *tds, const unsigned char *buf, int buflen, int f
 	return sent;
 }
 
+#if TDS_HAVE_WRITEV
+/**
+ * Write multiple buffers to an OS socket
+ * @returns 0 if blocking, <0 error >0 bytes written
+ */
+static int
+tds_socket_writev(TDSCONNECTION *conn, TDSSOCKET *tds, struct iovec *iov, int iovcnt)
+{
+	int err;
+	ssize_t len;
+	char *errstr;
+#if HAVE_SENDMSG
+	struct msghdr msg;
+#endif
+
+#if ENABLE_EXTRA_CHECKS
+	/* this simulate the fact that send can return less bytes */
+	size_t removed = 0;
+
+	if (iov[iovcnt - 1].iov_len >= 5) {
+		static int cnt = 0;
+		if (++cnt == 5) {
+			cnt = 0;
+			removed = 3;
+			iov[iovcnt - 1].iov_len -= removed;
+		}
+	}
+#endif
+
+#if HAVE_SENDMSG
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = iovcnt;
+	len = sendmsg(conn->s, &msg, TDS_NOSIGNAL);
+#else
+	len = writev(conn->s, iov, iovcnt);
+#endif
+#if ENABLE_EXTRA_CHECKS
+	iov[iovcnt - 1].iov_len += removed;
+#endif
+	++conn->stats.write_calls;
+	if (len > 0) {
+		conn->stats.bytes_sent += len;
+		return (int) len;
+	}
+
+	err = sock_errno;
+	if (0 == len || TDSSOCK_WOULDBLOCK(err))
+		return 0;
+
+	assert(len < 0);
+
+	/* detect connection close */
+	errstr = sock_strerror(err);
+	tdsdump_log(TDS_DBG_NETWORK, "sendmsg(2) failed: %d (%s)\n", err, errstr);
+	sock_strerror_free(errstr);
+	tds_connection_close(conn);
+	tdserror(conn->tds_ctx, tds, TDSEWRIT, err);
+	return -1;
+}
+#endif /* TDS_HAVE_WRITEV */
+
+#if ENABLE_ODBC_MARS
+/**
+ * Write a chain of packets to the server.
+ * If possible all packets are written with a single system call,
+ * otherwise only the first packet is written.
+ * \param tds the famous socket
+ * \param packet first packet to write
+ * \param num_packets number of packets of the chain to write
+ * \param pos bytes of first packet already written
+ * \param final 1 if there are no more data to send after these packets, else 0
+ * \return 0 if blocking, <0 on failure, >0 bytes written
+ */
+int
+tds_connection_write_packets(TDSSOCKET *tds, TDSPACKET *packet, unsigned num_packets, unsigned pos, int final)
+{
+#if TDS_HAVE_WRITEV
+	struct iovec iov[TDS_MAX_SEND_PACKETS];
+	TDSCONNECTION *conn = tds->conn;
+	int sent, iovcnt = 0;
+	size_t total = 0;
+
+#if !defined(_WIN32) && !defined(MSG_NOSIGNAL) && !defined(DOS32X) && (!defined(__APPLE__) || !defined(SO_NOSIGPIPE))
+	void (*oldsig) (int);
+#endif
+
+	assert(num_packets > 0 && num_packets <= TDS_MAX_SEND_PACKETS);
+
+	/* TLS encrypts each record separately, write single packet */
+	if (conn->tls_session || num_packets == 1)
+		return tds_connection_write(tds, packet->buf + packet->data_start + pos,
+					    packet->len - packet->data_start - pos, final && num_packets == 1);
+
+	for (; num_packets > 0; --num_packets, packet = packet->next) {
+		iov[iovcnt].iov_base = (void *) (packet->buf + packet->data_start + pos);
+		iov[iovcnt].iov_len = packet->len - packet->data_start - pos;
+		total += iov[iovcnt].iov_len;
+		++iovcnt;
+		pos = 0;
+	}
+
+#if !defined(_WIN32) && !defined(MSG_NOSIGNAL) && !defined(DOS32X) && (!defined(__APPLE__) || !defined(SO_NOSIGPIPE))
+	oldsig = signal(SIGPIPE, SIG_IGN);
+	if (oldsig == SIG_ERR) {
+		tdsdump_log(TDS_DBG_WARN, "TDS: Warning: Couldn't set SIGPIPE signal to be ignored\n");
+	}
+#endif
+
+	sent = tds_socket_writev(conn, tds, iov, iovcnt);
+
+	/* force packet flush */
+	if (final && sent >= (int) total)
+		tds_socket_flush(tds_get_s(tds));
+
+#if !defined(_WIN32) && !defined(MSG_NOSIGNAL) && !defined(DOS32X) && (!defined(__APPLE__) || !defined(SO_NOSIGPIPE))
+	if (signal(SIGPIPE, oldsig) == SIG_ERR) {
+		tdsdump_log(TDS_DBG_WARN, "TDS: Warning: Couldn't reset SIGPIPE signal to previous value\n");
+	}
+#endif
+	return sent;
+#else
+	return tds_connection_write(tds, packet->buf + packet->data_start + pos,
+				    packet->len - packet->data_start - pos, final && num_packets == 1);
+#endif
+}
+#elif TDS_HAVE_WRITEV
+/**
+ * Write a chain of packets to the server with a single system call,
+ * waiting till all data are written.
+ * Used without MARS to send packets queued by tds_write_packet.
+ * \param tds the famous socket
+ * \param packet first packet to write, at most TDS_MAX_SEND_PACKETS packets
+ * \param final 1 if there are no more data to send after these packets, else 0
+ * \return length written (>0), <0 on failure
+ */
+int
+tds_connection_write_chain(TDSSOCKET *tds, TDSPACKET *packet, int final)
+{
+	struct iovec iov[TDS_MAX_SEND_PACKETS], *first = iov;
+	TDSCONNECTION *conn = tds->conn;
+	int iovcnt = 0, len = 0;
+	size_t total = 0;
+
+#if !defined(_WIN32) && !defined(MSG_NOSIGNAL) && !defined(DOS32X) && (!defined(__APPLE__) || !defined(SO_NOSIGPIPE))
+	void (*oldsig) (int);
+#endif
+
+	for (; packet; packet = packet->next) {
+		assert(iovcnt < TDS_MAX_SEND_PACKETS);
+		iov[iovcnt].iov_base = (void *) (packet->buf + packet->data_start);
+		iov[iovcnt].iov_len = packet->len - packet->data_start;
+		total += iov[iovcnt].iov_len;
+		++iovcnt;
+	}
+
+#if !defined(_WIN32) && !defined(MSG_NOSIGNAL) && !defined(DOS32X) && (!defined(__APPLE__) || !defined(SO_NOSIGPIPE))
+	oldsig = signal(SIGPIPE, SIG_IGN);
+	if (oldsig == SIG_ERR) {
+		tdsdump_log(TDS_DBG_WARN, "TDS: Warning: Couldn't set SIGPIPE signal to be ignored\n");
+	}
+#endif
+
+	while (iovcnt > 0) {
+		len = tds_wait_write(tds);
+		if (len < 0)
+			break;
+		if (len == 0)
+			continue;
+
+		len = tds_socket_writev(conn, tds, first, iovcnt);
+		if (len < 0)
+			break;
+
+		/* skip data written */
+		for (; iovcnt > 0 && (size_t) len >= first->iov_len; --iovcnt, ++first)
+			len -= (int) first->iov_len;
+		if (iovcnt > 0) {
+			first->iov_base = (char *) first->iov_base + len;
+			first->iov_len -= len;
+		}
+	}
+
+	/* force packet flush */
+	if (final && iovcnt == 0)
+		tds_socket_flush(tds_get_s(tds));
+
+#if !defined(_WIN32) && !defined(MSG_NOSIGNAL) && !defined(DOS32X) && (!defined(__APPLE__) || !defined(SO_NOSIGPIPE))
+	if (signal(SIGPIPE, oldsig) == SIG_ERR) {
+		tdsdump_log(TDS_DBG_WARN, "TDS: Warning: Couldn't reset SIGPIPE signal to previous value\n");
+	}
+#endif
+	return len < 0 ? len : (int) total;
+}
+#endif /* TDS_HAVE_WRITEV */
+
 /**
  * Get port of all instances
  * @return default port number or 0 if error
@@ -87,6 +87,144 @@ tds_money_to_string(const TDS_MONEY * money, char *s)
 	return s;
 }
 
+#ifdef __SIZEOF_INT128__
+typedef unsigned __int128 TDS_NUMERIC_NATIVE;
+/** maximum number of digits always fitting in TDS_NUMERIC_NATIVE, 10^38 < 2^128 */
+#define TDS_NUMERIC_NATIVE_DIGITS 38
+#else
+typedef TDS_UINT8 TDS_NUMERIC_NATIVE;
+#define TDS_NUMERIC_NATIVE_DIGITS 19
+#endif
+
+static const TDS_UINT8 tds_pow10_uint8[20] = {
+	1u, 10u, 100u, 1000u, 10000u,
+	100000u, 1000000u, 10000000u, 100000000u, 1000000000u,
+	10000000000u, 100000000000u, 1000000000000u, 10000000000000u, 100000000000000u,
+	1000000000000000u, 10000000000000000u, 100000000000000000u, 1000000000000000000u,
+	10000000000000000000u
+};
+
+/** 10^n, n <= TDS_NUMERIC_NATIVE_DIGITS */
+static inline TDS_NUMERIC_NATIVE
+tds_pow10_native(unsigned int n)
+{
+#ifdef __SIZEOF_INT128__
+	if (n > 19)
+		return (TDS_NUMERIC_NATIVE) tds_pow10_uint8[19] * tds_pow10_uint8[n - 19];
+#endif
+	return tds_pow10_uint8[n];
+}
+
+/** decimal representation of numbers 0-99, two characters each */
+static const char tds_digit_pairs[201] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+/**
+ * Write decimal digits of n backward ending at end.
+ * @param min_digits minimum number of digits to write, padding with zeroes
+ * @return pointer to first digit written
+ */
+static char *
+tds_uint8_to_dec(TDS_UINT8 n, char *end, int min_digits)
+{
+	char *p = end;
+
+	while (n >= 100) {
+		unsigned int r = (unsigned int) (n % 100u);
+
+		n /= 100u;
+		p -= 2;
+		memcpy(p, tds_digit_pairs + 2 * r, 2);
+	}
+	if (n >= 10) {
+		p -= 2;
+		memcpy(p, tds_digit_pairs + 2 * n, 2);
+	} else {
+		*--p = (char) ('0' + n);
+	}
+	while (end - p < min_digits)
+		*--p = '0';
+	return p;
+}
+
+/**
+ * Convert a numeric fitting in 128 bits to string.
+ * @return false if the number is too big, nothing is written in this case
+ */
+static bool
+tds_numeric_to_string_fast(const TDS_NUMERIC * numeric, char *s)
+{
+	const unsigned char *number = numeric->array + 1;
+	int num_bytes = tds_numeric_bytes_per_prec[numeric->precision] - 1;
+	TDS_UINT8 hi = 0, lo = 0;
+	char digits[48], *const end = digits + sizeof(digits), *p;
+	size_t len;
+	int scale = numeric->scale;
+
+	/* bytes exceeding 128 bits must be zero */
+	for (; num_bytes > 16; --num_bytes, ++number)
+		if (*number)
+			return false;
+	for (; num_bytes > 8; --num_bytes)
+		hi = (hi << 8) | *number++;
+	for (; num_bytes > 0; --num_bytes)
+		lo = (lo << 8) | *number++;
+
+	if (!hi) {
+		p = tds_uint8_to_dec(lo, end, 1);
+	} else {
+#ifdef __SIZEOF_INT128__
+		const TDS_UINT8 e19 = tds_pow10_uint8[19];
+		TDS_NUMERIC_NATIVE n = ((TDS_NUMERIC_NATIVE) hi << 64) | lo;
+
+		/* split in 19 digit chunks, 2^128 has 39 digits */
+		p = tds_uint8_to_dec((TDS_UINT8) (n % e19), end, 19);
+		n /= e19;
+		if (n >> 64) {
+			p = tds_uint8_to_dec((TDS_UINT8) (n % e19), p, 19);
+			n /= e19;
+		}
+		p = tds_uint8_to_dec((TDS_UINT8) n, p, 1);
+#else
+		return false;
+#endif
+	}
+
+	if (numeric->array[0] == 1)
+		*s++ = '-';
+
+	/* integer part */
+	len = end - p;
+	if (len <= (size_t) scale) {
+		*s++ = '0';
+	} else {
+		memcpy(s, p, len - scale);
+		s += len - scale;
+		p += len - scale;
+		len = scale;
+	}
+
+	/* decimals, padded with zeroes */
+	if (scale) {
+		*s++ = '.';
+		memset(s, '0', scale - len);
+		s += scale - len;
+		memcpy(s, p, len);
+		s += len;
+	}
+	*s = 0;
+	return true;
+}
+
 /**
  * @return <0 if error
  */
@@ -114,6 +252,10 @@ tds_numeric_to_string(const TDS_NUMERIC * numeric, char *s)
 	if (numeric->precision < 1 || numeric->precision > MAXPRECISION || numeric->scale > numeric->precision)
 		return TDS_CONVERT_FAIL;
 
+	/* most numbers fit in 128 bits */
+	if (tds_numeric_to_string_fast(numeric, s))
+		return 1;
+
 	/* set sign */
 	if (numeric->array[0] == 1)
 		*s++ = '-';
@@ -237,6 +379,53 @@ tds_packet_check_overflow(TDS_WORD *packet, unsigned int packet_len, unsigned in
 	return 0;
 }
 
+/**
+ * Change precision and scale using native integers.
+ * @return 0 if number is too big for this method
+ */
+static TDS_INT
+tds_numeric_change_prec_scale_native(TDS_NUMERIC * numeric, unsigned int new_prec, unsigned int new_scale)
+{
+	const unsigned char *number = numeric->array + 1;
+	int bytes = tds_numeric_bytes_per_prec[numeric->precision] - 1;
+	int scale_diff = new_scale - numeric->scale;
+	TDS_NUMERIC_NATIVE n = 0;
+
+	if (new_prec > TDS_NUMERIC_NATIVE_DIGITS)
+		return 0;
+
+	/* bytes exceeding native size must be zero */
+	for (; bytes > (int) sizeof(n); --bytes, ++number)
+		if (*number)
+			return 0;
+	for (; bytes > 0; --bytes)
+		n = (n << 8) | *number++;
+
+	if (scale_diff >= 0) {
+		/* n * 10^scale_diff < 10^new_prec */
+		if (n >= tds_pow10_native(new_prec - scale_diff))
+			return TDS_CONVERT_OVERFLOW;
+		n *= tds_pow10_native(scale_diff);
+	} else {
+		/* n < 10^(TDS_NUMERIC_NATIVE_DIGITS+1) so result would be 0 */
+		if (-scale_diff > TDS_NUMERIC_NATIVE_DIGITS)
+			n = 0;
+		else
+			n /= tds_pow10_native(-scale_diff);
+		if (n >= tds_pow10_native(new_prec))
+			return TDS_CONVERT_OVERFLOW;
+	}
+
+	numeric->precision = new_prec;
+	numeric->scale = new_scale;
+	memset(numeric->array + 1, 0, sizeof(numeric->array) - 1);
+	bytes = tds_numeric_bytes_per_prec[new_prec];
+	for (; n; n >>= 8)
+		numeric->array[--bytes] = (unsigned char) n;
+
+	return sizeof(TDS_NUMERIC);
+}
+
 TDS_INT
 tds_numeric_change_prec_scale(TDS_NUMERIC * numeric, unsigned char new_prec, unsigned char new_scale)
 {
@@ -249,6 +438,7 @@ tds_numeric_change_prec_scale(TDS_NUMERIC * numeric, unsigned char new_prec, uns
 
 	unsigned int i, packet_len;
 	int scale_diff, bytes;
+	TDS_INT ret;
 
 	if (numeric->precision < 1 || numeric->precision > MAXPRECISION || numeric->scale > numeric->precision)
 		return TDS_CONVERT_FAIL;
@@ -267,6 +457,10 @@ tds_numeric_change_prec_scale(TDS_NUMERIC * numeric, unsigned char new_prec, uns
 		return sizeof(TDS_NUMERIC);
 	}
 
+	ret = tds_numeric_change_prec_scale_native(numeric, new_prec, new_scale);
+	if (ret)
+		return ret;
+
 	/* package number */
 	bytes = tds_numeric_bytes_per_prec[numeric->precision] - 1;
 	i = 0;
@@ -352,7 +546,7 @@ tds_numeric_change_prec_scale(TDS_NUMERIC * numeric, unsigned char new_prec, uns
 	numeric->precision = new_prec;
 	numeric->scale = new_scale;
 	bytes = tds_numeric_bytes_per_prec[numeric->precision] - 1;
-	for (i = bytes / sizeof(TDS_WORD); i >= packet_len; --i)
+	for (i = (bytes - 1) / sizeof(TDS_WORD); i >= packet_len; --i)
 		packet[i] = 0;
 	for (i = 0; bytes >= sizeof(TDS_WORD); bytes -= sizeof(TDS_WORD), ++i) {
 		TDS_PUT_UA4BE(&numeric->array[bytes-3], packet[i]);
@@ -60,72 +60,7 @@
 
 #if ENABLE_ODBC_MARS
 static TDSRET tds_update_recv_wnd(TDSSOCKET *tds, TDS_UINT new_recv_wnd);
-static short tds_packet_write(TDSCONNECTION *conn);
-
-/* get packet from the cache */
-static TDSPACKET *
-tds_get_packet(TDSCONNECTION *conn, unsigned len)
-{
-	TDSPACKET *packet, *to_free = NULL;
-
-	tds_mutex_lock(&conn->list_mtx);
-	while ((packet = conn->packet_cache) != NULL) {
-		--conn->num_cached_packets;
-		conn->packet_cache = packet->next;
-
-		/* return it */
-		if (packet->capacity >= len) {
-			TDS_MARK_UNDEFINED(packet->buf, packet->capacity);
-			packet->next = NULL;
-			packet->len = 0;
-			packet->sid = 0;
-			break;
-		}
-
-		/* discard packet if too small */
-		packet->next = to_free;
-		to_free = packet;
-	}
-	tds_mutex_unlock(&conn->list_mtx);
-
-	if (to_free)
-		tds_free_packets(to_free);
-
-	if (!packet)
-		packet = tds_alloc_packet(NULL, len);
-
-	return packet;
-}
-
-/* append packets in cached list. must have the lock! */
-static void
-tds_packet_cache_add(TDSCONNECTION *conn, TDSPACKET *packet)
-{
-	TDSPACKET *last;
-	unsigned count = 1;
-
-	assert(conn && packet);
-	tds_mutex_check_owned(&conn->list_mtx);
-
-	if (conn->num_cached_packets >= 8) {
-		tds_free_packets(packet);
-		return;
-	}
-
-	for (last = packet; last->next; last = last->next)
-		++count;
-
-	last->next = conn->packet_cache;
-	conn->packet_cache = packet;
-	conn->num_cached_packets += count;
-
-#if ENABLE_EXTRA_CHECKS
-	count = 0;
-	for (packet = conn->packet_cache; packet; packet = packet->next)
-		++count;
-	assert(count == conn->num_cached_packets);
-#endif
-}
+static int tds_packet_write(TDSCONNECTION *conn);
 
 /* read partial packet */
 static void
@@ -136,7 +71,7 @@ tds_packet_read(TDSCONNECTION *conn, TDSSOCKET *tds)
 
 	/* allocate some space to read data */
 	if (!packet) {
-		conn->recv_packet = packet = tds_get_packet(conn, MAX(conn->env.block_size + sizeof(TDS72_SMP_HEADER), 512));
+		conn->recv_packet = packet = tds_alloc_packet(NULL, MAX(conn->env.block_size + sizeof(TDS72_SMP_HEADER), 512));
 		if (!packet) goto Memory_Error;
 		TDS_MARK_UNDEFINED(packet->buf, packet->capacity);
 		conn->recv_pos = 0;
@@ -284,14 +219,19 @@ error:
 	tds_mutex_unlock(&conn->list_mtx);
 }
 
-static TDSPACKET*
-tds_build_packet(TDSSOCKET *tds, unsigned char *buf, unsigned len)
+/**
+ * Compute SMP headers to prepend to a TDS packet.
+ * \param tds  state information for the socket and the TDS protocol
+ * \param buf  TDS packet to send
+ * \param len  length of TDS packet
+ * \param mars where to store headers, must hold 2 headers
+ * \return number of bytes of headers
+ */
+static unsigned
+tds_build_smp_headers(TDSSOCKET *tds, const unsigned char *buf, unsigned len, TDS72_SMP_HEADER *mars)
 {
-	unsigned start;
-	TDS72_SMP_HEADER mars[2], *p;
-	TDSPACKET *packet;
+	TDS72_SMP_HEADER *p = mars;
 
-	p = mars;
 	if (buf[0] != TDS72_SMP && tds->conn->mars) {
 		/* allocate a new sid */
 		if (tds->sid == -1) {
@@ -321,9 +261,18 @@ tds_build_packet(TDSSOCKET *tds, unsigned char *buf, unsigned len)
 			p++;
 		}
 	}
+	return (p - mars) * sizeof(mars[0]);
+}
+
+static TDSPACKET*
+tds_build_packet(TDSSOCKET *tds, unsigned char *buf, unsigned len)
+{
+	unsigned start;
+	TDS72_SMP_HEADER mars[2];
+	TDSPACKET *packet;
 
-	start = (p - mars) * sizeof(mars[0]);
-	packet = tds_get_packet(tds->conn, len + start);
+	start = tds_build_smp_headers(tds, buf, len, mars);
+	packet = tds_alloc_packet(NULL, len + start);
 	if (TDS_LIKELY(packet)) {
 		packet->sid = tds->sid;
 		memcpy(packet->buf, mars, start);
@@ -333,6 +282,40 @@ tds_build_packet(TDSSOCKET *tds, unsigned char *buf, unsigned len)
 	return packet;
 }
 
+/**
+ * Take packet in output buffer for sending, replacing it with a new one.
+ * SMP headers are written in the space reserved before the TDS packet
+ * so data does not need to be copied.
+ * \param tds  state information for the socket and the TDS protocol
+ * \param left bytes after the packet to move to the new output buffer
+ * \return packet to send or NULL on failure
+ */
+static TDSPACKET*
+tds_take_send_packet(TDSSOCKET *tds, unsigned left)
+{
+	unsigned start;
+	TDS72_SMP_HEADER mars[2];
+	TDSPACKET *packet, *new_packet;
+
+	new_packet = tds_alloc_packet(NULL, tds->send_packet->capacity);
+	if (TDS_UNLIKELY(!new_packet)) {
+		memmove(tds->out_buf + 8, tds->out_buf + tds->out_buf_max, left);
+		return NULL;
+	}
+
+	start = tds_build_smp_headers(tds, tds->out_buf, tds->out_pos, mars);
+	packet = tds->send_packet;
+	packet->sid = tds->sid;
+	packet->data_start = TDS_SEND_HEADROOM - start;
+	packet->len = TDS_SEND_HEADROOM + tds->out_pos;
+	memcpy(packet->buf + packet->data_start, mars, start);
+
+	tds->send_packet = new_packet;
+	tds->out_buf = new_packet->buf + TDS_SEND_HEADROOM;
+	memcpy(tds->out_buf + 8, packet->buf + TDS_SEND_HEADROOM + tds->out_buf_max, left);
+	return packet;
+}
+
 static void
 tds_append_packet(TDSPACKET **p_packet, TDSPACKET *packet)
 {
@@ -366,6 +349,82 @@ tds_append_cancel(TDSSOCKET *tds)
 }
 
 
+/**
+ * Append a packet received completely to the packets of its session
+ * and wake up the session.
+ * Packets for unknown sessions and SMP control packets are freed.
+ * Lock must not be held.
+ */
+static void
+tds_connection_dispatch(TDSCONNECTION *conn, TDSPACKET *packet)
+{
+	TDSSOCKET *s;
+
+	tdsdump_dump_buf(TDS_DBG_NETWORK, "Received packet", packet->buf, packet->len);
+
+	tds_mutex_lock(&conn->list_mtx);
+	if (packet->sid >= 0 && packet->sid < conn->num_sessions) {
+		s = conn->sessions[packet->sid];
+		if (TDSSOCKET_VALID(s)) {
+			/* append to correct session */
+			if (packet->buf[0] == TDS72_SMP && packet->buf[1] != TDS_SMP_DATA)
+				tds_free_packets(packet);
+			else
+				tds_append_packet(&conn->packets, packet);
+			packet = NULL;
+			/* notify */
+			tds_cond_signal(&s->packet_cond);
+		}
+	}
+	tds_mutex_unlock(&conn->list_mtx);
+	tds_free_packets(packet);
+}
+
+/**
+ * Dispatch packets already received by the connection without blocking.
+ * Data are read from the socket only if available, partial packets are
+ * left in conn->recv_packet to be completed by tds_connection_network.
+ * Network must be owned (conn->in_net_tds), lock must not be held.
+ * With TLS only data already decrypted are dispatched, reading a
+ * partial record would block.
+ * \return true if reading should be tried anyway, to report an error or
+ *         end of file or to decrypt TLS data received
+ */
+static bool
+tds_connection_dispatch_buffered(TDSCONNECTION *conn, TDSSOCKET *tds)
+{
+	bool error;
+
+	error = tds_connection_fill(conn) && !tds_connection_has_packet(conn);
+
+	while (conn->tls_session ? tds_ssl_pending(conn) > 0 : tds_connection_buffered(conn) > 0) {
+		TDSPACKET *packet;
+
+		tds_packet_read(conn, tds);
+		packet = conn->recv_packet;
+		if (!packet)
+			return true;
+		if (conn->recv_pos < packet->len)
+			continue;
+		conn->recv_packet = NULL;
+		conn->recv_pos = 0;
+
+		tds_connection_dispatch(conn, packet);
+	}
+	return error || (conn->tls_session && tds_connection_buffered(conn) > 0);
+}
+
+static bool
+tds_session_has_packet(TDSCONNECTION *conn, short sid)
+{
+	const TDSPACKET *packet;
+
+	for (packet = conn->packets; packet; packet = packet->next)
+		if (packet->sid == sid)
+			return true;
+	return false;
+}
+
 static void
 tds_connection_network(TDSCONNECTION *conn, TDSSOCKET *tds, int send)
 {
@@ -404,18 +463,9 @@ tds_connection_network(TDSCONNECTION *conn, TDSSOCKET *tds, int send)
 		 */
 		/* something to send */
 		if (conn->send_packets && (rc & POLLOUT) != 0) {
-			TDSSOCKET *s;
+			if (tds_packet_write(conn))
+				break;	/* return to caller */
 
-			short sid = tds_packet_write(conn);
-			if (sid == tds->sid) break;	/* return to caller */
-
-			tds_mutex_lock(&conn->list_mtx);
-			if (sid >= 0 && sid < conn->num_sessions) {
-				s = conn->sessions[sid];
-				if (TDSSOCKET_VALID(s))
-					tds_cond_signal(&s->packet_cond);
-			}
-			tds_mutex_unlock(&conn->list_mtx);
 			/* avoid using a possible closed connection */
 			continue;
 		}
@@ -423,7 +473,6 @@ tds_connection_network(TDSCONNECTION *conn, TDSSOCKET *tds, int send)
 		/* received */
 		if (rc & POLLIN) {
 			TDSPACKET *packet;
-			TDSSOCKET *s;
 
 			/* try to read a packet */
 			tds_packet_read(conn, tds);
@@ -432,24 +481,7 @@ tds_connection_network(TDSCONNECTION *conn, TDSSOCKET *tds, int send)
 			conn->recv_packet = NULL;
 			conn->recv_pos = 0;
 
-			tdsdump_dump_buf(TDS_DBG_NETWORK, "Received packet", packet->buf, packet->len);
-
-			tds_mutex_lock(&conn->list_mtx);
-			if (packet->sid >= 0 && packet->sid < conn->num_sessions) {
-				s = conn->sessions[packet->sid];
-				if (TDSSOCKET_VALID(s)) {
-					/* append to correct session */
-					if (packet->buf[0] == TDS72_SMP && packet->buf[1] != TDS_SMP_DATA)
-						tds_packet_cache_add(conn, packet);
-					else
-						tds_append_packet(&conn->packets, packet);
-					packet = NULL;
-					/* notify */
-					tds_cond_signal(&s->packet_cond);
-				}
-			}
-			tds_mutex_unlock(&conn->list_mtx);
-			tds_free_packets(packet);
+			tds_connection_dispatch(conn, packet);
 			/* if we are receiving return the packet */
 			if (!send) break;
 		}
@@ -459,8 +491,29 @@ tds_connection_network(TDSCONNECTION *conn, TDSSOCKET *tds, int send)
 	conn->in_net_tds = NULL;
 }
 
+/**
+ * Check if a packet can be queued instead of being sent immediately.
+ * Without MARS the packets of a request are sent together with the last
+ * one, so a large RPC or bulk insert needs fewer system calls.
+ * TLS encrypts every packet separately, nothing would be gained.
+ * Lock must be held.
+ */
+static bool
+tds_connection_defer_packet(TDSCONNECTION *conn, int final)
+{
+	const TDSPACKET *packet;
+	unsigned num_packets = 1;
+
+	if (final || conn->mars || conn->in_net_tds || conn->tls_session || conn->encrypt_single_packet)
+		return false;
+	for (packet = conn->send_packets; packet; packet = packet->next)
+		if (++num_packets >= TDS_MAX_SEND_PACKETS)
+			return false;
+	return true;
+}
+
 static int
-tds_connection_put_packet(TDSSOCKET *tds, TDSPACKET *packet)
+tds_connection_put_packet(TDSSOCKET *tds, TDSPACKET *packet, int final)
 {
 	TDSCONNECTION *conn = tds->conn;
 
@@ -471,6 +524,11 @@ tds_connection_put_packet(TDSSOCKET *tds, TDSPACKET *packet)
 	tds->out_pos = 0;
 
 	tds_mutex_lock(&conn->list_mtx);
+	if (tds_connection_defer_packet(conn, final) && !IS_TDSDEAD(tds)) {
+		tds_append_packet(&conn->send_packets, packet);
+		tds_mutex_unlock(&conn->list_mtx);
+		return TDS_SUCCESS;
+	}
 	for (;;) {
 		int wait_res;
 
@@ -519,6 +577,224 @@ tds_connection_put_packet(TDSSOCKET *tds, TDSPACKET *packet)
 }
 #endif /* ENABLE_ODBC_MARS */
 
+/**
+ * Receive data already available from the server without blocking.
+ * With MARS the network is used only if no other session owns it,
+ * packets received are dispatched to their sessions like
+ * tds_connection_network does.
+ * \tds
+ * \param error set if an error or end of file should be reported reading
+ * \return true if a packet for this session is available
+ */
+static bool
+tds_receive_available(TDSSOCKET *tds, bool *error)
+{
+	TDSCONNECTION *conn = tds->conn;
+#if ENABLE_ODBC_MARS
+	bool found;
+
+	*error = false;
+	tds_mutex_lock(&conn->list_mtx);
+	if (!conn->in_net_tds && !IS_TDSDEAD(tds)) {
+		int n;
+
+		conn->in_net_tds = tds;
+		tds_mutex_unlock(&conn->list_mtx);
+		*error = tds_connection_dispatch_buffered(conn, tds);
+		tds_mutex_lock(&conn->list_mtx);
+		conn->in_net_tds = NULL;
+
+		/* sessions waiting for the network can use it now */
+		for (n = 0; n < conn->num_sessions; ++n)
+			if (TDSSOCKET_VALID(conn->sessions[n]) && conn->sessions[n] != tds)
+				tds_cond_signal(&conn->sessions[n]->packet_cond);
+	}
+	found = tds_session_has_packet(conn, tds->sid);
+	tds_mutex_unlock(&conn->list_mtx);
+	return found;
+#else
+	*error = tds_connection_fill(conn) && !tds_connection_has_packet(conn);
+	return tds_connection_has_packet(conn);
+#endif
+}
+
+/**
+ * Check if some data can be read without blocking.
+ * Data can be available in the current packet or in a packet already
+ * received from the server.
+ * For MARS sessions the network is checked only if not used by another
+ * session, packets of other sessions could be received first so reading
+ * can still block.
+ */
+bool
+tds_data_available(TDSSOCKET *tds)
+{
+	bool error;
+
+	if (tds->in_pos < tds->in_len)
+		return true;
+
+	if (TDS_IS_SOCKET_INVALID(tds_get_s(tds)))
+		return true;
+
+#if !ENABLE_ODBC_MARS
+	if (tds_connection_has_packet(tds->conn))
+		return true;
+#endif
+
+	return tds_receive_available(tds, &error) || error;
+}
+
+/**
+ * Walk data received for the session but not still read.
+ * Data left in the current packet are followed by data of the packets
+ * already received completely, without headers.
+ * \tds
+ * \param dst  where to copy data, NULL to count them only; counting
+ *             data are also received from the server if available
+ * \param max  maximum number of bytes to copy in dst
+ * \param last set if no more data can be received before these are read,
+ *             as they contain the end of the response, an error must be
+ *             reported or buffers are full
+ * \return number of bytes available (copied if dst is not NULL)
+ */
+static size_t
+tds_buffered_walk(TDSSOCKET *tds, unsigned char *dst, size_t max, bool *last)
+{
+	TDSCONNECTION *conn = tds->conn;
+	const unsigned left = tds->in_pos < tds->in_len ? tds->in_len - tds->in_pos : 0;
+	size_t size, n;
+	bool final = left > 0 && (tds->in_buf[1] & 1) != 0;
+	bool error, full;
+#if ENABLE_ODBC_MARS
+	const TDSPACKET *packet;
+	unsigned hdr_size;
+#else
+	const unsigned char *end;
+	unsigned pkt_len;
+#endif
+	const unsigned char *p;
+
+	error = TDS_IS_SOCKET_INVALID(tds_get_s(tds));
+	if (!dst && !final && !error)
+		tds_receive_available(tds, &error);
+
+	size = left;
+	if (dst) {
+		size = left < max ? left : max;
+		memcpy(dst, tds->in_buf + tds->in_pos, size);
+	}
+
+#if ENABLE_ODBC_MARS
+	tds_mutex_lock(&conn->list_mtx);
+	full = conn->mars && tds->recv_seq >= tds->recv_wnd;
+	for (packet = conn->packets; packet && !final; packet = packet->next) {
+		if (packet->sid != tds->sid)
+			continue;
+		hdr_size = packet->buf[0] == TDS72_SMP ? sizeof(TDS72_SMP_HEADER) : 0;
+		p = packet->buf + hdr_size;
+		n = packet->len - hdr_size - 8;
+		if (dst) {
+			if (size >= max)
+				break;
+			if (n > max - size)
+				n = max - size;
+			memcpy(dst + size, p + 8, n);
+		}
+		size += n;
+		final = (p[1] & 1) != 0;
+	}
+	tds_mutex_unlock(&conn->list_mtx);
+#else
+	/* with TLS received data are encrypted, only current packet is known */
+	if (conn->tls_session) {
+		final = true;
+	} else if (conn->recv_buf) {
+		p = conn->recv_buf + conn->recv_buf_pos;
+		end = conn->recv_buf + conn->recv_buf_len;
+		for (; !final && end - p >= 8; p += pkt_len) {
+			pkt_len = TDS_GET_A2BE(p + 2);
+			if (pkt_len < 8 || end - p < pkt_len) {
+				/* let reading report the error */
+				error = error || pkt_len < 8;
+				break;
+			}
+			n = pkt_len - 8;
+			if (dst) {
+				if (size >= max)
+					break;
+				if (n > max - size)
+					n = max - size;
+				memcpy(dst + size, p + 8, n);
+			}
+			size += n;
+			final = (p[1] & 1) != 0;
+		}
+	}
+	full = tds_connection_buffered(conn) >= TDS_RECV_BUF_SIZE;
+#endif
+
+	*last = final || error || full;
+	return size;
+}
+
+/**
+ * Count data received for the session but not still read, without
+ * copying them.
+ * Data are received from the server if available, see tds_data_available.
+ * \tds
+ * \param last set if no more data can be received before these are read,
+ *             see tds_buffered_data
+ * \return number of bytes available
+ */
+size_t
+tds_buffered_size(TDSSOCKET *tds, bool *last)
+{
+	return tds_buffered_walk(tds, NULL, 0, last);
+}
+
+/**
+ * Copy data received for the session but not still read.
+ * Data left in the current packet are followed by data of the packets
+ * already received completely, without headers, so the caller can check
+ * if a whole token can be read without blocking.
+ * Data are received from the server if available, see tds_data_available.
+ * \tds
+ * \param len  set to the number of bytes returned
+ * \param last set if no more data can be received before these are read,
+ *             as they contain the end of the response, an error must be
+ *             reported or buffers are full
+ * \return data to free with free(), NULL on memory error
+ */
+unsigned char *
+tds_buffered_data(TDSSOCKET *tds, size_t *len, bool *last)
+{
+	unsigned char *buf;
+	size_t size;
+	bool dummy;
+
+	size = tds_buffered_walk(tds, NULL, 0, last);
+	buf = (unsigned char *) malloc(size ? size : 1);
+	if (!buf)
+		return NULL;
+	*len = tds_buffered_walk(tds, buf, size, &dummy);
+	return buf;
+}
+
+/**
+ * Make values of current row not depend on the received packet,
+ * in_buf is going to be replaced.
+ * Skipped values are read first as they can be read pointing to the packet.
+ */
+static inline void
+tds_release_packet_values(TDSSOCKET * tds)
+{
+	if (tds->skipped_values)
+		tds_load_skipped_columns(tds);
+	if (tds->current_results)
+		tds_unpin_row_data(tds->current_results);
+}
+
 /**
  * Read in one 'packet' from the server.  This is a wrapped outer packet of
  * the protocol (they bundle result packets into chunks and wrap them at
@@ -532,6 +808,8 @@ tds_read_packet(TDSSOCKET * tds)
 #if ENABLE_ODBC_MARS
 	TDSCONNECTION *conn = tds->conn;
 
+	tds_release_packet_values(tds);
+
 	tds_mutex_lock(&conn->list_mtx);
 
 	for (;;) {
@@ -554,7 +832,7 @@ tds_read_packet(TDSSOCKET * tds)
 			/* remove our packet from list */
 			TDSPACKET *packet = *p_packet;
 			*p_packet = packet->next;
-			tds_packet_cache_add(conn, tds->recv_packet);
+			tds_free_packets(tds->recv_packet);
 			tds_mutex_unlock(&conn->list_mtx);
 
 			packet->next = NULL;
@@ -565,6 +843,9 @@ tds_read_packet(TDSSOCKET * tds)
 			tds->in_len = packet->len - hdr_size;
 			tds->in_pos  = 8;
 			tds->in_flag = tds->in_buf[0];
+			++tds->in_packets;
+			++conn->stats.packets_received;
+			tds_capture_packet(conn, 0, tds->in_buf, tds->in_len);
 
 			/* send acknowledge if needed */
 			if (tds->recv_seq + 2 >= tds->recv_wnd)
@@ -594,6 +875,8 @@ tds_read_packet(TDSSOCKET * tds)
 #else /* !ENABLE_ODBC_MARS */
 	unsigned char *pkt = tds->in_buf, *p, *end;
 
+	tds_release_packet_values(tds);
+
 	if (IS_TDSDEAD(tds)) {
 		tdsdump_log(TDS_DBG_NETWORK, "Read attempt when state is TDS_DEAD");
 		return -1;
@@ -637,7 +920,10 @@ tds_read_packet(TDSSOCKET * tds)
 	/* Set the length and pos (not sure what pos is used for now */
 	tds->in_len = p - pkt;
 	tds->in_pos = 8;
+	++tds->in_packets;
+	++tds->conn->stats.packets_received;
 	tdsdump_dump_buf(TDS_DBG_NETWORK, "Received packet", tds->in_buf, tds->in_len);
+	tds_capture_packet(tds->conn, 0, tds->in_buf, tds->in_len);
 
 	return tds->in_len;
 #endif /* !ENABLE_ODBC_MARS */
@@ -653,7 +939,7 @@ tds_update_recv_wnd(TDSSOCKET *tds, TDS_UINT new_recv_wnd)
 	if (!tds->conn->mars || tds->sid < 0)
 		return TDS_SUCCESS;
 
-	packet = tds_get_packet(tds->conn, sizeof(*mars));
+	packet = tds_alloc_packet(NULL, sizeof(*mars));
 	if (!packet)
 		return TDS_FAIL;	/* TODO check result */
 
@@ -693,7 +979,6 @@ tds_append_fin(TDSSOCKET *tds)
 	tds->recv_wnd = tds->recv_seq + 4;
 	TDS_PUT_A4LE(&mars.wnd, tds->recv_wnd);
 
-	/* do not use tds_get_packet as it require no lock ! */
 	packet = tds_alloc_packet(&mars, sizeof(mars));
 	if (!packet)
 		return TDS_FAIL;	/* TODO check result */
@@ -711,6 +996,89 @@ tds_append_fin(TDSSOCKET *tds)
 }
 #endif /* ENABLE_ODBC_MARS */
 
+#if !ENABLE_ODBC_MARS && TDS_HAVE_WRITEV
+/**
+ * Check if packets can be queued instead of being sent immediately.
+ * TLS encrypts every packet separately, nothing would be gained.
+ */
+static inline bool
+tds_can_queue_packet(TDSCONNECTION *conn)
+{
+	return !conn->tls_session && !conn->encrypt_single_packet;
+}
+
+/**
+ * Send queued packets with a single system call.
+ * \tds
+ * \param last   packet to send after the queued ones, not freed, can be NULL
+ * \param final  1 if there are no more data to send after these packets, else 0
+ */
+static TDSRET
+tds_send_queued_packets(TDSSOCKET * tds, TDSPACKET * last, int final)
+{
+	TDSCONNECTION *conn = tds->conn;
+	TDSPACKET **p_last;
+	unsigned num_packets = conn->num_send_packets + (last ? 1 : 0);
+	int sent;
+
+	for (p_last = &conn->send_packets; *p_last; p_last = &(*p_last)->next)
+		continue;
+	*p_last = last;
+	sent = tds_connection_write_chain(tds, conn->send_packets, final);
+	*p_last = NULL;
+
+	tds_free_packets(conn->send_packets);
+	conn->send_packets = NULL;
+	conn->num_send_packets = 0;
+
+	if (sent <= 0)
+		return TDS_FAIL;
+	conn->stats.packets_sent += num_packets;
+	return TDS_SUCCESS;
+}
+
+/**
+ * Queue packet in output buffer replacing the output buffer with a new one.
+ * Without MARS the packets of a request are sent together with the last
+ * one, so a large RPC or bulk insert needs fewer system calls.
+ * Queued packets are sent when the request is complete or when
+ * TDS_MAX_SEND_PACKETS packets are queued.
+ * \tds
+ * \param final 1 if this is the last packet of the request, else 0
+ * \param left  bytes after the packet to move to the new output buffer
+ */
+static TDSRET
+tds_queue_packet(TDSSOCKET * tds, int final, unsigned left)
+{
+	TDSCONNECTION *conn = tds->conn;
+	TDSPACKET *packet = tds->send_packet, *new_packet, **p_last;
+	TDSRET res;
+
+	packet->data_start = 0;
+	packet->len = tds->out_pos;
+
+	if (!final && conn->num_send_packets + 1 < TDS_MAX_SEND_PACKETS) {
+		new_packet = tds_alloc_packet(NULL, packet->capacity);
+		if (new_packet) {
+			tds->send_packet = new_packet;
+			tds->out_buf = new_packet->buf;
+			memcpy(tds->out_buf + 8, packet->buf + tds->out_buf_max, left);
+			packet->next = NULL;
+			for (p_last = &conn->send_packets; *p_last; p_last = &(*p_last)->next)
+				continue;
+			*p_last = packet;
+			++conn->num_send_packets;
+			return TDS_SUCCESS;
+		}
+	}
+
+	res = tds_send_queued_packets(tds, packet, final);
+#if TDS_ADDITIONAL_SPACE != 0
+	memcpy(tds->out_buf + 8, tds->out_buf + tds->out_buf_max, left);
+#endif
+	return res;
+}
+#endif /* !ENABLE_ODBC_MARS && TDS_HAVE_WRITEV */
 
 TDSRET
 tds_write_packet(TDSSOCKET * tds, unsigned char final)
@@ -737,13 +1105,24 @@ tds_write_packet(TDSSOCKET * tds, unsigned char final)
 		tds->out_buf[6] = 0x01;
 
 #if ENABLE_ODBC_MARS
-	res = tds_connection_put_packet(tds, tds_build_packet(tds, tds->out_buf, tds->out_pos));
+	res = tds_connection_put_packet(tds, tds_take_send_packet(tds, left), final);
 #else /* !ENABLE_ODBC_MARS */
 	tdsdump_dump_buf(TDS_DBG_NETWORK, "Sending packet", tds->out_buf, tds->out_pos);
+	tds_capture_packet(tds->conn, 1, tds->out_buf, tds->out_pos);
+
+#if TDS_HAVE_WRITEV
+	if (tds->conn->send_packets || (!final && tds_can_queue_packet(tds->conn))) {
+		res = tds_queue_packet(tds, final, left);
+		tds->out_pos = left + 8;
+		return res;
+	}
+#endif
 
 	/* GW added in check for write() returning <0 and SIGPIPE checking */
 	res = tds_connection_write(tds, tds->out_buf, tds->out_pos, final) <= 0 ?
 		TDS_FAIL : TDS_SUCCESS;
+	if (TDS_SUCCEED(res))
+		++tds->conn->stats.packets_sent;
 #endif /* !ENABLE_ODBC_MARS */
 
 	if (TDS_UNLIKELY(tds->conn->encrypt_single_packet)) {
@@ -751,7 +1130,7 @@ tds_write_packet(TDSSOCKET * tds, unsigned char final)
 		tds_ssl_deinit(tds->conn);
 	}
 
-#if TDS_ADDITIONAL_SPACE != 0
+#if TDS_ADDITIONAL_SPACE != 0 && !ENABLE_ODBC_MARS
 	memcpy(tds->out_buf + 8, tds->out_buf + tds->out_buf_max, left);
 #endif
 	tds->out_pos = left + 8;
@@ -775,11 +1154,20 @@ tds_put_cancel(TDSSOCKET * tds)
 		out_buf[6] = 0x01;
 
 	tdsdump_dump_buf(TDS_DBG_NETWORK, "Sending packet", out_buf, 8);
+	tds_capture_packet(tds->conn, 1, out_buf, 8);
+
+#if TDS_HAVE_WRITEV
+	/* packets of the request must be sent before the cancel */
+	if (tds->conn->send_packets && TDS_FAILED(tds_send_queued_packets(tds, NULL, 0)))
+		return TDS_FAIL;
+#endif
 
 	sent = tds_connection_write(tds, out_buf, 8, 1);
 
-	if (sent > 0)
+	if (sent > 0) {
 		tds->in_cancel = 2;
+		++tds->conn->stats.packets_sent;
+	}
 
 	/* GW added in check for write() returning <0 and SIGPIPE checking */
 	return sent <= 0 ? TDS_FAIL : TDS_SUCCESS;
@@ -788,53 +1176,102 @@ tds_put_cancel(TDSSOCKET * tds)
 
 
 #if ENABLE_ODBC_MARS
-static short
-tds_packet_write(TDSCONNECTION *conn)
+/* check if packet is the last one of a TDS request */
+static int
+tds_packet_final(const TDSPACKET *packet)
 {
-	int sent;
-	int final;
-	TDSPACKET *packet = conn->send_packets;
+	const unsigned char *p = packet->buf + packet->data_start;
+	unsigned len = packet->len - packet->data_start;
 
-	assert(packet);
+	/* skip SMP headers */
+	while (len >= sizeof(TDS72_SMP_HEADER) && p[0] == TDS72_SMP) {
+		p += sizeof(TDS72_SMP_HEADER);
+		len -= sizeof(TDS72_SMP_HEADER);
+	}
+	if (len >= 2)
+		return p[1] & 1;
+	return 1;
+}
 
-	if (conn->send_pos == 0)
-		tdsdump_dump_buf(TDS_DBG_NETWORK, "Sending packet", packet->buf, packet->len);
+/**
+ * Capture a packet sent, without SMP headers.
+ * SMP control packets are not captured.
+ */
+static void
+tds_capture_smp_packet(TDSCONNECTION *conn, const TDSPACKET *packet)
+{
+	const unsigned char *p = packet->buf + packet->data_start;
+	const unsigned char *end = packet->buf + packet->len;
+
+	while (end - p >= (int) sizeof(TDS72_SMP_HEADER) && p[0] == TDS72_SMP)
+		p += sizeof(TDS72_SMP_HEADER);
+	if (end - p >= 8)
+		tds_capture_packet(conn, 1, p, end - p);
+}
+
+/**
+ * Write queued packets.
+ * Multiple packets are written together to reduce the number of system calls.
+ * Sessions owning packets sent completely are signaled.
+ * \return 1 if a packet of the session doing network was sent, 0 otherwise
+ */
+static int
+tds_packet_write(TDSCONNECTION *conn)
+{
+	int sent, final, own_sent = 0;
+	unsigned num_packets, len;
+	TDSPACKET *packet, *last;
+	TDSSOCKET *tds = conn->in_net_tds, *s;
 
-	/* take into account other session packets */
-	if (packet->next != NULL)
-		final = 0;
-	/* take into account other packets for this session */
-	else if (packet->buf[0] != TDS72_SMP)
-		final = packet->buf[1] & 1;
-	else if (packet->len >= sizeof(TDS72_SMP_HEADER) + 2)
-		final = packet->buf[sizeof(TDS72_SMP_HEADER) + 1] & 1;
-	else
-		final = 1;
+	/* collect packets to send, only we remove packets from the queue */
+	tds_mutex_lock(&conn->list_mtx);
+	packet = conn->send_packets;
+	assert(packet);
+	for (num_packets = 1, last = packet; last->next && num_packets < TDS_MAX_SEND_PACKETS; ++num_packets)
+		last = last->next;
+	/* take into account other packets */
+	final = last->next ? 0 : tds_packet_final(last);
+	tds_mutex_unlock(&conn->list_mtx);
 
-	sent = tds_connection_write(conn->in_net_tds, packet->buf + conn->send_pos,
-				    packet->len - conn->send_pos, final);
+	sent = tds_connection_write_packets(tds, packet, num_packets, conn->send_pos, final);
 
 	if (TDS_UNLIKELY(sent < 0)) {
 		/* TODO tdserror called ?? */
 		tds_connection_close(conn);
-		return -1;
+		return 0;
 	}
 
-	/* update sent data */
-	conn->send_pos += sent;
-	/* remove packet if sent all data */
-	if (conn->send_pos >= packet->len) {
-		short sid = packet->sid;
-		tds_mutex_lock(&conn->list_mtx);
+	/* remove packets sent completely */
+	sent += conn->send_pos;
+	tds_mutex_lock(&conn->list_mtx);
+	for (; num_packets > 0; --num_packets) {
+		len = packet->len - packet->data_start;
+		if ((unsigned) sent < len)
+			break;
+		sent -= len;
+
+		tdsdump_dump_buf(TDS_DBG_NETWORK, "Sending packet", packet->buf + packet->data_start, len);
+		++conn->stats.packets_sent;
+		if (TDS_UNLIKELY(tds_capture_enabled))
+			tds_capture_smp_packet(conn, packet);
+
+		if (packet->sid == tds->sid) {
+			own_sent = 1;
+		} else if (packet->sid >= 0 && packet->sid < conn->num_sessions) {
+			s = conn->sessions[packet->sid];
+			if (TDSSOCKET_VALID(s))
+				tds_cond_signal(&s->packet_cond);
+		}
+
 		conn->send_packets = packet->next;
 		packet->next = NULL;
-		tds_packet_cache_add(conn, packet);
-		tds_mutex_unlock(&conn->list_mtx);
-		conn->send_pos = 0;
-		return sid;
+		tds_free_packets(packet);
+		packet = conn->send_packets;
 	}
+	conn->send_pos = sent;
+	tds_mutex_unlock(&conn->list_mtx);
 
-	return -1;
+	return own_sent;
 }
 #endif /* ENABLE_ODBC_MARS */
 
@@ -0,0 +1,350 @@
+/* FreeTDS - Library of routines accessing Sybase and Microsoft databases
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <config.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <assert.h>
+
+#if HAVE_ERRNO_H
+#include <errno.h>
+#endif /* HAVE_ERRNO_H */
+
+#if HAVE_STDLIB_H
+#include <stdlib.h>
+#endif /* HAVE_STDLIB_H */
+
+#if HAVE_STRING_H
+#include <string.h>
+#endif /* HAVE_STRING_H */
+
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+
+#if HAVE_POLL_H
+#include <poll.h>
+#endif /* HAVE_POLL_H */
+
+#if HAVE_SYS_EPOLL_H && HAVE_EPOLL_CREATE1
+#include <sys/epoll.h>
+#define USE_EPOLL 1
+#endif
+
+#include <freetds/tds.h>
+#include "replacements.h"
+
+#undef MIN
+#define MIN(a,b) (((a) < (b)) ? (a) : (b))
+
+/**
+ * \addtogroup network
+ * @{
+ */
+
+/**
+ * Wait for packets on many sockets using a single thread.
+ * On Linux epoll is used, otherwise poll.
+ */
+struct tds_reactor
+{
+	/** registered sockets */
+	TDSSOCKET **sockets;
+	unsigned num_sockets;
+	TDSPOLLWAKEUP wakeup;
+#if USE_EPOLL
+	int epoll_fd;
+	struct epoll_event *events;
+#else
+	struct pollfd *fds;
+#endif
+};
+
+/**
+ * Allocate a new reactor.
+ * \return new reactor or NULL on failure
+ */
+TDSREACTOR *
+tds_reactor_alloc(void)
+{
+	TDSREACTOR *reactor = tds_new0(TDSREACTOR, 1);
+
+	if (!reactor)
+		return NULL;
+
+#if USE_EPOLL
+	reactor->epoll_fd = -1;
+	reactor->events = tds_new(struct epoll_event, 1);
+	if (!reactor->events) {
+		free(reactor);
+		return NULL;
+	}
+#else
+	reactor->fds = tds_new(struct pollfd, 1);
+	if (!reactor->fds) {
+		free(reactor);
+		return NULL;
+	}
+#endif
+	if (tds_wakeup_init(&reactor->wakeup)) {
+#if USE_EPOLL
+		free(reactor->events);
+#else
+		free(reactor->fds);
+#endif
+		free(reactor);
+		return NULL;
+	}
+
+#if USE_EPOLL
+	reactor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (reactor->epoll_fd < 0) {
+		tds_reactor_free(reactor);
+		return NULL;
+	}
+	{
+		struct epoll_event ev;
+
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.ptr = NULL;
+		if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, tds_wakeup_get_fd(&reactor->wakeup), &ev) < 0) {
+			tds_reactor_free(reactor);
+			return NULL;
+		}
+	}
+#endif
+	return reactor;
+}
+
+/**
+ * Free a reactor.
+ * Registered sockets are not closed.
+ */
+void
+tds_reactor_free(TDSREACTOR *reactor)
+{
+	if (!reactor)
+		return;
+
+#if USE_EPOLL
+	if (reactor->epoll_fd >= 0)
+		close(reactor->epoll_fd);
+	free(reactor->events);
+#else
+	free(reactor->fds);
+#endif
+	tds_wakeup_close(&reactor->wakeup);
+	free(reactor->sockets);
+	free(reactor);
+}
+
+/**
+ * Register a socket.
+ * Connections using MARS sessions cannot be registered as the same
+ * network connection is shared by multiple sockets.
+ * \param reactor reactor
+ * \param tds socket to watch
+ * \return TDS_SUCCESS or TDS_FAIL
+ */
+TDSRET
+tds_reactor_add(TDSREACTOR *reactor, TDSSOCKET *tds)
+{
+	unsigned n = reactor->num_sockets;
+
+	assert(tds);
+	if (TDS_IS_SOCKET_INVALID(tds_get_s(tds)))
+		return TDS_FAIL;
+#if ENABLE_ODBC_MARS
+	if (tds->conn->mars)
+		return TDS_FAIL;
+#endif
+
+	if (!TDS_RESIZE(reactor->sockets, n + 1))
+		return TDS_FAIL;
+#if USE_EPOLL
+	if (!TDS_RESIZE(reactor->events, n + 2))
+		return TDS_FAIL;
+	{
+		struct epoll_event ev;
+
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.ptr = tds;
+		if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, tds_get_s(tds), &ev) < 0)
+			return TDS_FAIL;
+	}
+#else
+	if (!TDS_RESIZE(reactor->fds, n + 2))
+		return TDS_FAIL;
+#endif
+
+	reactor->sockets[n] = tds;
+	reactor->num_sockets = n + 1;
+	return TDS_SUCCESS;
+}
+
+/**
+ * Unregister a socket.
+ * Must be called before closing the socket.
+ * \return TDS_SUCCESS or TDS_FAIL if socket was not registered
+ */
+TDSRET
+tds_reactor_remove(TDSREACTOR *reactor, TDSSOCKET *tds)
+{
+	unsigned n;
+
+	for (n = 0; n < reactor->num_sockets; ++n)
+		if (reactor->sockets[n] == tds)
+			break;
+	if (n >= reactor->num_sockets)
+		return TDS_FAIL;
+
+#if USE_EPOLL
+	if (!TDS_IS_SOCKET_INVALID(tds_get_s(tds))) {
+		struct epoll_event ev;
+
+		/* old kernels require a not NULL event */
+		memset(&ev, 0, sizeof(ev));
+		epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, tds_get_s(tds), &ev);
+	}
+#endif
+	reactor->sockets[n] = reactor->sockets[--reactor->num_sockets];
+	return TDS_SUCCESS;
+}
+
+/**
+ * Wake up a thread waiting in tds_reactor_wait.
+ * Can be called from any thread.
+ */
+void
+tds_reactor_wakeup(TDSREACTOR *reactor)
+{
+	tds_wakeup_send(&reactor->wakeup, 0);
+}
+
+static void
+tds_reactor_clear_wakeup(TDSREACTOR *reactor)
+{
+	char buf[16];
+
+#if defined(__linux__) && HAVE_EVENTFD
+	if (reactor->wakeup.s_signal == -1) {
+		(void) read(tds_wakeup_get_fd(&reactor->wakeup), buf, 8);
+		return;
+	}
+#endif
+	(void) READSOCKET(tds_wakeup_get_fd(&reactor->wakeup), buf, sizeof(buf));
+}
+
+/**
+ * Wait for sockets with a complete packet to read.
+ * Data are read from the network and buffered in the connection so
+ * reading the reported packets does not block.
+ * For encrypted connections a socket is reported as soon as some data
+ * are received.
+ * Sockets closed or with network errors are reported too, the error
+ * is reported reading from them.
+ * \param reactor reactor
+ * \param ready array to fill with ready sockets
+ * \param max_ready size of ready array
+ * \param timeout_ms timeout in milliseconds, -1 to wait forever
+ * \return number of ready sockets, 0 on timeout or wake up, <0 on error
+ */
+int
+tds_reactor_wait(TDSREACTOR *reactor, TDSSOCKET **ready, int max_ready, int timeout_ms)
+{
+	int num_ready = 0, rc;
+	unsigned n, start = tds_gettime_ms();
+	TDSSOCKET *tds;
+
+	assert(reactor && ready && max_ready > 0);
+
+	/* packets received previously */
+	for (n = 0; n < reactor->num_sockets && num_ready < max_ready; ++n) {
+		tds = reactor->sockets[n];
+		if (TDS_IS_SOCKET_INVALID(tds_get_s(tds)) || tds_connection_has_packet(tds->conn))
+			ready[num_ready++] = tds;
+	}
+	/* just check for other sockets without waiting */
+	if (num_ready)
+		timeout_ms = 0;
+
+	for (;;) {
+		int timeout = timeout_ms;
+#if USE_EPOLL
+		int i;
+#endif
+
+		if (timeout_ms >= 0) {
+			timeout = timeout_ms - (int) (tds_gettime_ms() - start);
+			if (timeout < 0)
+				timeout = 0;
+		}
+
+#if USE_EPOLL
+		rc = epoll_wait(reactor->epoll_fd, reactor->events, MIN(max_ready, (int) reactor->num_sockets) + 1, timeout);
+		for (i = 0; i < rc; ++i) {
+			tds = (TDSSOCKET *) reactor->events[i].data.ptr;
+			if (!tds) {
+				tds_reactor_clear_wakeup(reactor);
+				timeout_ms = 0;
+				continue;
+			}
+			/* already reported, not reported packets will be found by next call */
+			if (tds_connection_has_packet(tds->conn) || num_ready >= max_ready)
+				continue;
+			if (tds_connection_fill(tds->conn))
+				ready[num_ready++] = tds;
+		}
+#else
+		for (n = 0; n < reactor->num_sockets; ++n) {
+			reactor->fds[n].fd = tds_get_s(reactor->sockets[n]);
+			reactor->fds[n].events = POLLIN;
+			reactor->fds[n].revents = 0;
+		}
+		reactor->fds[n].fd = tds_wakeup_get_fd(&reactor->wakeup);
+		reactor->fds[n].events = POLLIN;
+		reactor->fds[n].revents = 0;
+		rc = poll(reactor->fds, reactor->num_sockets + 1, timeout);
+		if (rc > 0 && reactor->fds[n].revents) {
+			tds_reactor_clear_wakeup(reactor);
+			timeout_ms = 0;
+		}
+		for (n = 0; rc > 0 && n < reactor->num_sockets && num_ready < max_ready; ++n) {
+			tds = reactor->sockets[n];
+			if (!reactor->fds[n].revents || tds_connection_has_packet(tds->conn))
+				continue;
+			if (tds_connection_fill(tds->conn))
+				ready[num_ready++] = tds;
+		}
+#endif
+		if (rc < 0) {
+			if (sock_errno == TDSSOCK_EINTR)
+				continue;
+			return -1;
+		}
+
+		/* return if something ready, timeout or woken up */
+		if (num_ready || rc == 0 || timeout_ms == 0)
+			return num_ready;
+	}
+}
+
+/** @} */
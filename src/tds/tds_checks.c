@@ -45,6 +45,7 @@ tds_check_packet_extra(const TDSPACKET * packet)
 	assert(packet);
 	for (; packet; packet = packet->next) {
 		assert(packet->len <= packet->capacity);
+		assert(packet->data_start <= packet->capacity);
 		assert(packet->sid >= -1);
 	}
 }
@@ -91,7 +92,7 @@ tds_check_tds_extra(const TDSSOCKET * tds)
 
 #if ENABLE_ODBC_MARS
 	if (tds->conn->send_packets)
-		assert(tds->conn->send_pos <= tds->conn->send_packets->len);
+		assert(tds->conn->send_pos <= tds->conn->send_packets->len - tds->conn->send_packets->data_start);
 	if (tds->conn->recv_packet)
 		assert(tds->conn->recv_pos <= tds->conn->recv_packet->len);
 #endif
@@ -101,8 +102,8 @@ tds_check_tds_extra(const TDSSOCKET * tds)
 	/* TODO remove blocksize from env and use out_len ?? */
 /*	assert(tds->out_pos <= tds->out_len); */
 /* 	assert(tds->out_len == 0 || tds->out_buf != NULL); */
-	assert(tds->send_packet->capacity >= tds->out_buf_max + TDS_ADDITIONAL_SPACE);
-	assert(tds->out_buf >= tds->send_packet->buf);
+	assert(tds->send_packet->capacity >= tds->out_buf_max + TDS_ADDITIONAL_SPACE + TDS_SEND_HEADROOM);
+	assert(tds->out_buf == tds->send_packet->buf + TDS_SEND_HEADROOM);
 	assert(tds->out_buf + tds->out_buf_max + TDS_ADDITIONAL_SPACE <=
 		tds->send_packet->buf + tds->send_packet->capacity);
 	assert(tds->out_pos <= tds->out_buf_max + TDS_ADDITIONAL_SPACE);
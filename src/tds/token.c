@@ -45,6 +45,13 @@
 #include <freetds/checks.h>
 #include <freetds/bytes.h>
 #include <freetds/alloca.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#define TDS_DONT_DEFINE_DEFAULT_FUNCTIONS
+#include <freetds/data.h>
 #include "replacements.h"
 
 /** \cond HIDDEN_SYMBOLS */
@@ -76,8 +83,9 @@ static TDSRET tds_process_tabname(TDSSOCKET *tds);
 static TDSRET tds_process_colinfo(TDSSOCKET * tds, char **names, int num_names);
 static TDSRET tds_process_compute(TDSSOCKET * tds);
 static TDSRET tds_process_cursor_tokens(TDSSOCKET * tds);
-static TDSRET tds_process_row(TDSSOCKET * tds);
-static TDSRET tds_process_nbcrow(TDSSOCKET * tds);
+static TDSRET tds_process_row(TDSSOCKET * tds, bool stream);
+static TDSRET tds_process_nbcrow(TDSSOCKET * tds, bool stream);
+static TDSRET tds_discard_row_tokens(TDSSOCKET * tds, int marker);
 static TDSRET tds_process_featureextack(TDSSOCKET * tds);
 static TDSRET tds_process_param_result(TDSSOCKET * tds, TDSPARAMINFO ** info);
 static TDSRET tds7_process_result(TDSSOCKET * tds);
@@ -223,7 +231,7 @@ tds_process_default_tokens(TDSSOCKET * tds, int marker)
 		return tds_process_col_fmt(tds);
 		break;
 	case TDS_ROW_TOKEN:
-		return tds_process_row(tds);
+		return tds_process_row(tds, false);
 		break;
 	case TDS5_PARAMFMT_TOKEN:
 		/* store discarded parameters in param_info, not in old dynamic */
@@ -272,7 +280,7 @@ tds_process_default_tokens(TDSSOCKET * tds, int marker)
 		tds_get_n(tds, NULL, tds_get_uint(tds));
 		break;
 	case TDS_NBC_ROW_TOKEN:
-		return tds_process_nbcrow(tds);
+		return tds_process_nbcrow(tds, false);
 		break;
 	default: 
 		tds_close_socket(tds);
@@ -451,6 +459,259 @@ tds_process_auth(TDSSOCKET * tds)
 	return tds->conn->authentication->handle_next(tds, tds->conn->authentication, pdu_size);
 }
 
+static inline TDS_USMALLINT
+tds_peek_token_len(TDSSOCKET * tds, const unsigned char *p)
+{
+#ifdef WORDS_BIGENDIAN
+	if (tds->conn->emul_little_endian)
+		return (TDS_USMALLINT) TDS_GET_UA2LE(p);
+#endif
+	return (TDS_USMALLINT) TDS_GET_UA2(p);
+}
+
+/**
+ * Compute the size of TDS 7 column information without consuming it.
+ * \tds
+ * \param p     received data starting with the token marker
+ * \param avail number of bytes in p
+ * \param need  set to the minimum number of bytes p must contain to hold
+ *              the token if it is not entirely in p
+ * \return size of the token including browse information read after it,
+ *         0 if the token is not entirely in p or -1 if its size is unknown
+ */
+static TDS_INT
+tds7_result_wire_size(TDSSOCKET * tds, const unsigned char *p, size_t avail, size_t *need)
+{
+	TDSCONNECTION *conn = tds->conn;
+	size_t pos = 3;
+	int col, num_cols;
+	unsigned char type, num_parts;
+
+/** \cond HIDDEN_SYMBOLS */
+#define NEED(n) do { if (pos + (n) > avail) { *need = pos + (n); return 0; } } while(0)
+/** \endcond */
+
+	if (!IS_TDS7_PLUS(conn))
+		return -1;
+	NEED(0);
+	num_cols = (TDS_SMALLINT) tds_peek_token_len(tds, p + 1);
+
+	for (col = 0; col < num_cols; ++col) {
+		/* user type and flags */
+		pos += IS_TDS72_PLUS(conn) ? 4 + 2 : 2 + 2;
+		NEED(1);
+		type = p[pos++];
+		if (!is_tds_type_valid(type))
+			return -1;
+
+		switch (type) {
+		case SYBNUMERIC:
+		case SYBDECIMAL:
+			/* size, precision and scale */
+			pos += 3;
+			break;
+		case SYBMSTIME:
+		case SYBMSDATETIME2:
+		case SYBMSDATETIMEOFFSET:
+			pos += 1;
+			break;
+		case SYBMSDATE:
+			break;
+		case SYBMSUDT:
+			return -1;
+		default:
+			switch (tds_get_varint_size(conn, type)) {
+			case 5:
+			case 4:
+				pos += 4;
+				break;
+			case 2:
+				pos += 2;
+				break;
+			case 1:
+				pos += 1;
+				break;
+			}
+			if (IS_TDS71_PLUS(conn) && is_collate_type(type))
+				pos += 5;
+			if (is_blob_type(type)) {
+				num_parts = 1;
+				if (IS_TDS72_PLUS(conn)) {
+					NEED(1);
+					num_parts = p[pos++];
+				}
+				for (; num_parts; --num_parts) {
+					NEED(2);
+					pos += 2 + 2 * tds_peek_token_len(tds, p + pos);
+				}
+			} else if (IS_TDS72_PLUS(conn) && type == SYBMSXML) {
+				NEED(1);
+				if (p[pos++]) {
+					/* database, owner and schema collection */
+					NEED(1);
+					pos += 1 + 2 * p[pos];
+					NEED(1);
+					pos += 1 + 2 * p[pos];
+					NEED(2);
+					pos += 2 + 2 * tds_peek_token_len(tds, p + pos);
+				}
+			}
+			break;
+		}
+
+		/* name */
+		NEED(1);
+		pos += 1 + 2 * p[pos];
+	}
+
+	/* browse information is read with column information */
+	NEED(1);
+	if (p[pos] == TDS_TABNAME_TOKEN) {
+		NEED(3);
+		pos += 3 + tds_peek_token_len(tds, p + pos + 1);
+	}
+	NEED(0);
+	return (TDS_INT) pos;
+#undef NEED
+}
+
+/**
+ * Compute the size of a token without consuming it.
+ * Only tokens usually found while reading results are handled:
+ * DONE, length prefixed tokens, TDS 7 column information and rows.
+ * \tds
+ * \param p     received data starting with the token marker
+ * \param avail number of bytes in p
+ * \param need  set to the minimum number of bytes p must contain to hold
+ *              the token if it is not entirely in p
+ * \return size of the token including data peeked after it, 0 if the
+ *         token is not entirely in p or -1 if its size is unknown
+ */
+static TDS_INT
+tds_token_wire_size(TDSSOCKET * tds, const unsigned char *p, size_t avail, size_t *need)
+{
+	TDSRESULTINFO *info;
+	TDS_INT size;
+	size_t pos, col_need;
+	unsigned int i, nbcsize = 0;
+
+	if (avail < 1) {
+		*need = 1;
+		return 0;
+	}
+
+	switch (p[0]) {
+	case TDS_DONE_TOKEN:
+	case TDS_DONEPROC_TOKEN:
+	case TDS_DONEINPROC_TOKEN:
+		pos = IS_TDS72_PLUS(tds->conn) ? 1 + 12 : 1 + 8;
+		break;
+	case TDS_RETURNSTATUS_TOKEN:
+		/* the following marker is peeked */
+		pos = 1 + 4 + 1;
+		break;
+	case TDS_PROCID_TOKEN:
+		pos = 1 + 8;
+		break;
+	case TDS_ENVCHANGE_TOKEN:
+	case TDS_INFO_TOKEN:
+	case TDS_ERROR_TOKEN:
+	case TDS_EED_TOKEN:
+	case TDS_LOGINACK_TOKEN:
+	case TDS_ORDERBY_TOKEN:
+	case TDS_COLINFO_TOKEN:
+	case TDS_TABNAME_TOKEN:
+	case TDS_CAPABILITY_TOKEN:
+	case TDS_AUTH_TOKEN:
+		pos = 3;
+		if (avail >= 3)
+			pos += tds_peek_token_len(tds, p + 1);
+		break;
+	case TDS7_RESULT_TOKEN:
+		return tds7_result_wire_size(tds, p, avail, need);
+	case TDS_NBC_ROW_TOKEN:
+	case TDS_ROW_TOKEN:
+		/* same results tds_process_tokens would select */
+		info = tds->cur_cursor ? tds->cur_cursor->res_info : tds->res_info ? tds->res_info : tds->current_results;
+		if (!info || info->num_cols <= 0)
+			return -1;
+		pos = 1;
+		if (p[0] == TDS_NBC_ROW_TOKEN) {
+			nbcsize = (info->num_cols + 7) / 8;
+			pos += nbcsize;
+			if (avail < pos) {
+				*need = pos;
+				return 0;
+			}
+		}
+		for (i = 0; i < info->num_cols; ++i) {
+			if (nbcsize && (p[1 + i / 8] & (1 << (i % 8))))
+				continue;
+			size = tds_column_wire_size(tds, info->columns[i], p + pos, avail - pos, &col_need);
+			if (size < -1)
+				return -1;
+			if (size < 0) {
+				*need = pos + col_need;
+				return 0;
+			}
+			pos += size;
+		}
+		return (TDS_INT) pos;
+	default:
+		return -1;
+	}
+	if (avail < pos) {
+		*need = pos;
+		return 0;
+	}
+	return (TDS_INT) pos;
+}
+
+/**
+ * Check if next token can be processed without blocking.
+ * The token has to be received completely, tokens of unknown size
+ * only if no more data can be received before reading them.
+ * The minimum size of a token not received completely is kept so
+ * buffered data are copied again only once they can contain it.
+ * \tds
+ * \return true if the token can be processed
+ */
+static bool
+tds_token_available(TDSSOCKET * tds)
+{
+	unsigned char *buf;
+	size_t len, need = 0;
+	bool last;
+	TDS_INT size;
+
+	if (!tds_data_available(tds))
+		return false;
+
+	/* most tokens are in the current packet */
+	if (tds_token_wire_size(tds, tds->in_buf + tds->in_pos, tds->in_len - tds->in_pos, &need) > 0)
+		return true;
+
+	if (tds->token_need_packet == tds->in_packets && tds->token_need_pos == tds->in_pos
+	    && tds->token_need > need)
+		need = tds->token_need;
+	if (need && tds_buffered_size(tds, &last) < need)
+		return last;
+
+	buf = tds_buffered_data(tds, &len, &last);
+	if (!buf)
+		return true;
+	size = tds_token_wire_size(tds, buf, len, &need);
+	free(buf);
+	if (size > 0)
+		return true;
+
+	/* a token of unknown size is available only with the last data */
+	tds->token_need_packet = tds->in_packets;
+	tds->token_need_pos = tds->in_pos;
+	tds->token_need = size < 0 ? (size_t) -1 : need;
+	return last;
+}
+
 /**
  * process all streams.
  * tds_process_tokens() is called after submitting a query with
@@ -497,11 +758,21 @@ tds_process_auth(TDSSOCKET * tds)
  *    <td>tds->ret_status contain the returned code</td>
  *  </tr></table>
  * @param done_flags Flags contained in the TDS_DONE*_TOKEN readed
- * @param flag Flags to select token type to stop/return
+ * @param flag Flags to select token type to stop/return.
+ *        If TDS_TOKEN_NOWAIT is set the function does not wait for new
+ *        packets before starting to process a token, TDS_WOULDBLOCK is
+ *        returned instead. Call again after the socket (tds_get_s) is
+ *        readable to resume processing. As data can be buffered by the
+ *        library, call until TDS_WOULDBLOCK is returned before waiting
+ *        on the socket. A token is processed only when received
+ *        completely; tokens of unknown size (like TDS 5 column
+ *        information) wait for the end of the response or for receive
+ *        buffers to be full. With TLS only the current packet is checked.
  * @todo Complete TDS_DESCRIBE_RESULT description
  * @retval TDS_SUCCESS if a result set is available for processing.
  * @retval TDS_FAIL on error.
  * @retval TDS_NO_MORE_RESULTS if all results have been completely processed.
+ * @retval TDS_WOULDBLOCK if TDS_TOKEN_NOWAIT was specified and no data are available.
  * @retval anything returned by one of the many functions it calls.  :-(
  */
 TDSRET
@@ -515,6 +786,8 @@ tds_process_tokens(TDSSOCKET *tds, TDS_INT *result_type, int *done_flags, unsign
 	TDS_INT ret_status;
 	int cancel_seen = 0;
 	unsigned return_flag = 0;
+	const bool nowait = (flag & TDS_TOKEN_NOWAIT) != 0;
+	const bool stream_blobs = (flag & TDS_TOKEN_STREAM_BLOBS) != 0;
 
 /** \cond HIDDEN_SYMBOLS */
 #define SET_RETURN(ret, f) do { \
@@ -522,6 +795,7 @@ tds_process_tokens(TDSSOCKET *tds, TDS_INT *result_type, int *done_flags, unsign
 	return_flag = TDS_RETURN_##f | TDS_STOPAT_##f; \
 	if (flag & TDS_STOPAT_##f) {\
 		tds_unget_byte(tds); \
+		--tds->conn->stats.tokens[marker]; \
 		tdsdump_log(TDS_DBG_FUNC, "tds_process_tokens::SET_RETURN stopping on current token\n"); \
 		goto set_return_exit; \
 	} } while(0)
@@ -540,10 +814,23 @@ tds_process_tokens(TDSSOCKET *tds, TDS_INT *result_type, int *done_flags, unsign
 	if (tds_set_state(tds, TDS_READING) != TDS_READING)
 		return TDS_FAIL;
 
+	/* complete row left with a large value on the wire */
+	if (TDS_FAILED(tds_blob_stream_finish(tds)))
+		return TDS_FAIL;
+
+	flag &= ~(TDS_TOKEN_NOWAIT|TDS_TOKEN_STREAM_BLOBS);
 	rc = TDS_SUCCESS;
 	for (;;) {
 
+		/* tokens are processed completely, so we can stop between them */
+		if (nowait && !tds_token_available(tds)) {
+			tdsdump_log(TDS_DBG_FUNC, "tds_process_tokens() no data available\n");
+			tds_set_state(tds, TDS_PENDING);
+			return TDS_WOULDBLOCK;
+		}
+
 		marker = tds_get_byte(tds);
+		++tds->conn->stats.tokens[marker];
 		tdsdump_log(TDS_DBG_INFO1, "processing result tokens.  marker is  %x(%s)\n", marker, tds_token_name(marker));
 
 		switch (marker) {
@@ -652,14 +939,21 @@ tds_process_tokens(TDSSOCKET *tds, TDS_INT *result_type, int *done_flags, unsign
 				tds->current_results->rows_exist = true;
 			SET_RETURN(TDS_ROW_RESULT, ROW);
 
+			/* rows not returned to the caller are just walked on the wire */
+			if (!(flag & TDS_RETURN_ROW) && tds->current_results) {
+				rc = tds_discard_row_tokens(tds, marker);
+				break;
+			}
+
 			switch (marker) {
 			case TDS_ROW_TOKEN:
-				rc = tds_process_row(tds);
+				rc = tds_process_row(tds, stream_blobs);
 				break;
 			case TDS_NBC_ROW_TOKEN:
-				rc = tds_process_nbcrow(tds);
+				rc = tds_process_nbcrow(tds, stream_blobs);
 				break;
 			}
+			++tds->conn->stats.rows;
 			break;
 		case TDS_CMP_ROW_TOKEN:
 			/* I don't know when this it's false but it happened, also server can send garbage... */
@@ -1541,6 +1835,74 @@ tds7_get_data_info(TDSSOCKET * tds, TDSCOLUMN * curcol)
 	return TDS_SUCCESS;
 }
 
+/**
+ * Reuse last results if metadata to read are identical.
+ * Client bindings are removed unless they have an owner, in this case
+ * the library owning them decides if they are still valid, see
+ * tds_reset_bindings.
+ * \tds
+ * \param info last results
+ * \param num_cols number of columns already read
+ * \return true if results were reused, metadata are skipped
+ */
+static bool
+tds7_reuse_results(TDSSOCKET * tds, TDSRESULTINFO * info, int num_cols)
+{
+	TDSCOLUMN *curcol;
+	int col;
+
+	/* still used by someone else */
+	if (!info || info->ref_count != 1 || !info->metadata || info->num_cols != num_cols)
+		return false;
+	if (tds->in_len - tds->in_pos < info->metadata_len
+	    || memcmp(tds->in_buf + tds->in_pos, info->metadata, info->metadata_len) != 0)
+		return false;
+
+	tdsdump_log(TDS_DBG_INFO1, "metadata identical to last results, reusing them\n");
+	tds->in_pos += info->metadata_len;
+
+	for (col = 0; col < num_cols; col++) {
+		curcol = info->columns[col];
+		tds_column_reset_data(curcol);
+		curcol->column_lazy = 0;
+		curcol->column_textpos = 0;
+		curcol->column_text_sqlgetdatapos = 0;
+		curcol->column_text_sqlputdatainfo = 0;
+	}
+	if (!info->bindings_owner)
+		tds_reset_bindings(info);
+	info->rows_exist = false;
+	info->more_results = false;
+	info->reused = true;
+
+	++info->ref_count;
+	tds_set_current_results(tds, info);
+	tds->res_info = info;
+	return true;
+}
+
+/**
+ * Keep results to be able to reuse them.
+ * \param plast where to keep results
+ * \param info results just read
+ * \param metadata raw metadata of the results
+ * \param len length of metadata
+ */
+static void
+tds_keep_results(TDSRESULTINFO ** plast, TDSRESULTINFO * info, const unsigned char *metadata, unsigned len)
+{
+	free(info->metadata);
+	info->metadata = (unsigned char *) malloc(len ? len : 1);
+	if (!info->metadata)
+		return;
+	memcpy(info->metadata, metadata, len);
+	info->metadata_len = len;
+
+	tds_free_results(*plast);
+	++info->ref_count;
+	*plast = info;
+}
+
 /**
  * tds7_process_result() is the TDS 7.0 result set processing routine.  It 
  * is responsible for populating the tds->res_info structure.
@@ -1552,7 +1914,9 @@ tds7_process_result(TDSSOCKET * tds)
 {
 	int col, num_cols;
 	TDSRET result;
-	TDSRESULTINFO *info;
+	TDSRESULTINFO *info, **plast;
+	unsigned start;
+	TDS_UINT start_packets;
 
 	CHECK_TDS_EXTRA(tds);
 	tdsdump_log(TDS_DBG_INFO1, "processing TDS7 result metadata.\n");
@@ -1571,6 +1935,16 @@ tds7_process_result(TDSSOCKET * tds)
 	tds_free_all_results(tds);
 	tds->rows_affected = TDS_NO_COUNT;
 
+	/* same statement executed again returns usually same metadata */
+	plast = NULL;
+	if (!tds->cur_cursor) {
+		plast = tds->cur_dyn ? &tds->cur_dyn->last_results : &tds->last_results;
+		if (tds7_reuse_results(tds, *plast, num_cols))
+			return TDS_SUCCESS;
+	}
+	start = tds->in_pos;
+	start_packets = tds->in_packets;
+
 	if ((info = tds_alloc_results(num_cols)) == NULL)
 		return TDS_FAIL;
 	tds_set_current_results(tds, info);
@@ -1613,6 +1987,10 @@ tds7_process_result(TDSSOCKET * tds)
 
 	/* all done now allocate a row for tds_process_row to use */
 	result = tds_alloc_row(info);
+
+	/* metadata can be compared only if all in the same packet */
+	if (plast && TDS_SUCCEED(result) && start_packets == tds->in_packets)
+		tds_keep_results(plast, info, tds->in_buf + start, tds->in_pos - start);
 	CHECK_TDS_EXTRA(tds);
 	return result;
 }
@@ -1919,16 +2297,290 @@ tds_process_compute(TDSSOCKET * tds)
 	return TDS_SUCCESS;
 }
 
+/** A step of a row decoding plan */
+typedef struct tds_row_plan_step
+{
+	TDS_USMALLINT first_col;	/**< first column decoded by the step */
+	TDS_USMALLINT num_cols;		/**< number of columns decoded */
+	/** bytes on the wire for a run of fixed size columns, 0 for generic decoding */
+	TDS_UINT wire_size;
+} TDSROWPLANSTEP;
+
+/**
+ * Plan to decode rows of a result.
+ * Consecutive columns of fixed size (not nullable) are copied from
+ * the packet with a single bound check, other columns use get_data.
+ */
+typedef struct tds_row_plan
+{
+	TDS_USMALLINT num_steps;
+	/** wire size of each column, 0 if not fixed */
+	unsigned char *sizes;
+	TDSROWPLANSTEP steps[1];
+} TDSROWPLAN;
+
+/**
+ * Return size of a column which can be copied from the wire as is, 0 otherwise.
+ */
+static unsigned
+tds_row_plan_fixed_size(const TDSCOLUMN * col)
+{
+	int size;
+
+	if (col->funcs->get_data != tds_generic_get || col->column_varint_size != 0 || col->char_conv)
+		return 0;
+	size = tds_get_size_by_type(col->column_type);
+	if (size <= 0 || size > 255 || size != col->column_size)
+		return 0;
+	return size;
+}
+
+/**
+ * Compile a plan to decode rows of a result.
+ * Called when column information are received, the plan is not used
+ * if no column can be decoded by the fast path.
+ * \param res_info result to compile
+ */
+void
+tds_compile_row_plan(TDSRESULTINFO * res_info)
+{
+	TDSROWPLAN *plan;
+	TDSROWPLANSTEP *step = NULL;
+	unsigned int i, num_fixed = 0;
+	unsigned size;
+
+	TDS_ZERO_FREE(res_info->row_plan);
+	if (res_info->num_cols <= 0)
+		return;
+
+	for (i = 0; i < res_info->num_cols; i++)
+		if (tds_row_plan_fixed_size(res_info->columns[i]))
+			++num_fixed;
+	if (!num_fixed)
+		return;
+
+	/* at most a step for each column, sizes are stored after steps */
+	plan = (TDSROWPLAN *) malloc(sizeof(TDSROWPLAN) + sizeof(TDSROWPLANSTEP) * (res_info->num_cols - 1)
+				     + res_info->num_cols);
+	if (!plan)
+		return;
+	plan->sizes = (unsigned char *) &plan->steps[res_info->num_cols];
+	plan->num_steps = 0;
+
+	for (i = 0; i < res_info->num_cols; i++) {
+		size = tds_row_plan_fixed_size(res_info->columns[i]);
+		plan->sizes[i] = size;
+		if (!step || (step->wire_size != 0) != (size != 0)) {
+			step = &plan->steps[plan->num_steps++];
+			step->first_col = i;
+			step->num_cols = 0;
+			step->wire_size = 0;
+		}
+		step->num_cols++;
+		step->wire_size += size;
+	}
+	tdsdump_log(TDS_DBG_INFO1, "tds_compile_row_plan(): %u fixed columns, %u steps\n", num_fixed, plan->num_steps);
+	res_info->row_plan = plan;
+}
+
+/**
+ * Read a value of a row, values not needed by the application are skipped.
+ * \tds
+ * \param curcol column to read
+ */
+static inline TDSRET
+tds_get_column_value(TDSSOCKET * tds, TDSCOLUMN * curcol)
+{
+	if (curcol->column_lazy)
+		return tds_skip_column(tds, curcol);
+	return curcol->funcs->get_data(tds, curcol);
+}
+
+/**
+ * Decode a row using a compiled plan.
+ */
+static TDSRET
+tds_process_row_plan(TDSSOCKET * tds, TDSRESULTINFO * info, const TDSROWPLAN * plan)
+{
+	const TDSROWPLANSTEP *step, *end = plan->steps + plan->num_steps;
+	unsigned int i, last;
+	TDSCOLUMN *curcol;
+
+	for (step = plan->steps; step != end; ++step) {
+		last = step->first_col + step->num_cols;
+
+		/* run of fixed columns all in the current packet */
+		if (step->wire_size && tds->in_len - tds->in_pos >= step->wire_size) {
+			const unsigned char *src = tds->in_buf + tds->in_pos;
+
+			for (i = step->first_col; i < last; i++) {
+				unsigned size = plan->sizes[i];
+
+				curcol = info->columns[i];
+				tds_column_reset_data(curcol);
+				memcpy(curcol->column_data, src, size);
+				curcol->column_cur_size = size;
+				src += size;
+			}
+			tds->in_pos += step->wire_size;
+			continue;
+		}
+
+		for (i = step->first_col; i < last; i++) {
+			curcol = info->columns[i];
+			if (TDS_FAILED(tds_get_column_value(tds, curcol)))
+				return TDS_FAIL;
+		}
+	}
+	return TDS_SUCCESS;
+}
+
+/**
+ * Check if rows can be decoded using the compiled plan.
+ */
+static inline const TDSROWPLAN *
+tds_get_row_plan(TDSSOCKET * tds, TDSRESULTINFO * info)
+{
+#ifdef WORDS_BIGENDIAN
+	/* data must be swapped */
+	if (tds->conn->emul_little_endian)
+		return NULL;
+#endif
+	return info->row_plan;
+}
+
+/**
+ * Read columns of current row starting from tds->blob_stream.next_col.
+ * \tds
+ * \param stream stop at the first large value to stream
+ */
+static TDSRET
+tds_blob_stream_columns(TDSSOCKET * tds, bool stream)
+{
+	TDSBLOBSTREAM *bs = &tds->blob_stream;
+	TDSRESULTINFO *info = bs->info;
+	TDSCOLUMN *curcol;
+	unsigned i;
+
+	while (bs->next_col < info->num_cols) {
+		i = bs->next_col++;
+		curcol = info->columns[i];
+		if (bs->nbc && (bs->nbcbuf[i / 8] >> (i % 8)) & 1) {
+			curcol->column_wire_data = NULL;
+			curcol->column_cur_size = -1;
+			continue;
+		}
+		tdsdump_log(TDS_DBG_INFO1, "tds_blob_stream_columns(): reading column %d \n", i);
+		if (!stream || !is_blob_col(curcol) || curcol->column_lazy) {
+			if (TDS_FAILED(tds_get_column_value(tds, curcol)))
+				return TDS_FAIL;
+			continue;
+		}
+		if (TDS_FAILED(tds_blob_stream_start(tds, curcol)))
+			return TDS_FAIL;
+		if (bs->column) {
+			/* values pointing to the packet won't survive reading the value */
+			tds_unpin_row_data(info);
+			return TDS_SUCCESS;
+		}
+	}
+	tds_blob_stream_reset(tds);
+	return TDS_SUCCESS;
+}
+
+/**
+ * Read a row leaving the first large value on the wire.
+ * \tds
+ * \param info results of the row
+ * \param nbcbuf NULL bitmap for NBCROW, NULL for ROW
+ * \param nbcsize size of the bitmap
+ */
+static TDSRET
+tds_blob_stream_row(TDSSOCKET * tds, TDSRESULTINFO * info, const unsigned char *nbcbuf, unsigned nbcsize)
+{
+	TDSBLOBSTREAM *bs = &tds->blob_stream;
+
+	tds_blob_stream_reset(tds);
+	if (nbcsize > bs->nbcbuf_size) {
+		if (!TDS_RESIZE(bs->nbcbuf, nbcsize))
+			return TDS_FAIL;
+		bs->nbcbuf_size = nbcsize;
+	}
+	if (nbcsize)
+		memcpy(bs->nbcbuf, nbcbuf, nbcsize);
+	bs->nbc = nbcbuf != NULL;
+	bs->next_col = 0;
+	bs->info = info;
+	++info->ref_count;
+	return tds_blob_stream_columns(tds, true);
+}
+
+/**
+ * Continue reading a row read using TDS_TOKEN_STREAM_BLOBS.
+ * The rest of the value being streamed is discarded.
+ * \tds
+ * \param stream stop at next large value, if false the row is read completely
+ * \return TDS_FAIL on error or TDS_SUCCESS; tds->blob_stream.column is set
+ *         if another value is left on the wire
+ */
+TDSRET
+tds_blob_stream_next(TDSSOCKET * tds, bool stream)
+{
+	CHECK_TDS_EXTRA(tds);
+
+	if (!tds->blob_stream.info)
+		return TDS_SUCCESS;
+	if (TDS_FAILED(tds_blob_stream_skip(tds)))
+		return TDS_FAIL;
+	return tds_blob_stream_columns(tds, stream);
+}
+
+/**
+ * Forget the row being streamed, releasing its results.
+ * \tds
+ */
+void
+tds_blob_stream_reset(TDSSOCKET * tds)
+{
+	TDSBLOBSTREAM *bs = &tds->blob_stream;
+	TDSRESULTINFO *info = bs->info;
+
+	bs->column = NULL;
+	bs->info = NULL;
+	tds_free_results(info);
+}
+
+/**
+ * Complete a row read using TDS_TOKEN_STREAM_BLOBS, reading the rest of
+ * the row. On failure the row is forgot and the connection is marked dead
+ * as the position in the stream is lost.
+ * \tds
+ * \return TDS_FAIL on error or TDS_SUCCESS
+ */
+TDSRET
+tds_blob_stream_finish(TDSSOCKET * tds)
+{
+	CHECK_TDS_EXTRA(tds);
+
+	if (!tds->blob_stream.info || TDS_SUCCEED(tds_blob_stream_next(tds, false)))
+		return TDS_SUCCESS;
+	tds_blob_stream_reset(tds);
+	tds_set_state(tds, TDS_DEAD);
+	return TDS_FAIL;
+}
+
 /**
  * tds_process_row() processes rows and places them in the row buffer.
  * \tds
+ * \param stream leave first large value on the wire, see TDS_TOKEN_STREAM_BLOBS
  */
 static TDSRET
-tds_process_row(TDSSOCKET * tds)
+tds_process_row(TDSSOCKET * tds, bool stream)
 {
 	unsigned int i;
 	TDSCOLUMN *curcol;
 	TDSRESULTINFO *info;
+	const TDSROWPLAN *plan;
 
 	CHECK_TDS_EXTRA(tds);
 
@@ -1936,25 +2588,88 @@ tds_process_row(TDSSOCKET * tds)
 	if (!info || info->num_cols <= 0)
 		return TDS_FAIL;
 
+	if (stream)
+		return tds_blob_stream_row(tds, info, NULL, 0);
+
+	plan = tds_get_row_plan(tds, info);
+	if (plan)
+		return tds_process_row_plan(tds, info, plan);
+
 	for (i = 0; i < info->num_cols; i++) {
 		tdsdump_log(TDS_DBG_INFO1, "tds_process_row(): reading column %d \n", i);
 		curcol = info->columns[i];
-		if (TDS_FAILED(curcol->funcs->get_data(tds, curcol)))
+		if (TDS_FAILED(tds_get_column_value(tds, curcol)))
 			return TDS_FAIL;
 	}
 	return TDS_SUCCESS;
 }
 
+/**
+ * Expand a NBCROW NULL bitmap to an array of indicators.
+ * Uses AVX2 or SSE2 if available at compile time.
+ * \param bitmap bitmap received, a bit for each column
+ * \param num_cols number of columns
+ * \param nulls array to fill, a byte for each column, 1 if NULL, 0 otherwise
+ */
+void
+tds_expand_null_bitmap(const unsigned char *bitmap, unsigned num_cols, unsigned char *nulls)
+{
+	unsigned i = 0;
+
+#if defined(__AVX2__)
+	{
+		/* every byte of the bitmap is replicated 8 times */
+		const __m256i shuffle = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+							 2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+		const __m256i bits = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+						      1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+		const __m256i one = _mm256_set1_epi8(1);
+
+		for (; i + 32 <= num_cols; i += 32) {
+			TDS_UINT w;
+			__m256i v;
+
+			memcpy(&w, bitmap + i / 8, 4);
+			v = _mm256_shuffle_epi8(_mm256_set1_epi32((int) w), shuffle);
+			v = _mm256_cmpeq_epi8(_mm256_and_si256(v, bits), bits);
+			_mm256_storeu_si256((__m256i *) (nulls + i), _mm256_and_si256(v, one));
+		}
+	}
+#endif
+#if defined(__SSE2__)
+	{
+		const __m128i bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+		const __m128i one = _mm_set1_epi8(1);
+
+		for (; i + 16 <= num_cols; i += 16) {
+			__m128i v = _mm_cvtsi32_si128(bitmap[i / 8] | (bitmap[i / 8 + 1] << 8));
+
+			/* replicate every byte 8 times */
+			v = _mm_unpacklo_epi8(v, v);
+			v = _mm_unpacklo_epi16(v, v);
+			v = _mm_unpacklo_epi32(v, v);
+			v = _mm_cmpeq_epi8(_mm_and_si128(v, bits), bits);
+			_mm_storeu_si128((__m128i *) (nulls + i), _mm_and_si128(v, one));
+		}
+	}
+#endif
+	for (; i < num_cols; ++i)
+		nulls[i] = (bitmap[i / 8] >> (i % 8)) & 1;
+}
+
 /**
  * tds_process_nbcrow() processes rows and places them in the row buffer.
+ * \param stream leave first large value on the wire, see TDS_TOKEN_STREAM_BLOBS
  */
 static TDSRET
-tds_process_nbcrow(TDSSOCKET * tds)
+tds_process_nbcrow(TDSSOCKET * tds, bool stream)
 {
-	unsigned int i;
+	unsigned int i, end, num_cols, nbcsize;
 	TDSCOLUMN *curcol;
 	TDSRESULTINFO *info;
-	char *nbcbuf;
+	const TDSROWPLAN *plan;
+	unsigned char *nbcbuf, *nulls;
+	const unsigned char *p;
 
 	CHECK_TDS_EXTRA(tds);
 
@@ -1962,18 +2677,289 @@ tds_process_nbcrow(TDSSOCKET * tds)
 	if (!info || info->num_cols <= 0)
 		return TDS_FAIL;
 
-	nbcbuf = (char *) alloca((info->num_cols + 7) / 8);
-	tds_get_n(tds, nbcbuf, (info->num_cols + 7) / 8);
-	for (i = 0; i < info->num_cols; i++) {
+	num_cols = info->num_cols;
+	nbcsize = (num_cols + 7) / 8;
+	nbcbuf = (unsigned char *) alloca(nbcsize);
+	tds_get_n(tds, nbcbuf, nbcsize);
+
+	if (stream)
+		return tds_blob_stream_row(tds, info, nbcbuf, nbcsize);
+
+	/* without NULLs the row is encoded like a normal row */
+	plan = tds_get_row_plan(tds, info);
+	if (plan) {
+		for (i = 0; i < nbcsize && !nbcbuf[i]; ++i)
+			continue;
+		if (i >= nbcsize)
+			return tds_process_row_plan(tds, info, plan);
+	}
+
+	nulls = (unsigned char *) alloca(num_cols);
+	tds_expand_null_bitmap(nbcbuf, num_cols, nulls);
+
+	for (i = 0; i < num_cols; i++) {
+		if (nulls[i]) {
+			/* skip to next not NULL column */
+			p = (const unsigned char *) memchr(nulls + i, 0, num_cols - i);
+			end = p ? (unsigned) (p - nulls) : num_cols;
+			for (; i < end; i++) {
+				curcol = info->columns[i];
+				curcol->column_wire_data = NULL;
+				curcol->column_cur_size = -1;
+			}
+			if (i >= num_cols)
+				break;
+		}
 		curcol = info->columns[i];
 		tdsdump_log(TDS_DBG_INFO1, "tds_process_nbcrow(): reading column %d \n", i);
-		if (nbcbuf[i / 8] & (1 << (i % 8))) {
-			curcol->column_cur_size = -1;
-		} else {
-			if (TDS_FAILED(curcol->funcs->get_data(tds, curcol)))
-				return TDS_FAIL;
+		if (TDS_FAILED(tds_get_column_value(tds, curcol)))
+			return TDS_FAIL;
+	}
+	return TDS_SUCCESS;
+}
+
+/**
+ * Discard a row reading only the size of its values.
+ * \tds
+ * \param info results the row belongs to
+ * \param marker token of the row, TDS_ROW_TOKEN or TDS_NBC_ROW_TOKEN
+ * \return TDS_FAIL on error or TDS_SUCCESS
+ */
+static TDSRET
+tds_discard_row(TDSSOCKET * tds, TDSRESULTINFO * info, int marker)
+{
+	unsigned int i, num_cols;
+	unsigned char *nbcbuf = NULL;
+
+	if (info->num_cols <= 0)
+		return TDS_FAIL;
+
+	num_cols = info->num_cols;
+	if (marker == TDS_NBC_ROW_TOKEN) {
+		nbcbuf = (unsigned char *) alloca((num_cols + 7) / 8);
+		tds_get_n(tds, nbcbuf, (num_cols + 7) / 8);
+	}
+
+	for (i = 0; i < num_cols; i++) {
+		if (nbcbuf && (nbcbuf[i / 8] & (1 << (i % 8))))
+			continue;
+		if (TDS_FAILED(tds_discard_column(tds, info->columns[i])))
+			return TDS_FAIL;
+	}
+	return TDS_SUCCESS;
+}
+
+/**
+ * Discard a row and following rows already received.
+ * Row marker is already read.
+ * \tds
+ * \param marker token of the row, TDS_ROW_TOKEN or TDS_NBC_ROW_TOKEN
+ * \return TDS_FAIL on error or TDS_SUCCESS
+ */
+static TDSRET
+tds_discard_row_tokens(TDSSOCKET * tds, int marker)
+{
+	TDSRESULTINFO *info = tds->current_results;
+	size_t need;
+
+	for (;;) {
+		if (TDS_FAILED(tds_discard_row(tds, info, marker)))
+			return TDS_FAIL;
+
+		/*
+		 * do not wait for other packets here, tds_process_tokens could be not blocking;
+		 * continue only if the whole next row is in the packet
+		 */
+		if (tds->in_pos >= tds->in_len)
+			return TDS_SUCCESS;
+		marker = tds->in_buf[tds->in_pos];
+		if (marker != TDS_ROW_TOKEN && marker != TDS_NBC_ROW_TOKEN)
+			return TDS_SUCCESS;
+		if (tds_token_wire_size(tds, tds->in_buf + tds->in_pos, tds->in_len - tds->in_pos, &need) <= 0)
+			return TDS_SUCCESS;
+		++tds->in_pos;
+		++tds->conn->stats.tokens[marker];
+	}
+}
+
+/**
+ * Discard rows of current results without decoding them.
+ * Values are walked on the wire using column information, they are not
+ * converted nor stored so abandoning a large result costs little more
+ * than reading it from the network.
+ * Stops at the first token which is not a row (usually a DONE or new
+ * results) which is left to tds_process_tokens.
+ * \tds
+ * \return TDS_FAIL on error or TDS_SUCCESS
+ */
+TDSRET
+tds_discard_rows(TDSSOCKET * tds)
+{
+	TDSRESULTINFO *info;
+	int marker;
+
+	CHECK_TDS_EXTRA(tds);
+
+	if (tds->state != TDS_PENDING)
+		return TDS_SUCCESS;
+
+	if (tds_set_state(tds, TDS_READING) != TDS_READING)
+		return TDS_FAIL;
+
+	/* complete row left with a large value on the wire */
+	if (TDS_FAILED(tds_blob_stream_finish(tds)))
+		return TDS_FAIL;
+
+	info = tds->cur_cursor ? tds->cur_cursor->res_info : tds->res_info;
+	while (info && ((marker = tds_peek(tds)) == TDS_ROW_TOKEN || marker == TDS_NBC_ROW_TOKEN)) {
+		tds_get_byte(tds);
+		++tds->conn->stats.tokens[marker];
+		tds_set_current_results(tds, info);
+		info->rows_exist = true;
+		if (TDS_FAILED(tds_discard_row(tds, info, marker))) {
+			tds_set_state(tds, TDS_DEAD);
+			return TDS_FAIL;
 		}
 	}
+
+	if (IS_TDSDEAD(tds))
+		return TDS_FAIL;
+	tds_set_state(tds, TDS_PENDING);
+	return TDS_SUCCESS;
+}
+
+/**
+ * Copy a value of a batch into the row buffer of its column.
+ * Blob values are duplicated, the batch keeps owning its ones.
+ */
+static TDSRET
+tds_batch_copy_value(TDSCOLUMN * curcol, const TDSBATCHCOLUMN * bcol, TDS_UINT row)
+{
+	const unsigned char *src = tds_batch_value(bcol, row);
+	TDSBLOB *dst;
+	TDS_CHAR *value = NULL;
+	TDS_INT len;
+
+	curcol->column_cur_size = bcol->lengths[row];
+	if (!bcol->is_blob) {
+		memcpy(curcol->column_data, src, curcol->funcs->row_len(curcol));
+		return TDS_SUCCESS;
+	}
+
+	/* variant has data and its length in different places */
+	dst = (TDSBLOB *) curcol->column_data;
+	if (curcol->column_type == SYBVARIANT)
+		len = ((const TDSVARIANT *) src)->data_len;
+	else
+		len = curcol->column_cur_size;
+	if (((const TDSBLOB *) src)->textvalue && len >= 0) {
+		value = (TDS_CHAR *) realloc(dst->textvalue, len ? len : 1);
+		if (!value)
+			return TDS_FAIL;
+		memcpy(value, ((const TDSBLOB *) src)->textvalue, len);
+	} else {
+		free(dst->textvalue);
+	}
+	memcpy(dst, src, sizeof(TDSBLOB));
+	dst->textvalue = value;
+	return TDS_SUCCESS;
+}
+
+/**
+ * Read multiple rows into a batch, storing values by column.
+ * Must be called when next token to read is a row, that is after
+ * tds_process_tokens returned TDS_ROW_RESULT stopping at the row
+ * (TDS_STOPAT_ROW).
+ * Rows are read until the batch is full or a token which is not a row
+ * is found, so after the call tds_process_tokens can be called to read
+ * other rows or tokens. The last row read is also left in the row buffer
+ * of the results, like if it was read by tds_process_tokens.
+ * \tds
+ * \param batch batch to fill, allocated using tds_alloc_batch for current results
+ * \return TDS_SUCCESS or TDS_FAIL, batch->num_rows contains rows read
+ */
+TDSRET
+tds_process_row_batch(TDSSOCKET * tds, TDSBATCH *batch)
+{
+	TDSRESULTINFO *info;
+	TDSCOLUMN *curcol;
+	TDSRET rc = TDS_SUCCESS;
+	unsigned char **saved_data;
+	unsigned int i;
+	TDS_UINT row;
+	int marker;
+
+	CHECK_TDS_EXTRA(tds);
+
+	batch->num_rows = 0;
+
+	info = tds->current_results;
+	if (!info || info->num_cols <= 0 || info->num_cols != batch->num_cols)
+		return TDS_FAIL;
+
+	if (tds_set_state(tds, TDS_READING) != TDS_READING)
+		return TDS_FAIL;
+
+	/* complete row left with a large value on the wire */
+	if (TDS_FAILED(tds_blob_stream_finish(tds)))
+		return TDS_FAIL;
+
+	saved_data = (unsigned char **) alloca(sizeof(unsigned char *) * info->num_cols);
+	for (i = 0; i < info->num_cols; i++) {
+		tds_column_reset_data(info->columns[i]);
+		saved_data[i] = info->columns[i]->column_data;
+	}
+
+	for (row = 0; row < batch->max_rows; ++row) {
+		marker = tds_peek(tds);
+		if (marker != TDS_ROW_TOKEN && marker != TDS_NBC_ROW_TOKEN)
+			break;
+		tds_get_byte(tds);
+		++tds->conn->stats.tokens[marker];
+
+		/* read directly into batch */
+		for (i = 0; i < info->num_cols; i++)
+			info->columns[i]->column_data = tds_batch_value(&batch->columns[i], row);
+
+		if (marker == TDS_ROW_TOKEN)
+			rc = tds_process_row(tds, false);
+		else
+			rc = tds_process_nbcrow(tds, false);
+		if (TDS_FAILED(rc))
+			break;
+
+		/* values must be in the batch */
+		tds_unpin_row_data(info);
+
+		for (i = 0; i < info->num_cols; i++) {
+			TDSBATCHCOLUMN *bcol = &batch->columns[i];
+			unsigned char mask = 1 << (row % 8);
+
+			curcol = info->columns[i];
+			bcol->lengths[row] = curcol->column_cur_size;
+			if (curcol->column_cur_size < 0)
+				bcol->nulls[row / 8] |= mask;
+			else
+				bcol->nulls[row / 8] &= ~mask;
+		}
+	}
+	batch->num_rows = row;
+	tds->conn->stats.rows += row;
+
+	for (i = 0; i < info->num_cols; i++) {
+		curcol = info->columns[i];
+		curcol->column_data = saved_data[i];
+		curcol->column_row_data = NULL;
+		/* last row read becomes the current row */
+		if (row > 0 && TDS_SUCCEED(rc))
+			rc = tds_batch_copy_value(curcol, &batch->columns[i], row - 1);
+	}
+
+	if (TDS_FAILED(rc)) {
+		tds_set_state(tds, TDS_DEAD);
+		return rc;
+	}
+	tds_set_state(tds, TDS_PENDING);
 	return TDS_SUCCESS;
 }
 
@@ -0,0 +1,1080 @@
+/* FreeTDS - Library of routines accessing Sybase and Microsoft databases
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * \file
+ * \brief Binary trace of the debug log.
+ *
+ * When the log is opened with TDS_DBGFLAG_BINARY in the debug flags
+ * messages are not formatted. Every thread appends compact records
+ * (time, level, source position, raw arguments) to its own ring buffer
+ * without taking any lock. A writer thread drains the buffers to the
+ * file. Records that do not fit in a full buffer are dropped and counted.
+ *
+ * Format strings and source file names are recorded by address and
+ * written once, so they must be constant strings, as they always are
+ * in the library. A forked child process does not write to the trace.
+ *
+ * tds_trace_decode() (used by the tdstrace utility) renders a binary
+ * trace as the usual text log.
+ */
+
+#include <config.h>
+
+#include <stdarg.h>
+
+#include <freetds/time.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <wchar.h>
+
+#if HAVE_STDLIB_H
+#include <stdlib.h>
+#endif /* HAVE_STDLIB_H */
+
+#if HAVE_STRING_H
+#include <string.h>
+#endif /* HAVE_STRING_H */
+
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+
+#ifdef _WIN32
+# include <process.h>
+#endif
+
+#include <freetds/tds.h>
+#include <freetds/thread.h>
+#include <freetds/utils.h>
+
+#undef MIN
+#define MIN(a,b) (((a) < (b)) ? (a) : (b))
+
+/** size of the buffer of every thread, must be a power of 2 */
+#define TRACE_RING_SIZE (256u * 1024u)
+/** maximum size of a log record */
+#define TRACE_MAX_LOG 2048u
+/** maximum number of bytes of a buffer dump recorded */
+#define TRACE_MAX_DUMP (16u * 1024u)
+/** maximum length of a string argument */
+#define TRACE_MAX_STRING 512u
+
+enum {
+	TRACE_STRING = 1,
+	TRACE_LOG,
+	TRACE_DUMP,
+	TRACE_DROPPED
+};
+
+/* memory ordering between the thread logging and the writer */
+#if defined(__ATOMIC_ACQUIRE)
+#define trace_load(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define trace_store(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#elif defined(_WIN32)
+#define trace_load(p) (MemoryBarrier(), *(volatile size_t *) (p))
+#define trace_store(p, v) do { MemoryBarrier(); *(volatile size_t *) (p) = (v); } while(0)
+#elif defined(__GNUC__)
+#define trace_load(p) (__sync_synchronize(), *(volatile size_t *) (p))
+#define trace_store(p, v) do { __sync_synchronize(); *(volatile size_t *) (p) = (v); } while(0)
+#else
+#define trace_load(p) (*(volatile size_t *) (p))
+#define trace_store(p, v) do { *(volatile size_t *) (p) = (v); } while(0)
+#endif
+
+/** record header inside rings */
+typedef struct
+{
+	TDS_UINT size;
+	unsigned char type;
+	unsigned char level;
+	TDS_USMALLINT unused;
+	TDS_UINT line;
+	TDS_UINT8 time;
+	const char *file;
+	const char *fmt;
+} TDSTRACEREC;
+
+/** buffer of a thread, written by the thread and read by the writer */
+typedef struct tds_trace_ring
+{
+	struct tds_trace_ring *next;
+	TDS_UINT thread;
+	/** set when thread terminated, the writer will free the buffer */
+	size_t orphan;
+	/** bytes written, updated by the thread */
+	size_t head;
+	/** bytes read, updated by the writer */
+	size_t tail;
+	/** records dropped, updated by the thread */
+	size_t dropped;
+	/** records dropped already reported by the writer */
+	size_t dropped_seen;
+	/** header of next record to write, used by the writer */
+	TDSTRACEREC pending;
+	int has_pending;
+	unsigned char data[TRACE_RING_SIZE];
+} TDSTRACERING;
+
+/** record header inside the file */
+typedef struct
+{
+	TDS_UINT size;
+	unsigned char type;
+	unsigned char level;
+	TDS_USMALLINT unused;
+	TDS_UINT thread;
+	TDS_UINT line;
+	TDS_UINT file;
+	TDS_UINT fmt;
+	TDS_UINT8 time;
+} TDSTRACEFILEREC;
+
+/** file header */
+typedef struct
+{
+	char magic[8];
+	TDS_UINT order;
+	TDS_UINT flags;
+	TDS_UINT pid;
+	TDS_UINT unused;
+	/** wall clock time at start, microseconds from 1970 */
+	TDS_UINT8 wall_time;
+	/** tds_gettime_us() at start */
+	TDS_UINT8 start_time;
+} TDSTRACEHEADER;
+
+static const char trace_magic[8] = "FTDSTRC1";
+
+/** a conversion in a printf format */
+typedef struct
+{
+	const char *start;
+	/** start of length modifier */
+	const char *mod;
+	const char *end;
+	/** 'h', 'l' (long), 'L' (long double), 'q' (64 bit), 'z', 't', 'j' or 0 */
+	char length;
+	char conv;
+	unsigned char stars;
+	/** precision, -1 if not specified, -2 if passed as argument */
+	int precision;
+} TDSTRACESPEC;
+
+/* all fields below are protected by g_trace_mutex */
+static tds_mutex g_trace_mutex = TDS_MUTEX_INITIALIZER;
+static TDSTRACERING *g_trace_rings = NULL;
+static TDS_UINT g_trace_threads = 0;
+static FILE *g_trace_file = NULL;
+/* map of addresses of constant strings to their identifiers in the file */
+static const void **g_trace_strings = NULL;
+static TDS_UINT g_trace_strings_size = 0, g_trace_strings_used = 0;
+static unsigned char *g_trace_record = NULL;
+
+#ifdef TDS_HAVE_MUTEX
+/* never destroyed, threads logging can signal it at any time */
+static tds_condition g_trace_cond;
+static int g_trace_cond_init = 0;
+static tds_thread g_trace_writer;
+static int g_trace_stop = 0;
+#endif
+
+#if defined(_THREAD_SAFE) && defined(TDS_HAVE_PTHREAD_MUTEX)
+static pthread_key_t g_trace_key;
+static pthread_once_t g_trace_key_once = PTHREAD_ONCE_INIT;
+
+static void
+tds_trace_release(void *ring)
+{
+	trace_store(&((TDSTRACERING *) ring)->orphan, 1);
+}
+
+/* the writer is not running in a child process, stop tracing there */
+static void
+tds_trace_fork_prepare(void)
+{
+	tds_mutex_lock(&g_trace_mutex);
+}
+
+static void
+tds_trace_fork_parent(void)
+{
+	tds_mutex_unlock(&g_trace_mutex);
+}
+
+static void
+tds_trace_fork_child(void)
+{
+	g_trace_file = NULL;
+	tds_mutex_unlock(&g_trace_mutex);
+}
+
+static void
+tds_trace_key_init(void)
+{
+	pthread_key_create(&g_trace_key, tds_trace_release);
+	pthread_atfork(tds_trace_fork_prepare, tds_trace_fork_parent, tds_trace_fork_child);
+}
+
+#define trace_key_init() pthread_once(&g_trace_key_once, tds_trace_key_init)
+#define trace_get_ring() ((TDSTRACERING *) pthread_getspecific(g_trace_key))
+#define trace_set_ring(ring) pthread_setspecific(g_trace_key, ring)
+#elif defined(_WIN32)
+static DWORD g_trace_key = TLS_OUT_OF_INDEXES;
+
+#define trace_key_init() do { \
+	if (g_trace_key == TLS_OUT_OF_INDEXES) g_trace_key = TlsAlloc(); } while(0)
+#define trace_get_ring() ((TDSTRACERING *) TlsGetValue(g_trace_key))
+#define trace_set_ring(ring) TlsSetValue(g_trace_key, ring)
+#else
+static TDSTRACERING *g_trace_ring = NULL;
+
+#define trace_key_init() do {} while(0)
+#define trace_get_ring() g_trace_ring
+#define trace_set_ring(ring) (g_trace_ring = (ring))
+#endif
+
+static TDS_UINT8
+tds_trace_wall_time(void)
+{
+#ifdef _WIN32
+	FILETIME ft;
+	TDS_UINT8 t;
+
+	GetSystemTimeAsFileTime(&ft);
+	t = ((TDS_UINT8) ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+	return (t - ((TDS_UINT8) 116444736u * 1000000000u)) / 10u;
+#elif defined(HAVE_GETTIMEOFDAY)
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (TDS_UINT8) tv.tv_sec * 1000000u + tv.tv_usec;
+#else
+	return (TDS_UINT8) time(NULL) * 1000000u;
+#endif
+}
+
+/**
+ * Find next conversion in a printf format.
+ * \return pointer to conversion or NULL if no more conversions
+ */
+static const char *
+tds_trace_next_spec(const char *fmt, TDSTRACESPEC *spec)
+{
+	const char *p;
+
+	for (;;) {
+		fmt = strchr(fmt, '%');
+		if (!fmt)
+			return NULL;
+		if (fmt[1] != '%')
+			break;
+		fmt += 2;
+	}
+
+	spec->start = fmt;
+	spec->length = 0;
+	spec->stars = 0;
+	spec->precision = -1;
+	p = fmt + 1;
+	while (*p && strchr("-+ #0'", *p))
+		++p;
+	for (; *p == '*' || *p == '.' || (*p >= '0' && *p <= '9'); ++p) {
+		if (*p == '*') {
+			++spec->stars;
+			if (spec->precision == 0)
+				spec->precision = -2;
+		} else if (*p == '.') {
+			spec->precision = 0;
+		} else if (spec->precision >= 0 && spec->precision < 0x10000) {
+			spec->precision = spec->precision * 10 + (*p - '0');
+		}
+	}
+	spec->mod = p;
+	switch (*p) {
+	case 'h':
+		spec->length = 'h';
+		if (*++p == 'h')
+			++p;
+		break;
+	case 'l':
+		spec->length = 'l';
+		if (*++p == 'l') {
+			spec->length = 'q';
+			++p;
+		}
+		break;
+	case 'q':
+		spec->length = 'q';
+		++p;
+		break;
+	case 'I':
+		if ((p[1] == '6' && p[2] == '4') || (p[1] == '3' && p[2] == '2')) {
+			spec->length = p[1] == '6' ? 'q' : 0;
+			p += 3;
+		}
+		break;
+	case 'L':
+	case 'z':
+	case 't':
+	case 'j':
+		spec->length = *p++;
+		break;
+	}
+	spec->conv = *p;
+	spec->end = *p ? p + 1 : p;
+	return fmt;
+}
+
+static unsigned char *
+tds_trace_put(unsigned char *p, char tag, const void *value, size_t len)
+{
+	*p++ = tag;
+	memcpy(p, value, len);
+	return p + len;
+}
+
+static unsigned char *
+tds_trace_put_int(unsigned char *p, TDS_INT8 value)
+{
+	return tds_trace_put(p, 'i', &value, sizeof(value));
+}
+
+/**
+ * Store arguments of a printf like function.
+ * \return end of data written
+ */
+static unsigned char *
+tds_trace_encode_args(unsigned char *p, unsigned char *end, const char *fmt, va_list ap)
+{
+	TDSTRACESPEC spec;
+	TDS_UINT8 u;
+	double d;
+	void *ptr;
+	const char *s;
+	const wchar_t *ws;
+	TDS_USMALLINT len, i;
+	int arg = -1;
+
+	while ((fmt = tds_trace_next_spec(fmt, &spec)) != NULL) {
+		fmt = spec.end;
+		/* a string can be shortened, other arguments always fit */
+		if (end - p < 32)
+			break;
+		for (; spec.stars; --spec.stars) {
+			arg = va_arg(ap, int);
+			p = tds_trace_put_int(p, arg);
+		}
+		/* precision is the last star, negative means not specified */
+		if (spec.precision == -2)
+			spec.precision = arg;
+		switch (spec.conv) {
+		case 'd':
+		case 'i':
+			switch (spec.length) {
+			case 'l': p = tds_trace_put_int(p, va_arg(ap, long)); break;
+			case 'q': p = tds_trace_put_int(p, va_arg(ap, TDS_INT8)); break;
+			case 'z': p = tds_trace_put_int(p, va_arg(ap, size_t)); break;
+			case 't': p = tds_trace_put_int(p, va_arg(ap, ptrdiff_t)); break;
+			case 'j': p = tds_trace_put_int(p, va_arg(ap, intmax_t)); break;
+			default:  p = tds_trace_put_int(p, va_arg(ap, int)); break;
+			}
+			break;
+		case 'o':
+		case 'u':
+		case 'x':
+		case 'X':
+			switch (spec.length) {
+			case 'l': u = va_arg(ap, unsigned long); break;
+			case 'q': u = va_arg(ap, TDS_UINT8); break;
+			case 'z': u = va_arg(ap, size_t); break;
+			case 't': u = va_arg(ap, ptrdiff_t); break;
+			case 'j': u = va_arg(ap, uintmax_t); break;
+			default:  u = va_arg(ap, unsigned int); break;
+			}
+			p = tds_trace_put(p, 'u', &u, sizeof(u));
+			break;
+		case 'c':
+			p = tds_trace_put_int(p, va_arg(ap, int));
+			break;
+		case 'e':
+		case 'E':
+		case 'f':
+		case 'F':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+			if (spec.length == 'L')
+				d = (double) va_arg(ap, long double);
+			else
+				d = va_arg(ap, double);
+			p = tds_trace_put(p, 'f', &d, sizeof(d));
+			break;
+		case 'p':
+			ptr = va_arg(ap, void *);
+			u = (TDS_UINTPTR) ptr;
+			p = tds_trace_put(p, 'p', &u, sizeof(u));
+			break;
+		case 'n':
+			(void) va_arg(ap, void *);
+			break;
+		case 's':
+			s = NULL;
+			ws = NULL;
+			if (spec.length == 'l')
+				ws = va_arg(ap, const wchar_t *);
+			else
+				s = va_arg(ap, const char *);
+			if (!s && !ws) {
+				*p++ = 'n';
+				break;
+			}
+			len = (TDS_USMALLINT) MIN((size_t) (end - p - 3), TRACE_MAX_STRING);
+			/* string can be not terminated, do not read past precision */
+			if (spec.precision >= 0 && spec.precision < len)
+				len = (TDS_USMALLINT) spec.precision;
+			if (s) {
+				len = (TDS_USMALLINT) strnlen(s, len);
+				memcpy(p + 3, s, len);
+			} else {
+				/* wide strings are recorded as ASCII */
+				for (i = 0; i < len && ws[i]; ++i)
+					p[3 + i] = ws[i] > 0 && ws[i] < 128 ? (unsigned char) ws[i] : '?';
+				len = i;
+			}
+			p = tds_trace_put(p, 's', &len, sizeof(len));
+			p += len;
+			break;
+		default:
+			/* unknown conversion, next arguments cannot be retrieved */
+			return p;
+		}
+	}
+	return p;
+}
+
+/**
+ * Allocate the buffer for current thread.
+ */
+static TDSTRACERING *
+tds_trace_new_ring(void)
+{
+	TDSTRACERING *ring;
+
+	ring = tds_new0(TDSTRACERING, 1);
+	if (!ring)
+		return NULL;
+
+	tds_mutex_lock(&g_trace_mutex);
+	ring->thread = ++g_trace_threads;
+	ring->next = g_trace_rings;
+	g_trace_rings = ring;
+	tds_mutex_unlock(&g_trace_mutex);
+
+	trace_set_ring(ring);
+	return ring;
+}
+
+static size_t tds_trace_drain(void);
+
+/**
+ * Append a record to the buffer of current thread.
+ * Never blocks, if there is no space the record is discarded.
+ */
+static void
+tds_trace_write(const void *rec, size_t rec_len, const void *data, size_t data_len)
+{
+	TDSTRACERING *ring = trace_get_ring();
+	size_t head, used, pos, part;
+
+	if (!ring && !(ring = tds_trace_new_ring()))
+		return;
+
+	head = ring->head;
+	used = head - trace_load(&ring->tail);
+	if (rec_len + data_len > TRACE_RING_SIZE - used) {
+		trace_store(&ring->dropped, ring->dropped + 1);
+		return;
+	}
+
+	pos = head & (TRACE_RING_SIZE - 1);
+	part = MIN(rec_len, TRACE_RING_SIZE - pos);
+	memcpy(ring->data + pos, rec, part);
+	memcpy(ring->data, (const char *) rec + part, rec_len - part);
+	if (data_len) {
+		pos = (head + rec_len) & (TRACE_RING_SIZE - 1);
+		part = MIN(data_len, TRACE_RING_SIZE - pos);
+		memcpy(ring->data + pos, data, part);
+		memcpy(ring->data, (const char *) data + part, data_len - part);
+	}
+	trace_store(&ring->head, head + rec_len + data_len);
+
+	/* wake up the writer early if the buffer is filling up */
+	if (used + rec_len + data_len > TRACE_RING_SIZE / 2) {
+#ifdef TDS_HAVE_MUTEX
+		tds_cond_signal(&g_trace_cond);
+#else
+		tds_trace_drain();
+#endif
+	}
+}
+
+static void
+tds_trace_init_rec(TDSTRACEREC *rec, int type, const char *file, unsigned int level_line)
+{
+	rec->type = type;
+	rec->level = level_line & 15;
+	rec->unused = 0;
+	rec->line = level_line >> 4;
+	rec->time = tds_gettime_us();
+	rec->file = file;
+	rec->fmt = NULL;
+}
+
+/**
+ * Record a log message.
+ * Parameters are the same of tdsdump_log().
+ */
+void
+tds_trace_log(const char *file, unsigned int level_line, const char *fmt, va_list ap)
+{
+	union {
+		TDSTRACEREC rec;
+		unsigned char buf[TRACE_MAX_LOG];
+	} u;
+	unsigned char *p;
+
+	tds_trace_init_rec(&u.rec, TRACE_LOG, file, level_line);
+	u.rec.fmt = fmt;
+	p = tds_trace_encode_args(u.buf + sizeof(u.rec), u.buf + sizeof(u.buf), fmt, ap);
+	u.rec.size = (TDS_UINT) (p - u.buf);
+	tds_trace_write(u.buf, u.rec.size, NULL, 0);
+}
+
+/**
+ * Record a dump of a buffer.
+ * Parameters are the same of tdsdump_dump_buf().
+ */
+void
+tds_trace_dump_buf(const char *file, unsigned int level_line, const char *msg, const void *buf, size_t length)
+{
+	union {
+		TDSTRACEREC rec;
+		unsigned char buf[sizeof(TDSTRACEREC) + 8 + TRACE_MAX_STRING];
+	} u;
+	unsigned char *p = u.buf + sizeof(u.rec);
+	TDS_USMALLINT msg_len = (TDS_USMALLINT) strnlen(msg, TRACE_MAX_STRING);
+	TDS_UINT total = (TDS_UINT) length;
+
+	tds_trace_init_rec(&u.rec, TRACE_DUMP, file, level_line);
+	memcpy(p, &total, sizeof(total));
+	memcpy(p + 4, &msg_len, sizeof(msg_len));
+	memcpy(p + 6, msg, msg_len);
+	p += 6 + msg_len;
+	length = MIN(length, TRACE_MAX_DUMP);
+	u.rec.size = (TDS_UINT) (p - u.buf + length);
+	tds_trace_write(u.buf, p - u.buf, buf, length);
+}
+
+/**
+ * Return identifier of a constant string, writing it to file if needed.
+ */
+static TDS_UINT
+tds_trace_string(const char *s)
+{
+	TDS_UINT i, hash;
+	struct {
+		TDS_UINT size;
+		unsigned char type;
+		unsigned char unused[3];
+		TDS_UINT id;
+	} rec;
+
+	if (!s)
+		return 0;
+
+	/* open addressing, identifiers start from 1 */
+	if (g_trace_strings_used * 2 >= g_trace_strings_size) {
+		TDS_UINT old_size = g_trace_strings_size;
+		const void **old = g_trace_strings;
+		TDS_UINT new_size = old_size ? old_size * 2 : 1024;
+
+		g_trace_strings = tds_new0(const void *, new_size * 2);
+		if (!g_trace_strings) {
+			g_trace_strings = old;
+			return 0;
+		}
+		g_trace_strings_size = new_size;
+		for (i = 0; i < old_size; ++i) {
+			if (!old[i * 2])
+				continue;
+			hash = (TDS_UINT) (((TDS_UINTPTR) old[i * 2] >> 3) & (new_size - 1));
+			while (g_trace_strings[hash * 2])
+				hash = (hash + 1) & (new_size - 1);
+			g_trace_strings[hash * 2] = old[i * 2];
+			g_trace_strings[hash * 2 + 1] = old[i * 2 + 1];
+		}
+		free(old);
+	}
+
+	hash = (TDS_UINT) (((TDS_UINTPTR) s >> 3) & (g_trace_strings_size - 1));
+	while (g_trace_strings[hash * 2]) {
+		if (g_trace_strings[hash * 2] == s)
+			return (TDS_UINT) (TDS_UINTPTR) g_trace_strings[hash * 2 + 1];
+		hash = (hash + 1) & (g_trace_strings_size - 1);
+	}
+
+	g_trace_strings[hash * 2] = s;
+	g_trace_strings[hash * 2 + 1] = (const void *) (TDS_UINTPTR) ++g_trace_strings_used;
+
+	rec.type = TRACE_STRING;
+	memset(rec.unused, 0, sizeof(rec.unused));
+	rec.id = g_trace_strings_used;
+	rec.size = (TDS_UINT) (sizeof(rec) + strlen(s) + 1);
+	fwrite(&rec, sizeof(rec), 1, g_trace_file);
+	fwrite(s, rec.size - sizeof(rec), 1, g_trace_file);
+	return rec.id;
+}
+
+static void
+tds_trace_ring_read(const TDSTRACERING *ring, size_t pos, void *dest, size_t len)
+{
+	size_t part;
+
+	pos &= TRACE_RING_SIZE - 1;
+	part = MIN(len, TRACE_RING_SIZE - pos);
+	memcpy(dest, ring->data + pos, part);
+	memcpy((char *) dest + part, ring->data, len - part);
+}
+
+/**
+ * Write all records available in the buffers to file.
+ * Records of different threads are merged by time.
+ * Called with g_trace_mutex locked.
+ * \return number of bytes read from buffers
+ */
+static size_t
+tds_trace_drain(void)
+{
+	TDSTRACERING *ring, **prev;
+	TDSTRACEREC best_rec;
+	TDSTRACEFILEREC frec;
+	TDSTRACERING *best;
+	size_t dropped, drained = 0;
+
+	if (!g_trace_file)
+		return 0;
+
+	if (!g_trace_record) {
+		g_trace_record = tds_new(unsigned char, TRACE_MAX_DUMP + 2 * TRACE_MAX_LOG);
+		if (!g_trace_record)
+			return 0;
+	}
+
+	for (;;) {
+		best = NULL;
+		for (ring = g_trace_rings; ring; ring = ring->next) {
+			if (!ring->has_pending) {
+				if (ring->tail == trace_load(&ring->head))
+					continue;
+				tds_trace_ring_read(ring, ring->tail, &ring->pending, sizeof(ring->pending));
+				ring->has_pending = 1;
+			}
+			if (!best || ring->pending.time < best->pending.time)
+				best = ring;
+		}
+		if (!best)
+			break;
+		best_rec = best->pending;
+		best->has_pending = 0;
+
+		frec.size = (TDS_UINT) (best_rec.size - sizeof(best_rec) + sizeof(frec));
+		frec.type = best_rec.type;
+		frec.level = best_rec.level;
+		frec.unused = 0;
+		frec.thread = best->thread;
+		frec.line = best_rec.line;
+		frec.file = tds_trace_string(best_rec.file);
+		frec.fmt = tds_trace_string(best_rec.fmt);
+		frec.time = best_rec.time;
+		tds_trace_ring_read(best, best->tail + sizeof(best_rec), g_trace_record, best_rec.size - sizeof(best_rec));
+		trace_store(&best->tail, best->tail + best_rec.size);
+		drained += best_rec.size;
+
+		fwrite(&frec, sizeof(frec), 1, g_trace_file);
+		fwrite(g_trace_record, best_rec.size - sizeof(best_rec), 1, g_trace_file);
+	}
+
+	/* report dropped records and free buffers of terminated threads */
+	prev = &g_trace_rings;
+	while ((ring = *prev) != NULL) {
+		dropped = trace_load(&ring->dropped);
+		if (dropped != ring->dropped_seen) {
+			TDS_UINT8 count = dropped - ring->dropped_seen;
+
+			memset(&frec, 0, sizeof(frec));
+			frec.size = sizeof(frec) + sizeof(count);
+			frec.type = TRACE_DROPPED;
+			frec.thread = ring->thread;
+			frec.time = tds_gettime_us();
+			fwrite(&frec, sizeof(frec), 1, g_trace_file);
+			fwrite(&count, sizeof(count), 1, g_trace_file);
+			ring->dropped_seen = dropped;
+		}
+		if (trace_load(&ring->orphan) && ring->tail == trace_load(&ring->head)) {
+			*prev = ring->next;
+			free(ring);
+			continue;
+		}
+		prev = &ring->next;
+	}
+
+	fflush(g_trace_file);
+	return drained;
+}
+
+#ifdef TDS_HAVE_MUTEX
+static TDS_THREAD_PROC_DECLARE(tds_trace_writer, arg)
+{
+	tds_mutex_lock(&g_trace_mutex);
+	while (!g_trace_stop) {
+		/* sleep only if threads are not logging heavily */
+		if (tds_trace_drain() < TRACE_RING_SIZE / 4)
+			tds_cond_timedwait(&g_trace_cond, &g_trace_mutex, 1);
+	}
+	tds_trace_drain();
+	tds_mutex_unlock(&g_trace_mutex);
+	return NULL;
+}
+#endif
+
+/**
+ * Start writing binary trace to a file.
+ * \param file opened file, must stay opened till tds_trace_stop()
+ * \return TDS_SUCCESS on success
+ */
+TDSRET
+tds_trace_start(FILE *file)
+{
+	TDSTRACEHEADER hdr;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, trace_magic, sizeof(hdr.magic));
+	hdr.order = 0x01020304;
+	hdr.flags = tds_debug_flags;
+	hdr.pid = (TDS_UINT) getpid();
+	hdr.wall_time = tds_trace_wall_time();
+	hdr.start_time = tds_gettime_us();
+	if (fwrite(&hdr, sizeof(hdr), 1, file) != 1 || fflush(file) != 0)
+		return TDS_FAIL;
+
+	trace_key_init();
+	tds_mutex_lock(&g_trace_mutex);
+	g_trace_file = file;
+	TDS_ZERO_FREE(g_trace_strings);
+	g_trace_strings_size = g_trace_strings_used = 0;
+#ifdef TDS_HAVE_MUTEX
+	g_trace_stop = 0;
+	if (!g_trace_cond_init && tds_cond_init(&g_trace_cond) == 0)
+		g_trace_cond_init = 1;
+	if (!g_trace_cond_init || tds_thread_create(&g_trace_writer, tds_trace_writer, NULL)) {
+		g_trace_file = NULL;
+		tds_mutex_unlock(&g_trace_mutex);
+		return TDS_FAIL;
+	}
+#endif
+	tds_mutex_unlock(&g_trace_mutex);
+	return TDS_SUCCESS;
+}
+
+/**
+ * Stop writing binary trace, all pending records are written.
+ * The file is not closed.
+ */
+void
+tds_trace_stop(void)
+{
+#ifdef TDS_HAVE_MUTEX
+	tds_mutex_lock(&g_trace_mutex);
+	if (!g_trace_file) {
+		tds_mutex_unlock(&g_trace_mutex);
+		return;
+	}
+	g_trace_stop = 1;
+	tds_cond_signal(&g_trace_cond);
+	tds_mutex_unlock(&g_trace_mutex);
+	tds_thread_join(g_trace_writer, NULL);
+#endif
+
+	tds_mutex_lock(&g_trace_mutex);
+	tds_trace_drain();
+	g_trace_file = NULL;
+	TDS_ZERO_FREE(g_trace_strings);
+	g_trace_strings_size = g_trace_strings_used = 0;
+	TDS_ZERO_FREE(g_trace_record);
+	tds_mutex_unlock(&g_trace_mutex);
+}
+
+/**
+ * Print a part of a format without conversions.
+ */
+static void
+tds_trace_print_literal(FILE *out, const char *s, const char *end)
+{
+	for (; s < end; ++s) {
+		if (*s == '%' && s + 1 < end && s[1] == '%')
+			++s;
+		putc(*s, out);
+	}
+}
+
+/**
+ * Print a log record using its format.
+ */
+static void
+tds_trace_print_args(FILE *out, const char *fmt, const unsigned char *p, const unsigned char *end)
+{
+	TDSTRACESPEC spec;
+	const char *s;
+	char conv[64], *c, str[TRACE_MAX_STRING + 1];
+	TDS_INT8 i;
+	TDS_UINT8 u;
+	double d;
+	TDS_USMALLINT len;
+
+#define GET(dest) do { \
+	if (end - p < (ptrdiff_t) sizeof(dest) + 1) goto missing; \
+	memcpy(&dest, p + 1, sizeof(dest)); p += 1 + sizeof(dest); } while(0)
+
+	while ((s = tds_trace_next_spec(fmt, &spec)) != NULL) {
+		tds_trace_print_literal(out, fmt, s);
+		fmt = spec.end;
+
+		/* build a conversion using recorded types */
+		c = conv;
+		for (; s < spec.mod && c < conv + 40; ++s) {
+			if (*s == '*') {
+				GET(i);
+				/* negative precision is taken as omitted */
+				if (i < 0 && c[-1] == '.')
+					--c;
+				else
+					c += sprintf(c, "%d", (int) i);
+			} else {
+				*c++ = *s;
+			}
+		}
+		switch (spec.conv) {
+		case 'd':
+		case 'i':
+		case 'c':
+			GET(i);
+			if (spec.conv == 'c') {
+				strcpy(c, "c");
+				fprintf(out, conv, (int) i);
+			} else {
+				sprintf(c, "%s%c", TDS_I64_PREFIX, spec.conv);
+				fprintf(out, conv, i);
+			}
+			break;
+		case 'o':
+		case 'u':
+		case 'x':
+		case 'X':
+			GET(u);
+			sprintf(c, "%s%c", TDS_I64_PREFIX, spec.conv);
+			fprintf(out, conv, u);
+			break;
+		case 'e':
+		case 'E':
+		case 'f':
+		case 'F':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+			GET(d);
+			sprintf(c, "%c", spec.conv);
+			fprintf(out, conv, d);
+			break;
+		case 'p':
+			GET(u);
+			strcpy(c, "p");
+			fprintf(out, conv, (void *) (TDS_UINTPTR) u);
+			break;
+		case 'n':
+			break;
+		case 's':
+			if (p < end && *p == 'n') {
+				++p;
+				strcpy(c, "s");
+				fprintf(out, conv, "(null)");
+				break;
+			}
+			GET(len);
+			if (end - p < len)
+				goto missing;
+			memcpy(str, p, len);
+			str[len] = 0;
+			p += len;
+			strcpy(c, "s");
+			fprintf(out, conv, str);
+			break;
+		default:
+			goto missing;
+		}
+	}
+	tds_trace_print_literal(out, fmt, strchr(fmt, 0));
+	return;
+
+missing:
+	/* truncated record, print the rest of format as is */
+	fputs(spec.start, out);
+#undef GET
+}
+
+static const char *
+tds_trace_get_string(char **strings, TDS_UINT num_strings, TDS_UINT id)
+{
+	if (id == 0 || id > num_strings || !strings[id - 1])
+		return "";
+	return strings[id - 1];
+}
+
+/**
+ * Convert a binary trace to the text format of the log.
+ * \param in  binary trace
+ * \param out text output
+ * \return TDS_SUCCESS on success, TDS_FAIL if input is not a valid trace
+ */
+TDSRET
+tds_trace_decode(FILE *in, FILE *out)
+{
+	TDSTRACEHEADER hdr;
+	TDSTRACEFILEREC rec;
+	unsigned char *data = NULL;
+	size_t data_size = 0, len;
+	char **strings = NULL;
+	TDS_UINT num_strings = 0, id, total;
+	TDSRET ret = TDS_FAIL;
+
+	if (fread(&hdr, sizeof(hdr), 1, in) != 1 || memcmp(hdr.magic, trace_magic, sizeof(hdr.magic)) != 0
+	    || hdr.order != 0x01020304)
+		return TDS_FAIL;
+
+	for (;;) {
+		/* records are at least as big as string ones */
+		if (fread(&rec, 12, 1, in) != 1) {
+			ret = feof(in) ? TDS_SUCCESS : TDS_FAIL;
+			break;
+		}
+		if (rec.size < 12)
+			break;
+		if (rec.type != TRACE_STRING) {
+			if (rec.size < sizeof(rec)
+			    || fread((char *) &rec + 12, sizeof(rec) - 12, 1, in) != 1)
+				break;
+			len = rec.size - sizeof(rec);
+		} else {
+			len = rec.size - 12;
+		}
+		if (len + 1 > data_size) {
+			if (!TDS_RESIZE(data, len + 1))
+				break;
+			data_size = len + 1;
+		}
+		if (len && fread(data, len, 1, in) != 1)
+			break;
+		data[len] = 0;
+
+		if (rec.type == TRACE_STRING) {
+			/* identifier is just after the type */
+			id = rec.thread;
+			if (id == 0 || id > 0x1000000u)
+				break;
+			if (id > num_strings) {
+				TDS_UINT n = num_strings;
+
+				if (!TDS_RESIZE(strings, id))
+					break;
+				num_strings = id;
+				while (n < id)
+					strings[n++] = NULL;
+			}
+			free(strings[id - 1]);
+			strings[id - 1] = strdup((const char *) data);
+			continue;
+		}
+
+		if (rec.type == TRACE_DROPPED) {
+			TDS_UINT8 count = 0;
+
+			memcpy(&count, data, MIN(len, sizeof(count)));
+			fprintf(out, "*** %" PRIu64 " log records of thread %u dropped ***\n", count, (unsigned) rec.thread);
+			continue;
+		}
+
+		if (rec.type != TRACE_LOG && rec.type != TRACE_DUMP)
+			continue;
+
+		/* same prefix of text log */
+		{
+			char timestamp[64];
+			TDS_UINT8 t = hdr.wall_time + (rec.time - hdr.start_time);
+			time_t secs = (time_t) (t / 1000000u);
+			struct tm res;
+
+			timestamp[0] = 0;
+			if (tds_localtime_r(&secs, &res))
+				strftime(timestamp, sizeof(timestamp) - 8, "%H:%M:%S", &res);
+			sprintf(strchr(timestamp, 0), ".%06u", (unsigned) (t % 1000000u));
+			tdsdump_prefix(out, hdr.flags, timestamp, hdr.pid,
+				       tds_trace_get_string(strings, num_strings, rec.file), rec.line);
+		}
+
+		if (rec.type == TRACE_LOG) {
+			tds_trace_print_args(out, tds_trace_get_string(strings, num_strings, rec.fmt), data, data + len);
+			continue;
+		}
+
+		/* dump */
+		if (len < 6)
+			break;
+		memcpy(&total, data, 4);
+		{
+			TDS_USMALLINT msg_len;
+
+			memcpy(&msg_len, data + 4, 2);
+			if (len < 6u + msg_len)
+				break;
+			fprintf(out, "%.*s\n", (int) msg_len, data + 6);
+			len -= 6u + msg_len;
+			tdsdump_hex(out, data + 6 + msg_len, len);
+			if (total > len)
+				fprintf(out, "(%u bytes not traced)\n\n", (unsigned) (total - len));
+		}
+	}
+
+	while (num_strings)
+		free(strings[--num_strings]);
+	free(strings);
+	free(data);
+	return ret;
+}
@@ -0,0 +1,229 @@
+/* FreeTDS - Library of routines accessing Sybase and Microsoft databases
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: test tds_process_row_batch reading synthetic rows, both ROW
+ * and NBCROW tokens, gives the same values of reading them one by one.
+ */
+#include "common.h"
+#include <assert.h>
+
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+
+#include "replacements.h"
+
+#if HAVE_SOCKETPAIR
+
+#define NUM_COLS 3
+#define NUM_ROWS 10
+
+static TDS_SYS_SOCKET peer;
+static TEST_STREAM stream;
+
+static const TEST_COLUMN cols[NUM_COLS] = {
+	{ SYBINTN, 4, true },
+	{ XSYBVARBINARY, 100, true },
+	{ SYBIMAGE, 0x7fffffff, true },
+};
+
+/* size of values, -1 for NULL */
+static int
+value_len(int row, int col)
+{
+	if ((row + col) % 4 == 3)
+		return -1;
+	switch (col) {
+	case 0:
+		return 4;
+	case 1:
+		return row * 7 % 100;
+	}
+	return row * 50;
+}
+
+static void
+build_stream(void)
+{
+	int row, col, lens[NUM_COLS];
+
+	test_stream_metadata(&stream, cols, NUM_COLS);
+
+	/* even rows use ROW, odd ones NBCROW */
+	for (row = 0; row < NUM_ROWS; ++row) {
+		for (col = 0; col < NUM_COLS; ++col)
+			lens[col] = value_len(row, col);
+		test_stream_row(&stream, cols, NUM_COLS, row, row % 2 != 0, lens);
+	}
+
+	test_stream_done(&stream, TDS_DONE_COUNT, NUM_ROWS);
+}
+
+static void
+check_value(int row, int col, TDS_INT size, const unsigned char *data, bool blob)
+{
+	if (blob && size >= 0) {
+		const TDSBLOB *b = (const TDSBLOB *) data;
+
+		assert(b->valid_ptr && memcmp(b->textptr, "pppppppppppppppp", 16) == 0);
+	}
+	test_check_value(row, col, value_len(row, col), size, data, blob);
+}
+
+/* send the whole response again, rows are split across packets */
+static void
+start(TDSSOCKET * tds)
+{
+	TDS_INT result_type;
+	int done_flags;
+
+	stream.sent = 0;
+	test_stream_send(&stream, peer, 0, 512, true);
+	tds->state = TDS_PENDING;
+
+	assert(tds_process_tokens(tds, &result_type, &done_flags, TDS_RETURN_ROWFMT) == TDS_SUCCESS);
+	assert(result_type == TDS_ROWFMT_RESULT);
+}
+
+static void
+finish(TDSSOCKET * tds)
+{
+	TDS_INT result_type;
+	int done_flags;
+
+	assert(tds_process_tokens(tds, &result_type, &done_flags, TDS_RETURN_DONE) == TDS_SUCCESS);
+	assert(result_type == TDS_DONE_RESULT);
+	assert(tds_process_tokens(tds, &result_type, &done_flags, TDS_RETURN_DONE) == TDS_NO_MORE_RESULTS);
+	assert(tds->in_pos == tds->in_len && tds->state == TDS_IDLE);
+}
+
+/* read rows one by one, the generic way */
+static void
+read_rows(TDSSOCKET * tds)
+{
+	TDS_INT result_type;
+	int done_flags, row, col;
+	TDSRESULTINFO *info;
+
+	start(tds);
+	info = tds->current_results;
+	for (row = 0; row < NUM_ROWS; ++row) {
+		assert(tds_process_tokens(tds, &result_type, &done_flags, TDS_RETURN_ROW) == TDS_SUCCESS);
+		assert(result_type == TDS_ROW_RESULT);
+		for (col = 0; col < NUM_COLS; ++col) {
+			TDSCOLUMN *curcol = info->columns[col];
+
+			check_value(row, col, curcol->column_cur_size, curcol->column_data, col == 2);
+		}
+	}
+	finish(tds);
+}
+
+static void
+read_batches(TDSSOCKET * tds, TDS_UINT batch_rows)
+{
+	TDS_INT result_type;
+	int done_flags, row = 0, col;
+	TDSRESULTINFO *info;
+	TDSBATCH *batch;
+	TDS_UINT n;
+
+	start(tds);
+	info = tds->current_results;
+	batch = tds_alloc_batch(info, batch_rows);
+	assert(batch && batch->num_cols == NUM_COLS);
+	assert(tds_process_tokens(tds, &result_type, &done_flags, TDS_STOPAT_ROW) == TDS_SUCCESS);
+	assert(result_type == TDS_ROW_RESULT);
+
+	for (;;) {
+		assert(tds_process_row_batch(tds, batch) == TDS_SUCCESS);
+		assert(batch->num_rows <= batch_rows);
+		if (!batch->num_rows)
+			break;
+		for (n = 0; n < batch->num_rows; ++n, ++row) {
+			for (col = 0; col < NUM_COLS; ++col) {
+				TDSBATCHCOLUMN *bcol = &batch->columns[col];
+
+				assert(tds_batch_is_null(bcol, n) == (value_len(row, col) < 0));
+				check_value(row, col, bcol->lengths[n], tds_batch_value(bcol, n), bcol->is_blob);
+			}
+		}
+		/* last row is also the current one */
+		for (col = 0; col < NUM_COLS; ++col) {
+			TDSCOLUMN *curcol = info->columns[col];
+
+			check_value(row - 1, col, curcol->column_cur_size, curcol->column_data, col == 2);
+		}
+	}
+	assert(row == NUM_ROWS);
+	assert(tds->state == TDS_PENDING);
+	finish(tds);
+	tds_free_batch(batch);
+}
+
+int
+main(void)
+{
+	TDSCONTEXT *ctx;
+	TDSSOCKET *tds;
+	TDSRESULTINFO *info;
+	TDSBATCH *batch;
+	TDS_UINT batch_rows;
+
+	build_stream();
+
+	ctx = tds_alloc_context(NULL);
+	assert(ctx);
+	tds = tds_alloc_socket(ctx, 512);
+	assert(tds);
+	tds->conn->tds_version = 0x703;
+	peer = test_stream_connect(tds);
+
+	read_rows(tds);
+	for (batch_rows = 1; batch_rows <= NUM_ROWS + 1; ++batch_rows)
+		read_batches(tds, batch_rows);
+
+	/* batch must match current results */
+	info = tds->current_results;
+	assert(tds_alloc_batch(info, 0) == NULL);
+	assert(tds_alloc_batch(NULL, 4) == NULL);
+	batch = tds_alloc_batch(info, 4);
+	assert(batch);
+	--batch->num_cols;
+	start(tds);
+	assert(tds_process_row_batch(tds, batch) == TDS_FAIL);
+	++batch->num_cols;
+	tds_free_batch(batch);
+
+	tds_free_socket(tds);
+	CLOSESOCKET(peer);
+	tds_free_context(ctx);
+	test_stream_free(&stream);
+
+	return 0;
+}
+
+#else
+int
+main(void)
+{
+	fprintf(stderr, "Not possible for this platform.\n");
+	return 0;
+}
+#endif
@@ -0,0 +1,331 @@
+/* FreeTDS - Library of routines accessing Sybase and Microsoft databases
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: test large values can be read incrementally from the wire
+ * using TDS_TOKEN_STREAM_BLOBS or skipped and read later.
+ */
+#include "common.h"
+#include <assert.h>
+
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+
+#include "replacements.h"
+
+#if HAVE_SOCKETPAIR
+
+static TDS_SYS_SOCKET peer;
+static TEST_STREAM stream;
+
+/* int, varbinary(max), image, int */
+static const TEST_COLUMN cols[] = {
+	{ SYBINTN, 4, true },
+	{ XSYBVARBINARY, 0xffff, true },
+	{ SYBIMAGE, 0x7fffffff, true },
+	{ SYBINTN, 4, true },
+};
+
+static void
+build_stream(void)
+{
+	static const unsigned chunks0[] = { 1000, 1500, 500, 0 };
+	static const unsigned chunks2[] = { 10, 20, 0 };
+	static const unsigned chunks3[] = { 0 };
+
+	test_stream_metadata(&stream, cols, 4);
+
+	/* row 0, large values split in chunks */
+	test_stream_byte(&stream, TDS_ROW_TOKEN);
+	test_stream_value(&stream, &cols[0], 0, 0, 4);
+	test_stream_plp(&stream, 0, 1, 3000, chunks0);
+	test_stream_value(&stream, &cols[2], 0, 2, 2000);
+	test_stream_value(&stream, &cols[3], 0, 3, 4);
+
+	/* row 1, NULL varbinary(max) */
+	test_stream_byte(&stream, TDS_NBC_ROW_TOKEN);
+	test_stream_byte(&stream, 2);
+	test_stream_value(&stream, &cols[0], 1, 0, 4);
+	test_stream_value(&stream, &cols[2], 1, 2, 100);
+	test_stream_value(&stream, &cols[3], 1, 3, 4);
+
+	/* row 2, unknown size, NULL image */
+	test_stream_byte(&stream, TDS_ROW_TOKEN);
+	test_stream_value(&stream, &cols[0], 2, 0, 4);
+	test_stream_plp(&stream, 2, 1, -2, chunks2);
+	test_stream_value(&stream, &cols[2], 2, 2, -1);
+	test_stream_value(&stream, &cols[3], 2, 3, 4);
+
+	/* row 3, empty values */
+	test_stream_byte(&stream, TDS_ROW_TOKEN);
+	test_stream_value(&stream, &cols[0], 3, 0, 4);
+	test_stream_plp(&stream, 3, 1, 0, chunks3);
+	test_stream_value(&stream, &cols[2], 3, 2, 0);
+	test_stream_value(&stream, &cols[3], 3, 3, 4);
+
+	test_stream_done(&stream, TDS_DONE_COUNT, 4);
+}
+
+/* send the whole response again, in a single packet */
+static void
+start(TDSSOCKET *tds)
+{
+	stream.sent = 0;
+	test_stream_send(&stream, peer, 0, 0, true);
+	tds->state = TDS_PENDING;
+}
+
+static TDSRESULTINFO *
+next_row(TDSSOCKET *tds, unsigned flag)
+{
+	TDS_INT result_type;
+	int done_flags;
+
+	assert(tds_process_tokens(tds, &result_type, &done_flags, TDS_RETURN_ROW|flag) == TDS_SUCCESS);
+	assert(result_type == TDS_ROW_RESULT);
+	assert(tds->current_results && tds->current_results->num_cols == 4);
+	return tds->current_results;
+}
+
+static void
+end_results(TDSSOCKET *tds)
+{
+	TDS_INT result_type;
+	int done_flags;
+
+	assert(tds_process_tokens(tds, &result_type, &done_flags, TDS_RETURN_ROW|TDS_TOKEN_STREAM_BLOBS) == TDS_NO_MORE_RESULTS);
+	assert(tds->in_pos == tds->in_len);
+	assert(tds->blob_stream.info == NULL && tds->blob_stream.column == NULL);
+}
+
+static void
+check_int(TDSCOLUMN *col, int row, int cnum)
+{
+	test_check_value(row, cnum, 4, col->column_cur_size, col->column_data, false);
+}
+
+/* read streamed value checking its content */
+static void
+check_stream(TDSSOCKET *tds, int row, int col, unsigned len, unsigned bufsize)
+{
+	unsigned char buf[1024];
+	unsigned pos = 0, i;
+	int n;
+
+	assert(bufsize <= sizeof(buf));
+	while ((n = tds_blob_stream_read(tds, buf, bufsize)) > 0) {
+		assert((unsigned) n <= bufsize);
+		for (i = 0; i < (unsigned) n; ++i)
+			assert(buf[i] == test_value_byte(row, col, pos + i));
+		pos += n;
+	}
+	assert(n == 0);
+	assert(pos == len);
+	/* end of value is sticky */
+	assert(tds_blob_stream_read(tds, buf, bufsize) == 0);
+}
+
+static void
+check_blob(TDSCOLUMN *col, int row, int cnum, int len)
+{
+	test_check_value(row, cnum, len, col->column_cur_size, col->column_data, true);
+}
+
+int
+main(int argc, char **argv)
+{
+	TDSCONTEXT *ctx;
+	TDSSOCKET *tds;
+	TDSRESULTINFO *info;
+	unsigned char buf[16];
+	TDS_INT result_type;
+	int done_flags;
+
+	build_stream();
+
+	ctx = tds_alloc_context(NULL);
+	assert(ctx);
+	tds = tds_alloc_socket(ctx, 512);
+	assert(tds);
+	tds->conn->tds_version = 0x702;
+	peer = test_stream_connect(tds);
+
+	/* values are read as usual without the flag */
+	start(tds);
+	info = next_row(tds, 0);
+	check_int(info->columns[0], 0, 0);
+	check_blob(info->columns[1], 0, 1, 3000);
+	check_blob(info->columns[2], 0, 2, 2000);
+	check_int(info->columns[3], 0, 3);
+	assert(tds->blob_stream.column == NULL);
+	info = next_row(tds, 0);
+	assert(info->columns[1]->column_cur_size == -1);
+	check_blob(info->columns[2], 1, 2, 100);
+	info = next_row(tds, 0);
+	check_blob(info->columns[1], 2, 1, 30);
+	assert(info->columns[2]->column_cur_size == -1);
+	info = next_row(tds, 0);
+	assert(info->columns[1]->column_cur_size == 0);
+	assert(info->columns[2]->column_cur_size == 0);
+	end_results(tds);
+
+	/* row is read up to first large value */
+	start(tds);
+	info = next_row(tds, TDS_TOKEN_STREAM_BLOBS);
+	check_int(info->columns[0], 0, 0);
+	assert(tds->blob_stream.column == info->columns[1]);
+	assert(tds->blob_stream.size == 3000);
+	assert(info->columns[1]->column_cur_size == 0);
+	assert(((TDSBLOB *) info->columns[1]->column_data)->textvalue == NULL);
+	check_stream(tds, 0, 1, 3000, 700);
+
+	/* stop at next large value */
+	assert(tds_blob_stream_next(tds, true) == TDS_SUCCESS);
+	assert(tds->blob_stream.column == info->columns[2]);
+	assert(tds->blob_stream.size == 2000);
+	assert(((TDSBLOB *) info->columns[2]->column_data)->valid_ptr);
+
+	/* rest of the value is discarded */
+	assert(tds_blob_stream_read(tds, buf, sizeof(buf)) == sizeof(buf));
+	assert(buf[0] == test_value_byte(0, 2, 0));
+	assert(tds_blob_stream_next(tds, true) == TDS_SUCCESS);
+	assert(tds->blob_stream.column == NULL);
+	check_int(info->columns[3], 0, 3);
+
+	/* NULL values are not streamed, unread row is completed reading next one */
+	info = next_row(tds, TDS_TOKEN_STREAM_BLOBS);
+	assert(info->columns[1]->column_cur_size == -1);
+	assert(tds->blob_stream.column == info->columns[2]);
+	assert(tds->blob_stream.size == 100);
+	info = next_row(tds, TDS_TOKEN_STREAM_BLOBS);
+	check_int(info->columns[0], 2, 0);
+	assert(tds->blob_stream.column == info->columns[1]);
+	assert(tds->blob_stream.size == -1);
+	check_stream(tds, 2, 1, 30, 1);
+	assert(tds_blob_stream_next(tds, true) == TDS_SUCCESS);
+	assert(tds->blob_stream.column == NULL);
+	assert(info->columns[2]->column_cur_size == -1);
+	check_int(info->columns[3], 2, 3);
+
+	/* empty values */
+	info = next_row(tds, TDS_TOKEN_STREAM_BLOBS);
+	assert(tds->blob_stream.column == NULL);
+	assert(info->columns[1]->column_cur_size == 0);
+	assert(info->columns[2]->column_cur_size == 0);
+	check_int(info->columns[3], 3, 3);
+	end_results(tds);
+
+	/* skipped values can be read later */
+	start(tds);
+	assert(tds_process_tokens(tds, &result_type, &done_flags, TDS_RETURN_ROWFMT) == TDS_SUCCESS);
+	info = tds->current_results;
+	info->columns[1]->column_lazy = 1;
+	info->columns[2]->column_lazy = 1;
+	info = next_row(tds, 0);
+	assert(info->columns[1]->column_cur_size == -1 && info->columns[1]->column_wire_data);
+	assert(info->columns[2]->column_cur_size == -1 && info->columns[2]->column_wire_data);
+	check_int(info->columns[3], 0, 3);
+	assert(tds_load_column(tds, info->columns[2]) == TDS_SUCCESS);
+	check_blob(info->columns[2], 0, 2, 2000);
+	assert(tds_load_column(tds, info->columns[1]) == TDS_SUCCESS);
+	check_blob(info->columns[1], 0, 1, 3000);
+	info = next_row(tds, 0);
+	assert(info->columns[1]->column_cur_size == -1 && !info->columns[1]->column_wire_data);
+	assert(info->columns[2]->column_wire_data);
+	info = next_row(tds, TDS_TOKEN_STREAM_BLOBS);
+	assert(tds->blob_stream.column == NULL);
+	assert(tds_load_column(tds, info->columns[1]) == TDS_SUCCESS);
+	check_blob(info->columns[1], 2, 1, 30);
+	assert(tds_load_column(tds, info->columns[2]) == TDS_SUCCESS);
+	assert(info->columns[2]->column_cur_size == -1);
+	info = next_row(tds, 0);
+	assert(tds_load_column(tds, info->columns[1]) == TDS_SUCCESS);
+	assert(info->columns[1]->column_cur_size == 0);
+	end_results(tds);
+
+	/* values not available anymore */
+	tds->in_packets++;
+	assert(tds_load_column(tds, info->columns[2]) == TDS_FAIL);
+	assert(info->columns[2]->column_cur_size == -1);
+
+	/* skipped values are read before the packet is replaced */
+	start(tds);
+	assert(tds_process_tokens(tds, &result_type, &done_flags, TDS_RETURN_ROWFMT) == TDS_SUCCESS);
+	info = tds->current_results;
+	info->columns[1]->column_lazy = 1;
+	info->columns[2]->column_lazy = 1;
+	info = next_row(tds, 0);
+	assert(tds->skipped_values);
+	tds_load_skipped_columns(tds);
+	assert(!tds->skipped_values);
+	tds->in_packets++;
+	check_blob(info->columns[1], 0, 1, 3000);
+	check_blob(info->columns[2], 0, 2, 2000);
+	next_row(tds, 0);
+	next_row(tds, 0);
+	info = next_row(tds, 0);
+	assert(tds_load_column(tds, info->columns[1]) == TDS_SUCCESS);
+	end_results(tds);
+
+	/* rows not returned are discarded without decoding them */
+	start(tds);
+	assert(tds_process_tokens(tds, &result_type, &done_flags, TDS_RETURN_DONE) == TDS_SUCCESS);
+	assert(result_type == TDS_DONE_RESULT);
+	assert(done_flags == TDS_DONE_COUNT && tds->rows_affected == 4);
+	assert(tds->in_pos == tds->in_len);
+	info = tds->current_results;
+	assert(info->rows_exist);
+	check_int(info->columns[3], 3, 3);
+	assert(info->columns[1]->column_cur_size == 0);
+
+	/* discard rows left, also while streaming */
+	start(tds);
+	info = next_row(tds, TDS_TOKEN_STREAM_BLOBS);
+	assert(tds->blob_stream.column == info->columns[1]);
+	assert(tds_discard_rows(tds) == TDS_SUCCESS);
+	assert(tds->state == TDS_PENDING);
+	assert(tds->blob_stream.info == NULL && tds->blob_stream.column == NULL);
+	assert(tds->in_buf[tds->in_pos] == TDS_DONE_TOKEN);
+	assert(tds_discard_rows(tds) == TDS_SUCCESS);
+	assert(tds->in_buf[tds->in_pos] == TDS_DONE_TOKEN);
+	assert(tds_process_tokens(tds, &result_type, &done_flags, TDS_RETURN_DONE) == TDS_SUCCESS);
+	assert(result_type == TDS_DONE_RESULT);
+	end_results(tds);
+
+	/* socket can be freed while streaming */
+	start(tds);
+	info = next_row(tds, TDS_TOKEN_STREAM_BLOBS);
+	assert(tds->blob_stream.column == info->columns[1]);
+
+	tds_free_socket(tds);
+	CLOSESOCKET(peer);
+	tds_free_context(ctx);
+	test_stream_free(&stream);
+
+	return 0;
+}
+
+#else
+int
+main(void)
+{
+	fprintf(stderr, "Not possible for this platform.\n");
+	return 0;
+}
+#endif
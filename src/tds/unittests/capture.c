@@ -0,0 +1,162 @@
+/* FreeTDS - Library of routines accessing Sybase and Microsoft databases
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: test capture of packets, packets read back must be the ones exchanged.
+ */
+#include "common.h"
+#include <assert.h>
+#include <freetds/bytes.h>
+
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+
+#if HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif /* HAVE_SYS_SOCKET_H */
+
+#if HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif /* HAVE_SYS_STAT_H */
+
+#include "replacements.h"
+
+#if HAVE_SOCKETPAIR
+
+static unsigned char reply[8 + 13 * 2];
+static unsigned char *buf = NULL;
+static size_t buf_size = 0;
+
+static void
+check_packet(FILE *f, int sent, const unsigned char *data, unsigned len, TDS_UINT8 *last_time)
+{
+	TDSCAPTURERECORD rec;
+
+	assert(tds_capture_read(f, &rec, &buf, &buf_size) == 1);
+	assert(rec.conn == 1);
+	assert(rec.sent == sent);
+	assert(rec.len == len);
+	assert(rec.time >= *last_time);
+	assert(memcmp(buf, data, len) == 0);
+	*last_time = rec.time;
+}
+
+int
+main(int argc, char **argv)
+{
+	TDSCONTEXT *ctx;
+	TDSSOCKET *tds;
+	TDS_SYS_SOCKET sv[2];
+	unsigned char packet[64], request[16], login[16], *p;
+	TDS_INT result_type;
+	int done_flags;
+	TDS_UINT8 last_time = 0;
+	TDSCAPTURERECORD rec;
+	FILE *f;
+
+	ctx = tds_alloc_context(NULL);
+	assert(ctx);
+	tds = tds_alloc_socket(ctx, 512);
+	assert(tds);
+	tds->conn->tds_version = 0x702;
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	assert(tds_socket_set_nonblocking(sv[0]) == 0);
+	tds_set_s(tds, sv[0]);
+
+	assert(tds_capture_open("capture.bin"));
+#if !defined(_WIN32)
+	{
+		struct stat st;
+
+		assert(stat("capture.bin", &st) == 0);
+		assert((st.st_mode & 077) == 0);
+	}
+#endif
+
+	/* login content is not recorded */
+	tds->state = TDS_WRITING;
+	tds->out_flag = TDS7_LOGIN;
+	tds_put_n(tds, "password", 8);
+	assert(tds_flush_packet(tds) == TDS_SUCCESS);
+	assert(READSOCKET(sv[1], login, sizeof(login)) == 8 + 8);
+	memset(login + 8, 0, 8);
+
+	/* request */
+	tds->state = TDS_WRITING;
+	tds->out_flag = TDS_QUERY;
+	tds_put_n(tds, "select 1", 8);
+	assert(tds_flush_packet(tds) == TDS_SUCCESS);
+	assert(READSOCKET(sv[1], request, sizeof(request)) == 8 + 8);
+
+	/* response */
+	p = reply + 8;
+	*p++ = TDS_DONE_TOKEN;
+	TDS_PUT_UA2LE(p, TDS_DONE_MORE_RESULTS);
+	memset(p + 2, 0, 10);
+	p += 12;
+	*p++ = TDS_DONE_TOKEN;
+	TDS_PUT_UA2LE(p, TDS_DONE_FINAL);
+	memset(p + 2, 0, 10);
+	reply[0] = TDS_REPLY;
+	reply[1] = 1;
+	TDS_PUT_UA2BE(reply + 2, sizeof(reply));
+	memset(reply + 4, 0, 4);
+	assert(WRITESOCKET(sv[1], reply, sizeof(reply)) == (int) sizeof(reply));
+
+	tds->state = TDS_PENDING;
+	while (tds->state != TDS_IDLE)
+		assert(tds_process_tokens(tds, &result_type, &done_flags, TDS_RETURN_DONE) == TDS_SUCCESS);
+
+	tds_capture_close();
+
+	/* packets are not captured anymore */
+	tds->state = TDS_WRITING;
+	tds->out_flag = TDS_QUERY;
+	tds_put_n(tds, "select 2", 8);
+	assert(tds_flush_packet(tds) == TDS_SUCCESS);
+	assert(READSOCKET(sv[1], packet, sizeof(packet)) == 8 + 8);
+
+	/* read back */
+	f = fopen("capture.bin", "rb");
+	assert(f);
+	assert(tds_capture_read_header(f));
+	check_packet(f, 1, login, sizeof(login), &last_time);
+	check_packet(f, 1, request, sizeof(request), &last_time);
+	check_packet(f, 0, reply, sizeof(reply), &last_time);
+	assert(tds_capture_read(f, &rec, &buf, &buf_size) == 0);
+	fclose(f);
+	free(buf);
+
+	tds_free_socket(tds);
+	CLOSESOCKET(sv[1]);
+	tds_free_context(ctx);
+
+	unlink("capture.bin");
+	return 0;
+}
+
+#else
+int
+main(void)
+{
+	fprintf(stderr, "Not possible for this platform.\n");
+	return 0;
+}
+#endif
@@ -1,5 +1,17 @@
 #define TDS_DONT_DEFINE_DEFAULT_FUNCTIONS
 #include "common.h"
+#include <assert.h>
+#include <freetds/bytes.h>
+
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+
+#if HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif /* HAVE_SYS_SOCKET_H */
+
+#include "replacements.h"
 
 char USER[512];
 char SERVER[512];
@@ -165,3 +177,272 @@ run_query(TDSSOCKET * tds, const char *query)
 
 	return TDS_SUCCESS;
 }
+
+/* make room for len more bytes, returns where to write them */
+static unsigned char *
+test_stream_reserve(TEST_STREAM * s, unsigned len)
+{
+	unsigned char *p;
+
+	if (s->len + len > s->size) {
+		s->size = (s->len + len) * 2 + 1024;
+		s->data = (unsigned char *) realloc(s->data, s->size);
+		assert(s->data);
+	}
+	p = s->data + s->len;
+	s->len += len;
+	return p;
+}
+
+void
+test_stream_free(TEST_STREAM * s)
+{
+	free(s->data);
+	memset(s, 0, sizeof(*s));
+}
+
+void
+test_stream_byte(TEST_STREAM * s, unsigned char b)
+{
+	*test_stream_reserve(s, 1) = b;
+}
+
+void
+test_stream_smallint(TEST_STREAM * s, TDS_USMALLINT n)
+{
+	TDS_PUT_UA2LE(test_stream_reserve(s, 2), n);
+}
+
+void
+test_stream_int(TEST_STREAM * s, TDS_UINT n)
+{
+	TDS_PUT_UA4LE(test_stream_reserve(s, 4), n);
+}
+
+void
+test_stream_int8(TEST_STREAM * s, TDS_INT8 n)
+{
+	test_stream_int(s, (TDS_UINT) n);
+	test_stream_int(s, (TDS_UINT) (n >> 32));
+}
+
+void
+test_stream_fill(TEST_STREAM * s, unsigned char fill, unsigned len)
+{
+	memset(test_stream_reserve(s, len), fill, len);
+}
+
+/* content of values, changes with row, column and position */
+unsigned char
+test_value_byte(int row, int col, unsigned pos)
+{
+	return (unsigned char) (row * 31 + col * 7 + pos);
+}
+
+void
+test_stream_data(TEST_STREAM * s, int row, int col, unsigned start, unsigned len)
+{
+	unsigned char *p = test_stream_reserve(s, len);
+	unsigned i;
+
+	for (i = 0; i < len; ++i)
+		p[i] = test_value_byte(row, col, start + i);
+}
+
+/* COLMETADATA for TDS 7.x, columns without names */
+void
+test_stream_metadata(TEST_STREAM * s, const TEST_COLUMN * cols, unsigned num_cols)
+{
+	const TEST_COLUMN *col;
+
+	test_stream_byte(s, TDS7_RESULT_TOKEN);
+	test_stream_smallint(s, num_cols);
+	for (col = cols; col < cols + num_cols; ++col) {
+		test_stream_int(s, 0);		/* user type */
+		test_stream_smallint(s, col->nullable ? 1 : 0);
+		test_stream_byte(s, col->type);
+		switch (col->type) {
+		case SYBINTN:
+			test_stream_byte(s, col->size);
+			break;
+		case XSYBVARBINARY:
+			test_stream_smallint(s, col->size);
+			break;
+		case SYBIMAGE:
+			test_stream_int(s, col->size);
+			test_stream_byte(s, 0);	/* table name parts */
+			break;
+		default:
+			break;
+		}
+		test_stream_byte(s, 0);		/* name */
+	}
+}
+
+/* value of column n, len < 0 for NULL, ignored for fixed columns */
+void
+test_stream_value(TEST_STREAM * s, const TEST_COLUMN * col, int row, int n, int len)
+{
+	switch (col->type) {
+	case SYBINTN:
+		test_stream_byte(s, len < 0 ? 0 : len);
+		break;
+	case XSYBVARBINARY:
+		if (col->size == 0xffff) {
+			unsigned chunks[2];
+
+			/* single chunk */
+			chunks[0] = len > 0 ? len : 0;
+			chunks[1] = 0;
+			test_stream_plp(s, row, n, len < 0 ? -1 : len, chunks);
+			return;
+		}
+		test_stream_smallint(s, len < 0 ? 0xffff : len);
+		break;
+	case SYBIMAGE:
+		if (len < 0) {
+			test_stream_byte(s, 0);
+			return;
+		}
+		test_stream_byte(s, 16);
+		test_stream_fill(s, 'p', 16);	/* text pointer */
+		test_stream_fill(s, 't', 8);	/* timestamp */
+		test_stream_int(s, len);
+		break;
+	default:
+		len = col->size;
+		break;
+	}
+	if (len > 0)
+		test_stream_data(s, row, n, 0, len);
+}
+
+/*
+ * varbinary(max) value split in chunks (0 terminated), size -1 for NULL,
+ * -2 for unknown size
+ */
+void
+test_stream_plp(TEST_STREAM * s, int row, int col, TDS_INT8 size, const unsigned *chunks)
+{
+	unsigned pos = 0;
+
+	test_stream_int8(s, size);
+	if (size == -1)
+		return;
+	for (; *chunks; ++chunks) {
+		test_stream_int(s, *chunks);
+		test_stream_data(s, row, col, pos, *chunks);
+		pos += *chunks;
+	}
+	test_stream_int(s, 0);
+}
+
+/* ROW or NBCROW token, lens[n] < 0 for NULL values */
+void
+test_stream_row(TEST_STREAM * s, const TEST_COLUMN * cols, unsigned num_cols, int row, bool nbc, const int *lens)
+{
+	unsigned char *bitmap;
+	unsigned n;
+
+	if (!nbc) {
+		test_stream_byte(s, TDS_ROW_TOKEN);
+		for (n = 0; n < num_cols; ++n)
+			test_stream_value(s, &cols[n], row, n, lens[n]);
+		return;
+	}
+
+	test_stream_byte(s, TDS_NBC_ROW_TOKEN);
+	bitmap = test_stream_reserve(s, (num_cols + 7) / 8);
+	memset(bitmap, 0, (num_cols + 7) / 8);
+	for (n = 0; n < num_cols; ++n)
+		if (lens[n] < 0)
+			bitmap[n / 8] |= 1 << (n % 8);
+	for (n = 0; n < num_cols; ++n)
+		if (lens[n] >= 0)
+			test_stream_value(s, &cols[n], row, n, lens[n]);
+}
+
+void
+test_stream_done(TEST_STREAM * s, TDS_USMALLINT status, TDS_UINT rows)
+{
+	test_stream_byte(s, TDS_DONE_TOKEN);
+	test_stream_smallint(s, status);
+	test_stream_smallint(s, 0);	/* current command */
+	test_stream_int(s, rows);
+	test_stream_int(s, 0);
+}
+
+/*
+ * Check a value read matches the one written by test_stream_value.
+ * size and data are the ones of the column, blob data point to a TDSBLOB.
+ */
+void
+test_check_value(int row, int col, int len, TDS_INT size, const void *data, bool blob)
+{
+	const unsigned char *p = (const unsigned char *) data;
+	int i;
+
+	if (len < 0) {
+		assert(size < 0);
+		return;
+	}
+	assert(size == len);
+	if (blob)
+		p = (const unsigned char *) ((const TDSBLOB *) data)->textvalue;
+	for (i = 0; i < len; ++i)
+		assert(p[i] == test_value_byte(row, col, i));
+}
+
+#if HAVE_SOCKETPAIR
+/* connect the socket to a fake server, returns the server side */
+TDS_SYS_SOCKET
+test_stream_connect(TDSSOCKET * tds)
+{
+	TDS_SYS_SOCKET sv[2];
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	assert(tds_socket_set_nonblocking(sv[0]) == 0);
+	tds_set_s(tds, sv[0]);
+	return sv[1];
+}
+#endif
+
+/*
+ * Send len bytes of the stream not sent yet (0 for all) in packets of
+ * packet_size bytes (0 for a single packet) with a single write, so the
+ * data must fit in the socket buffers.
+ * If final the last packet ends the response.
+ */
+void
+test_stream_send(TEST_STREAM * s, TDS_SYS_SOCKET peer, unsigned len, unsigned packet_size, bool final)
+{
+	unsigned char *buf, *p;
+	unsigned pos, end, chunk;
+
+	if (!len)
+		len = s->len - s->sent;
+	if (!packet_size)
+		packet_size = len ? len : 1;
+	assert(s->sent + len <= s->len && packet_size <= 0xffff - 8);
+
+	buf = (unsigned char *) malloc(len + (len / packet_size + 1) * 8);
+	assert(buf);
+	p = buf;
+	end = s->sent + len;
+	pos = s->sent;
+	do {
+		chunk = end - pos < packet_size ? end - pos : packet_size;
+		p[0] = TDS_REPLY;
+		p[1] = final && pos + chunk >= end ? 1 : 0;
+		TDS_PUT_UA2BE(p + 2, chunk + 8);
+		memset(p + 4, 0, 4);
+		if (chunk)
+			memcpy(p + 8, s->data + pos, chunk);
+		p += chunk + 8;
+		pos += chunk;
+	} while (pos < end);
+	assert(WRITESOCKET(peer, buf, p - buf) == (int) (p - buf));
+	free(buf);
+
+	s->sent = end;
+}
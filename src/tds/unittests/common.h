@@ -43,4 +43,38 @@ char *to_utf8(const char *src, char *dest);
 typedef void tds_any_type_t(TDSSOCKET *tds, TDSCOLUMN *col);
 void tds_all_types(TDSSOCKET *tds, tds_any_type_t *func);
 
+/* synthetic token streams, as sent by a server */
+typedef struct
+{
+	unsigned char *data;
+	unsigned len, size;
+	/** bytes already sent */
+	unsigned sent;
+} TEST_STREAM;
+
+typedef struct
+{
+	TDS_SERVER_TYPE type;
+	/** size of fixed columns, maximum size for others, 0xffff for varbinary(max) */
+	int size;
+	bool nullable;
+} TEST_COLUMN;
+
+void test_stream_free(TEST_STREAM * s);
+void test_stream_byte(TEST_STREAM * s, unsigned char b);
+void test_stream_smallint(TEST_STREAM * s, TDS_USMALLINT n);
+void test_stream_int(TEST_STREAM * s, TDS_UINT n);
+void test_stream_int8(TEST_STREAM * s, TDS_INT8 n);
+void test_stream_fill(TEST_STREAM * s, unsigned char fill, unsigned len);
+unsigned char test_value_byte(int row, int col, unsigned pos);
+void test_stream_data(TEST_STREAM * s, int row, int col, unsigned start, unsigned len);
+void test_stream_metadata(TEST_STREAM * s, const TEST_COLUMN * cols, unsigned num_cols);
+void test_stream_value(TEST_STREAM * s, const TEST_COLUMN * col, int row, int n, int len);
+void test_stream_plp(TEST_STREAM * s, int row, int col, TDS_INT8 size, const unsigned *chunks);
+void test_stream_row(TEST_STREAM * s, const TEST_COLUMN * cols, unsigned num_cols, int row, bool nbc, const int *lens);
+void test_stream_done(TEST_STREAM * s, TDS_USMALLINT status, TDS_UINT rows);
+void test_check_value(int row, int col, int len, TDS_INT size, const void *data, bool blob);
+TDS_SYS_SOCKET test_stream_connect(TDSSOCKET * tds);
+void test_stream_send(TEST_STREAM * s, TDS_SYS_SOCKET peer, unsigned len, unsigned packet_size, bool final);
+
 #endif
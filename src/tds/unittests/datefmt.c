@@ -0,0 +1,240 @@
+/* FreeTDS - Library of routines accessing Sybase and Microsoft databases
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Test compiled date formats give the same results of tds_strftime()
+ * and tds_datecrack() splits days correctly.
+ */
+
+#include "common.h"
+#include <freetds/convert.h>
+
+static int g_result = 0;
+
+static const char *const formats[] = {
+	"%b %d %Y %I:%M%p",
+	"%b %e %Y %I:%M:%S:%z%p",
+	"%b %d %Y %I:%M:%S:%z%p",
+	"%Y-%m-%d %H:%M:%S.%z",
+	"%Y-%m-%d",
+	"%H:%M:%S.%z",
+	"%Y-%m-%d %H:%M:%S",
+	"%d/%m/%y %H%M%S %j",
+	"%a %A %B %h",
+	"%%z %z %%",
+	"x%n%t%%Y.%z",
+	".%z",
+	"",
+	NULL
+};
+
+/* tds_strftime() handles these formats differently, they should not be compiled */
+static const char *const unsupported[] = {
+	"%Q",
+	"%Y %",
+	"%z",
+	"%z %H",
+	"%H %z %z",
+	"%%%z",
+	NULL
+};
+
+static void
+test(const char *format, const TDSDATEREC * dr, int prec)
+{
+	TDS_DATE_FORMAT *plan;
+	char expected[1024], result[1024];
+	size_t expected_len, len, size;
+
+	plan = tds_date_format_compile(format);
+	if (!plan) {
+		fprintf(stderr, "Error compiling format \"%s\"\n", format);
+		exit(1);
+	}
+
+	expected_len = tds_strftime(expected, sizeof(expected), format, dr, prec);
+	len = tds_date_format_apply(result, sizeof(result), plan, dr, prec);
+	if (len != expected_len || strcmp(result, expected) != 0) {
+		fprintf(stderr, "Format \"%s\" prec %d: got \"%s\" expected \"%s\"\n", format, prec, result, expected);
+		g_result = 1;
+	}
+
+	/* small buffers */
+	for (size = 0; size <= expected_len + 1; ++size) {
+		len = tds_date_format_apply(result, size, plan, dr, prec);
+		if (len != (size > expected_len ? expected_len : 0)) {
+			fprintf(stderr, "Format \"%s\" size %u: wrong length %u\n", format, (unsigned) size, (unsigned) len);
+			g_result = 1;
+		}
+	}
+
+	tds_date_format_free(plan);
+}
+
+/* check ISO formats, handled by tds_strftime() too, against strftime(3) */
+static void
+test_iso(const char *format, const TDSDATEREC * dr, int prec)
+{
+	char fmt[64], expected[128], result[128];
+	size_t len;
+
+	/* a trailing space avoids the ISO fast path */
+	snprintf(fmt, sizeof(fmt), "%s ", format);
+	len = tds_strftime(expected, sizeof(expected), fmt, dr, prec);
+	if (!len) {
+		fprintf(stderr, "Error formatting \"%s\"\n", fmt);
+		exit(1);
+	}
+	expected[len - 1] = 0;
+
+	len = tds_strftime(result, sizeof(result), format, dr, prec);
+	if (len != strlen(expected) || strcmp(result, expected) != 0) {
+		fprintf(stderr, "Format \"%s\" prec %d: got \"%s\" expected \"%s\"\n", format, prec, result, expected);
+		g_result = 1;
+	}
+}
+
+/* crack every day from 0001-01-01 to 9999-12-31 checking it follows the previous one */
+static void
+test_datecrack(void)
+{
+	static const int mdays[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+	TDSDATEREC prev, dr;
+	TDS_DATE days;
+	TDS_DATETIME dt;
+
+	/* 1900-01-01 is a Monday */
+	days = 0;
+	tds_datecrack(SYBDATE, &days, &dr);
+	if (dr.year != 1900 || dr.month != 0 || dr.day != 1 || dr.weekday != 1 || dr.dayofyear != 1) {
+		fprintf(stderr, "Wrong day 0\n");
+		g_result = 1;
+	}
+
+	days = -693595;
+	tds_datecrack(SYBDATE, &days, &prev);
+	if (prev.year != 1 || prev.month != 0 || prev.day != 1 || prev.dayofyear != 1) {
+		fprintf(stderr, "Wrong first day\n");
+		g_result = 1;
+	}
+	for (++days; days <= 2958463; ++days) {
+		int leap, last;
+
+		tds_datecrack(SYBDATE, &days, &dr);
+		leap = (prev.year % 4 == 0 && prev.year % 100 != 0) || prev.year % 400 == 0;
+		last = mdays[prev.month] + (prev.month == 1 && leap);
+		if (prev.day < last) {
+			++prev.day;
+			++prev.dayofyear;
+		} else if (prev.month < 11) {
+			prev.day = 1;
+			++prev.month;
+			++prev.dayofyear;
+		} else {
+			prev.day = 1;
+			prev.month = 0;
+			prev.dayofyear = 1;
+			++prev.year;
+		}
+		prev.quarter = prev.month / 3;
+		prev.weekday = (prev.weekday + 1) % 7;
+		if (memcmp(&prev, &dr, sizeof(dr)) != 0) {
+			fprintf(stderr, "Wrong date cracking day %d: %d-%d-%d\n", (int) days, dr.year, dr.month + 1, dr.day);
+			g_result = 1;
+			return;
+		}
+	}
+
+	/* time part */
+	dt.dtdays = 45364;
+	dt.dttime = ((23 * 60 + 59) * 60 + 58) * 300 + 299;
+	tds_datecrack(SYBDATETIME, &dt, &dr);
+	if (dr.year != 2024 || dr.month != 2 || dr.day != 15 || dr.hour != 23 || dr.minute != 59 || dr.second != 58
+	    || dr.decimicrosecond != 9970000) {
+		fprintf(stderr, "Wrong datetime cracking\n");
+		g_result = 1;
+	}
+}
+
+int
+main(void)
+{
+	static const TDSDATEREC fixed[] = {
+		/* year quarter month day dayofyear weekday hour minute second decimicrosecond timezone */
+		{ 1900, 0, 0, 1, 0, 1, 0, 0, 0, 0, 0 },
+		{ 2024, 0, 1, 29, 59, 4, 12, 30, 59, 9999999, 0 },
+		{ 9999, 3, 11, 31, 364, 5, 23, 59, 59, 9970000, 0 },
+		{ 1, 0, 0, 1, 0, 1, 11, 5, 7, 1234567, 0 },
+		{ 753, 2, 6, 9, 189, 0, 13, 0, 0, 10, 0 },
+	};
+	TDSDATEREC dr;
+	unsigned int seed = 12345, i;
+	const char *const *fmt;
+	int prec;
+
+	for (fmt = unsupported; *fmt; ++fmt) {
+		TDS_DATE_FORMAT *plan = tds_date_format_compile(*fmt);
+
+		if (plan) {
+			fprintf(stderr, "Format \"%s\" should not be compiled\n", *fmt);
+			tds_date_format_free(plan);
+			g_result = 1;
+		}
+	}
+
+	for (i = 0; i < 1000 + TDS_VECTOR_SIZE(fixed); ++i) {
+		if (i < TDS_VECTOR_SIZE(fixed)) {
+			dr = fixed[i];
+		} else {
+			memset(&dr, 0, sizeof(dr));
+#define RND(n) (seed = seed * 1103515245u + 12345u, (int) ((seed >> 8) % (n)))
+			dr.year = 1753 + RND(8247);
+			dr.month = RND(12);
+			dr.day = 1 + RND(28);
+			dr.dayofyear = RND(366);
+			dr.weekday = RND(7);
+			dr.hour = RND(24);
+			dr.minute = RND(60);
+			dr.second = RND(60);
+			dr.decimicrosecond = RND(10000000);
+		}
+		for (prec = -1; prec <= 8; ++prec) {
+			for (fmt = formats; *fmt; ++fmt)
+				test(*fmt, &dr, prec);
+			test_iso("%Y-%m-%d %H:%M:%S.%z", &dr, prec);
+			test_iso("%Y-%m-%d", &dr, prec);
+			test_iso("%H:%M:%S.%z", &dr, prec);
+		}
+	}
+
+	/* literal longer than 255 characters */
+	{
+		char fmt[600];
+
+		memset(fmt, 'x', 590);
+		strcpy(fmt + 590, "%Y.%z");
+		test(fmt, &fixed[1], 3);
+		test(fmt, &fixed[1], 0);
+	}
+
+	test_datecrack();
+
+	if (!g_result)
+		printf("All passed!\n");
+	return g_result;
+}
@@ -0,0 +1,237 @@
+/* FreeTDS - Library of routines accessing Sybase and Microsoft databases
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: test decoding of NBCROW tokens using synthetic wide rows.
+ * Check also that results are reused if metadata do not change and
+ * that only bindings with an owner are kept.
+ * If a number of iterations is passed the decoding is timed.
+ */
+#include "common.h"
+#include <assert.h>
+
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+
+#include "replacements.h"
+
+#if HAVE_SOCKETPAIR
+
+#define NUM_COLS 300
+#define NUM_ROWS 200
+
+static TDS_SYS_SOCKET peer;
+static TEST_STREAM stream;
+static TEST_COLUMN cols[NUM_COLS];
+
+static bool
+is_null(int row, int col)
+{
+	/* mostly NULLs, some rows without NULLs at all */
+	if (row % 10 == 0)
+		return false;
+	return (col * 7 + row) % 23 != 0;
+}
+
+static void
+build_stream(void)
+{
+	int row, col, lens[NUM_COLS];
+
+	/* all nullable integers */
+	for (col = 0; col < NUM_COLS; ++col) {
+		cols[col].type = SYBINTN;
+		cols[col].size = 4;
+		cols[col].nullable = true;
+	}
+	test_stream_metadata(&stream, cols, NUM_COLS);
+
+	for (row = 0; row < NUM_ROWS; ++row) {
+		for (col = 0; col < NUM_COLS; ++col)
+			lens[col] = is_null(row, col) ? -1 : 4;
+		test_stream_row(&stream, cols, NUM_COLS, row, true, lens);
+	}
+
+	test_stream_done(&stream, TDS_DONE_COUNT, NUM_ROWS);
+}
+
+/* send the whole response again */
+static void
+start(TDSSOCKET *tds)
+{
+	stream.sent = 0;
+	/* a single packet, skipped values stay available */
+	test_stream_send(&stream, peer, 0, 0, true);
+	tds->state = TDS_PENDING;
+}
+
+static void
+check_expand(void)
+{
+	unsigned char bitmap[64], nulls[512];
+	unsigned num_cols, i, n;
+
+	srand(1234);
+	for (num_cols = 1; num_cols <= 512; ++num_cols) {
+		for (i = 0; i < sizeof(bitmap); ++i)
+			bitmap[i] = (unsigned char) rand();
+		memset(nulls, 0xaa, sizeof(nulls));
+		tds_expand_null_bitmap(bitmap, num_cols, nulls);
+		for (n = 0; n < num_cols; ++n)
+			assert(nulls[n] == ((bitmap[n / 8] >> (n % 8)) & 1));
+		for (; n < sizeof(nulls); ++n)
+			assert(nulls[n] == 0xaa);
+	}
+}
+
+static void
+check_column(TDSCOLUMN *curcol, int row, int col)
+{
+	test_check_value(row, col, is_null(row, col) ? -1 : 4, curcol->column_cur_size, curcol->column_data, false);
+}
+
+/* odd columns are skipped and read only when requested */
+static void
+decode_lazy(TDSSOCKET *tds)
+{
+	TDS_INT result_type;
+	int done_flags, rows = 0, col;
+	TDSRESULTINFO *info;
+
+	start(tds);
+	assert(tds_process_tokens(tds, &result_type, &done_flags, TDS_RETURN_ROWFMT) == TDS_SUCCESS);
+	assert(result_type == TDS_ROWFMT_RESULT);
+	info = tds->current_results;
+	for (col = 0; col < NUM_COLS; ++col)
+		info->columns[col]->column_lazy = col % 2;
+
+	while (tds_process_tokens(tds, &result_type, &done_flags, TDS_RETURN_ROW) == TDS_SUCCESS) {
+		for (col = 0; col < NUM_COLS; ++col) {
+			TDSCOLUMN *curcol = info->columns[col];
+
+			if (is_null(rows, col)) {
+				assert(curcol->column_cur_size < 0 && curcol->column_wire_data == NULL);
+				continue;
+			}
+			if (col % 2) {
+				assert(curcol->column_cur_size < 0 && curcol->column_wire_data != NULL);
+				if (col % 3)
+					continue;
+				assert(tds_load_column(tds, curcol) == TDS_SUCCESS);
+				assert(curcol->column_wire_data == NULL);
+			}
+			check_column(curcol, rows, col);
+		}
+		++rows;
+	}
+	assert(rows == NUM_ROWS);
+	assert(tds->state == TDS_IDLE);
+}
+
+static void
+decode_rows(TDSSOCKET *tds, bool check)
+{
+	TDS_INT result_type;
+	int done_flags, rows = 0, col;
+	TDSRET rc;
+
+	start(tds);
+	while ((rc = tds_process_tokens(tds, &result_type, &done_flags, TDS_RETURN_ROW)) == TDS_SUCCESS) {
+		assert(result_type == TDS_ROW_RESULT);
+		assert(tds->current_results && tds->current_results->num_cols == NUM_COLS);
+		if (check) {
+			for (col = 0; col < NUM_COLS; ++col)
+				check_column(tds->current_results->columns[col], rows, col);
+		}
+		++rows;
+	}
+	assert(rc == TDS_NO_MORE_RESULTS);
+	assert(rows == NUM_ROWS);
+	assert(tds->state == TDS_IDLE);
+}
+
+int
+main(int argc, char **argv)
+{
+	TDSCONTEXT *ctx;
+	TDSSOCKET *tds;
+	TDSRESULTINFO *info;
+	int i, iterations = argc > 1 ? atoi(argv[1]) : 0;
+	unsigned start_ms;
+
+	check_expand();
+	build_stream();
+
+	ctx = tds_alloc_context(NULL);
+	assert(ctx);
+	tds = tds_alloc_socket(ctx, 512);
+	assert(tds);
+	tds->conn->tds_version = 0x703;
+	peer = test_stream_connect(tds);
+
+	decode_rows(tds, true);
+	info = tds->current_results;
+	assert(info && !info->reused);
+
+	/* same metadata, results are reused removing bindings */
+	info->columns[0]->column_bindtype = SYBINT4;
+	info->columns[0]->column_varaddr = (char *) &i;
+	decode_rows(tds, true);
+	assert(tds->current_results == info && info->reused);
+	assert(!info->columns[0]->column_bindtype && !info->columns[0]->column_varaddr);
+
+	/* bindings with an owner are kept */
+	info->columns[0]->column_bindtype = SYBINT4;
+	info->columns[0]->column_varaddr = (char *) &i;
+	info->bindings_owner = &i;
+	decode_rows(tds, true);
+	assert(tds->current_results == info && info->reused && info->bindings_owner == &i);
+	assert(info->columns[0]->column_bindtype == SYBINT4 && info->columns[0]->column_varaddr == (char *) &i);
+	tds_reset_bindings(info);
+	assert(!info->columns[0]->column_bindtype && !info->columns[0]->column_varaddr && !info->bindings_owner);
+
+	/* reused results do not keep the lazy flags */
+	decode_lazy(tds);
+	decode_rows(tds, true);
+	assert(tds->current_results == info && !info->columns[1]->column_lazy);
+
+	if (iterations > 0) {
+		start_ms = tds_gettime_ms();
+		for (i = 0; i < iterations; ++i)
+			decode_rows(tds, false);
+		printf("%d rows of %d columns decoded in %u ms\n", iterations * NUM_ROWS, NUM_COLS,
+		       (unsigned) (tds_gettime_ms() - start_ms));
+	}
+
+	tds_free_socket(tds);
+	CLOSESOCKET(peer);
+	tds_free_context(ctx);
+	test_stream_free(&stream);
+
+	return 0;
+}
+
+#else
+int
+main(void)
+{
+	fprintf(stderr, "Not possible for this platform.\n");
+	return 0;
+}
+#endif
@@ -0,0 +1,249 @@
+/* FreeTDS - Library of routines accessing Sybase and Microsoft databases
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: test tds_process_tokens with TDS_TOKEN_NOWAIT does not block
+ * on tokens split across packets not received completely, also discarding
+ * rows, and keeps the size of tokens not received completely.
+ */
+#include "common.h"
+#include <assert.h>
+
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+
+#include "replacements.h"
+
+#if HAVE_SOCKETPAIR
+
+#define NOWAIT_FLAGS (TDS_RETURN_ROWFMT|TDS_RETURN_ROW|TDS_RETURN_DONE|TDS_TOKEN_NOWAIT)
+
+static TDS_SYS_SOCKET peer;
+static TEST_STREAM stream;
+
+/* int, varbinary(100) */
+static const TEST_COLUMN cols[] = {
+	{ SYBINTN, 4, true },
+	{ XSYBVARBINARY, 100, true },
+};
+
+static void
+add_row(int row)
+{
+	static const int lens[] = { 4, 40 };
+
+	test_stream_row(&stream, cols, 2, row, false, lens);
+}
+
+static void
+add_info(const char *text)
+{
+	test_stream_byte(&stream, TDS_INFO_TOKEN);
+	test_stream_smallint(&stream, (TDS_USMALLINT) (4 + 1 + 1 + 2 + 2 * strlen(text) + 1 + 1 + 4));
+	test_stream_int(&stream, 5701);		/* number */
+	test_stream_byte(&stream, 1);		/* state */
+	test_stream_byte(&stream, 0);		/* class */
+	test_stream_smallint(&stream, (TDS_USMALLINT) strlen(text));
+	for (; *text; ++text)
+		test_stream_smallint(&stream, (unsigned char) *text);
+	test_stream_byte(&stream, 0);		/* server */
+	test_stream_byte(&stream, 0);		/* procedure */
+	test_stream_int(&stream, 1);		/* line */
+}
+
+/* send a packet with len bytes of the stream not sent yet, 0 for all */
+static void
+send_packet(unsigned len, bool final)
+{
+	test_stream_send(&stream, peer, len, 0, final);
+}
+
+static void
+check_row(TDSSOCKET * tds, int row)
+{
+	TDSRESULTINFO *info = tds->current_results;
+	TDSCOLUMN *col;
+
+	assert(info && info->num_cols == 2);
+	col = info->columns[0];
+	test_check_value(row, 0, 4, col->column_cur_size, col->column_data, false);
+	col = info->columns[1];
+	test_check_value(row, 1, 40, col->column_cur_size, col->column_data, false);
+}
+
+static int
+msg_handler(const TDSCONTEXT * ctx, TDSSOCKET * tds, TDSMESSAGE * msg)
+{
+	int *num_msgs = (int *) tds_get_parent(tds);
+
+	assert(msg->msgno == 5701);
+	++*num_msgs;
+	return 0;
+}
+
+static TDSRET
+process(TDSSOCKET * tds, TDS_INT expected_type)
+{
+	TDS_INT result_type;
+	int done_flags;
+	TDSRET rc;
+
+	rc = tds_process_tokens(tds, &result_type, &done_flags, NOWAIT_FLAGS);
+	if (rc == TDS_SUCCESS)
+		assert(result_type == expected_type);
+	return rc;
+}
+
+int
+main(int argc, char **argv)
+{
+	TDSCONTEXT *ctx;
+	TDSSOCKET *tds;
+	unsigned row_pos;
+	int num_msgs = 0, done_flags;
+	TDS_INT result_type;
+
+	ctx = tds_alloc_context(NULL);
+	assert(ctx);
+	ctx->msg_handler = msg_handler;
+	tds = tds_alloc_socket(ctx, 512);
+	assert(tds);
+	tds->conn->tds_version = 0x702;
+	tds_set_parent(tds, &num_msgs);
+	tds_iconv_open(tds->conn, "ISO-8859-1", 0);
+
+	peer = test_stream_connect(tds);
+	tds->state = TDS_PENDING;
+
+	/* nothing received */
+	assert(process(tds, 0) == TDS_WOULDBLOCK);
+	assert(tds->state == TDS_PENDING);
+
+	/* rows are returned only when complete */
+	test_stream_metadata(&stream, cols, 2);
+	add_row(1);
+	row_pos = stream.len;
+	add_row(2);
+	send_packet(row_pos + 3, false);
+	assert(process(tds, TDS_ROWFMT_RESULT) == TDS_SUCCESS);
+	assert(process(tds, TDS_ROW_RESULT) == TDS_SUCCESS);
+	check_row(tds, 1);
+	assert(process(tds, 0) == TDS_WOULDBLOCK);
+	assert(tds->state == TDS_PENDING);
+
+	/* INFO split, message is not processed */
+	add_info("Changed database context");
+	add_row(3);
+	test_stream_done(&stream, TDS_DONE_MORE_RESULTS | TDS_DONE_COUNT, 0);
+	send_packet(row_pos + 48 - stream.sent + 5, false);
+	assert(process(tds, TDS_ROW_RESULT) == TDS_SUCCESS);
+	check_row(tds, 2);
+	assert(process(tds, 0) == TDS_WOULDBLOCK);
+	assert(num_msgs == 0);
+
+	/* token split in many packets all received */
+	send_packet(20, false);
+	send_packet(20, false);
+	send_packet(20, false);
+	send_packet(60, false);
+	assert(process(tds, TDS_ROW_RESULT) == TDS_SUCCESS);
+	assert(num_msgs == 1);
+	check_row(tds, 3);
+
+	/* DONE split */
+	assert(process(tds, 0) == TDS_WOULDBLOCK);
+	send_packet(0, false);
+	assert(process(tds, TDS_DONE_RESULT) == TDS_SUCCESS);
+	assert(tds->in_pos == tds->in_len);
+
+	/* token of unknown size waits for the end of the response */
+	test_stream_byte(&stream, TDS_SESSIONSTATE_TOKEN);
+	test_stream_int(&stream, 4);
+	test_stream_int(&stream, 0);
+	send_packet(0, false);
+	assert(process(tds, 0) == TDS_WOULDBLOCK);
+	test_stream_done(&stream, 0, 0);
+	send_packet(0, true);
+	assert(process(tds, TDS_DONE_RESULT) == TDS_SUCCESS);
+	assert(process(tds, 0) == TDS_NO_MORE_RESULTS);
+
+	/* rows not returned are discarded without waiting for a split row */
+	tds->state = TDS_PENDING;
+	test_stream_metadata(&stream, cols, 2);
+	add_row(4);
+	row_pos = stream.len;
+	add_row(5);
+	test_stream_done(&stream, TDS_DONE_COUNT, 2);
+	send_packet(row_pos + 3 - stream.sent, false);
+	assert(tds_process_tokens(tds, &result_type, &done_flags, TDS_RETURN_DONE|TDS_TOKEN_NOWAIT) == TDS_WOULDBLOCK);
+	assert(tds->state == TDS_PENDING);
+	send_packet(0, true);
+	assert(tds_process_tokens(tds, &result_type, &done_flags, TDS_RETURN_DONE|TDS_TOKEN_NOWAIT) == TDS_SUCCESS);
+	assert(result_type == TDS_DONE_RESULT && tds->rows_affected == 2);
+	assert(process(tds, 0) == TDS_NO_MORE_RESULTS);
+
+	/* size of a split row is kept, buffered data are checked again only when enough */
+	tds->state = TDS_PENDING;
+	test_stream_metadata(&stream, cols, 2);
+	row_pos = stream.len;
+	add_row(6);
+	test_stream_done(&stream, TDS_DONE_COUNT, 1);
+	send_packet(row_pos + 4 - stream.sent, false);
+	send_packet(20, false);
+	assert(process(tds, TDS_ROWFMT_RESULT) == TDS_SUCCESS);
+	assert(process(tds, 0) == TDS_WOULDBLOCK);
+	assert(tds->token_need == 48);
+	send_packet(10, false);
+	assert(process(tds, 0) == TDS_WOULDBLOCK);
+	assert(tds->token_need == 48);
+	send_packet(0, true);
+	assert(process(tds, TDS_ROW_RESULT) == TDS_SUCCESS);
+	check_row(tds, 6);
+	assert(process(tds, TDS_DONE_RESULT) == TDS_SUCCESS);
+	assert(process(tds, 0) == TDS_NO_MORE_RESULTS);
+
+	/* column information split, all received */
+	tds->state = TDS_PENDING;
+	test_stream_metadata(&stream, cols, 2);
+	test_stream_done(&stream, TDS_DONE_COUNT, 0);
+	send_packet(10, false);
+	send_packet(13, false);
+	assert(process(tds, TDS_ROWFMT_RESULT) == TDS_SUCCESS);
+	assert(process(tds, 0) == TDS_WOULDBLOCK);
+	send_packet(0, true);
+	assert(process(tds, TDS_DONE_RESULT) == TDS_SUCCESS);
+	assert(tds->state == TDS_IDLE);
+	assert(tds->in_pos == tds->in_len);
+
+	tds_free_socket(tds);
+	CLOSESOCKET(peer);
+	tds_free_context(ctx);
+	test_stream_free(&stream);
+
+	return 0;
+}
+
+#else
+int
+main(void)
+{
+	fprintf(stderr, "Not possible for this platform.\n");
+	return 0;
+}
+#endif
@@ -90,6 +90,59 @@ test(const char *src, int prec, int scale, int scale2)
 	test0(src, prec, scale, prec, scale2);
 }
 
+/* convert a string to numeric and back, result should be the same string */
+static void
+test_string(const char *src, int prec, int scale)
+{
+	char result[256];
+	CONV_RESULT cr;
+
+	memset(&cr.n, 0, sizeof(cr.n));
+	cr.n.precision = prec;
+	cr.n.scale = scale;
+	if (tds_convert(&ctx, SYBVARCHAR, src, (TDS_UINT)strlen(src), SYBNUMERIC, &cr) < 0)
+		strcpy(result, "error");
+	else if (tds_numeric_to_string(&cr.n, result) < 0)
+		strcpy(result, "error");
+
+	if (strcmp(src, result) != 0) {
+		fprintf(stderr, "Failed! %s (%d,%d) converted back to %s\n", src, prec, scale, result);
+		g_result = 1;
+		exit(1);
+	}
+}
+
+/* test all number of digits for a given precision and scale */
+static void
+test_digits(int prec, int scale)
+{
+	char digits[80], num[96], *p;
+	int i, n;
+
+	for (n = 1; n <= prec; ++n) {
+		for (i = 0; i < n; ++i)
+			digits[i] = '9' - (i % 10);
+		p = num;
+		if (n & 1)
+			*p++ = '-';
+		if (n <= scale) {
+			*p++ = '0';
+			*p++ = '.';
+			memset(p, '0', scale - n);
+			p += scale - n;
+			memcpy(p, digits, n);
+			p += n;
+		} else {
+			memcpy(p, digits, n - scale);
+			p += n - scale;
+			if (scale)
+				p += sprintf(p, ".%.*s", scale, digits + n - scale);
+		}
+		*p = 0;
+		test_string(num, prec, scale);
+	}
+}
+
 int
 main(int argc, char **argv)
 {
@@ -125,6 +178,60 @@ main(int argc, char **argv)
 	test0("10000000000000000", 30, 10, 19, 0);
 	test0("10000000000000000", 30, 10, 12, 0);
 
+	/* rescale largest numbers between precisions around native integer limits */
+	{
+		static const int precs[] = { 1, 5, 10, 18, 19, 20, 28, 38, 39, 50, 77 };
+		char num[96];
+		int p1, s1, p2, s2;
+
+		for (p1 = 0; p1 < TDS_VECTOR_SIZE(precs); ++p1)
+		for (s1 = 0; s1 <= 2; ++s1)
+		for (p2 = 0; p2 < TDS_VECTOR_SIZE(precs); ++p2)
+		for (s2 = 0; s2 <= 2; ++s2) {
+			int prec = precs[p1], scale = prec * s1 / 2;
+
+			memset(num, '9', prec + 1);
+			num[prec + 1] = 0;
+			num[prec - scale] = '.';
+			test0(num, prec, scale, precs[p2], precs[p2] * s2 / 2);
+		}
+	}
+
+	/* string conversions, around 64 and 128 bits limits */
+	test_string("0", 1, 0);
+	test_string("0.000", 5, 3);
+	test_string("-0.01", 5, 2);
+	test_string("18446744073709551615", 20, 0);
+	test_string("18446744073709551616", 20, 0);
+	test_string("-1844674407370955161.6", 38, 1);
+	test_string("9999999999999999999", 19, 0);
+	test_string("10000000000000000000", 20, 0);
+	test_string("99999999999999999999999999999999999999", 38, 0);
+	test_string("0.99999999999999999999999999999999999999", 38, 38);
+	test_string("340282366920938463463374607431768211455", 39, 0);
+	test_string("340282366920938463463374607431768211456", 39, 0);
+	test_string("-3402823669209384634633746074317682114.56", 77, 2);
+	for (i = 1; i <= 77; ++i) {
+		test_digits(i, 0);
+		test_digits(i, i / 2);
+		test_digits(i, i);
+	}
+
+	/* check binary representation around 64 bits limit */
+	{
+		CONV_RESULT cr;
+		static const unsigned char expected[] = { 0, 1, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+		memset(&cr.n, 0, sizeof(cr.n));
+		cr.n.precision = 20;
+		cr.n.scale = 0;
+		if (tds_convert(&ctx, SYBVARCHAR, "18446744073709551616", 20, SYBNUMERIC, &cr) < 0
+		    || memcmp(cr.n.array, expected, sizeof(expected)) != 0) {
+			fprintf(stderr, "Wrong conversion of 2^64\n");
+			return 1;
+		}
+	}
+
 #if 0
 	{
 		int p1, s1, p2, s2;
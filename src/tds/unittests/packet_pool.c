@@ -0,0 +1,103 @@
+/* FreeTDS - Library of routines accessing Sybase and Microsoft databases
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: test packets are reused by the packet pool.
+ */
+#include "common.h"
+#include <assert.h>
+
+int
+main(int argc, char **argv)
+{
+	TDSPACKETPOOLSTATS stats;
+	TDSPACKET *packet, *packet2, *list;
+	unsigned char buf[16];
+	int i;
+
+	tds_packet_pool_flush();
+
+	/* packets are reused */
+	packet = tds_alloc_packet(NULL, 4096 + 48);
+	assert(packet);
+	assert(packet->capacity >= 4096 + 48);
+	tds_free_packets(packet);
+
+	packet2 = tds_alloc_packet(NULL, 4096);
+	assert(packet2 == packet);
+	assert(packet2->capacity >= 4096 + 48);
+	assert(packet2->len == 0 && packet2->next == NULL);
+
+	tds_packet_pool_get_stats(&stats);
+	assert(stats.hits == 1);
+	assert(stats.misses == 1);
+	assert(stats.released == 1);
+	assert(stats.cached == 0);
+
+	/* packets with different sizes are not mixed */
+	memset(buf, 'x', sizeof(buf));
+	packet = tds_alloc_packet(buf, sizeof(buf));
+	assert(packet && packet != packet2);
+	assert(packet->len == sizeof(buf));
+	assert(memcmp(packet->buf, buf, sizeof(buf)) == 0);
+	packet->next = packet2;
+	tds_free_packets(packet);
+	tds_packet_pool_get_stats(&stats);
+	assert(stats.cached == 2);
+
+	/* reallocated packets go back to the pool */
+	packet = tds_alloc_packet(NULL, 100);
+	packet = tds_realloc_packet(packet, 10000);
+	assert(packet && packet->capacity >= 10000);
+	tds_free_packets(packet);
+	packet = tds_alloc_packet(NULL, 9000);
+	tds_packet_pool_get_stats(&stats);
+	assert(stats.hits == 3);
+	tds_free_packets(packet);
+
+	/* huge packets are not kept */
+	packet = tds_alloc_packet(NULL, 1024 * 1024);
+	assert(packet && packet->capacity == 1024 * 1024);
+	tds_free_packets(packet);
+	tds_packet_pool_get_stats(&stats);
+	assert(stats.cached == 2);
+
+	/* limit the number of packets kept */
+	tds_packet_pool_set_limit(2);
+	list = NULL;
+	for (i = 0; i < 5; ++i) {
+		packet = tds_alloc_packet(NULL, 512);
+		assert(packet);
+		packet->next = list;
+		list = packet;
+	}
+	tds_free_packets(list);
+	tds_packet_pool_get_stats(&stats);
+	assert(stats.discarded == 3);
+
+	/* disable pool */
+	tds_packet_pool_set_limit(0);
+	tds_packet_pool_get_stats(&stats);
+	assert(stats.cached == 0);
+	packet = tds_alloc_packet(NULL, 512);
+	tds_free_packets(packet);
+	tds_packet_pool_get_stats(&stats);
+	assert(stats.cached == 0);
+
+	return 0;
+}
@@ -0,0 +1,127 @@
+/* FreeTDS - Library of routines accessing Sybase and Microsoft databases
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: test reactor reports sockets only when a full packet is received.
+ */
+#include "common.h"
+#include <assert.h>
+
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+
+#if HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif /* HAVE_SYS_SOCKET_H */
+
+#include "replacements.h"
+
+#if HAVE_SOCKETPAIR
+
+#define NUM_SOCKETS 4
+
+static TDS_SYS_SOCKET peers[NUM_SOCKETS];
+
+static void
+send_data(int n, const unsigned char *data, size_t len)
+{
+	assert(WRITESOCKET(peers[n], data, len) == (int) len);
+}
+
+int
+main(int argc, char **argv)
+{
+	static const unsigned char packet[] = { 0x04, 0x01, 0x00, 0x0b, 0x00, 0x00, 0x01, 0x00, 0xfd, 0x00, 0x00 };
+	TDSCONTEXT *ctx;
+	TDSSOCKET *sockets[NUM_SOCKETS], *ready[NUM_SOCKETS];
+	TDSREACTOR *reactor;
+	TDS_SYS_SOCKET sv[2];
+	int i;
+
+	ctx = tds_alloc_context(NULL);
+	assert(ctx);
+
+	reactor = tds_reactor_alloc();
+	assert(reactor);
+
+	for (i = 0; i < NUM_SOCKETS; ++i) {
+		sockets[i] = tds_alloc_socket(ctx, 512);
+		assert(sockets[i]);
+		assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+		assert(tds_socket_set_nonblocking(sv[0]) == 0);
+		tds_set_s(sockets[i], sv[0]);
+		peers[i] = sv[1];
+		assert(tds_reactor_add(reactor, sockets[i]) == TDS_SUCCESS);
+	}
+
+	/* nothing received */
+	assert(tds_reactor_wait(reactor, ready, NUM_SOCKETS, 0) == 0);
+
+	/* wake up */
+	tds_reactor_wakeup(reactor);
+	assert(tds_reactor_wait(reactor, ready, NUM_SOCKETS, -1) == 0);
+
+	/* partial packets are not reported */
+	send_data(1, packet, 6);
+	assert(tds_reactor_wait(reactor, ready, NUM_SOCKETS, 100) == 0);
+
+	send_data(1, packet + 6, sizeof(packet) - 6);
+	assert(tds_reactor_wait(reactor, ready, NUM_SOCKETS, 1000) == 1);
+	assert(ready[0] == sockets[1]);
+	assert(tds_connection_buffered(sockets[1]->conn) == sizeof(packet));
+
+	/* buffered packets are reported without waiting */
+	send_data(2, packet, sizeof(packet));
+	send_data(2, packet, sizeof(packet));
+	assert(tds_reactor_wait(reactor, ready, 1, 1000) == 1);
+	assert(tds_reactor_wait(reactor, ready, NUM_SOCKETS, 1000) == 2);
+	assert((ready[0] == sockets[1] && ready[1] == sockets[2]) || (ready[0] == sockets[2] && ready[1] == sockets[1]));
+
+	/* removed sockets are not reported */
+	assert(tds_reactor_remove(reactor, sockets[1]) == TDS_SUCCESS);
+	assert(tds_reactor_remove(reactor, sockets[1]) == TDS_FAIL);
+	assert(tds_reactor_wait(reactor, ready, NUM_SOCKETS, 0) == 1);
+	assert(ready[0] == sockets[2]);
+
+	/* closed connections are reported */
+	assert(tds_reactor_remove(reactor, sockets[2]) == TDS_SUCCESS);
+	CLOSESOCKET(peers[3]);
+	peers[3] = INVALID_SOCKET;
+	assert(tds_reactor_wait(reactor, ready, 1, 1000) == 1);
+	assert(ready[0] == sockets[3]);
+
+	tds_reactor_free(reactor);
+	for (i = 0; i < NUM_SOCKETS; ++i) {
+		tds_free_socket(sockets[i]);
+		if (!TDS_IS_SOCKET_INVALID(peers[i]))
+			CLOSESOCKET(peers[i]);
+	}
+	tds_free_context(ctx);
+
+	return 0;
+}
+
+#else
+int
+main(void)
+{
+	fprintf(stderr, "Not possible for this platform.\n");
+	return 0;
+}
+#endif
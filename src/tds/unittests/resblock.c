@@ -0,0 +1,123 @@
+/* FreeTDS - Library of routines accessing Sybase and Microsoft databases
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: test results allocated with their columns in a single block
+ * (inline_columns) are freed completely, including names, row buffers
+ * and parameters appended to them.
+ * Memory leaks are detected running under a leak checker (like valgrind
+ * or AddressSanitizer).
+ */
+#include "common.h"
+#include <assert.h>
+
+#define NUM_COLS 5
+
+static void
+set_columns(TDSCONNECTION * conn, TDSRESULTINFO * info)
+{
+	char name[64];
+	int i;
+
+	for (i = 0; i < info->num_cols; ++i) {
+		TDSCOLUMN *col = info->columns[i];
+
+		tds_set_column_type(conn, col, i % 2 ? SYBIMAGE : SYBINT4);
+		col->on_server.column_size = col->column_size = i % 2 ? 0x7fffffff : 4;
+		snprintf(name, sizeof(name), "column_with_a_quite_long_name_%d", i);
+		assert(tds_dstr_copy(&col->column_name, name));
+		assert(tds_dstr_copy(&col->table_name, "table"));
+		assert(tds_dstr_copy(&col->table_column_name, name));
+	}
+}
+
+static void
+check_block(TDSRESULTINFO * info, int num_cols)
+{
+	int i;
+
+	assert(info && info->ref_count == 1 && info->num_cols == num_cols);
+	assert(info->num_inline_cols == num_cols);
+	for (i = 0; i < num_cols; ++i) {
+		assert(info->columns[i] == &info->inline_columns[i]);
+		assert(tds_dstr_isempty(&info->columns[i]->column_name));
+	}
+}
+
+int
+main(void)
+{
+	TDSCONTEXT *ctx;
+	TDSSOCKET *tds;
+	TDSRESULTINFO *info;
+	TDSPARAMINFO *params;
+	TDSCOLUMN **columns;
+	int i;
+
+	ctx = tds_alloc_context(NULL);
+	assert(ctx);
+	tds = tds_alloc_socket(ctx, 512);
+	assert(tds);
+
+	for (i = 0; i < 100; ++i) {
+		/* no columns */
+		info = tds_alloc_results(0);
+		assert(info && info->ref_count == 1 && !info->columns && !info->inline_columns);
+		tds_free_results(info);
+
+		/* columns with names and a row */
+		info = tds_alloc_results(NUM_COLS);
+		check_block(info, NUM_COLS);
+		set_columns(tds->conn, info);
+		assert(tds_alloc_row(info) == TDS_SUCCESS);
+		((TDSBLOB *) info->columns[1]->column_data)->textvalue = strdup("blob value");
+
+		/* other references keep it alive */
+		++info->ref_count;
+		tds_free_results(info);
+		assert(strcmp(tds_dstr_cstr(&info->columns[NUM_COLS - 1]->column_name),
+			      "column_with_a_quite_long_name_4") == 0);
+		tds_free_results(info);
+
+		/* parameters added to a block move column pointers out of it */
+		params = tds_alloc_results(2);
+		check_block(params, 2);
+		columns = params->columns;
+		set_columns(tds->conn, params);
+		assert(tds_alloc_param_result(params) == params);
+		assert(params->num_cols == 3 && params->columns != columns);
+		assert(params->columns[0] == &params->inline_columns[0]);
+		assert(params->columns[2] < params->inline_columns || params->columns[2] >= params->inline_columns + 2);
+		assert(tds_dstr_copy(&params->columns[2]->column_name, "@param"));
+		tds_set_column_type(tds->conn, params->columns[2], SYBINT4);
+		assert(tds_alloc_param_data(params->columns[2]));
+		assert(tds_alloc_param_result(params) == params && params->num_cols == 4);
+
+		/* removing parameters frees appended and inline columns */
+		tds_free_param_result(params);
+		tds_free_param_result(params);
+		tds_free_param_result(params);
+		assert(params->num_cols == 1);
+		tds_free_param_results(params);
+	}
+
+	tds_free_socket(tds);
+	tds_free_context(ctx);
+
+	return 0;
+}
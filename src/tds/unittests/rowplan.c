@@ -0,0 +1,284 @@
+/* FreeTDS - Library of routines accessing Sybase and Microsoft databases
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: test rows decoded using a compiled row plan give the same
+ * values of the generic decoding, also with rows split across packets.
+ * Check also plans are kept reusing results, recompiled for new
+ * metadata and do not prevent skipping and streaming values.
+ */
+#include "common.h"
+#include <assert.h>
+
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+
+#include "replacements.h"
+
+#if HAVE_SOCKETPAIR
+
+#define NUM_ROWS 30
+
+/* fixed columns are grouped in runs separated by variable ones */
+static const TEST_COLUMN mixed[] = {
+	{ SYBINT4, 4, false },
+	{ SYBINT8, 8, false },
+	{ SYBINTN, 4, true },
+	{ SYBFLT8, 8, false },
+	{ SYBINT2, 2, false },
+	{ XSYBVARBINARY, 20, true },
+	{ SYBINT1, 1, false },
+	{ SYBBIT, 1, false },
+	{ SYBDATETIME, 8, false },
+	{ SYBMONEY, 8, false },
+	{ 0, 0, false }
+};
+
+static const TEST_COLUMN variable[] = {
+	{ SYBINTN, 4, true },
+	{ XSYBVARBINARY, 20, true },
+	{ 0, 0, false }
+};
+
+static const TEST_COLUMN with_blob[] = {
+	{ SYBINT4, 4, false },
+	{ SYBIMAGE, 0x7fffffff, true },
+	{ SYBINT4, 4, false },
+	{ 0, 0, false }
+};
+
+static TDS_SYS_SOCKET peer;
+static TEST_STREAM stream;
+
+static unsigned
+num_cols(const TEST_COLUMN * cols)
+{
+	unsigned n = 0;
+
+	while (cols[n].type)
+		++n;
+	return n;
+}
+
+static bool
+is_null(const TEST_COLUMN * col, int row, int n)
+{
+	return col->nullable && (row + n) % 4 == 1;
+}
+
+/* length of a value, -1 for NULL */
+static int
+value_len(const TEST_COLUMN * col, int row, int n)
+{
+	if (is_null(col, row, n))
+		return -1;
+	if (col->type == XSYBVARBINARY)
+		return row % 21;
+	if (col->type == SYBIMAGE)
+		return 100 + row;
+	return col->size;
+}
+
+/* even rows use ROW, odd ones NBCROW */
+static void
+build_stream(const TEST_COLUMN * cols)
+{
+	unsigned n, ncols = num_cols(cols);
+	int row, lens[16];
+
+	assert(ncols <= TDS_VECTOR_SIZE(lens));
+	stream.len = stream.sent = 0;
+	test_stream_metadata(&stream, cols, ncols);
+	for (row = 0; row < NUM_ROWS; ++row) {
+		for (n = 0; n < ncols; ++n)
+			lens[n] = value_len(&cols[n], row, n);
+		test_stream_row(&stream, cols, ncols, row, row % 2 != 0, lens);
+	}
+	test_stream_done(&stream, TDS_DONE_COUNT, NUM_ROWS);
+}
+
+static void
+check_value(TDSCOLUMN * curcol, const TEST_COLUMN * col, int row, int n)
+{
+	test_check_value(row, n, value_len(col, row, n), curcol->column_cur_size, curcol->column_data,
+			 col->type == SYBIMAGE);
+}
+
+static TDSRESULTINFO *
+start(TDSSOCKET * tds, const TEST_COLUMN * cols, unsigned packet_size)
+{
+	TDS_INT result_type;
+	int done_flags;
+
+	build_stream(cols);
+	test_stream_send(&stream, peer, 0, packet_size, true);
+	tds->state = TDS_PENDING;
+	assert(tds_process_tokens(tds, &result_type, &done_flags, TDS_RETURN_ROWFMT) == TDS_SUCCESS);
+	assert(result_type == TDS_ROWFMT_RESULT);
+	assert(tds->current_results && tds->current_results->num_cols == num_cols(cols));
+	return tds->current_results;
+}
+
+static void
+read_rows(TDSSOCKET * tds, const TEST_COLUMN * cols)
+{
+	TDS_INT result_type;
+	int done_flags, row = 0;
+	unsigned n;
+	TDSRET rc;
+
+	while ((rc = tds_process_tokens(tds, &result_type, &done_flags, TDS_RETURN_ROW)) == TDS_SUCCESS) {
+		TDSRESULTINFO *info = tds->current_results;
+
+		assert(result_type == TDS_ROW_RESULT);
+		for (n = 0; n < info->num_cols; ++n) {
+			TDSCOLUMN *curcol = info->columns[n];
+
+			/* fixed columns can be copied by the plan anyway */
+			if (curcol->column_lazy && cols[n].nullable)
+				assert((curcol->column_wire_data != NULL) == !is_null(&cols[n], row, n));
+			if (curcol->column_wire_data) {
+				assert(curcol->column_cur_size < 0);
+				assert(tds_load_column(tds, curcol) == TDS_SUCCESS);
+			}
+			check_value(curcol, &cols[n], row, n);
+		}
+		++row;
+	}
+	assert(rc == TDS_NO_MORE_RESULTS);
+	assert(row == NUM_ROWS);
+	assert(tds->state == TDS_IDLE);
+}
+
+static void
+decode(TDSSOCKET * tds, const TEST_COLUMN * cols, unsigned packet_size)
+{
+	start(tds, cols, packet_size);
+	read_rows(tds, cols);
+}
+
+/* values are streamed also if the result has a plan */
+static void
+check_stream(TDSSOCKET * tds)
+{
+	TDSRESULTINFO *info;
+	TDS_INT result_type;
+	int done_flags, row = 0, len;
+	unsigned char buf[256];
+	TDSRET rc;
+
+	info = start(tds, with_blob, 500);
+	assert(info->row_plan);
+	while ((rc = tds_process_tokens(tds, &result_type, &done_flags, TDS_RETURN_ROW|TDS_TOKEN_STREAM_BLOBS))
+	       == TDS_SUCCESS) {
+		check_value(info->columns[0], &with_blob[0], row, 0);
+		if (is_null(&with_blob[1], row, 1)) {
+			assert(!tds->blob_stream.column);
+			check_value(info->columns[1], &with_blob[1], row, 1);
+		} else {
+			assert(tds->blob_stream.column == info->columns[1]);
+			len = tds_blob_stream_read(tds, buf, sizeof(buf));
+			assert(len == value_len(&with_blob[1], row, 1));
+			assert(buf[0] == test_value_byte(row, 1, 0) && buf[len - 1] == test_value_byte(row, 1, len - 1));
+			assert(tds_blob_stream_next(tds, false) == TDS_SUCCESS);
+		}
+		check_value(info->columns[2], &with_blob[2], row, 2);
+		++row;
+	}
+	assert(rc == TDS_NO_MORE_RESULTS && row == NUM_ROWS);
+}
+
+int
+main(int argc, char **argv)
+{
+	static const unsigned packet_sizes[] = { 8000, 500, 64, 13, 7, 1 };
+	TDSCONTEXT *ctx;
+	TDSSOCKET *tds;
+	TDSRESULTINFO *info;
+	void *plan;
+	unsigned i;
+
+	ctx = tds_alloc_context(NULL);
+	assert(ctx);
+	tds = tds_alloc_socket(ctx, 512);
+	assert(tds);
+	tds->conn->tds_version = 0x703;
+
+	peer = test_stream_connect(tds);
+
+	/* plan compiled for fixed columns */
+	info = start(tds, mixed, 500);
+	assert(info->row_plan);
+	plan = info->row_plan;
+	read_rows(tds, mixed);
+
+	/* plan kept reusing results, runs of fixed columns can be split in packets */
+	for (i = 0; i < TDS_VECTOR_SIZE(packet_sizes); ++i) {
+		info = start(tds, mixed, packet_sizes[i]);
+		/* metadata split in packets are not compared */
+		if (i < 2)
+			assert(info->reused && info->row_plan == plan);
+		assert(info->row_plan);
+		plan = info->row_plan;
+		read_rows(tds, mixed);
+	}
+
+	/* same values without the plan */
+	info = start(tds, mixed, 500);
+	free(info->row_plan);
+	info->row_plan = NULL;
+	read_rows(tds, mixed);
+	tds_compile_row_plan(info);
+	assert(info->row_plan);
+	plan = info->row_plan;
+
+	/* skipped columns in a plan */
+	info = start(tds, mixed, 8000);
+	assert(info->row_plan == plan);
+	info->columns[1]->column_lazy = 1;
+	info->columns[2]->column_lazy = 1;
+	info->columns[5]->column_lazy = 1;
+	read_rows(tds, mixed);
+
+	/* no plan without fixed columns, new plan for new metadata */
+	info = start(tds, variable, 500);
+	assert(!info->reused && !info->row_plan);
+	read_rows(tds, variable);
+	info = start(tds, mixed, 7);
+	assert(!info->reused && info->row_plan);
+	read_rows(tds, mixed);
+
+	check_stream(tds);
+
+	tds_free_socket(tds);
+	CLOSESOCKET(peer);
+	tds_free_context(ctx);
+	test_stream_free(&stream);
+
+	return 0;
+}
+
+#else
+int
+main(void)
+{
+	fprintf(stderr, "Not possible for this platform.\n");
+	return 0;
+}
+#endif
@@ -0,0 +1,143 @@
+/* FreeTDS - Library of routines accessing Sybase and Microsoft databases
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: test activity counters of a connection.
+ */
+#include "common.h"
+#include <assert.h>
+#include <freetds/bytes.h>
+
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+
+#if HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif /* HAVE_SYS_SOCKET_H */
+
+#include "replacements.h"
+
+#if HAVE_SOCKETPAIR
+
+int
+main(int argc, char **argv)
+{
+	TDSCONTEXT *ctx;
+	TDSSOCKET *tds;
+	TDS_SYS_SOCKET peer;
+	TDSSTATS stats;
+	TEST_STREAM stream;
+	unsigned char packet[64];
+	unsigned len, i;
+	TDS_INT result_type;
+	int done_flags;
+
+	ctx = tds_alloc_context(NULL);
+	assert(ctx);
+	tds = tds_alloc_socket(ctx, 512);
+	assert(tds);
+	tds->conn->tds_version = 0x702;
+
+	peer = test_stream_connect(tds);
+
+	/* all counters start from zero, time waiting is measured once they are read */
+	assert(!tds->conn->stats_timing);
+	tds_get_stats(tds->conn, &stats);
+	assert(tds->conn->stats_timing);
+	assert(stats.bytes_sent == 0 && stats.bytes_received == 0 && stats.rows == 0);
+	for (i = 0; i < TDS_VECTOR_SIZE(stats.tokens); ++i)
+		assert(stats.tokens[i] == 0);
+
+	/* sending */
+	tds->state = TDS_WRITING;
+	tds->out_flag = TDS_QUERY;
+	tds_put_n(tds, "select 1", 8);
+	assert(tds_flush_packet(tds) == TDS_SUCCESS);
+	tds_get_stats(tds->conn, &stats);
+	assert(stats.packets_sent == 1);
+	assert(stats.bytes_sent == 8 + 8);
+	assert(stats.write_calls >= 1);
+	assert(READSOCKET(peer, packet, sizeof(packet)) == 8 + 8);
+
+	/* packets of a request are sent together */
+	tds_reset_stats(tds->conn);
+	tds->out_flag = TDS_QUERY;
+	for (i = 0; i < 20 * 504; ++i)
+		tds_put_byte(tds, (unsigned char) i);
+	assert(tds_flush_packet(tds) == TDS_SUCCESS);
+	tds_get_stats(tds->conn, &stats);
+	assert(stats.packets_sent == 20);
+	assert(stats.bytes_sent == 20 * 512);
+#if TDS_HAVE_WRITEV && !defined(ENABLE_EXTRA_CHECKS)
+	assert(stats.write_calls < stats.packets_sent);
+#endif
+	for (i = 0; i < 20; ++i) {
+		unsigned char buf[512];
+		unsigned j;
+
+		for (len = 0; len < sizeof(buf); len += (unsigned) READSOCKET(peer, buf + len, sizeof(buf) - len))
+			continue;
+		assert(buf[0] == TDS_QUERY && buf[1] == (i == 19));
+		assert(TDS_GET_UA2BE(buf + 2) == 512);
+		for (j = 0; j < 504; ++j)
+			assert(buf[8 + j] == (unsigned char) (i * 504 + j));
+	}
+
+	/* receiving */
+	memset(&stream, 0, sizeof(stream));
+	test_stream_done(&stream, TDS_DONE_MORE_RESULTS, 0);
+	test_stream_done(&stream, TDS_DONE_FINAL, 0);
+	len = 8 + stream.len;
+	test_stream_send(&stream, peer, 0, 0, true);
+	test_stream_free(&stream);
+
+	tds->state = TDS_PENDING;
+	assert(tds_process_tokens(tds, &result_type, &done_flags, TDS_RETURN_DONE) == TDS_SUCCESS);
+	assert(tds_process_tokens(tds, &result_type, &done_flags, TDS_RETURN_DONE) == TDS_SUCCESS);
+	assert(tds->state == TDS_IDLE);
+
+	tds_get_stats(tds->conn, &stats);
+	assert(stats.packets_received == 1);
+	assert(stats.bytes_received == len);
+	assert(stats.read_calls >= 1);
+	assert(stats.waits >= 1);
+	assert(stats.tokens[TDS_DONE_TOKEN] == 2);
+	assert(stats.rows == 0);
+
+	/* reset */
+	tds_reset_stats(tds->conn);
+	tds_get_stats(tds->conn, &stats);
+	assert(stats.packets_sent == 0 && stats.packets_received == 0);
+	assert(stats.tokens[TDS_DONE_TOKEN] == 0);
+
+	tds_free_socket(tds);
+	CLOSESOCKET(peer);
+	tds_free_context(ctx);
+
+	return 0;
+}
+
+#else
+int
+main(void)
+{
+	fprintf(stderr, "Not possible for this platform.\n");
+	return 0;
+}
+#endif
@@ -0,0 +1,139 @@
+/* FreeTDS - Library of routines accessing Sybase and Microsoft databases
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: test binary trace, once decoded it must be the same of the text log.
+ */
+#include "common.h"
+#include <assert.h>
+#include <freetds/thread.h>
+
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+
+static void
+log_events(void)
+{
+	static const unsigned char data[40] = "binary\x01\x02\x03 data dumped in the log...";
+	static const struct {
+		char unterminated[4];
+		char next[8];
+	} strings = { { 'a', 'b', 'c', 'd' }, "overrun" };
+	int n = 7;
+
+	tdsdump_log(TDS_DBG_INFO1, "plain message\n");
+	tdsdump_log(TDS_DBG_ERROR, "int %d unsigned %u hex %x char %c percent %%\n", -12, 34u, 0xabcu, 'z');
+	tdsdump_log(TDS_DBG_FUNC, "long %ld %lu size %lu int8 %" PRId64 "\n", -123456L, 654321UL,
+		    (unsigned long) sizeof(data), (TDS_INT8) -1234567890123);
+	tdsdump_log(TDS_DBG_INFO2, "string '%s' '%-8s|' '%.3s' wide %ls\n", "str", "left", "truncated", L"wide");
+	tdsdump_log(TDS_DBG_NETWORK, "width %*d|%-*d| float %5.2f %g %e\n", 6, n, 4, n, 3.14159, 0.5, 12345.678);
+	tdsdump_log(TDS_DBG_INFO2, "precision '%.4s' '%.*s' '%-6.*s|' '%.*s' '%.2ls'\n", strings.unterminated,
+		    3, strings.unterminated, 2, strings.unterminated, -1, "negative", L"wide");
+	tdsdump_log(TDS_DBG_INFO1, "pointer %p\n", (void *) data);
+	tdsdump_dump_buf(TDS_DBG_NETWORK, "Sending packet", data, sizeof(data));
+	tdsdump_dump_buf(TDS_DBG_NETWORK, "Empty", data, 0);
+}
+
+#ifdef TDS_HAVE_MUTEX
+static TDS_THREAD_PROC_DECLARE(log_thread, arg)
+{
+	log_events();
+	return NULL;
+}
+#endif
+
+static void
+log_all(void)
+{
+#ifdef TDS_HAVE_MUTEX
+	tds_thread th;
+#endif
+
+	log_events();
+#ifdef TDS_HAVE_MUTEX
+	assert(tds_thread_create(&th, log_thread, NULL) == 0);
+	assert(tds_thread_join(th, NULL) == 0);
+#endif
+	tdsdump_log(TDS_DBG_INFO1, "done\n");
+}
+
+static char *
+read_log(const char *name)
+{
+	FILE *f = fopen(name, "rb");
+	char *buf, *p;
+	long len;
+
+	assert(f);
+	assert(fseek(f, 0, SEEK_END) == 0);
+	len = ftell(f);
+	assert(len > 0);
+	rewind(f);
+	buf = (char *) calloc(len + 1, 1);
+	assert(buf);
+	assert(fread(buf, len, 1, f) == 1);
+	fclose(f);
+
+	/* skip the starting message, contains time */
+	p = strstr(buf, "with debug flags");
+	assert(p);
+	p = strchr(p, '\n');
+	assert(p);
+	memmove(buf, p + 1, strlen(p + 1) + 1);
+	return buf;
+}
+
+int
+main(int argc, char **argv)
+{
+	FILE *in, *out;
+	char *text, *decoded;
+
+	tds_debug_flags = TDS_DBGFLAG_ALL | TDS_DBGFLAG_SOURCE;
+	assert(tdsdump_open("trace.log"));
+	log_all();
+	tdsdump_close();
+
+	tds_debug_flags |= TDS_DBGFLAG_BINARY;
+	assert(tdsdump_open("trace.bin"));
+	log_all();
+	tdsdump_close();
+
+	in = fopen("trace.bin", "rb");
+	assert(in);
+	out = fopen("trace.out", "w");
+	assert(out);
+	assert(tds_trace_decode(in, out) == TDS_SUCCESS);
+	fclose(in);
+	fclose(out);
+
+	text = read_log("trace.log");
+	decoded = read_log("trace.out");
+	if (strcmp(text, decoded) != 0) {
+		fprintf(stderr, "text log:\n%s\ndecoded trace:\n%s\n", text, decoded);
+		return 1;
+	}
+	free(text);
+	free(decoded);
+
+	unlink("trace.log");
+	unlink("trace.bin");
+	unlink("trace.out");
+	return 0;
+}
@@ -0,0 +1,121 @@
+/* FreeTDS - Library of routines accessing Sybase and Microsoft databases
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Purpose: test values pointing to the received packet (zero copy) are
+ * still valid once a row spanning multiple packets is read.
+ */
+#include "common.h"
+#include <assert.h>
+
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+
+#include "replacements.h"
+
+#if HAVE_SOCKETPAIR
+
+#define NUM_COLS 3
+#define VALUE_LEN 60
+
+static TDS_SYS_SOCKET peer;
+static TEST_STREAM stream;
+
+/* send a row with each value in a different packet */
+static void
+send_response(void)
+{
+	TEST_COLUMN cols[NUM_COLS];
+	int col;
+
+	/* varbinary(100) columns */
+	for (col = 0; col < NUM_COLS; ++col) {
+		cols[col].type = XSYBVARBINARY;
+		cols[col].size = 100;
+		cols[col].nullable = true;
+	}
+	test_stream_metadata(&stream, cols, NUM_COLS);
+
+	test_stream_byte(&stream, TDS_ROW_TOKEN);
+	for (col = 0; col < NUM_COLS; ++col) {
+		test_stream_value(&stream, &cols[col], 0, col, VALUE_LEN);
+		if (col < NUM_COLS - 1)
+			test_stream_send(&stream, peer, 0, 0, false);
+	}
+
+	test_stream_done(&stream, TDS_DONE_COUNT, 1);
+	test_stream_send(&stream, peer, 0, 0, true);
+}
+
+int
+main(int argc, char **argv)
+{
+	TDSCONTEXT *ctx;
+	TDSSOCKET *tds;
+	TDSRESULTINFO *info;
+	TDS_INT result_type;
+	int done_flags, col;
+
+	ctx = tds_alloc_context(NULL);
+	assert(ctx);
+	tds = tds_alloc_socket(ctx, 512);
+	assert(tds);
+	tds->conn->tds_version = 0x702;
+	tds->conn->zero_copy = 1;
+
+	peer = test_stream_connect(tds);
+
+	send_response();
+	tds->state = TDS_PENDING;
+	assert(tds_process_tokens(tds, &result_type, &done_flags, TDS_RETURN_ROW) == TDS_SUCCESS);
+	assert(result_type == TDS_ROW_RESULT);
+	assert(tds->in_packets == 3);
+
+	/* values read from previous packets were copied to the row */
+	info = tds->current_results;
+	for (col = 0; col < NUM_COLS; ++col) {
+		TDSCOLUMN *curcol = info->columns[col];
+
+		test_check_value(0, col, VALUE_LEN, curcol->column_cur_size, curcol->column_data, false);
+		if (col < NUM_COLS - 1)
+			assert(!curcol->column_row_data);
+	}
+	/* last value is still in the packet */
+	assert(info->columns[NUM_COLS - 1]->column_row_data);
+
+	assert(tds_process_tokens(tds, &result_type, &done_flags, TDS_RETURN_DONE) == TDS_SUCCESS);
+	assert(result_type == TDS_DONE_RESULT);
+	assert(tds->state == TDS_IDLE);
+
+	tds_free_socket(tds);
+	CLOSESOCKET(peer);
+	tds_free_context(ctx);
+	test_stream_free(&stream);
+
+	return 0;
+}
+
+#else
+int
+main(void)
+{
+	fprintf(stderr, "Not possible for this platform.\n");
+	return 0;
+}
+#endif
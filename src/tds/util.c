@@ -204,6 +204,59 @@ tds_gettime_ms(void)
 #endif
 }
 
+/**
+ * Return a monotonic time in microseconds, used to measure intervals.
+ */
+TDS_UINT8
+tds_gettime_us(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER count, freq;
+
+	if (QueryPerformanceCounter(&count) && QueryPerformanceFrequency(&freq) && freq.QuadPart)
+		return (TDS_UINT8) (count.QuadPart / freq.QuadPart * 1000000u
+				    + count.QuadPart % freq.QuadPart * 1000000u / freq.QuadPart);
+	return (TDS_UINT8) GetTickCount() * 1000u;
+#elif defined(HAVE_GETHRTIME)
+	return (TDS_UINT8) (gethrtime() / 1000u);
+#elif defined(HAVE_CLOCK_GETTIME) && defined(TDS_GETTIMEMILLI_CONST)
+	struct timespec ts;
+	clock_gettime(TDS_GETTIMEMILLI_CONST, &ts);
+	return (TDS_UINT8) ts.tv_sec * 1000000u + ts.tv_nsec / 1000u;
+#elif defined(HAVE_GETTIMEOFDAY)
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (TDS_UINT8) tv.tv_sec * 1000000u + tv.tv_usec;
+#else
+#error How to implement tds_gettime_us ??
+#endif
+}
+
+/**
+ * Copy activity counters of a connection.
+ * Counters are not protected by locks, with MARS values updated
+ * by other sessions during the copy can be inconsistent.
+ * \param conn connection
+ * \param stats structure to fill
+ */
+void
+tds_get_stats(TDSCONNECTION * conn, TDSSTATS * stats)
+{
+	memcpy(stats, &conn->stats, sizeof(*stats));
+	conn->stats_timing = true;
+}
+
+/**
+ * Reset activity counters of a connection.
+ * \param conn connection
+ */
+void
+tds_reset_stats(TDSCONNECTION * conn)
+{
+	memset(&conn->stats, 0, sizeof(conn->stats));
+	conn->stats_timing = true;
+}
+
 /*
  * Call the client library's error handler
  */